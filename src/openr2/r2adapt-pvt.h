@@ -0,0 +1,46 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * Adaptive protocol timers. Timers waiting for the far end to answer are
+ * shortened to what the far end has been measured to take.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _OPENR2_ADAPT_PVT_H_
+#define _OPENR2_ADAPT_PVT_H_
+
+#include "r2context.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+struct openr2_chan_s;
+
+int openr2_adapt_configure(openr2_context_t *r2context, const openr2_adaptive_timers_t *config);
+int openr2_adapt_get_stats(openr2_context_t *r2context, int span_id, openr2_adaptive_timer_t timer, int configured, openr2_timer_stats_t *stats);
+void openr2_adapt_destroy(openr2_context_t *r2context);
+int openr2_adapt_timeout(struct openr2_chan_s *r2chan, openr2_adaptive_timer_t timer, int configured);
+void openr2_adapt_sample(struct openr2_chan_s *r2chan, openr2_adaptive_timer_t timer);
+void openr2_adapt_cancel(struct openr2_chan_s *r2chan, openr2_adaptive_timer_t timer);
+void openr2_adapt_reset(struct openr2_chan_s *r2chan, openr2_adaptive_timer_t timer);
+
+#if defined(__cplusplus)
+} /* endif extern "C" */
+#endif
+
+#endif /* endif defined _OPENR2_ADAPT_PVT_H_ */
@@ -0,0 +1,45 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * Admission control. Incoming calls over the configured limits are
+ * rejected with network congestion by the library itself.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _OPENR2_ADMIT_PVT_H_
+#define _OPENR2_ADMIT_PVT_H_
+
+#include "r2context.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+struct openr2_chan_s;
+
+int openr2_admit_configure(openr2_context_t *r2context, const openr2_admission_t *admission);
+int openr2_admit_get_stats(openr2_context_t *r2context, openr2_admission_stats_t *stats);
+int openr2_admit_set_load(openr2_context_t *r2context, int load);
+void openr2_admit_destroy(openr2_context_t *r2context);
+int openr2_admit_call(struct openr2_chan_s *r2chan);
+void openr2_admit_setup_done(struct openr2_chan_s *r2chan);
+
+#if defined(__cplusplus)
+} /* endif extern "C" */
+#endif
+
+#endif /* endif defined _OPENR2_ADMIT_PVT_H_ */
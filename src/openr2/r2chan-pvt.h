@@ -45,6 +45,14 @@ extern "C" {
 /* getting half second of silence we declare DTMF DNIS string as ended */
 #define OR2_DTMF_MAX_SILENCE_SAMPLES 4000
 
+/* the context number plan says we got every DNIS digit */
+#define OR2_NUMPLAN_COMPLETE(r2chan) \
+	((r2chan)->numplan_length && (r2chan)->dnis_len >= (unsigned)(r2chan)->numplan_length)
+
+/* read buffers of OR2_CHAN_READ_SIZE requested to the driver, a read
+   gap longer than all of them together means audio was lost */
+#define OR2_CHAN_IO_NUMBUFS 4
+
 struct openr2_chan_s;
 struct openr2_context_s;
 
@@ -96,8 +104,33 @@ typedef struct openr2_chan_timer_ids_s {
 	int dtmf_start_dial;
 } openr2_chan_timer_ids_t;
 
+/* call control command posted by the user, linked in the
+   channel lock-free command queue until the channel runs it */
+typedef struct openr2_chan_cmd_s {
+	struct openr2_chan_cmd_s *volatile next;
+	openr2_chan_cmd_type_t type;
+	union {
+		struct {
+			char ani[OR2_MAX_ANI];
+			char dnis[OR2_MAX_DNIS];
+			int has_ani;
+			openr2_calling_party_category_t category;
+			int ani_restricted;
+		} make_call;
+		openr2_call_mode_t accept_mode;
+		openr2_answer_mode_t answer_mode;
+		struct {
+			openr2_call_disconnect_cause_t cause;
+			unsigned call_id;
+		} disconnect;
+	} args;
+	openr2_chan_cmd_done_func_t done;
+	void *user_data;
+} openr2_chan_cmd_t;
+
 typedef enum r2chan_flags_e {
 	OR2_CHAN_CALL_DNIS_CALLBACK = (1 << 0),
+	OR2_CHAN_SINGLE_OWNER = (1 << 1),
 } r2chan_flags_t;
 
 /* R2 channel. Hold the states of the R2 signaling, I/O device etc.
@@ -114,6 +147,27 @@ typedef struct openr2_chan_s {
 	/* I/O device fd */
 	openr2_io_fd_t fd;
 
+	/* data the I/O backend attaches to the channel */
+	void *io_private;
+
+	/* I/O trace being recorded or replayed on the channel */
+	void *io_trace;
+
+	/* line impairment simulator state */
+	void *io_impair;
+
+	/* span I/O staged for the channel by openr2_context_process_span(), its
+	   I/O calls are served from here while span_staged is set (see r2iospan.c) */
+	int span_staged;
+	int span_flags;
+	int span_rx_len;
+	int span_tx_len;
+	int span_cas;
+	int span_cas_valid;
+	int span_cas_changed;
+	uint8_t span_rx[OR2_CHAN_READ_SIZE];
+	uint8_t span_tx[OR2_CHAN_READ_SIZE];
+
 	/* I/O buffer size */
 	int io_buf_size;
 
@@ -152,6 +206,9 @@ typedef struct openr2_chan_s {
 	/* Call state for this channel */
 	openr2_call_state_t call_state;
 
+	/* incremented when a call starts, see openr2_chan_get_call_id() */
+	unsigned call_id;
+
 	/* last raw R2 signal read on this channel */
 	int cas_read;
 
@@ -180,6 +237,9 @@ typedef struct openr2_chan_s {
 	/* R2 context this channel belongs to */
 	struct openr2_context_s *r2context;
 
+	/* protocol settings of the context when the current call started */
+	struct openr2_config_s *config;
+
 	/* received ANI */
 	char ani[OR2_MAX_ANI];
 	char *ani_ptr;
@@ -190,6 +250,25 @@ typedef struct openr2_chan_s {
 	int dnis_index;
 	unsigned dnis_len;
 
+	/* where the DNIS so far is in the context number plan and
+	   the DNIS length it gives, 0 while unknown */
+	int numplan_node;
+	int numplan_length;
+
+	/* when the adaptive timers being timed were started (see r2adapt.c),
+	   adapt_timing has a bit per openr2_adaptive_timer_t being timed */
+	struct timeval adapt_start[OR2_NUM_ADAPTIVE_TIMERS];
+	int adapt_timing;
+
+	/* admission control (see r2admit.c), admit_setup is set while the
+	   call counts as in setup and shedding while rejecting the call */
+	int admit_setup;
+	int shedding;
+
+	/* the user does not know about the call (shed or released on
+	   openr2_chan_resync()), no events are reported for it */
+	int quiet;
+
 	/* 1 when the caller ANI is restricted */
 	int caller_ani_is_restricted;
 
@@ -229,6 +308,9 @@ typedef struct openr2_chan_s {
 	/* MF signal we last wrote */
 	int mf_write_tone;
 
+	/* the I/O backend repeats mf_write_tone on its own (see openr2_io_interface_t play_loop) */
+	int mf_looping;
+
 	/* MF signal we last read */
 	int mf_read_tone;
 
@@ -266,16 +348,82 @@ typedef struct openr2_chan_s {
 	/* generic flags */
 	int32_t flags;
 
-	/* linking */
-	struct openr2_chan_s *next;
+	/* where the context keeps us in its channel and span arrays, -1 if not there */
+	int chan_index;
+	int span_index;
 
 	/* span's id this channel belong to */
 	int span_id;
 
+	/* posted commands, producers push at cmd_head without holding the channel lock,
+	   the processing thread pops from cmd_tail. cmd_stub keeps the queue never empty */
+	openr2_chan_cmd_t *volatile cmd_head;
+	openr2_chan_cmd_t *cmd_tail;
+	openr2_chan_cmd_t cmd_stub;
+
+	/* called after posting a command to wake up the processing thread */
+	openr2_chan_wake_func_t wake_func;
+	void *wake_data;
+
+	/* thread that owns the channel when in single owner mode, 0 until first use */
+	unsigned long owner_thread;
+
+	/* processing lag watchdog, time of the last read and counters */
+	struct timeval last_read_time;
+	openr2_chan_lag_stats_t lag_stats;
+
+	/* call clearing, when the first clearing signal was sent or
+	   received (releasing is set meanwhile) and the counters */
+	struct timeval release_start;
+	int releasing;
+	openr2_chan_release_stats_t release_stats;
+
+	/* times openr2_chan_process() returned early because of the context budget */
+	unsigned long budget_hits;
+
 } openr2_chan_t;
 
-#define openr2_chan_lock(r2chan) openr2_mutex_lock(r2chan->lock)
-#define openr2_chan_unlock(r2chan) openr2_mutex_unlock(r2chan->lock)
+/* single owner channels are used by just one thread, they skip the channel lock
+   and the context timers lock. Compiling with OR2_SINGLE_OWNER_CHANNELS makes all
+   channels single owner and removes the locking code completely */
+#ifdef OR2_SINGLE_OWNER_CHANNELS
+#define openr2_chan_is_single_owner(r2chan) 1
+#else
+#define openr2_chan_is_single_owner(r2chan) ((r2chan)->flags & OR2_CHAN_SINGLE_OWNER)
+#endif
+
+/* with OR2_OWNER_DEBUG complain loudly when a single owner channel is used from a foreign thread */
+#ifdef OR2_OWNER_DEBUG
+#define openr2_chan_check_owner(r2chan) openr2_chan_assert_owner(r2chan, __FUNCTION__)
+#else
+#define openr2_chan_check_owner(r2chan)
+#endif
+
+#define openr2_chan_lock(r2chan) do { \
+		if (openr2_chan_is_single_owner(r2chan)) { \
+			openr2_chan_check_owner(r2chan); \
+		} else { \
+			openr2_mutex_lock((r2chan)->lock); \
+		} \
+	} while (0)
+#define openr2_chan_unlock(r2chan) do { \
+		if (!openr2_chan_is_single_owner(r2chan)) { \
+			openr2_mutex_unlock((r2chan)->lock); \
+		} \
+	} while (0)
+#define openr2_chan_timers_lock(r2chan) do { \
+		if (!openr2_chan_is_single_owner(r2chan)) { \
+			openr2_mutex_lock((r2chan)->r2context->timers_lock); \
+		} \
+	} while (0)
+#define openr2_chan_timers_unlock(r2chan) do { \
+		if (!openr2_chan_is_single_owner(r2chan)) { \
+			openr2_mutex_unlock((r2chan)->r2context->timers_lock); \
+		} \
+	} while (0)
+void openr2_chan_assert_owner(openr2_chan_t *r2chan, const char *function);
+/* posted commands are waiting to run, only for the thread processing the channel */
+#define openr2_chan_has_commands(r2chan) (openr2_atomic_load_ptr(&(r2chan)->cmd_head) != (r2chan)->cmd_tail)
 #define OR2_INVALID_IO_HANDLE NULL
 int openr2_chan_add_timer(openr2_chan_t *r2chan, int ms, openr2_callback_t callback, const char *name);
 void openr2_chan_cancel_timer(openr2_chan_t *r2chan, int *timer_id);
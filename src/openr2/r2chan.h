@@ -39,9 +39,59 @@ extern "C" {
 /*! \brief How many bytes to read each time at once from the channel */
 #define OR2_CHAN_READ_SIZE 160
 
+/*! \brief returned by the processing functions when the budget ran out and the channel has more work to do */
+#define OR2_CHAN_PROCESS_PENDING 1
+
 /* callback for logging channel related info */
 typedef void (*openr2_chan_logging_func_t)(openr2_chan_t *r2chan, const char *file, const char *function, unsigned int line, openr2_log_level_t level, const char *fmt, va_list ap);
 
+/*! \brief call control commands that can be posted to a channel without blocking */
+typedef enum {
+	OR2_CHAN_CMD_MAKE_CALL,
+	OR2_CHAN_CMD_ACCEPT_CALL,
+	OR2_CHAN_CMD_ANSWER_CALL,
+	OR2_CHAN_CMD_DISCONNECT_CALL
+} openr2_chan_cmd_type_t;
+
+/* callback for the completion of a posted command, result is what the blocking version would have returned */
+typedef void (*openr2_chan_cmd_done_func_t)(openr2_chan_t *r2chan, openr2_chan_cmd_type_t cmd, int result, void *user_data);
+
+/* callback to wake up whoever waits on the channel, called by the thread posting a command */
+typedef void (*openr2_chan_wake_func_t)(openr2_chan_t *r2chan, void *wake_data);
+
+/*! \brief processing lag counters, only updated while the context lag watchdog is enabled */
+typedef struct {
+	/* reads measured, largest gap between reads and reads later than the threshold */
+	unsigned long reads;
+	int max_read_gap_ms;
+	unsigned long late_reads;
+	/* reads so late the driver buffers overflowed */
+	unsigned long read_overruns;
+	/* timers fired, largest lateness and timers later than the threshold */
+	unsigned long timers;
+	int max_timer_lateness_ms;
+	unsigned long late_timers;
+} openr2_chan_lag_stats_t;
+
+/*! \brief call clearing counters, from the first clearing signal to the channel being available again */
+typedef struct {
+	unsigned long releases;
+	int last_release_ms;
+	int max_release_ms;
+	/* sum of every release time, divide by releases for the mean */
+	unsigned long total_release_ms;
+} openr2_chan_release_stats_t;
+
+/*! \brief how urgent it is to process a channel, lower values must be serviced first */
+typedef enum {
+	/* MF compelled cycle, CAS persistence check or any other non answered state */
+	OR2_CHAN_CLASS_SIGNALING,
+	/* DTMF dialing or detection */
+	OR2_CHAN_CLASS_DTMF,
+	/* answered calls just moving media */
+	OR2_CHAN_CLASS_MEDIA
+} openr2_chan_service_class_t;
+
 /*! \brief allocate and initialize a new channel openning the underlying hardware channel number */
 OR2_DECLARE(openr2_chan_t *) openr2_chan_new(openr2_context_t *r2context, int channo);
 
@@ -67,10 +117,47 @@ OR2_DECLARE(int) openr2_chan_answer_call_with_mode(openr2_chan_t *r2chan, openr2
      the reason is ignored if its an acknowledge of hangup */
 OR2_DECLARE(int) openr2_chan_disconnect_call(openr2_chan_t *r2chan, openr2_call_disconnect_cause_t cause);
 
+/*! \brief Same as openr2_chan_disconnect_call() but only if the channel is still on the call with the given id.
+    With the fast release policy the library may release the call and the far end seize the channel again
+    before the user disconnects, a late disconnect would then clear the new call */
+OR2_DECLARE(int) openr2_chan_disconnect_call_id(openr2_chan_t *r2chan, unsigned call_id, openr2_call_disconnect_cause_t cause);
+
+/*! \brief Return the id of the current or last call on the channel, it changes when a new call starts */
+OR2_DECLARE(unsigned) openr2_chan_get_call_id(openr2_chan_t *r2chan);
+
 /*! \brief Makes a call with the given ani, dnis and category */
 OR2_DECLARE(int) openr2_chan_make_call(openr2_chan_t *r2chan, const char *ani, const char *dnis, 
 		openr2_calling_party_category_t category, int ani_restricted);
 
+/*! \brief Queue a make call command to be executed on the next processing pass of the channel, does not block.
+    See openr2_chan_set_wake_func() to get the channel processed soon */
+OR2_DECLARE(int) openr2_chan_post_make_call(openr2_chan_t *r2chan, const char *ani, const char *dnis,
+		openr2_calling_party_category_t category, int ani_restricted, openr2_chan_cmd_done_func_t done, void *user_data);
+
+/*! \brief Queue an accept command to be executed on the next processing pass of the channel, does not block.
+    See openr2_chan_set_wake_func() to get the channel processed soon */
+OR2_DECLARE(int) openr2_chan_post_accept_call(openr2_chan_t *r2chan, openr2_call_mode_t mode,
+		openr2_chan_cmd_done_func_t done, void *user_data);
+
+/*! \brief Queue an answer command to be executed on the next processing pass of the channel, does not block.
+    See openr2_chan_set_wake_func() to get the channel processed soon */
+OR2_DECLARE(int) openr2_chan_post_answer_call(openr2_chan_t *r2chan, openr2_answer_mode_t mode,
+		openr2_chan_cmd_done_func_t done, void *user_data);
+
+/*! \brief Queue a disconnect command to be executed on the next processing pass of the channel, does not block.
+    The command is dropped if the call there was when posting it is gone by then (see openr2_chan_get_call_id()).
+    See openr2_chan_set_wake_func() to get the channel processed soon */
+OR2_DECLARE(int) openr2_chan_post_disconnect_call(openr2_chan_t *r2chan, openr2_call_disconnect_cause_t cause,
+		openr2_chan_cmd_done_func_t done, void *user_data);
+
+/*! \brief Set the function the openr2_chan_post_*() calls use to wake up the thread processing the channel.
+    Posted commands only run when the channel is processed, an idle channel has nothing to read and
+    the thread polling it may sleep forever. The function is called from the posting thread right
+    after queueing the command, it should make the processing thread call openr2_chan_process_event()
+    or any other processing function soon (i.e, write to an eventfd or pipe that thread also polls).
+    Set it before posting the first command */
+OR2_DECLARE(void) openr2_chan_set_wake_func(openr2_chan_t *r2chan, openr2_chan_wake_func_t func, void *wake_data);
+
 /*! \brief Return the direction of the call in the given channel */
 OR2_DECLARE(openr2_direction_t) openr2_chan_get_direction(openr2_chan_t *r2chan);
 
@@ -143,9 +230,33 @@ OR2_DECLARE(int) openr2_chan_process_cas_signaling(openr2_chan_t *r2chan);
 /*! \brief check for MF signaling changes and process them if any change occured */
 OR2_DECLARE(int) openr2_chan_process_mf_signaling(openr2_chan_t *r2chan);
 
-/*! \brief check for any signaling change and process them if any change occured */
+/*! \brief check for any signaling change and process them if any change occured
+ * returns OR2_CHAN_PROCESS_PENDING if the context processing budget ran out with work still pending,
+ * the same applies to openr2_chan_process_mf_signaling and openr2_chan_process_oob_events
+ */
 OR2_DECLARE(int) openr2_chan_process_signaling(openr2_chan_t *r2chan);
 
+/*! \brief Return how many times processing the channel stopped because the budget ran out */
+OR2_DECLARE(unsigned long) openr2_chan_get_budget_hits(openr2_chan_t *r2chan);
+
+/*! \brief Get the processing lag counters of the channel */
+OR2_DECLARE(void) openr2_chan_get_lag_stats(openr2_chan_t *r2chan, openr2_chan_lag_stats_t *stats);
+
+/*! \brief Reset the processing lag counters of the channel */
+OR2_DECLARE(void) openr2_chan_reset_lag_stats(openr2_chan_t *r2chan);
+
+/*! \brief Get the call clearing counters of the channel */
+OR2_DECLARE(void) openr2_chan_get_release_stats(openr2_chan_t *r2chan, openr2_chan_release_stats_t *stats);
+
+/*! \brief Reset the call clearing counters of the channel */
+OR2_DECLARE(void) openr2_chan_reset_release_stats(openr2_chan_t *r2chan);
+
+/*! \brief Return non-zero if a new call can be made on the channel right now */
+OR2_DECLARE(int) openr2_chan_is_available(openr2_chan_t *r2chan);
+
+/*! \brief Return the service class of the channel, used to decide which ready channels must be processed first */
+OR2_DECLARE(openr2_chan_service_class_t) openr2_chan_get_service_class(openr2_chan_t *r2chan);
+
 /*! \brief check if there is any expired timer and execute the timeout callbacks if needed */
 OR2_DECLARE(int) openr2_chan_run_schedule(openr2_chan_t *r2chan);
 
@@ -188,7 +299,23 @@ OR2_DECLARE(int) openr2_chan_set_dtmf_handles(openr2_chan_t *r2chan, void *dtmf_
 /*! \brief set the opaque handles that will be passed back to the MF generation and detection callbacks */
 OR2_DECLARE(int) openr2_chan_set_mflib_handles(openr2_chan_t *r2chan, void *mf_write_handle, void *mf_read_handle);
 
-/*! \brief set channel's span_id */
+/*! \brief skip all channel locking, only one thread will ever use the channel from now on.
+    openr2_context_get_time_to_next_event() ignores the channel from now on, the owner thread
+    must use openr2_chan_get_time_to_next_event() instead */
+OR2_DECLARE(void) openr2_chan_set_single_owner(openr2_chan_t *r2chan, int enable);
+
+/*! \brief return non-zero if the channel is in single owner mode */
+OR2_DECLARE(int) openr2_chan_get_single_owner(openr2_chan_t *r2chan);
+
+/*! \brief get the usage counters of the channel lock */
+OR2_DECLARE(void) openr2_chan_get_lock_stats(openr2_chan_t *r2chan, openr2_mutex_stats_t *stats);
+
+/*! \brief warm start alternative to openr2_chan_set_idle(), rebuild the channel state from the CAS bits.
+    Returns 1 if an answered call was recovered, 0 if the channel was left idle, blocked or releasing a call */
+OR2_DECLARE(int) openr2_chan_resync(openr2_chan_t *r2chan);
+
+/*! \brief set channel's span_id, alarms are reported once per span if the user handles on_span_alarm.
+    Span ids go from 0 (no span) to 4095, other ids are logged as an error and the channel keeps its span */
 OR2_DECLARE(void) openr2_chan_set_span_id(openr2_chan_t *r2chan, int span_id);
 
 #ifdef __OR2_COMPILING_LIBRARY__
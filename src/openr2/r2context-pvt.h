@@ -39,6 +39,19 @@ extern "C" {
    already include us */
 struct openr2_chan_s;
 
+/* span ids are small numbers (1 to the spans in the box), 0 is no span */
+#define OR2_MAX_SPAN_ID 4096
+
+/* channel numbers the context indexes, larger ones are looked up the slow way */
+#define OR2_MAX_CHAN_NUMBER 65536
+
+/* channels of one span, in no particular order */
+typedef struct {
+	struct openr2_chan_s **chans;
+	int count;
+	int size;
+} openr2_span_chans_t;
+
 /* R2 protocol timers */
 typedef struct {
 	/* Max amount of time the backward MF cycle can last. 
@@ -69,9 +82,95 @@ typedef struct {
 	int r2_seize_persist;
 } openr2_timers_t;
 
+/* entry of the CAS transition table, what to do with
+   some R2 bits received in some R2 state */
+typedef struct {
+	openr2_cas_action_t action;
+	/* signal the bits mean in this state, OR2_CAS_INVALID if none */
+	openr2_cas_signal_t signal;
+	openr2_cas_state_t next_state;
+	/* for OR2_CAS_ACTION_DISCONNECT */
+	openr2_call_disconnect_cause_t cause;
+	/* optional message to log when taking the transition */
+	openr2_log_level_t note_level;
+	const char *note;
+} openr2_cas_transition_t;
+
+/* protocol settings that can change on a running context. Published copies
+   are never modified, a channel keeps a reference to the one it started its
+   call with and the last reference out frees it */
+typedef struct openr2_config_s {
+
+	/* references to a published copy, unused in the context copy */
+	int refs;
+
+	/* CAS transitions for the variant in use, indexed by
+	   R2 state and the received R2 bits */
+	openr2_cas_transition_t cas_table[OR2_NUM_R2_STATES][OR2_NUM_CAS_BITS];
+
+	/* Backward MF tones */
+	openr2_mf_ga_tones_t mf_ga_tones;
+	openr2_mf_gb_tones_t mf_gb_tones;
+	openr2_mf_gc_tones_t mf_gc_tones;
+
+	/* Forward MF tones */
+	openr2_mf_g1_tones_t mf_g1_tones;
+	openr2_mf_g2_tones_t mf_g2_tones;
+
+	/* reverse lookups of the MF tones above, what each received tone means */
+	unsigned char mf_ga_decode[OR2_MF_DECODE_SIZE];
+	unsigned char mf_gb_decode[OR2_MF_DECODE_SIZE];
+	unsigned char mf_gc_decode[OR2_MF_DECODE_SIZE];
+	unsigned char mf_gi_decode[OR2_MF_DECODE_SIZE];
+	unsigned char mf_gii_decode[OR2_MF_DECODE_SIZE];
+
+	/* R2 timers */
+	openr2_timers_t timers;
+
+	/* Max amount of DNIS digits that a channel on this context expect */
+	int max_dnis;
+
+	/* Max amount of ANI digits that a channel on this context expect */
+	int max_ani;
+
+	/* whether or not to get the ANI before getting DNIS */
+	int get_ani_first;
+
+	/* Skip category request and go to GII/B signals right away */
+	int skip_category;
+
+	/* whether or not accept the call bypassing the use of group B and II tones */
+	int immediate_accept;
+
+	/* use double answer with all channels */
+	int double_answer;
+
+	/* how calls are cleared, and whether the variant lets the forward
+	   side clear as soon as it receives a clear back */
+	openr2_release_policy_t release_policy;
+	int fast_clear_back;
+
+	/* MF threshold time in ms */
+	int mf_threshold;
+
+	/* use DTMF for outbound dialing */
+	int dial_with_dtmf;
+
+	/* use DTMF for inbound */
+	int detect_dtmf;
+	
+	/* How much time a DTMF digit should be ON */
+	int dtmf_on;
+
+	/* How much time the dtmf engine should be OFF between digits */
+	int dtmf_off;
+
+} openr2_config_t;
+
 typedef enum r2context_flags_e {
 	OR2_ANI_CAN_COME_FIRST = (1 << 0),
 	OR2_FORCE_USE_MAX_ANI = (1 << 1),
+	OR2_CONTEXT_SINGLE_OWNER = (1 << 2),
 } r2context_flags_t;
 
 /* R2 library context. Holds the R2 channel list,
@@ -118,74 +217,123 @@ typedef struct openr2_context_s {
 	   R2 signaling */
 	openr2_cas_signal_t cas_r2_bits;
 
-	/* Backward MF tones */
-	openr2_mf_ga_tones_t mf_ga_tones;
-	openr2_mf_gb_tones_t mf_gb_tones;
-	openr2_mf_gc_tones_t mf_gc_tones;
+	/* protocol settings as the setters leave them, and the snapshot last
+	   published out of them, which is what channels use (see r2context.c).
+	   Between openr2_context_begin_config() and openr2_context_apply_config()
+	   the setters do not publish (config_batch) */
+	openr2_config_t config;
+	openr2_config_t *live_config;
+	openr2_mutex_t *config_lock;
+	int config_batch;
 
-	/* Forward MF tones */
-	openr2_mf_g1_tones_t mf_g1_tones;
-	openr2_mf_g2_tones_t mf_g2_tones;
+	/* R2 logging mask */
+	openr2_log_level_t loglevel;
 
-	/* R2 timers */
-	openr2_timers_t timers;
+	/* R2 logging directory */
+	char logdir[OR2_MAX_PATH];
 
-	/* Max amount of DNIS digits that a channel on this context expect */
-	int max_dnis;
+	/* whether or not the advanced configuration file was used */
+	int configured_from_file;
 
-	/* Max amount of ANI digits that a channel on this context expect */
-	int max_ani;
+	/* access token to the timers */
+	openr2_mutex_t *timers_lock;
 
-	/* whether or not to get the ANI before getting DNIS */
-	int get_ani_first;
+	/* channels that belong to this context. chans is dense, a removed channel
+	   takes the place of the last one, and is what a scan of every channel
+	   walks. chans_by_number and spans find them by number and by span id */
+	struct openr2_chan_s **chans;
+	int chans_count;
+	int chans_size;
+	struct openr2_chan_s **chans_by_number;
+	int chans_by_number_size;
+	openr2_span_chans_t *spans;
+	int spans_size;
 
-	/* Skip category request and go to GII/B signals right away */
-	int skip_category;
+	/* context flags */
+	r2context_flags_t flags;
 
-	/* whether or not accept the call bypassing the use of group B and II tones */
-	int immediate_accept;
+	/* when the event queue is enabled evmanager points to queued_evmanager
+	   and the interface provided by the user is saved here */
+	openr2_event_interface_t *user_evmanager;
+	openr2_event_interface_t queued_evmanager;
 
-	/* use double answer with all channels */
-	int double_answer;
+	/* event queue ring, access token, read position, count and size */
+	openr2_mutex_t *events_lock;
+	openr2_event_t *events;
+	unsigned events_head;
+	unsigned events_count;
+	unsigned events_size;
 
-	/* MF threshold time in ms */
-	int mf_threshold;
+	/* events lost because the queue was full */
+	unsigned events_dropped;
 
-	/* use DTMF for outbound dialing */
-	int dial_with_dtmf;
+	/* ms after which openr2_context_service() leaves the media channels for the next pass, 0 never defers */
+	int media_defer_threshold;
 
-	/* use DTMF for inbound */
-	int detect_dtmf;
-	
-	/* How much time a DTMF digit should be ON */
-	int dtmf_on;
+	/* media channels left for a later pass by openr2_context_service() */
+	unsigned media_deferred;
 
-	/* How much time the dtmf engine should be OFF between digits */
-	int dtmf_off;
+	/* processing lag watchdog thresholds in ms, 0 disables the check */
+	int lag_read_threshold;
+	int lag_timer_threshold;
 
-	/* R2 logging mask */
-	openr2_log_level_t loglevel;
+	/* max loop iterations and microseconds a single channel processing call
+	   may take before returning OR2_CHAN_PROCESS_PENDING, 0 is unlimited */
+	int process_max_iterations;
+	int process_max_usecs;
 
-	/* R2 logging directory */
-	char logdir[OR2_MAX_PATH];
+	/* directory of the OR2_IO_SOCKET sockets and channels multiplexed
+	   on each of them, 0 for one socket per channel */
+	char io_socket_dir[OR2_MAX_PATH];
+	int io_socket_span;
 
-	/* whether or not the advanced configuration file was used */
-	int configured_from_file;
+	/* OR2_IO_URING ring shared by the context channels and the interface
+	   used for everything but reading and writing audio */
+	void *io_ring;
+	openr2_io_interface_t *io_lower;
 
-	/* access token to the timers */
-	openr2_mutex_t *timers_lock;
+	/* I/O recording and replay (see r2iotrace.c), io_recorded is the
+	   interface being recorded, io_trace the replay state */
+	char io_trace_dir[OR2_MAX_PATH];
+	openr2_io_interface_t *io_recorded;
+	void *io_trace;
 
-	/* list of channels that belong to this context */
-	struct openr2_chan_s *chanlist;
+	/* line impairment simulator (see r2ioimpair.c), io_impaired is the
+	   interface being impaired, io_impair the impairments and statistics */
+	openr2_io_interface_t *io_impaired;
+	void *io_impair;
 
-	/* context flags */
-	r2context_flags_t flags;
+	/* prefixes and lengths of the numbers we can be called at (see r2numplan.c) */
+	struct openr2_numplan_s *numplan;
+
+	/* adaptive timers configuration and far end statistics (see r2adapt.c) */
+	void *adapt;
+
+	/* admission control limits and counters (see r2admit.c) */
+	void *admit;
+
+	/* alarm state of each span indexed by span id, only kept when
+	   the user wants on_span_alarm (span_alarm_events) */
+	openr2_mutex_t *spans_lock;
+	int *span_alarms;
+	int span_alarms_size;
+	int span_alarm_events;
+
+	/* shared memory copy of the signal each channel transmits (see r2mirror.c) */
+	void *mirror;
+
+	/* clock for the protocol timers, NULL for the system clock */
+	int (*gettime)(struct openr2_context_s *r2context, struct timeval *tv);
 
 } openr2_context_t;
 
 
-void openr2_context_add_channel(openr2_context_t *r2context, struct openr2_chan_s *r2chan);
+int openr2_context_add_channel(openr2_context_t *r2context, struct openr2_chan_s *r2chan);
 void openr2_context_remove_channel(openr2_context_t *r2context, struct openr2_chan_s *r2chan);
+int openr2_context_set_channel_span(openr2_context_t *r2context, struct openr2_chan_s *r2chan, int span_id);
+int openr2_context_update_span_alarm(openr2_context_t *r2context, int span_id, int alarm);
+void openr2_context_pin_config(openr2_context_t *r2context, struct openr2_chan_s *r2chan);
+void openr2_context_unpin_config(openr2_context_t *r2context, struct openr2_chan_s *r2chan);
 #include "r2context.h"
 
 #if defined(__cplusplus)
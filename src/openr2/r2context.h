@@ -65,6 +65,16 @@ typedef struct {
 	openr2_mf_write_dispose_func mf_write_dispose;
 } openr2_mflib_interface_t;
 
+/* kind of processing lag detected by the channel watchdog */
+typedef enum {
+	/* a read came later than the frame period plus the read threshold */
+	OR2_LAG_READ_GAP,
+	/* a scheduled timer ran later than the timer threshold */
+	OR2_LAG_TIMER,
+	/* reads were late enough for the driver buffers to overflow, audio was lost */
+	OR2_LAG_READ_OVERRUN
+} openr2_lag_type_t;
+
 /* Event Management interface. Users should provide
    this interface to handle library events like call starting, new call, read audio etc. */
 typedef void (*openr2_handle_new_call_func)(openr2_chan_t *r2chan);
@@ -85,6 +95,9 @@ typedef void (*openr2_handle_billing_pulse_received_func)(openr2_chan_t *r2chan)
 typedef void (*openr2_handle_call_log_created_func)(openr2_chan_t *r2chan, const char *name);
 typedef int (*openr2_handle_dnis_digit_received_func)(openr2_chan_t *r2chan, char digit);
 typedef void (*openr2_handle_ani_digit_received_func)(openr2_chan_t *r2chan, char digit);
+typedef void (*openr2_handle_processing_lag_func)(openr2_chan_t *r2chan, openr2_lag_type_t type, int lag_ms);
+typedef void (*openr2_handle_channel_available_func)(openr2_chan_t *r2chan);
+typedef void (*openr2_handle_span_alarm_func)(openr2_chan_t *r2chan, int span_id, int alarm);
 typedef void (*openr2_handle_context_logging_func)(openr2_context_t *r2context, const char *file, const char *function, unsigned int line, openr2_log_level_t level, const char *fmt, va_list ap);
 typedef struct {
 	/* A new call has just started. We will start to 
@@ -145,8 +158,88 @@ typedef struct {
 
 	/* New call log was created */
 	openr2_handle_call_log_created_func on_call_log_created;
+
+	/* The members below were appended after on_call_log_created and changed the
+	   size of this structure, the library version was bumped for it. Applications
+	   built against older headers must be rebuilt */
+
+	/* The channel was processed late, lag_ms is how late.
+	   See openr2_context_set_lag_thresholds() */
+	openr2_handle_processing_lag_func on_processing_lag;
+
+	/* The channel can take a new call again, both ends are idle */
+	openr2_handle_channel_available_func on_channel_available;
+
+	/* The span of the channel went in or out of alarm, see openr2_chan_set_span_id().
+	   Called once per span, on the first channel that noticed it, instead of
+	   on_hardware_alarm on every channel of the span. Leave it NULL to keep
+	   getting on_hardware_alarm on each channel */
+	openr2_handle_span_alarm_func on_span_alarm;
 } openr2_event_interface_t;
 
+/* Event records used when the context event queue is enabled. Instead of calling
+   the event interface the library appends one record per event to the context queue
+   and the user pulls them with openr2_context_poll_events(). Media (on_call_read)
+   and logging callbacks are still called directly. The queue starts with room for
+   max_events and doubles when it is full, only processing lag events are dropped
+   then (see openr2_context_get_dropped_events()). Disable it while no channel is
+   being processed, events generated meanwhile are dropped */
+typedef enum {
+	OR2_EVENT_NONE = 0,
+	OR2_EVENT_CALL_INIT,
+	OR2_EVENT_CALL_PROCEED,
+	OR2_EVENT_CALL_OFFERED,
+	OR2_EVENT_CALL_ACCEPTED,
+	OR2_EVENT_CALL_ANSWERED,
+	OR2_EVENT_CALL_DISCONNECT,
+	OR2_EVENT_CALL_END,
+	OR2_EVENT_HARDWARE_ALARM,
+	OR2_EVENT_OS_ERROR,
+	OR2_EVENT_PROTOCOL_ERROR,
+	OR2_EVENT_LINE_BLOCKED,
+	OR2_EVENT_LINE_IDLE,
+	OR2_EVENT_DNIS_DIGIT,
+	OR2_EVENT_ANI_DIGIT,
+	OR2_EVENT_BILLING_PULSE,
+	OR2_EVENT_PROCESSING_LAG,
+	OR2_EVENT_CHANNEL_AVAILABLE,
+	OR2_EVENT_SPAN_ALARM
+} openr2_event_type_t;
+
+typedef struct {
+	/* what happened */
+	openr2_event_type_t type;
+	/* channel where it happened and its number, the record
+	   does not need the channel lock to be consumed */
+	openr2_chan_t *r2chan;
+	int channo;
+	/* call the event belongs to, for openr2_chan_disconnect_call_id() */
+	unsigned call_id;
+	/* event data, copied inline */
+	union {
+		struct {
+			char ani[OR2_MAX_ANI];
+			char dnis[OR2_MAX_DNIS];
+			openr2_calling_party_category_t category;
+			int ani_restricted;
+		} offered;
+		openr2_call_mode_t mode;
+		openr2_call_disconnect_cause_t cause;
+		int alarm;
+		int oserrorcode;
+		openr2_protocol_error_t error;
+		char digit;
+		struct {
+			openr2_lag_type_t type;
+			int ms;
+		} lag;
+		struct {
+			int span_id;
+			int alarm;
+		} span;
+	} data;
+} openr2_event_t;
+
 typedef openr2_io_fd_t (*openr2_io_open_func)(openr2_context_t* r2context, int channo);
 typedef int (*openr2_io_close_func)(openr2_chan_t *r2chan);
 typedef int (*openr2_io_set_cas_func)(openr2_chan_t *r2chan, int cas);
@@ -158,6 +251,15 @@ typedef int (*openr2_io_setup_func)(openr2_chan_t *r2chan);
 typedef int (*openr2_io_wait_func)(openr2_chan_t *r2chan, int *flags, int block);
 typedef int (*openr2_io_get_oob_event_func)(openr2_chan_t *r2chan, openr2_oob_event_t *event);
 typedef int (*openr2_io_get_alarm_state_func)(openr2_chan_t *r2chan, int *alarm);
+typedef int (*openr2_io_play_loop_func)(openr2_chan_t *r2chan, const void *buf, int size);
+typedef int (*openr2_io_stop_loop_func)(openr2_chan_t *r2chan);
+typedef int (*openr2_io_wait_span_func)(openr2_context_t *r2context, openr2_chan_t *chans[], int flags[], int n, int block);
+typedef int (*openr2_io_read_span_func)(openr2_context_t *r2context, openr2_chan_t *chans[], void *bufs[], int sizes[], int n);
+typedef int (*openr2_io_write_span_func)(openr2_context_t *r2context, openr2_chan_t *chans[], const void *bufs[], int sizes[], int n);
+typedef int (*openr2_io_get_cas_span_func)(openr2_context_t *r2context, openr2_chan_t *chans[], int cas[], int n, uint32_t *changed);
+
+/* span operations get at most this many channels per call */
+#define OR2_IO_MAX_SPAN_CHANS 32
 typedef struct {
 	openr2_io_open_func open;
 	openr2_io_close_func close;
@@ -170,6 +272,23 @@ typedef struct {
 	openr2_io_wait_func wait;
 	openr2_io_get_oob_event_func get_oob_event;
 	openr2_io_get_alarm_state_func get_alarm_state;
+	/* the members below were appended after get_alarm_state and changed the size of
+	   this structure, custom interfaces built against older headers must be rebuilt.
+	   Zero the whole structure before filling it so unused members are NULL */
+
+	/* optional, NULL if the backend cannot do it. play_loop copies buf (ALAW) and
+	   transmits it over and over after whatever was written before, until stop_loop
+	   is called, the library then stops writing MF tones until the tone changes */
+	openr2_io_play_loop_func play_loop;
+	openr2_io_stop_loop_func stop_loop;
+	/* optional, used by openr2_context_process_span() when wait_span is there. They work
+	   like their per channel versions on n channels at once, sizes are updated with the
+	   bytes moved (or -1) and get_cas_span sets bit i of changed if chans[i] bits changed
+	   since the previous call. The other span members are refused without wait_span */
+	openr2_io_wait_span_func wait_span;
+	openr2_io_read_span_func read_span;
+	openr2_io_write_span_func write_span;
+	openr2_io_get_cas_span_func get_cas_span;
 } openr2_io_interface_t;
 
 typedef enum {
@@ -177,9 +296,122 @@ typedef enum {
 	/* OR2_IO_OPENZAP (libopenzap I/O) */
 	/* OR2_IO_SANGOMA (libsangoma I/O) */
 	OR2_IO_ZT, /* Zaptel or DAHDI I/O */
+	OR2_IO_LOOPBACK, /* in-process back to back channel pairs, see r2ioloop.c */
+	OR2_IO_SOCKET, /* UNIX socket per channel or span to another process, see r2iosock.c */
+	OR2_IO_URING, /* audio through one io_uring per context, control through another interface, see r2iouring.c */
+	OR2_IO_REPLAY, /* replay of traces recorded with openr2_context_set_io_recording(), see r2iotrace.c */
 	OR2_IO_CUSTOM = 9 /* any unsupported vendor I/O (pika, digivoice, kohmp etc) */
 } openr2_io_type_t;
 
+/* Line impairments applied to what the library receives, see openr2_context_set_io_impairments() */
+typedef struct {
+	/* random generator seed, runs with the same seed and traffic get the same impairments */
+	unsigned seed;
+	/* propagation delay of audio and CAS, plus up to jitter_ms more for each audio frame */
+	int delay_ms;
+	int jitter_ms;
+	/* white noise level (negative, 0 is no noise) */
+	int noise_dbm0;
+	/* loss, and level difference between the high and the low frequencies */
+	int attenuation_db;
+	int twist_db;
+	/* audio frames lost */
+	int drop_per_mille;
+	/* random flips of the A or B bit lasting cas_glitch_ms */
+	int cas_glitches_per_min;
+	int cas_glitch_ms;
+	/* random alarms lasting alarm_flap_ms */
+	int alarm_flaps_per_min;
+	int alarm_flap_ms;
+} openr2_impairments_t;
+
+typedef struct {
+	unsigned long frames;
+	unsigned long frames_dropped;
+	unsigned long samples_slipped;
+	unsigned long cas_delayed;
+	unsigned long cas_glitches;
+	unsigned long alarm_flaps;
+} openr2_impairment_stats_t;
+
+/* lock usage counters, updated by the lock owner right after acquiring it */
+typedef struct openr2_mutex_stats {
+	/* times the lock was taken (recursive re-entries not included) */
+	uint64_t acquisitions;
+	/* times the lock was held by someone else when we tried to take it */
+	uint64_t contended;
+	/* total time spent waiting for the lock in contended acquisitions */
+	uint64_t wait_ns;
+} openr2_mutex_stats_t;
+
+/* Protocol timers that can adapt to how fast the far end answers, see openr2_context_set_adaptive_timers() */
+typedef enum {
+	OR2_ADAPTIVE_R2_SEIZE, /* seize to seize ack */
+	OR2_ADAPTIVE_MF_BACK_CYCLE, /* backward MF tone to the next forward tone */
+	OR2_NUM_ADAPTIVE_TIMERS
+} openr2_adaptive_timer_t;
+
+/* Setting NULL disables the adaptive timers, what was learned is kept */
+typedef struct {
+	/* far end responses measured before shortening a timer */
+	int min_samples;
+	/* the timer is the mean response time plus this many mean deviations */
+	int deviations;
+	/* but never less than this percentage of the configured timer */
+	int min_percent;
+} openr2_adaptive_timers_t;
+
+typedef struct {
+	unsigned samples;
+	int mean_ms;
+	int deviation_ms;
+	/* what the timer is currently set to */
+	int timeout_ms;
+} openr2_timer_stats_t;
+
+/* How fast a call is cleared, see openr2_context_set_release_policy() */
+typedef enum {
+	/* wait for the user to disconnect after a disconnection from the far end */
+	OR2_RELEASE_STANDARD,
+	/* complete the release as soon as the far end cleared, where the variant allows it.
+	   A new call may arrive before the user disconnects the old one, users disconnecting
+	   late must use openr2_chan_disconnect_call_id() or drop their pending disconnect
+	   on on_call_end */
+	OR2_RELEASE_FAST
+} openr2_release_policy_t;
+
+/* Limits for incoming calls, see openr2_context_set_admission(). 0 means no limit.
+   Setting NULL disables admission control, the counters are kept */
+typedef struct {
+	/* incoming calls seized and not accepted yet */
+	int max_setups;
+	/* new incoming calls per second, in bursts of up to burst calls (max_rate if 0) */
+	int max_rate;
+	int burst;
+	/* shed every new call while the load given to openr2_context_set_load() is at least this */
+	int max_load;
+} openr2_admission_t;
+
+/* what an advanced configuration file changes, shared by every context
+   configured from the same version of the file */
+typedef struct openr2_profile_s openr2_profile_t;
+
+typedef struct {
+	unsigned long admitted;
+	/* calls rejected with network congestion and the limit they hit */
+	unsigned long shed_load;
+	unsigned long shed_setups;
+	unsigned long shed_rate;
+	/* admitted calls in setup right now */
+	int setups;
+} openr2_admission_stats_t;
+
+/* How OR2_IO_REPLAY releases the recorded events */
+typedef enum {
+	OR2_REPLAY_REAL_TIME, /* as they were recorded */
+	OR2_REPLAY_MAX_SPEED /* as soon as the channels are idle, protocol timers run on the recorded time */
+} openr2_replay_mode_t;
+
 /* Transcoding interface. Users should provide this interface
    to provide transcoding services from linear to alaw and 
    viceversa */
@@ -234,6 +466,7 @@ typedef enum {
 	OR2_LIBERR_INVALID_INTERFACE
 } openr2_liberr_t;
 
+/* single owner channels are not considered, their owner thread must use openr2_chan_get_time_to_next_event() */
 OR2_DECLARE(int) openr2_context_get_time_to_next_event(openr2_context_t *r2context);
 OR2_DECLARE(openr2_context_t *) openr2_context_new(openr2_variant_t variant, openr2_event_interface_t *callmgmt, int max_ani, int max_dnis);
 OR2_DECLARE(void) openr2_context_delete(openr2_context_t *r2context);
@@ -260,8 +493,52 @@ OR2_DECLARE(void) openr2_context_set_metering_pulse_timeout(openr2_context_t *r2
 OR2_DECLARE(int) openr2_context_get_metering_pulse_timeout(openr2_context_t *r2context);
 OR2_DECLARE(void) openr2_context_set_double_answer(openr2_context_t *r2context, int enable);
 OR2_DECLARE(int) openr2_context_get_double_answer(openr2_context_t *r2context);
+OR2_DECLARE(void) openr2_context_set_release_policy(openr2_context_t *r2context, openr2_release_policy_t policy);
+OR2_DECLARE(openr2_release_policy_t) openr2_context_get_release_policy(openr2_context_t *r2context);
+OR2_DECLARE(void) openr2_context_begin_config(openr2_context_t *r2context);
+OR2_DECLARE(int) openr2_context_apply_config(openr2_context_t *r2context);
+OR2_DECLARE(void) openr2_context_set_single_owner(openr2_context_t *r2context, int enable);
+OR2_DECLARE(int) openr2_context_get_single_owner(openr2_context_t *r2context);
+OR2_DECLARE(void) openr2_context_get_lock_stats(openr2_context_t *r2context, openr2_mutex_stats_t *timers_stats, openr2_mutex_stats_t *chans_stats);
+OR2_DECLARE(void) openr2_context_reset_lock_stats(openr2_context_t *r2context);
+OR2_DECLARE(void) openr2_context_dump_lock_stats(openr2_context_t *r2context);
+OR2_DECLARE(void) openr2_context_set_media_defer_threshold(openr2_context_t *r2context, int ms);
+OR2_DECLARE(int) openr2_context_get_media_defer_threshold(openr2_context_t *r2context);
+OR2_DECLARE(unsigned) openr2_context_get_deferred_media(openr2_context_t *r2context);
+OR2_DECLARE(int) openr2_context_service(openr2_context_t *r2context, openr2_chan_t *ready_chans[], int n);
+OR2_DECLARE(void) openr2_context_set_lag_thresholds(openr2_context_t *r2context, int read_ms, int timer_ms);
+OR2_DECLARE(void) openr2_context_get_lag_thresholds(openr2_context_t *r2context, int *read_ms, int *timer_ms);
+OR2_DECLARE(const char *) openr2_context_get_lag_string(openr2_lag_type_t type);
+OR2_DECLARE(void) openr2_context_set_process_budget(openr2_context_t *r2context, int max_iterations, int max_usecs);
+OR2_DECLARE(void) openr2_context_get_process_budget(openr2_context_t *r2context, int *max_iterations, int *max_usecs);
+OR2_DECLARE(int) openr2_context_add_number_plan(openr2_context_t *r2context, const char *prefix, int length);
+OR2_DECLARE(int) openr2_context_clear_number_plan(openr2_context_t *r2context);
+OR2_DECLARE(int) openr2_context_get_number_plan_size(openr2_context_t *r2context);
+OR2_DECLARE(void) openr2_context_dump_cas_table(openr2_context_t *r2context);
 OR2_DECLARE(int) openr2_context_configure_from_advanced_file(openr2_context_t *r2context, const char *filename);
+OR2_DECLARE(int) openr2_context_set_profile(openr2_context_t *r2context, openr2_profile_t *profile);
+OR2_DECLARE(openr2_profile_t *) openr2_profile_get(const char *filename);
+OR2_DECLARE(void) openr2_profile_release(openr2_profile_t *profile);
+OR2_DECLARE(void) openr2_profile_clear_cache(void);
 OR2_DECLARE(int) openr2_context_set_io_type(openr2_context_t *r2context, openr2_io_type_t io_type, openr2_io_interface_t *io_interface);
+OR2_DECLARE(int) openr2_context_io_tick(openr2_context_t *r2context, int wait_ms);
+OR2_DECLARE(int) openr2_context_process_span(openr2_context_t *r2context, int block);
+OR2_DECLARE(void) openr2_context_get_io_tick_stats(openr2_context_t *r2context, unsigned *submits, unsigned *completions);
+OR2_DECLARE(int) openr2_context_set_socket_io(openr2_context_t *r2context, const char *directory, int span_channels);
+OR2_DECLARE(int) openr2_context_get_socket_io(openr2_context_t *r2context, char *directory, int len);
+OR2_DECLARE(int) openr2_context_set_io_recording(openr2_context_t *r2context, const char *directory);
+OR2_DECLARE(int) openr2_context_set_io_replay(openr2_context_t *r2context, const char *directory, openr2_replay_mode_t mode);
+OR2_DECLARE(int) openr2_context_get_replay_status(openr2_context_t *r2context, int *pending_chans, unsigned *divergences);
+OR2_DECLARE(int) openr2_context_set_io_impairments(openr2_context_t *r2context, const openr2_impairments_t *impairments);
+OR2_DECLARE(int) openr2_context_get_impairment_stats(openr2_context_t *r2context, openr2_impairment_stats_t *stats);
+OR2_DECLARE(int) openr2_context_set_adaptive_timers(openr2_context_t *r2context, const openr2_adaptive_timers_t *config);
+/* adaptive timer estimates are kept per span, openr2_context_get_timer_stats() reports the channels without a span id */
+OR2_DECLARE(int) openr2_context_get_timer_stats(openr2_context_t *r2context, openr2_adaptive_timer_t timer, openr2_timer_stats_t *stats);
+OR2_DECLARE(int) openr2_context_get_span_timer_stats(openr2_context_t *r2context, int span_id, openr2_adaptive_timer_t timer, openr2_timer_stats_t *stats);
+OR2_DECLARE(int) openr2_context_set_admission(openr2_context_t *r2context, const openr2_admission_t *admission);
+OR2_DECLARE(int) openr2_context_get_admission_stats(openr2_context_t *r2context, openr2_admission_stats_t *stats);
+OR2_DECLARE(int) openr2_context_set_load(openr2_context_t *r2context, int load);
+OR2_DECLARE(int) openr2_context_set_state_mirror(openr2_context_t *r2context, const char *path);
 OR2_DECLARE(void) openr2_context_set_dtmf_detection(openr2_context_t *r2context, int enable);
 OR2_DECLARE(int) openr2_context_get_dtmf_detection(openr2_context_t *r2context);
 OR2_DECLARE(void) openr2_context_set_dtmf_dialing(openr2_context_t *r2context, int enable, int dtmf_on, int dtmf_off);
@@ -269,6 +546,19 @@ OR2_DECLARE(int) openr2_context_get_dtmf_dialing(openr2_context_t *r2context, in
 OR2_DECLARE(int) openr2_context_set_dtmf_interface(openr2_context_t *r2context, openr2_dtmf_interface_t *dtmf_interface);
 OR2_DECLARE(int) openr2_context_set_mflib_interface(openr2_context_t *r2context, openr2_mflib_interface_t *mflib);
 OR2_DECLARE(int) openr2_context_set_transcoder_interface(openr2_context_t *r2context, openr2_transcoder_interface_t *transcoder);
+OR2_DECLARE(int) openr2_context_enable_event_queue(openr2_context_t *r2context, int max_events);
+OR2_DECLARE(void) openr2_context_disable_event_queue(openr2_context_t *r2context);
+OR2_DECLARE(int) openr2_context_poll_events(openr2_context_t *r2context, openr2_event_t *events, int max);
+OR2_DECLARE(unsigned) openr2_context_get_dropped_events(openr2_context_t *r2context);
+OR2_DECLARE(const char *) openr2_context_get_event_string(openr2_event_type_t type);
+/* the channel getters and openr2_context_process_span() walk the context channels without
+   a lock, channels must not be created or deleted while other threads use them. The timer
+   and lock stats calls are safe to use from a monitor thread at any time */
+OR2_DECLARE(openr2_chan_t *) openr2_context_get_chan(openr2_context_t *r2context, int channo);
+OR2_DECLARE(int) openr2_context_get_chan_count(openr2_context_t *r2context);
+OR2_DECLARE(int) openr2_context_get_chans(openr2_context_t *r2context, openr2_chan_t *chans[], int max);
+OR2_DECLARE(int) openr2_context_get_span_chans(openr2_context_t *r2context, int span_id, openr2_chan_t *chans[], int max);
+OR2_DECLARE(int) openr2_context_get_spans(openr2_context_t *r2context, int spans[], int max);
 
 #ifdef __OR2_COMPILING_LIBRARY__
 #undef openr2_chan_t 
@@ -47,8 +47,27 @@ int openr2_io_setup(openr2_chan_t *r2chan);
 int openr2_io_wait(openr2_chan_t *r2chan, int *flags, int wait);
 int openr2_io_get_oob_event(openr2_chan_t *r2chan, openr2_oob_event_t *event);
 int openr2_io_get_alarm_state(openr2_chan_t *r2chan, int *alarm);
+int openr2_io_play_loop(openr2_chan_t *r2chan, const void *buf, int size);
+int openr2_io_stop_loop(openr2_chan_t *r2chan);
 openr2_io_interface_t *openr2_io_get_zt_interface(void);
 openr2_io_interface_t *openr2_io_get_dummy_interface(void);
+openr2_io_interface_t *openr2_io_get_loopback_interface(void);
+openr2_io_interface_t *openr2_io_get_socket_interface(void);
+openr2_io_interface_t *openr2_io_get_uring_interface(void);
+int openr2_io_uring_tick(openr2_context_t *r2context, int wait_ms);
+void openr2_io_uring_get_stats(openr2_context_t *r2context, unsigned *submits, unsigned *completions);
+void openr2_io_uring_destroy(openr2_context_t *r2context);
+openr2_io_interface_t *openr2_io_get_record_interface(void);
+openr2_io_interface_t *openr2_io_get_replay_interface(void);
+int openr2_io_replay_start(openr2_context_t *r2context, openr2_replay_mode_t mode);
+int openr2_io_replay_status(openr2_context_t *r2context, int *pending, unsigned *divergences);
+void openr2_io_replay_destroy(openr2_context_t *r2context);
+openr2_io_interface_t *openr2_io_get_impair_interface(void);
+openr2_io_interface_t *openr2_io_get_span_staged_interface(void);
+int openr2_io_span_process(openr2_context_t *r2context, int block);
+int openr2_io_impair_configure(openr2_context_t *r2context, const openr2_impairments_t *impairments);
+int openr2_io_impair_get_stats(openr2_context_t *r2context, openr2_impairment_stats_t *stats);
+void openr2_io_impair_destroy(openr2_context_t *r2context);
 
 #if defined(__cplusplus)
 } /* endif extern "C" */
@@ -0,0 +1,44 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * Channel state mirror. The CAS signal each channel is transmitting, kept in
+ * a shared memory file so a restarted or standby process can tell the calls
+ * in progress apart (see openr2_chan_resync()).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _OPENR2_MIRROR_PVT_H_
+#define _OPENR2_MIRROR_PVT_H_
+
+#include "r2context.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+struct openr2_chan_s;
+
+int openr2_mirror_open(openr2_context_t *r2context, const char *path);
+void openr2_mirror_close(openr2_context_t *r2context);
+void openr2_mirror_update(struct openr2_chan_s *r2chan);
+openr2_cas_signal_t openr2_mirror_get_tx(struct openr2_chan_s *r2chan);
+
+#if defined(__cplusplus)
+} /* endif extern "C" */
+#endif
+
+#endif /* endif defined _OPENR2_MIRROR_PVT_H_ */
@@ -0,0 +1,47 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * Number plan. Prefixes with the length of the numbers starting with them,
+ * used to know when a DNIS is complete without waiting for max DNIS digits.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _OPENR2_NUMPLAN_PVT_H_
+#define _OPENR2_NUMPLAN_PVT_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* node where the walk of every DNIS starts */
+#define OR2_NUMPLAN_ROOT 0
+
+/* walked off the number plan, no prefix can match anymore */
+#define OR2_NUMPLAN_NONE -1
+
+typedef struct openr2_numplan_s openr2_numplan_t;
+
+int openr2_numplan_add(openr2_numplan_t **plan, const char *prefix, int length);
+void openr2_numplan_free(openr2_numplan_t *plan);
+int openr2_numplan_count(const openr2_numplan_t *plan);
+int openr2_numplan_step(const openr2_numplan_t *plan, int node, char digit, int *length);
+
+#if defined(__cplusplus)
+} /* endif extern "C" */
+#endif
+
+#endif /* endif defined _OPENR2_NUMPLAN_PVT_H_ */
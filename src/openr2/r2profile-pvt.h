@@ -0,0 +1,38 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * Advanced configuration profiles, what an advanced file changes in the
+ * settings of the contexts using it.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _OPENR2_PROFILE_PVT_H_
+#define _OPENR2_PROFILE_PVT_H_
+
+#include "r2context.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+void openr2_profile_apply(openr2_profile_t *profile, openr2_context_t *r2context);
+
+#if defined(__cplusplus)
+} /* endif extern "C" */
+#endif
+
+#endif /* endif defined _OPENR2_PROFILE_PVT_H_ */
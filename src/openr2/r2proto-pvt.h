@@ -253,6 +253,42 @@ typedef enum {
 	OR2_DOUBLE_SEIZURE = 500,
 } openr2_cas_state_t;
 
+/* amount of R2 states above, the CAS table uses a dense index for them */
+#define OR2_NUM_R2_STATES 23
+
+/* every pattern the ABCD bits can have */
+#define OR2_NUM_CAS_BITS 16
+
+/* what to do when the R2 bits change while in some R2 state */
+typedef enum {
+	/* bits not expected in this state */
+	OR2_CAS_ACTION_PROTOCOL_ERROR = 0,
+	/* we should not be receiving anything in this state */
+	OR2_CAS_ACTION_STATE_ERROR,
+	/* the state has no CAS handling at all */
+	OR2_CAS_ACTION_UNHANDLED_STATE,
+	/* log and do nothing else */
+	OR2_CAS_ACTION_IGNORE,
+	/* just move to the next state */
+	OR2_CAS_ACTION_SET_STATE,
+	OR2_CAS_ACTION_LINE_IDLE,
+	OR2_CAS_ACTION_LINE_BLOCKED,
+	OR2_CAS_ACTION_INCOMING_CALL,
+	/* move to the next state and report the disconnection cause */
+	OR2_CAS_ACTION_DISCONNECT,
+	OR2_CAS_ACTION_CALL_END,
+	OR2_CAS_ACTION_SEIZE_ACK_MF,
+	OR2_CAS_ACTION_SEIZE_ACK_DTMF,
+	OR2_CAS_ACTION_SEIZE_ACK_CLEAR_FWD,
+	OR2_CAS_ACTION_GLARE,
+	OR2_CAS_ACTION_ANSWER_MF,
+	OR2_CAS_ACTION_ANSWER_DTMF,
+	/* clear back that may still be a metering pulse */
+	OR2_CAS_ACTION_CLEAR_BACK_METERING,
+	OR2_CAS_ACTION_METERING_PULSE,
+	OR2_NUM_CAS_ACTIONS
+} openr2_cas_action_t;
+
 /* Call States */
 typedef enum {
 	/* ready to accept or make calls */
@@ -323,6 +359,57 @@ typedef struct {
 	openr2_mf_tone_t pay_phone;
 } openr2_mf_g2_tones_t;
 
+/* size of the per context MF decode tables, indexed by the received tone */
+#define OR2_MF_DECODE_SIZE 128
+
+/* meaning of a Group A tone received by the forward side */
+typedef enum {
+	OR2_MF_GA_NONE = 0,
+	OR2_MF_GA_NEXT_DNIS,
+	OR2_MF_GA_DNIS_MINUS_1,
+	OR2_MF_GA_DNIS_MINUS_2,
+	OR2_MF_GA_DNIS_MINUS_3,
+	OR2_MF_GA_ALL_DNIS_AGAIN,
+	OR2_MF_GA_CATEGORY,
+	OR2_MF_GA_CATEGORY_AND_CHANGE_TO_GC,
+	OR2_MF_GA_CHANGE_TO_G2,
+	OR2_MF_GA_ADDRESS_COMPLETE,
+	OR2_MF_GA_NETWORK_CONGESTION,
+	/* flag, the tone requests the next ANI digit once the category has been sent */
+	OR2_MF_GA_NEXT_ANI = 0x80
+} openr2_mf_ga_meaning_t;
+
+/* meaning of a Group B tone received by the forward side */
+typedef enum {
+	OR2_MF_GB_NONE = 0,
+	OR2_MF_GB_ACCEPT_WITH_CHARGE,
+	OR2_MF_GB_ACCEPT_NO_CHARGE,
+	OR2_MF_GB_SPECIAL_INFO,
+	OR2_MF_GB_BUSY_NUMBER,
+	OR2_MF_GB_NETWORK_CONGESTION,
+	OR2_MF_GB_UNALLOCATED_NUMBER,
+	OR2_MF_GB_NUMBER_CHANGED,
+	OR2_MF_GB_LINE_OUT_OF_ORDER
+} openr2_mf_gb_meaning_t;
+
+/* meaning of a Group C tone received by the forward side */
+typedef enum {
+	OR2_MF_GC_NONE = 0,
+	OR2_MF_GC_NEXT_ANI,
+	OR2_MF_GC_CHANGE_TO_G2,
+	OR2_MF_GC_NEXT_DNIS_AND_CHANGE_TO_GA,
+	OR2_MF_GC_NETWORK_CONGESTION
+} openr2_mf_gc_meaning_t;
+
+/* meanings of a Group I tone received by the backward side, a tone
+   may mean more than one thing depending on what we asked for */
+typedef enum {
+	OR2_MF_GI_DIGIT = (1 << 0),
+	OR2_MF_GI_NO_MORE_DNIS = (1 << 1),
+	OR2_MF_GI_NO_MORE_ANI = (1 << 2),
+	OR2_MF_GI_ANI_RESTRICTED = (1 << 3)
+} openr2_mf_gi_meaning_t;
+
 const char *openr2_proto_get_rx_cas_string(struct openr2_chan_s *r2chan);
 const char *openr2_proto_get_tx_cas_string(struct openr2_chan_s *r2chan);
 openr2_cas_signal_t openr2_proto_get_rx_cas(struct openr2_chan_s *r2chan);
@@ -341,9 +428,14 @@ int openr2_proto_answer_call_with_mode(struct openr2_chan_s *r2chan, openr2_answ
 int openr2_proto_disconnect_call(struct openr2_chan_s *r2chan, openr2_call_disconnect_cause_t cause);
 int openr2_proto_handle_cas(struct openr2_chan_s *r2chan);
 int openr2_proto_set_idle(struct openr2_chan_s *r2chan);
+int openr2_proto_resync(struct openr2_chan_s *r2chan);
+int openr2_proto_is_available(struct openr2_chan_s *r2chan);
 int openr2_proto_set_blocked(struct openr2_chan_s *r2chan);
 int openr2_proto_set_cas_signal(struct openr2_chan_s *r2chan, openr2_cas_signal_t signal);
 int openr2_proto_configure_context(struct openr2_context_s *r2context, openr2_variant_t variant, int max_ani, int max_dnis);
+void openr2_proto_compile_cas_table(struct openr2_context_s *r2context);
+void openr2_proto_compile_mf_tables(struct openr2_context_s *r2context);
+void openr2_proto_dump_cas_table(struct openr2_context_s *r2context);
 void openr2_proto_handle_mf_tone(struct openr2_chan_s *r2chan, int tone);
 void openr2_proto_handle_dtmf_end(struct openr2_chan_s *r2chan);
 int openr2_proto_handle_alarm_state(struct openr2_chan_s *r2chan);
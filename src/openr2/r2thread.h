@@ -26,6 +26,8 @@
 #ifndef _R2THREAD_H
 #define _R2THREAD_H
 
+#include "r2context.h" /* just for openr2_mutex_stats_t */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -41,10 +43,6 @@ extern "C" {
 #define OR2_THREAD_CALLING_CONVENTION __stdcall
 typedef HANDLE openr2_socket_t;
 
-struct openr2_mutex {
-	CRITICAL_SECTION mutex;
-};
-
 #else /* WIN32 */
 #define OR2_INVALID_SOCKET -1
 typedef int openr2_socket_t;
@@ -65,10 +63,34 @@ typedef int openr2_socket_t;
 
 #define OR2_THREAD_CALLING_CONVENTION
 
+#endif
+
+#if defined(WIN32)
+struct openr2_mutex {
+	CRITICAL_SECTION mutex;
+	/* recursion depth, only touched by the owner */
+	unsigned int depth;
+	openr2_mutex_stats_t stats;
+};
+#elif defined(__linux__)
+/* spin then futex wait lock, recursion only for locks created recursive */
+#define OR2_FUTEX_MUTEX 1
+struct openr2_mutex {
+	/* 0 unlocked, 1 locked, 2 locked and someone may be sleeping on it */
+	volatile int state;
+	int recursive;
+	/* owner thread and recursion depth, only meaningful while locked */
+	volatile unsigned long owner;
+	unsigned int depth;
+	openr2_mutex_stats_t stats;
+};
+#else
 struct openr2_mutex {
 	pthread_mutex_t mutex;
+	/* recursion depth, only touched by the owner */
+	unsigned int depth;
+	openr2_mutex_stats_t stats;
 };
-
 #endif
 
 
@@ -130,8 +152,12 @@ struct openr2_thread {
 openr2_status_t openr2_thread_create_detached(openr2_thread_function_t func, void *data);
 openr2_status_t openr2_thread_create_detached_ex(openr2_thread_function_t func, void *data, size_t stack_size);
 
+/* openr2_mutex_create() creates recursive mutexes, openr2_mutex_create_ex() lets you choose */
 openr2_status_t openr2_mutex_create(openr2_mutex_t **mutex);
+openr2_status_t openr2_mutex_create_ex(openr2_mutex_t **mutex, int recursive);
 openr2_status_t openr2_mutex_destroy(openr2_mutex_t **mutex);
+void openr2_mutex_get_stats(openr2_mutex_t *mutex, openr2_mutex_stats_t *stats);
+void openr2_mutex_reset_stats(openr2_mutex_t *mutex);
 
 #define openr2_mutex_lock(_x) _openr2_mutex_lock(_x)
 openr2_status_t _openr2_mutex_lock(openr2_mutex_t *mutex);
@@ -142,6 +168,25 @@ openr2_status_t _openr2_mutex_trylock(openr2_mutex_t *mutex);
 #define openr2_mutex_unlock(_x) _openr2_mutex_unlock(_x)
 openr2_status_t _openr2_mutex_unlock(openr2_mutex_t *mutex);
 
+/* pointer sized atomic operations used by the lock-free queues, and 32 bit
+   ones for memory shared with other processes. openr2_atomic_cas_ptr() returns
+   the value found, it only stored the new one if that is the old one given */
+#ifdef WIN32
+#define openr2_atomic_xchg_ptr(_ptr, _val) InterlockedExchangePointer((PVOID volatile *)(_ptr), (_val))
+#define openr2_atomic_load_ptr(_ptr) (MemoryBarrier(), *(_ptr))
+#define openr2_atomic_store_ptr(_ptr, _val) do { MemoryBarrier(); *(_ptr) = (_val); } while (0)
+#define openr2_atomic_cas_ptr(_ptr, _old, _new) InterlockedCompareExchangePointer((PVOID volatile *)(_ptr), (_new), (_old))
+#define openr2_atomic_load_32(_ptr) InterlockedCompareExchange((LONG volatile *)(_ptr), 0, 0)
+#define openr2_atomic_store_32(_ptr, _val) InterlockedExchange((LONG volatile *)(_ptr), (_val))
+#else
+#define openr2_atomic_xchg_ptr(_ptr, _val) __atomic_exchange_n((_ptr), (_val), __ATOMIC_ACQ_REL)
+#define openr2_atomic_load_ptr(_ptr) __atomic_load_n((_ptr), __ATOMIC_ACQUIRE)
+#define openr2_atomic_store_ptr(_ptr, _val) __atomic_store_n((_ptr), (_val), __ATOMIC_RELEASE)
+#define openr2_atomic_cas_ptr(_ptr, _old, _new) __sync_val_compare_and_swap((_ptr), (_old), (_new))
+#define openr2_atomic_load_32(_ptr) __atomic_load_n((_ptr), __ATOMIC_ACQUIRE)
+#define openr2_atomic_store_32(_ptr, _val) __atomic_store_n((_ptr), (_val), __ATOMIC_RELEASE)
+#endif
+
 openr2_status_t openr2_interrupt_create(openr2_interrupt_t **cond, openr2_socket_t device);
 openr2_status_t openr2_interrupt_destroy(openr2_interrupt_t **cond);
 openr2_status_t openr2_interrupt_signal(openr2_interrupt_t *cond);
@@ -81,6 +81,10 @@ char *openr2_ctime_r(const time_t *timep, char *buf);
 int gettimeofday(struct timeval *tp, void *nothing);
 #endif
 
+/* time used for protocol timers, the context may run them on a virtual clock (see r2iotrace.c) */
+#define openr2_gettimeofday(r2context, tv) \
+	((r2context)->gettime ? (r2context)->gettime((r2context), (tv)) : gettimeofday((tv), NULL))
+
 #define openr2_assert(assertion, msg) \
 	do { \
 		if (!(assertion)) { \
@@ -0,0 +1,270 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * Adaptive protocol timers. The configured protocol timers must cover the
+ * slowest far end, a switch that answers in 100ms still makes us wait the
+ * whole r2_seize or mf_back_cycle before a dead line or the end of the DNIS
+ * (in variants without a no more DNIS tone) is noticed. Once enabled, the
+ * time the far end takes to answer is measured on every channel and the
+ * timer is set to the mean plus some mean deviations, computed the way TCP
+ * estimates its round trip time (RFC 6298), but never above the configured
+ * timer or below a percentage of it. Any timeout resets what was learned,
+ * so a far end that slowed down gets the configured timer back. Each span
+ * (see openr2_chan_set_span_id()) has its own estimates, spans of the same
+ * context may well go to different switches.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include "openr2/r2log-pvt.h"
+#include "openr2/r2chan-pvt.h"
+#include "openr2/r2context-pvt.h"
+#include "openr2/r2utils-pvt.h"
+#include "openr2/r2adapt-pvt.h"
+
+/* responses slower than this are not a far end being slow but something else going on */
+#define ADAPT_MAX_SAMPLE_US 60000000
+
+typedef struct {
+	unsigned samples;
+	/* in microseconds */
+	long mean;
+	long deviation;
+} adapt_estimate_t;
+
+typedef struct {
+	openr2_adaptive_timers_t params;
+	/* cleared by openr2_context_set_adaptive_timers(NULL), the state
+	   lives as long as the context since channels may be using it */
+	int enabled;
+	openr2_mutex_t *lock;
+	/* indexed by span id, grown when a span gets its first sample */
+	adapt_estimate_t (*spans)[OR2_NUM_ADAPTIVE_TIMERS];
+	int spans_size;
+} adapt_state_t;
+
+int openr2_adapt_configure(openr2_context_t *r2context, const openr2_adaptive_timers_t *config)
+{
+	adapt_state_t *state = r2context->adapt;
+	if (!config) {
+		if (state) {
+			openr2_mutex_lock(state->lock);
+			state->enabled = 0;
+			openr2_mutex_unlock(state->lock);
+		}
+		return 0;
+	}
+	if (config->min_samples < 1 || config->deviations < 0 
+	    || config->min_percent < 1 || config->min_percent > 100) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Invalid adaptive timers configuration\n");
+		return -1;
+	}
+	if (!state) {
+		state = calloc(1, sizeof(*state));
+		if (!state) {
+			r2context->last_error = OR2_LIBERR_OUT_OF_MEMORY;
+			return -1;
+		}
+		openr2_mutex_create_ex(&state->lock, 0);
+		r2context->adapt = state;
+	}
+	/* what was learned so far is kept */
+	openr2_mutex_lock(state->lock);
+	state->enabled = 1;
+	state->params = *config;
+	openr2_mutex_unlock(state->lock);
+	return 0;
+}
+
+/* only when deleting the context, no channel can be using the state anymore */
+void openr2_adapt_destroy(openr2_context_t *r2context)
+{
+	adapt_state_t *state = r2context->adapt;
+	if (!state) {
+		return;
+	}
+	r2context->adapt = NULL;
+	openr2_mutex_destroy(&state->lock);
+	free(state->spans);
+	free(state);
+}
+
+/*! \brief estimate of the timer on the span, NULL if nothing was learned there
+    and create is not set or there is no memory. Caller holds the lock */
+static adapt_estimate_t *adapt_get_estimate(adapt_state_t *state, int span_id, openr2_adaptive_timer_t timer, int create)
+{
+	adapt_estimate_t (*spans)[OR2_NUM_ADAPTIVE_TIMERS];
+	int size;
+	if (span_id < 0) {
+		return NULL;
+	}
+	if (span_id >= state->spans_size) {
+		if (!create) {
+			return NULL;
+		}
+		size = state->spans_size ? state->spans_size : 8;
+		while (size <= span_id) {
+			size *= 2;
+		}
+		spans = realloc(state->spans, size * sizeof(*spans));
+		if (!spans) {
+			return NULL;
+		}
+		memset(&spans[state->spans_size], 0, (size - state->spans_size) * sizeof(*spans));
+		state->spans = spans;
+		state->spans_size = size;
+	}
+	return &state->spans[span_id][timer];
+}
+
+/* caller holds the lock */
+static int adapt_compute_timeout(adapt_state_t *state, adapt_estimate_t *estimate, int configured)
+{
+	long timeout, floor;
+	if (!state->enabled || !estimate || estimate->samples < (unsigned)state->params.min_samples) {
+		return configured;
+	}
+	timeout = (estimate->mean + state->params.deviations * estimate->deviation + 999) / 1000;
+	floor = (long)configured * state->params.min_percent / 100;
+	if (timeout < floor) {
+		return floor;
+	}
+	return timeout > configured ? configured : timeout;
+}
+
+int openr2_adapt_get_stats(openr2_context_t *r2context, int span_id, openr2_adaptive_timer_t timer, int configured, openr2_timer_stats_t *stats)
+{
+	adapt_state_t *state = r2context->adapt;
+	adapt_estimate_t *estimate;
+	if (timer < 0 || timer >= OR2_NUM_ADAPTIVE_TIMERS || span_id < 0 || span_id >= OR2_MAX_SPAN_ID) {
+		return -1;
+	}
+	stats->samples = 0;
+	stats->mean_ms = 0;
+	stats->deviation_ms = 0;
+	stats->timeout_ms = configured;
+	if (!state) {
+		return 0;
+	}
+	openr2_mutex_lock(state->lock);
+	estimate = adapt_get_estimate(state, span_id, timer, 0);
+	if (estimate) {
+		stats->samples = estimate->samples;
+		stats->mean_ms = estimate->mean / 1000;
+		stats->deviation_ms = estimate->deviation / 1000;
+	}
+	stats->timeout_ms = adapt_compute_timeout(state, estimate, configured);
+	openr2_mutex_unlock(state->lock);
+	return 0;
+}
+
+/* timeout to use for the given timer, it starts timing the far end as well */
+int openr2_adapt_timeout(openr2_chan_t *r2chan, openr2_adaptive_timer_t timer, int configured)
+{
+	adapt_state_t *state = r2chan->r2context->adapt;
+	int timeout;
+	if (!state) {
+		return configured;
+	}
+	if (openr2_gettimeofday(r2chan->r2context, &r2chan->adapt_start[timer])) {
+		return configured;
+	}
+	r2chan->adapt_timing |= (1 << timer);
+	openr2_mutex_lock(state->lock);
+	timeout = adapt_compute_timeout(state, adapt_get_estimate(state, r2chan->span_id, timer, 0), configured);
+	openr2_mutex_unlock(state->lock);
+	if (timeout != configured) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Using adaptive timeout of %dms instead of %dms\n", timeout, configured);
+	}
+	return timeout;
+}
+
+/* the far end answered */
+void openr2_adapt_sample(openr2_chan_t *r2chan, openr2_adaptive_timer_t timer)
+{
+	adapt_state_t *state = r2chan->r2context->adapt;
+	adapt_estimate_t *estimate;
+	struct timeval now;
+	long sample, error;
+	if (!(r2chan->adapt_timing & (1 << timer))) {
+		return;
+	}
+	r2chan->adapt_timing &= ~(1 << timer);
+	if (!state || openr2_gettimeofday(r2chan->r2context, &now)) {
+		return;
+	}
+	sample = (now.tv_sec - r2chan->adapt_start[timer].tv_sec) * 1000000L 
+	       + (now.tv_usec - r2chan->adapt_start[timer].tv_usec);
+	if (sample < 0 || sample > ADAPT_MAX_SAMPLE_US) {
+		return;
+	}
+	openr2_mutex_lock(state->lock);
+	estimate = state->enabled ? adapt_get_estimate(state, r2chan->span_id, timer, 1) : NULL;
+	if (!estimate) {
+		openr2_mutex_unlock(state->lock);
+		return;
+	}
+	if (!estimate->samples) {
+		estimate->mean = sample;
+		estimate->deviation = sample / 2;
+	} else {
+		/* mean gain 1/8, deviation gain 1/4 */
+		error = sample - estimate->mean;
+		estimate->mean += error / 8;
+		if (error < 0) {
+			error = -error;
+		}
+		estimate->deviation += (error - estimate->deviation) / 4;
+	}
+	estimate->samples++;
+	openr2_mutex_unlock(state->lock);
+}
+
+/* the timer was cancelled for some other reason than the far end answering */
+void openr2_adapt_cancel(openr2_chan_t *r2chan, openr2_adaptive_timer_t timer)
+{
+	r2chan->adapt_timing &= ~(1 << timer);
+}
+
+/* the far end did not answer in time, forget about how fast it used to be */
+void openr2_adapt_reset(openr2_chan_t *r2chan, openr2_adaptive_timer_t timer)
+{
+	adapt_state_t *state = r2chan->r2context->adapt;
+	adapt_estimate_t *estimate;
+	int adapted = 0;
+	r2chan->adapt_timing &= ~(1 << timer);
+	if (!state) {
+		return;
+	}
+	openr2_mutex_lock(state->lock);
+	estimate = adapt_get_estimate(state, r2chan->span_id, timer, 0);
+	if (estimate) {
+		adapted = estimate->samples >= (unsigned)state->params.min_samples;
+		estimate->samples = 0;
+		estimate->mean = 0;
+		estimate->deviation = 0;
+	}
+	openr2_mutex_unlock(state->lock);
+	if (adapted) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_NOTICE, "Adaptive timer timed out, using the configured timer again\n");
+	}
+}
@@ -0,0 +1,207 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * Admission control. When the application cannot keep up with the calls
+ * being offered, calls time out half way through the MF dance and the trunk
+ * is busy for nothing. Once enabled with openr2_context_set_admission(), new
+ * seizures are checked against the load reported by the application, the
+ * number of incoming calls in setup (seized and not accepted yet) and a
+ * token bucket for the call rate. Calls over any limit are answered with the
+ * network congestion signal of the variant without the application ever
+ * hearing about them.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include "openr2/r2log-pvt.h"
+#include "openr2/r2chan-pvt.h"
+#include "openr2/r2context-pvt.h"
+#include "openr2/r2utils-pvt.h"
+#include "openr2/r2admit-pvt.h"
+
+typedef struct {
+	openr2_admission_t params;
+	/* cleared by openr2_context_set_admission(NULL), the state
+	   lives as long as the context since channels may be using it */
+	int enabled;
+	openr2_mutex_t *lock;
+	/* reported by the application */
+	int load;
+	/* call rate token bucket, in thousandths of a call */
+	long tokens;
+	struct timeval last_refill;
+	openr2_admission_stats_t stats;
+} admit_state_t;
+
+int openr2_admit_configure(openr2_context_t *r2context, const openr2_admission_t *admission)
+{
+	admit_state_t *state = r2context->admit;
+	if (!admission) {
+		if (state) {
+			openr2_mutex_lock(state->lock);
+			state->enabled = 0;
+			openr2_mutex_unlock(state->lock);
+		}
+		return 0;
+	}
+	if (admission->max_setups < 0 || admission->max_rate < 0 || admission->burst < 0 || admission->max_load < 0) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Invalid admission control configuration\n");
+		return -1;
+	}
+	if (!state) {
+		state = calloc(1, sizeof(*state));
+		if (!state) {
+			r2context->last_error = OR2_LIBERR_OUT_OF_MEMORY;
+			return -1;
+		}
+		openr2_mutex_create_ex(&state->lock, 0);
+		r2context->admit = state;
+	}
+	openr2_mutex_lock(state->lock);
+	state->enabled = 1;
+	state->params = *admission;
+	if (!state->params.burst) {
+		state->params.burst = state->params.max_rate;
+	}
+	/* start with a full bucket */
+	state->tokens = state->params.burst * 1000L;
+	state->last_refill.tv_sec = 0;
+	state->last_refill.tv_usec = 0;
+	openr2_mutex_unlock(state->lock);
+	return 0;
+}
+
+int openr2_admit_get_stats(openr2_context_t *r2context, openr2_admission_stats_t *stats)
+{
+	admit_state_t *state = r2context->admit;
+	if (!state) {
+		return -1;
+	}
+	openr2_mutex_lock(state->lock);
+	*stats = state->stats;
+	openr2_mutex_unlock(state->lock);
+	return 0;
+}
+
+int openr2_admit_set_load(openr2_context_t *r2context, int load)
+{
+	admit_state_t *state = r2context->admit;
+	if (!state || load < 0) {
+		return -1;
+	}
+	openr2_mutex_lock(state->lock);
+	state->load = load;
+	openr2_mutex_unlock(state->lock);
+	return 0;
+}
+
+/* only when deleting the context, no channel can be using the state anymore */
+void openr2_admit_destroy(openr2_context_t *r2context)
+{
+	admit_state_t *state = r2context->admit;
+	if (!state) {
+		return;
+	}
+	r2context->admit = NULL;
+	openr2_mutex_destroy(&state->lock);
+	free(state);
+}
+
+/* caller holds the lock */
+static int admit_take_token(admit_state_t *state, openr2_context_t *r2context)
+{
+	struct timeval now;
+	long elapsed_ms;
+	if (!state->params.max_rate) {
+		return 1;
+	}
+	if (!openr2_gettimeofday(r2context, &now)) {
+		if (state->last_refill.tv_sec || state->last_refill.tv_usec) {
+			elapsed_ms = (now.tv_sec - state->last_refill.tv_sec) * 1000 + (now.tv_usec - state->last_refill.tv_usec) / 1000;
+			if (elapsed_ms > 0) {
+				/* max_rate calls a second is max_rate thousandths a ms */
+				state->tokens += elapsed_ms * state->params.max_rate;
+				if (state->tokens > state->params.burst * 1000L) {
+					state->tokens = state->params.burst * 1000L;
+				}
+			}
+		}
+		state->last_refill = now;
+	}
+	if (state->tokens < 1000) {
+		return 0;
+	}
+	state->tokens -= 1000;
+	return 1;
+}
+
+/* returns 0 if the new call on the channel must be shed */
+int openr2_admit_call(openr2_chan_t *r2chan)
+{
+	admit_state_t *state = r2chan->r2context->admit;
+	const char *reason = NULL;
+	if (!state) {
+		return 1;
+	}
+	openr2_mutex_lock(state->lock);
+	if (!state->enabled) {
+		openr2_mutex_unlock(state->lock);
+		return 1;
+	}
+	if (state->params.max_load && state->load >= state->params.max_load) {
+		state->stats.shed_load++;
+		reason = "load too high";
+	} else if (state->params.max_setups && state->stats.setups >= state->params.max_setups) {
+		state->stats.shed_setups++;
+		reason = "too many calls in setup";
+	} else if (!admit_take_token(state, r2chan->r2context)) {
+		state->stats.shed_rate++;
+		reason = "call rate over the limit";
+	} else {
+		state->stats.admitted++;
+		state->stats.setups++;
+		r2chan->admit_setup = 1;
+	}
+	openr2_mutex_unlock(state->lock);
+	if (reason) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_NOTICE, "Shedding incoming call, %s\n", reason);
+		return 0;
+	}
+	return 1;
+}
+
+/* the admitted call on the channel is accepted or gone */
+void openr2_admit_setup_done(openr2_chan_t *r2chan)
+{
+	admit_state_t *state = r2chan->r2context->admit;
+	if (!r2chan->admit_setup) {
+		return;
+	}
+	r2chan->admit_setup = 0;
+	if (!state) {
+		return;
+	}
+	openr2_mutex_lock(state->lock);
+	if (state->stats.setups > 0) {
+		state->stats.setups--;
+	}
+	openr2_mutex_unlock(state->lock);
+}
@@ -78,6 +78,8 @@ static openr2_chan_t *__openr2_chan_new(openr2_context_t *r2context, int channo,
 		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to allocate memory for r2chan %d\n", channo);
 		return NULL;
 	}
+	r2chan->chan_index = -1;
+	r2chan->span_index = -1;
 #ifdef OR2_MF_DEBUG
 	/* open the channel log */
 	snprintf(logfile, sizeof(logfile)-1, "openr2-chan-%d-tx.raw", channo);
@@ -103,6 +105,10 @@ static openr2_chan_t *__openr2_chan_new(openr2_context_t *r2context, int channo,
 
 	openr2_mutex_create(&r2chan->lock);
 
+	/* empty command queue, just the stub */
+	r2chan->cmd_head = &r2chan->cmd_stub;
+	r2chan->cmd_tail = &r2chan->cmd_stub;
+
 	/* no persistence check has been done */
 	r2chan->cas_persistence_check_signal = -1;
 
@@ -112,6 +118,14 @@ static openr2_chan_t *__openr2_chan_new(openr2_context_t *r2context, int channo,
 	/* set the owner context */
 	r2chan->r2context = r2context;
 
+	/* settings to use until the first call */
+	openr2_context_pin_config(r2context, r2chan);
+
+	/* channels inherit the context locking mode */
+	if (openr2_test_flag(r2context, OR2_CONTEXT_SINGLE_OWNER)) {
+		openr2_set_flag(r2chan, OR2_CHAN_SINGLE_OWNER);
+	}
+
 	/* DTMF and MF tone detection default hooks handles */
 	r2chan->dtmf_write_handle = &r2chan->default_dtmf_write_handle;
 	r2chan->dtmf_read_handle = &r2chan->default_dtmf_read_handle;
@@ -132,6 +146,9 @@ static openr2_chan_t *__openr2_chan_new(openr2_context_t *r2context, int channo,
 	/* we do not start blocked nor idle  */
 	r2chan->r2_state = OR2_INIT;
 
+	/* I/O backends sharing one descriptor among several channels need the number on setup */
+	r2chan->number = channo;
+
 	/* open channel only if requested */
 	if (openchan) {
 		/* channel fd */
@@ -151,11 +168,13 @@ static openr2_chan_t *__openr2_chan_new(openr2_context_t *r2context, int channo,
 		r2chan->fd_created = 0;
 	}	
 
-	r2chan->number = channo;
 	r2chan->io_buf_size = OR2_CHAN_READ_SIZE;
 
 	/* add ourselves to the list of channels in the context */
-	openr2_context_add_channel(r2context, r2chan);
+	if (openr2_context_add_channel(r2context, r2chan)) {
+		openr2_chan_delete(r2chan);
+		return NULL;
+	}
 
 	/* check for alarms */
 	openr2_io_get_alarm_state(r2chan, &alarm_state);
@@ -171,10 +190,57 @@ OR2_DECLARE(void) openr2_chan_set_span_id(openr2_chan_t *r2chan, int span_id)
 {
 	openr2_chan_lock(r2chan);
 	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Setting span_id: %d\n", span_id);
-	r2chan->span_id = span_id;
+	if (openr2_context_set_channel_span(r2chan->r2context, r2chan, span_id)) {
+		openr2_chan_unlock(r2chan);
+		return;
+	}
+	/* the alarm state found when the channel was created is the span state too,
+	   nothing to report, like for the channel itself */
+	openr2_context_update_span_alarm(r2chan->r2context, r2chan->span_id, r2chan->inalarm ? 1 : 0);
 	openr2_chan_unlock(r2chan);
 }
 
+OR2_DECLARE(void) openr2_chan_set_single_owner(openr2_chan_t *r2chan, int enable)
+{
+	if (enable < 0) {
+		return;
+	}
+	/* take the lock before switching modes in case some other thread is still using it,
+	   after this point only the owner thread must use the channel */
+	openr2_mutex_lock(r2chan->lock);
+	if (enable) {
+		openr2_set_flag(r2chan, OR2_CHAN_SINGLE_OWNER);
+	} else {
+		openr2_clear_flag(r2chan, OR2_CHAN_SINGLE_OWNER);
+	}
+	/* the owner will be the first thread using the channel */
+	r2chan->owner_thread = 0;
+	openr2_mutex_unlock(r2chan->lock);
+}
+
+OR2_DECLARE(int) openr2_chan_get_single_owner(openr2_chan_t *r2chan)
+{
+	return openr2_chan_is_single_owner(r2chan) ? 1 : 0;
+}
+
+OR2_DECLARE(void) openr2_chan_get_lock_stats(openr2_chan_t *r2chan, openr2_mutex_stats_t *stats)
+{
+	openr2_mutex_get_stats(r2chan->lock, stats);
+}
+
+void openr2_chan_assert_owner(openr2_chan_t *r2chan, const char *function)
+{
+	unsigned long self = openr2_thread_self();
+	if (!r2chan->owner_thread) {
+		r2chan->owner_thread = self;
+		return;
+	}
+	if (r2chan->owner_thread != self) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Single owner channel used by foreign thread %lu in %s, owner is %lu!\n", 
+				self, function, r2chan->owner_thread);
+	}
+}
+
 OR2_DECLARE(int) openr2_chan_set_dtmf_handles(openr2_chan_t *r2chan, void *dtmf_read_handle, void *dtmf_write_handle)
 {
 	openr2_chan_lock(r2chan);
@@ -239,6 +305,7 @@ OR2_DECLARE(int) openr2_chan_set_mflib_handles(openr2_chan_t *r2chan, void *mf_w
 
 static int openr2_chan_handle_oob_event(openr2_chan_t *r2chan, openr2_oob_event_t event)
 {
+	int res;
 	switch (event) {
 	case OR2_OOB_EVENT_CAS_CHANGE:
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Handling OOB CAS event\n");
@@ -248,9 +315,17 @@ static int openr2_chan_handle_oob_event(openr2_chan_t *r2chan, openr2_oob_event_
 	case OR2_OOB_EVENT_ALARM_OFF:
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, (event == OR2_OOB_EVENT_ALARM_ON) ? "Alarm Raised\n" : "Alarm Cleared\n");
 		r2chan->inalarm = (event == OR2_OOB_EVENT_ALARM_ON) ? 1 : 0;
-
-		/* give the user first a chance to do something */
-		EMI(r2chan)->on_hardware_alarm(r2chan, r2chan->inalarm);
+		/* no reads while in alarm, do not take the silence for processing lag */
+		memset(&r2chan->last_read_time, 0, sizeof(r2chan->last_read_time));
+
+		/* give the user first a chance to do something, once per span
+		   when the span is known, the rest of the span just follows */
+		res = openr2_context_update_span_alarm(r2chan->r2context, r2chan->span_id, r2chan->inalarm);
+		if (res < 0) {
+			EMI(r2chan)->on_hardware_alarm(r2chan, r2chan->inalarm);
+		} else if (res) {
+			EMI(r2chan)->on_span_alarm(r2chan, r2chan->span_id, r2chan->inalarm);
+		}
 
 		openr2_proto_handle_alarm_state(r2chan);
 		break;
@@ -261,6 +336,46 @@ static int openr2_chan_handle_oob_event(openr2_chan_t *r2chan, openr2_oob_event_
 	return 0;
 }
 
+/*! \brief must be called with chan lock held */
+static void openr2_chan_check_timer_lag(openr2_chan_t *r2chan, int late_ms)
+{
+	r2chan->lag_stats.timers++;
+	if (late_ms > r2chan->lag_stats.max_timer_lateness_ms) {
+		r2chan->lag_stats.max_timer_lateness_ms = late_ms;
+	}
+	if (late_ms >= r2chan->r2context->lag_timer_threshold) {
+		r2chan->lag_stats.late_timers++;
+		EMI(r2chan)->on_processing_lag(r2chan, OR2_LAG_TIMER, late_ms);
+	}
+}
+
+/*! \brief must be called with chan lock held, bytes is the size of the read just done */
+static void openr2_chan_check_read_lag(openr2_chan_t *r2chan, int bytes)
+{
+	struct timeval nowtv;
+	int gap_ms, period_ms;
+	openr2_gettimeofday(r2chan->r2context, &nowtv);
+	if (r2chan->last_read_time.tv_sec || r2chan->last_read_time.tv_usec) {
+		gap_ms = ((nowtv.tv_sec - r2chan->last_read_time.tv_sec) * 1000) +
+		         ((nowtv.tv_usec - r2chan->last_read_time.tv_usec) / 1000);
+		/* one ALAW byte per sample at 8000 samples per second */
+		period_ms = bytes / 8;
+		r2chan->lag_stats.reads++;
+		if (gap_ms > r2chan->lag_stats.max_read_gap_ms) {
+			r2chan->lag_stats.max_read_gap_ms = gap_ms;
+		}
+		if (gap_ms > (OR2_CHAN_IO_NUMBUFS * period_ms)) {
+			r2chan->lag_stats.read_overruns++;
+			r2chan->lag_stats.late_reads++;
+			EMI(r2chan)->on_processing_lag(r2chan, OR2_LAG_READ_OVERRUN, gap_ms - period_ms);
+		} else if ((gap_ms - period_ms) >= r2chan->r2context->lag_read_threshold) {
+			r2chan->lag_stats.late_reads++;
+			EMI(r2chan)->on_processing_lag(r2chan, OR2_LAG_READ_GAP, gap_ms - period_ms);
+		}
+	}
+	r2chan->last_read_time = nowtv;
+}
+
 /*! \brief must be called with chan lock held */
 static int openr2_chan_handle_timers(openr2_chan_t *r2chan)
 {
@@ -268,7 +383,7 @@ static int openr2_chan_handle_timers(openr2_chan_t *r2chan)
 	openr2_sched_timer_t to_dispatch[OR2_MAX_SCHED_TIMERS];
 	int res, ms, t, i, timerid;
 
-	res = gettimeofday(&nowtv, NULL);
+	res = openr2_gettimeofday(r2chan->r2context, &nowtv);
 	if (res == -1) {
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Yikes! gettimeofday failed, me may miss events!!\n");
 		return -1;
@@ -282,6 +397,9 @@ static int openr2_chan_handle_timers(openr2_chan_t *r2chan)
 		if (ms <= 0) {
 			memcpy(&to_dispatch[i], &r2chan->sched_timers[t], sizeof(to_dispatch[0]));
 			i++;
+			if (r2chan->r2context->lag_timer_threshold) {
+				openr2_chan_check_timer_lag(r2chan, -ms);
+			}
 		}	
 	}
 	
@@ -299,6 +417,128 @@ static int openr2_chan_handle_timers(openr2_chan_t *r2chan)
 	return 0;
 }
 
+/* lock-free multi-producer single-consumer queue of posted commands (intrusive, Vyukov style).
+   Any thread may push, only the thread processing the channel pops (with the chan lock held) */
+static void openr2_chan_push_cmd(openr2_chan_t *r2chan, openr2_chan_cmd_t *cmd)
+{
+	openr2_chan_cmd_t *prev;
+	cmd->next = NULL;
+	prev = openr2_atomic_xchg_ptr(&r2chan->cmd_head, cmd);
+	openr2_atomic_store_ptr(&prev->next, cmd);
+}
+
+/* queue a command from any thread and let the thread processing the channel know */
+static void openr2_chan_post_cmd(openr2_chan_t *r2chan, openr2_chan_cmd_t *cmd)
+{
+	openr2_chan_push_cmd(r2chan, cmd);
+	if (r2chan->wake_func) {
+		r2chan->wake_func(r2chan, r2chan->wake_data);
+	}
+}
+
+/*! \brief must be called with chan lock held */
+static openr2_chan_cmd_t *openr2_chan_pop_cmd(openr2_chan_t *r2chan)
+{
+	openr2_chan_cmd_t *tail = r2chan->cmd_tail;
+	openr2_chan_cmd_t *next = openr2_atomic_load_ptr(&tail->next);
+	if (tail == &r2chan->cmd_stub) {
+		if (!next) {
+			return NULL;
+		}
+		r2chan->cmd_tail = next;
+		tail = next;
+		next = openr2_atomic_load_ptr(&tail->next);
+	}
+	if (next) {
+		r2chan->cmd_tail = next;
+		return tail;
+	}
+	if (tail != openr2_atomic_load_ptr(&r2chan->cmd_head)) {
+		/* a producer is in the middle of a push, we will get it on the next pass */
+		return NULL;
+	}
+	openr2_chan_push_cmd(r2chan, &r2chan->cmd_stub);
+	next = openr2_atomic_load_ptr(&tail->next);
+	if (next) {
+		r2chan->cmd_tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+static const char *openr2_chan_cmd_name(openr2_chan_cmd_type_t type)
+{
+	switch (type) {
+	case OR2_CHAN_CMD_MAKE_CALL:
+		return "Make Call";
+	case OR2_CHAN_CMD_ACCEPT_CALL:
+		return "Accept Call";
+	case OR2_CHAN_CMD_ANSWER_CALL:
+		return "Answer Call";
+	case OR2_CHAN_CMD_DISCONNECT_CALL:
+		return "Disconnect Call";
+	default:
+		return "*Unknown*";
+	}
+}
+
+/*! \brief must be called with chan lock held. A disconnect meant for a call that is gone
+    must not clear the next one, which may be there already with the fast release policy */
+static int openr2_chan_disconnect_call_id_locked(openr2_chan_t *r2chan, unsigned call_id, openr2_call_disconnect_cause_t cause)
+{
+	if (call_id != r2chan->call_id) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Ignoring disconnect of call %u, the channel is on call %u now\n", 
+				call_id, r2chan->call_id);
+		return 0;
+	}
+	return openr2_proto_disconnect_call(r2chan, cause);
+}
+
+/*! \brief must be called with chan lock held */
+static void openr2_chan_handle_commands(openr2_chan_t *r2chan)
+{
+	openr2_chan_cmd_t *cmd;
+	int res;
+	while ((cmd = openr2_chan_pop_cmd(r2chan))) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Running posted command %s\n", openr2_chan_cmd_name(cmd->type));
+		switch (cmd->type) {
+		case OR2_CHAN_CMD_MAKE_CALL:
+			res = openr2_proto_make_call(r2chan, cmd->args.make_call.has_ani ? cmd->args.make_call.ani : NULL, 
+					cmd->args.make_call.dnis, cmd->args.make_call.category, cmd->args.make_call.ani_restricted);
+			break;
+		case OR2_CHAN_CMD_ACCEPT_CALL:
+			res = openr2_proto_accept_call(r2chan, cmd->args.accept_mode);
+			break;
+		case OR2_CHAN_CMD_ANSWER_CALL:
+			res = openr2_proto_answer_call_with_mode(r2chan, cmd->args.answer_mode);
+			break;
+		case OR2_CHAN_CMD_DISCONNECT_CALL:
+			res = openr2_chan_disconnect_call_id_locked(r2chan, cmd->args.disconnect.call_id, cmd->args.disconnect.cause);
+			break;
+		default:
+			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Unknown posted command %d\n", cmd->type);
+			res = -1;
+			break;
+		}
+		if (cmd->done) {
+			cmd->done(r2chan, cmd->type, res, cmd->user_data);
+		}
+		free(cmd);
+	}
+}
+
+static openr2_chan_cmd_t *openr2_chan_new_cmd(openr2_chan_cmd_type_t type, openr2_chan_cmd_done_func_t done, void *user_data)
+{
+	openr2_chan_cmd_t *cmd = calloc(1, sizeof(*cmd));
+	if (!cmd) {
+		return NULL;
+	}
+	cmd->type = type;
+	cmd->done = done;
+	cmd->user_data = user_data;
+	return cmd;
+}
+
 OR2_DECLARE(int) openr2_chan_run_schedule(openr2_chan_t *r2chan)
 {
 	int ret = 0;
@@ -335,11 +575,32 @@ static int openr2_chan_process(openr2_chan_t *r2chan, int processing_mask)
 	int16_t tone_buf[OR2_CHAN_READ_SIZE];
 	/* just one return point in this function, set retcode and call goto done when done */
 	int retcode = 0;
+	int iterations = 0;
+	int max_iterations = r2chan->r2context->process_max_iterations;
+	int max_usecs = r2chan->r2context->process_max_usecs;
+	struct timeval starttv, nowtv;
 
 	openr2_chan_lock(r2chan);
+	if (max_usecs) {
+		gettimeofday(&starttv, NULL);
+	}
 	openr2_chan_handle_timers(r2chan);
+	openr2_chan_handle_commands(r2chan);
 
 tryagain:
+	/* do not let a channel that is always ready starve the others served by this thread */
+	if (iterations++ && (max_iterations || max_usecs)) {
+		if (max_usecs) {
+			gettimeofday(&nowtv, NULL);
+		}
+		if ((max_iterations && iterations > max_iterations) ||
+		    (max_usecs && (((nowtv.tv_sec - starttv.tv_sec) * 1000000) + (nowtv.tv_usec - starttv.tv_usec)) >= max_usecs)) {
+			r2chan->budget_hits++;
+			retcode = OR2_CHAN_PROCESS_PENDING;
+			goto done;
+		}
+	}
+
 	/* check for CAS and ALARM events only if requested */
 	interesting_events = (processing_mask & OR2_CHAN_PROCESS_OOB) ? OR2_IO_OOB_EVENT : 0;
 
@@ -354,7 +615,7 @@ tryagain:
 		/* mf should be ignored, therefore OR2_IO_WRITE must not be enabled regardless of other flags */
 	} else if (r2chan->dialing_dtmf) {
 		interesting_events |= OR2_IO_WRITE;
-	} else if (OR2_MF_OFF_STATE != r2chan->mf_state && 
+	} else if (OR2_MF_OFF_STATE != r2chan->mf_state && !r2chan->mf_looping &&
 			MFI(r2chan)->mf_want_generate(r2chan->mf_write_handle, r2chan->mf_write_tone) ) {
 		interesting_events |= OR2_IO_WRITE;
 	}
@@ -395,6 +656,9 @@ tryagain:
 			/* if nothing was read, continue, may be there is a priority event (ie DAHDI read ELAST) */
 			goto tryagain;
 		}
+		if (r2chan->r2context->lag_read_threshold) {
+			openr2_chan_check_read_lag(r2chan, res);
+		}
 		/* if the DTMF or MF detector is enabled, we are supposed to detect tones */
 		if (r2chan->mf_state != OR2_MF_OFF_STATE) {
 			/* assuming ALAW codec */
@@ -406,6 +670,11 @@ tryagain:
 #endif
 			if (r2chan->detecting_dtmf) {
 				DTMF(r2chan)->dtmf_rx(r2chan->dtmf_read_handle, tone_buf, res);
+				if (OR2_NUMPLAN_COMPLETE(r2chan)) {
+					openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Done with DTMF detection, DNIS is complete\n");
+					openr2_proto_handle_dtmf_end(r2chan);
+					goto checkwrite;
+				}
 				res = DTMF(r2chan)->dtmf_rx_status(r2chan->dtmf_read_handle);
 				if (!res) {
 					r2chan->dtmf_silence_samples += OR2_CHAN_READ_SIZE;
@@ -492,6 +761,60 @@ OR2_DECLARE(int) openr2_chan_process_signaling(openr2_chan_t *r2chan)
 	return openr2_chan_process(r2chan, OR2_CHAN_PROCESS_MF | OR2_CHAN_PROCESS_OOB);
 }
 
+OR2_DECLARE(unsigned long) openr2_chan_get_budget_hits(openr2_chan_t *r2chan)
+{
+	OR2_CHAN_RET_PROP(unsigned long,budget_hits);
+}
+
+OR2_DECLARE(void) openr2_chan_get_lag_stats(openr2_chan_t *r2chan, openr2_chan_lag_stats_t *stats)
+{
+	openr2_chan_lock(r2chan);
+	memcpy(stats, &r2chan->lag_stats, sizeof(*stats));
+	openr2_chan_unlock(r2chan);
+}
+
+OR2_DECLARE(void) openr2_chan_reset_lag_stats(openr2_chan_t *r2chan)
+{
+	openr2_chan_lock(r2chan);
+	memset(&r2chan->lag_stats, 0, sizeof(r2chan->lag_stats));
+	openr2_chan_unlock(r2chan);
+}
+
+OR2_DECLARE(void) openr2_chan_get_release_stats(openr2_chan_t *r2chan, openr2_chan_release_stats_t *stats)
+{
+	openr2_chan_lock(r2chan);
+	memcpy(stats, &r2chan->release_stats, sizeof(*stats));
+	openr2_chan_unlock(r2chan);
+}
+
+OR2_DECLARE(void) openr2_chan_reset_release_stats(openr2_chan_t *r2chan)
+{
+	openr2_chan_lock(r2chan);
+	memset(&r2chan->release_stats, 0, sizeof(r2chan->release_stats));
+	openr2_chan_unlock(r2chan);
+}
+
+OR2_DECLARE(int) openr2_chan_is_available(openr2_chan_t *r2chan)
+{
+	int available;
+	openr2_chan_lock(r2chan);
+	available = openr2_proto_is_available(r2chan);
+	openr2_chan_unlock(r2chan);
+	return available;
+}
+
+OR2_DECLARE(openr2_chan_service_class_t) openr2_chan_get_service_class(openr2_chan_t *r2chan)
+{
+	/* no locking, this is just a hint to order the processing and a stale value is harmless */
+	if (r2chan->dialing_dtmf || r2chan->detecting_dtmf) {
+		return OR2_CHAN_CLASS_DTMF;
+	}
+	if (r2chan->answered && r2chan->mf_state == OR2_MF_OFF_STATE && !r2chan->timer_ids.cas_persistence_check) {
+		return OR2_CHAN_CLASS_MEDIA;
+	}
+	return OR2_CHAN_CLASS_SIGNALING;
+}
+
 int openr2_chan_add_timer(openr2_chan_t *r2chan, int ms, openr2_callback_t callback, const char *name)
 {
 	int myerrno;
@@ -500,13 +823,13 @@ int openr2_chan_add_timer(openr2_chan_t *r2chan, int ms, openr2_callback_t callb
 	int res;
 	int i;
 
-	openr2_mutex_lock(r2chan->r2context->timers_lock);
+	openr2_chan_timers_lock(r2chan);
 
-	res = gettimeofday(&tv, NULL);
+	res = openr2_gettimeofday(r2chan->r2context, &tv);
 	if (-1 == res) {
 		myerrno = errno;
 
-		openr2_mutex_unlock(r2chan->r2context->timers_lock);
+		openr2_chan_timers_unlock(r2chan);
 
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Failed to get time of day to schedule timer!!");
 		EMI(r2chan)->on_os_error(r2chan, myerrno);
@@ -514,7 +837,7 @@ int openr2_chan_add_timer(openr2_chan_t *r2chan, int ms, openr2_callback_t callb
 	}
 	if (r2chan->timers_count == OR2_MAX_SCHED_TIMERS) {
 
-		openr2_mutex_unlock(r2chan->r2context->timers_lock);
+		openr2_chan_timers_unlock(r2chan);
 
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "No more time slots, failed to schedule timer, this is bad!\n");
 		return -1;
@@ -546,7 +869,7 @@ int openr2_chan_add_timer(openr2_chan_t *r2chan, int ms, openr2_callback_t callb
 	}
 	r2chan->timers_count++;
 
-	openr2_mutex_unlock(r2chan->r2context->timers_lock);
+	openr2_chan_timers_unlock(r2chan);
 	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_EX_DEBUG, "scheduled timer id %d (%s)\n", newtimer.id, newtimer.name);
 	return newtimer.id;
 }
@@ -560,7 +883,7 @@ void openr2_chan_cancel_timer(openr2_chan_t *r2chan, int *timer_id)
 		return;
 	}
 
-	openr2_mutex_lock(r2chan->r2context->timers_lock);
+	openr2_chan_timers_lock(r2chan);
 
 	for ( ; i < r2chan->timers_count; i++) {
 		if (r2chan->sched_timers[i].id == *timer_id) {
@@ -577,24 +900,34 @@ void openr2_chan_cancel_timer(openr2_chan_t *r2chan, int *timer_id)
 		}
 	}
 
-	openr2_mutex_unlock(r2chan->r2context->timers_lock);
+	openr2_chan_timers_unlock(r2chan);
 }
 
 void openr2_chan_cancel_all_timers(openr2_chan_t *r2chan)
 {
-	openr2_mutex_lock(r2chan->r2context->timers_lock);
+	openr2_chan_timers_lock(r2chan);
 
 	r2chan->timers_count = 0;
 	r2chan->timer_id = 1;
 	memset(&r2chan->timer_ids, 0, sizeof(r2chan->timer_ids));
 	memset(r2chan->sched_timers, 0, sizeof(r2chan->sched_timers));
 
-	openr2_mutex_unlock(r2chan->r2context->timers_lock);
+	openr2_chan_timers_unlock(r2chan);
 }
 
 OR2_DECLARE(void) openr2_chan_delete(openr2_chan_t *r2chan)
 {
+	openr2_chan_cmd_t *cmd;
+	/* nobody can find us in the context from now on */
+	openr2_context_remove_channel(r2chan->r2context, r2chan);
 	openr2_chan_lock(r2chan);
+	/* commands that never got to run are reported as failed */
+	while ((cmd = openr2_chan_pop_cmd(r2chan))) {
+		if (cmd->done) {
+			cmd->done(r2chan, cmd->type, -1, cmd->user_data);
+		}
+		free(cmd);
+	}
 	if (MFI(r2chan)->mf_read_dispose) {
 		MFI(r2chan)->mf_read_dispose(r2chan->mf_read_handle);
 	}	
@@ -612,6 +945,7 @@ OR2_DECLARE(void) openr2_chan_delete(openr2_chan_t *r2chan)
 	close(r2chan->mf_read_fd);
 #endif
 	openr2_chan_unlock(r2chan);
+	openr2_context_unpin_config(r2chan->r2context, r2chan);
 	free(r2chan);
 }
 
@@ -651,6 +985,20 @@ OR2_DECLARE(int) openr2_chan_disconnect_call(openr2_chan_t *r2chan, openr2_call_
 	return retcode;
 }
 
+OR2_DECLARE(int) openr2_chan_disconnect_call_id(openr2_chan_t *r2chan, unsigned call_id, openr2_call_disconnect_cause_t cause)
+{
+	int retcode = 0;
+	openr2_chan_lock(r2chan);
+	retcode = openr2_chan_disconnect_call_id_locked(r2chan, call_id, cause);
+	openr2_chan_unlock(r2chan);
+	return retcode;
+}
+
+OR2_DECLARE(unsigned) openr2_chan_get_call_id(openr2_chan_t *r2chan)
+{
+	OR2_CHAN_RET_PROP(unsigned, call_id);
+}
+
 OR2_DECLARE(int) openr2_chan_set_idle(openr2_chan_t *r2chan)
 {
 	int retcode = 0;
@@ -660,6 +1008,15 @@ OR2_DECLARE(int) openr2_chan_set_idle(openr2_chan_t *r2chan)
 	return retcode;
 }
 
+OR2_DECLARE(int) openr2_chan_resync(openr2_chan_t *r2chan)
+{
+	int retcode = 0;
+	openr2_chan_lock(r2chan);
+	retcode = openr2_proto_resync(r2chan);
+	openr2_chan_unlock(r2chan);
+	return retcode;
+}
+
 OR2_DECLARE(int) openr2_chan_set_blocked(openr2_chan_t *r2chan)
 {
 	int retcode = 0;
@@ -797,6 +1154,73 @@ OR2_DECLARE(int) openr2_chan_make_call(openr2_chan_t *r2chan, const char *ani, c
 	return retcode;
 }
 
+OR2_DECLARE(int) openr2_chan_post_make_call(openr2_chan_t *r2chan, const char *ani, const char *dnis, 
+		openr2_calling_party_category_t category, int ani_restricted, openr2_chan_cmd_done_func_t done, void *user_data)
+{
+	openr2_chan_cmd_t *cmd;
+	if (!dnis) {
+		return -1;
+	}
+	cmd = openr2_chan_new_cmd(OR2_CHAN_CMD_MAKE_CALL, done, user_data);
+	if (!cmd) {
+		return -1;
+	}
+	if (ani) {
+		strncpy(cmd->args.make_call.ani, ani, sizeof(cmd->args.make_call.ani)-1);
+		cmd->args.make_call.has_ani = 1;
+	}
+	strncpy(cmd->args.make_call.dnis, dnis, sizeof(cmd->args.make_call.dnis)-1);
+	cmd->args.make_call.category = category;
+	cmd->args.make_call.ani_restricted = ani_restricted;
+	openr2_chan_post_cmd(r2chan, cmd);
+	return 0;
+}
+
+OR2_DECLARE(int) openr2_chan_post_accept_call(openr2_chan_t *r2chan, openr2_call_mode_t mode,
+		openr2_chan_cmd_done_func_t done, void *user_data)
+{
+	openr2_chan_cmd_t *cmd = openr2_chan_new_cmd(OR2_CHAN_CMD_ACCEPT_CALL, done, user_data);
+	if (!cmd) {
+		return -1;
+	}
+	cmd->args.accept_mode = mode;
+	openr2_chan_post_cmd(r2chan, cmd);
+	return 0;
+}
+
+OR2_DECLARE(int) openr2_chan_post_answer_call(openr2_chan_t *r2chan, openr2_answer_mode_t mode,
+		openr2_chan_cmd_done_func_t done, void *user_data)
+{
+	openr2_chan_cmd_t *cmd = openr2_chan_new_cmd(OR2_CHAN_CMD_ANSWER_CALL, done, user_data);
+	if (!cmd) {
+		return -1;
+	}
+	cmd->args.answer_mode = mode;
+	openr2_chan_post_cmd(r2chan, cmd);
+	return 0;
+}
+
+OR2_DECLARE(int) openr2_chan_post_disconnect_call(openr2_chan_t *r2chan, openr2_call_disconnect_cause_t cause,
+		openr2_chan_cmd_done_func_t done, void *user_data)
+{
+	openr2_chan_cmd_t *cmd = openr2_chan_new_cmd(OR2_CHAN_CMD_DISCONNECT_CALL, done, user_data);
+	if (!cmd) {
+		return -1;
+	}
+	/* the call there is now, not the one there may be when the command runs. Read
+	   without the channel lock, posting never blocks */
+	cmd->args.disconnect.cause = cause;
+	cmd->args.disconnect.call_id = r2chan->call_id;
+	openr2_chan_post_cmd(r2chan, cmd);
+	return 0;
+}
+
+OR2_DECLARE(void) openr2_chan_set_wake_func(openr2_chan_t *r2chan, openr2_chan_wake_func_t func, void *wake_data)
+{
+	r2chan->wake_data = wake_data;
+	r2chan->wake_func = func;
+}
+
 OR2_DECLARE(openr2_direction_t) openr2_chan_get_direction(openr2_chan_t *r2chan)
 {
 	OR2_CHAN_RET_PROP(openr2_direction_t,direction);
@@ -840,7 +1264,7 @@ OR2_DECLARE(int) openr2_chan_get_time_to_next_event(openr2_chan_t *r2chan)
 	ms = -1;
 
 	openr2_chan_lock(r2chan);	
-	openr2_mutex_lock(r2chan->r2context->timers_lock);
+	openr2_chan_timers_lock(r2chan);
 
 	/* if no timers, return 'infinite' */
 	if (!r2chan->timers_count) {
@@ -848,7 +1272,7 @@ OR2_DECLARE(int) openr2_chan_get_time_to_next_event(openr2_chan_t *r2chan)
 		goto done;
 	}
 
-	res = gettimeofday(&currtime, NULL);
+	res = openr2_gettimeofday(r2chan->r2context, &currtime);
 
 	if (-1 == res) {
 		myerrno = errno;
@@ -867,7 +1291,7 @@ OR2_DECLARE(int) openr2_chan_get_time_to_next_event(openr2_chan_t *r2chan)
 
 done:
 
-	openr2_mutex_unlock(r2chan->r2context->timers_lock);
+	openr2_chan_timers_unlock(r2chan);
 	openr2_chan_unlock(r2chan);
 
 	return ms;
@@ -890,7 +1314,11 @@ OR2_DECLARE(openr2_log_level_t) openr2_chan_get_log_level(openr2_chan_t *r2chan)
 
 OR2_DECLARE(void) openr2_chan_enable_read(openr2_chan_t *r2chan)
 {
-	OR2_CHAN_SET_PROP(read_enabled,1);
+	openr2_chan_lock(r2chan);
+	r2chan->read_enabled = 1;
+	/* start measuring read gaps from the next read */
+	memset(&r2chan->last_read_time, 0, sizeof(r2chan->last_read_time));
+	openr2_chan_unlock(r2chan);
 }
 
 OR2_DECLARE(void) openr2_chan_disable_read(openr2_chan_t *r2chan)
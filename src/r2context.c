@@ -51,6 +51,11 @@
 #include "openr2/r2chan-pvt.h"
 #include "openr2/r2context-pvt.h"
 #include "openr2/r2ioabs.h"
+#include "openr2/r2numplan-pvt.h"
+#include "openr2/r2adapt-pvt.h"
+#include "openr2/r2admit-pvt.h"
+#include "openr2/r2mirror-pvt.h"
+#include "openr2/r2profile-pvt.h"
 
 static void on_call_init_default(openr2_chan_t *r2chan)
 {
@@ -143,6 +148,228 @@ static void on_call_log_created_default(openr2_chan_t *r2chan, const char *logna
 	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_NOTICE, "Log %s created on chan %d\n", logname, openr2_chan_get_number(r2chan));
 }
 
+static void on_processing_lag_default(openr2_chan_t *r2chan, openr2_lag_type_t type, int lag_ms)
+{
+	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "%s on chan %d, %d ms late\n", 
+			openr2_context_get_lag_string(type), openr2_chan_get_number(r2chan), lag_ms);
+}
+
+static void on_channel_available_default(openr2_chan_t *r2chan)
+{
+	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Channel %d available\n", openr2_chan_get_number(r2chan));
+}
+
+static void on_span_alarm_default(openr2_chan_t *r2chan, int span_id, int alarm)
+{
+	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "Alarm %s on span %d\n", alarm ? "raised" : "cleared", span_id);
+}
+
+/*! \brief double the size of the event queue, must be called with the events lock held */
+static int event_queue_grow(openr2_context_t *r2context)
+{
+	openr2_event_t *events;
+	unsigned size = r2context->events_size * 2;
+	unsigned first = r2context->events_size - r2context->events_head;
+	events = calloc(size, sizeof(*events));
+	if (!events) {
+		return -1;
+	}
+	/* unwrap the ring, the oldest event goes first */
+	if (first > r2context->events_count) {
+		first = r2context->events_count;
+	}
+	memcpy(events, &r2context->events[r2context->events_head], first * sizeof(*events));
+	memcpy(&events[first], r2context->events, (r2context->events_count - first) * sizeof(*events));
+	free(r2context->events);
+	r2context->events = events;
+	r2context->events_size = size;
+	r2context->events_head = 0;
+	return 0;
+}
+
+/* handlers used instead of the user event interface when the event queue is enabled,
+   each one copies the event data in a record and appends it to the context queue */
+static void event_queue_push(openr2_chan_t *r2chan, openr2_event_t *event)
+{
+	openr2_context_t *r2context = r2chan->r2context;
+	unsigned tail;
+	event->r2chan = r2chan;
+	event->channo = r2chan->number;
+	event->call_id = r2chan->call_id;
+	openr2_mutex_lock(r2context->events_lock);
+	/* the queue may have been disabled after we were called through it */
+	if (!r2context->events) {
+		r2context->events_dropped++;
+		openr2_mutex_unlock(r2context->events_lock);
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Event queue is disabled, dropping %s event\n", 
+				openr2_context_get_event_string(event->type));
+		return;
+	}
+	/* call control must not be lost, the queue grows for it. Lag reports are just dropped */
+	if (r2context->events_count == r2context->events_size &&
+	    (event->type == OR2_EVENT_PROCESSING_LAG || event_queue_grow(r2context))) {
+		r2context->events_dropped++;
+		openr2_mutex_unlock(r2context->events_lock);
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Event queue is full, dropping %s event\n", 
+				openr2_context_get_event_string(event->type));
+		return;
+	}
+	tail = (r2context->events_head + r2context->events_count) % r2context->events_size;
+	memcpy(&r2context->events[tail], event, sizeof(*event));
+	r2context->events_count++;
+	openr2_mutex_unlock(r2context->events_lock);
+}
+
+static void event_queue_push_simple(openr2_chan_t *r2chan, openr2_event_type_t type)
+{
+	openr2_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.type = type;
+	event_queue_push(r2chan, &event);
+}
+
+static void on_call_init_queued(openr2_chan_t *r2chan)
+{
+	event_queue_push_simple(r2chan, OR2_EVENT_CALL_INIT);
+}
+
+static void on_call_proceed_queued(openr2_chan_t *r2chan)
+{
+	event_queue_push_simple(r2chan, OR2_EVENT_CALL_PROCEED);
+}
+
+static void on_call_offered_queued(openr2_chan_t *r2chan, const char *ani, 
+		const char *dnis, openr2_calling_party_category_t category, int ani_restricted)
+{
+	openr2_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.type = OR2_EVENT_CALL_OFFERED;
+	if (ani) {
+		strncpy(event.data.offered.ani, ani, sizeof(event.data.offered.ani)-1);
+	}
+	if (dnis) {
+		strncpy(event.data.offered.dnis, dnis, sizeof(event.data.offered.dnis)-1);
+	}
+	event.data.offered.category = category;
+	event.data.offered.ani_restricted = ani_restricted;
+	event_queue_push(r2chan, &event);
+}
+
+static void on_call_accepted_queued(openr2_chan_t *r2chan, openr2_call_mode_t mode)
+{
+	openr2_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.type = OR2_EVENT_CALL_ACCEPTED;
+	event.data.mode = mode;
+	event_queue_push(r2chan, &event);
+}
+
+static void on_call_answered_queued(openr2_chan_t *r2chan)
+{
+	event_queue_push_simple(r2chan, OR2_EVENT_CALL_ANSWERED);
+}
+
+static void on_call_disconnect_queued(openr2_chan_t *r2chan, openr2_call_disconnect_cause_t cause)
+{
+	openr2_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.type = OR2_EVENT_CALL_DISCONNECT;
+	event.data.cause = cause;
+	event_queue_push(r2chan, &event);
+}
+
+static void on_call_end_queued(openr2_chan_t *r2chan)
+{
+	event_queue_push_simple(r2chan, OR2_EVENT_CALL_END);
+}
+
+static void on_os_error_queued(openr2_chan_t *r2chan, int oserrorcode)
+{
+	openr2_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.type = OR2_EVENT_OS_ERROR;
+	event.data.oserrorcode = oserrorcode;
+	event_queue_push(r2chan, &event);
+}
+
+static void on_hardware_alarm_queued(openr2_chan_t *r2chan, int alarm)
+{
+	openr2_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.type = OR2_EVENT_HARDWARE_ALARM;
+	event.data.alarm = alarm;
+	event_queue_push(r2chan, &event);
+}
+
+static void on_protocol_error_queued(openr2_chan_t *r2chan, openr2_protocol_error_t error)
+{
+	openr2_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.type = OR2_EVENT_PROTOCOL_ERROR;
+	event.data.error = error;
+	event_queue_push(r2chan, &event);
+}
+
+static void on_line_idle_queued(openr2_chan_t *r2chan)
+{
+	event_queue_push_simple(r2chan, OR2_EVENT_LINE_IDLE);
+}
+
+static void on_line_blocked_queued(openr2_chan_t *r2chan)
+{
+	event_queue_push_simple(r2chan, OR2_EVENT_LINE_BLOCKED);
+}
+
+static int on_dnis_digit_received_queued(openr2_chan_t *r2chan, char digit)
+{
+	openr2_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.type = OR2_EVENT_DNIS_DIGIT;
+	event.data.digit = digit;
+	event_queue_push(r2chan, &event);
+	/* the user cannot answer synchronously, ask for as much dnis as possible */
+	return 1;
+}
+
+static void on_ani_digit_received_queued(openr2_chan_t *r2chan, char digit)
+{
+	openr2_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.type = OR2_EVENT_ANI_DIGIT;
+	event.data.digit = digit;
+	event_queue_push(r2chan, &event);
+}
+
+static void on_billing_pulse_received_queued(openr2_chan_t *r2chan)
+{
+	event_queue_push_simple(r2chan, OR2_EVENT_BILLING_PULSE);
+}
+
+static void on_processing_lag_queued(openr2_chan_t *r2chan, openr2_lag_type_t type, int lag_ms)
+{
+	openr2_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.type = OR2_EVENT_PROCESSING_LAG;
+	event.data.lag.type = type;
+	event.data.lag.ms = lag_ms;
+	event_queue_push(r2chan, &event);
+}
+
+static void on_channel_available_queued(openr2_chan_t *r2chan)
+{
+	event_queue_push_simple(r2chan, OR2_EVENT_CHANNEL_AVAILABLE);
+}
+
+static void on_span_alarm_queued(openr2_chan_t *r2chan, int span_id, int alarm)
+{
+	openr2_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.type = OR2_EVENT_SPAN_ALARM;
+	event.data.span.span_id = span_id;
+	event.data.span.alarm = alarm;
+	event_queue_push(r2chan, &event);
+}
+
 static int want_generate_default(openr2_mf_tx_state_t *state, int signal)
 {
 	return 1;
@@ -192,7 +419,36 @@ static openr2_event_interface_t default_evmanager = {
 	/* .on_dnis_digit_received */ on_dnis_digit_received_default,
 	/* .on_ani_digit_received */ on_ani_digit_received_default,
 	/* .on_billing_pulse_received */ on_billing_pulse_received_default,
-	/* .on_call_log_created */ on_call_log_created_default
+	/* .on_call_log_created */ on_call_log_created_default,
+	/* .on_processing_lag */ on_processing_lag_default,
+	/* .on_channel_available */ on_channel_available_default,
+	/* .on_span_alarm */ on_span_alarm_default
+};
+
+/* on_call_read, on_context_log and on_call_log_created are
+   taken from the user interface when enabling the queue */
+static openr2_event_interface_t queued_evmanager = {
+	/* .on_call_init */ on_call_init_queued,
+	/* .on_call_proceed */ on_call_proceed_queued,
+	/* .on_call_offered */ on_call_offered_queued,
+	/* .on_call_accepted */ on_call_accepted_queued,
+	/* .on_call_answered */ on_call_answered_queued,
+	/* .on_call_disconnect */ on_call_disconnect_queued,
+	/* .on_call_end */ on_call_end_queued,
+	/* .on_call_read */ NULL,
+	/* .on_hardware_alarm */ on_hardware_alarm_queued,
+	/* .on_os_error */ on_os_error_queued,
+	/* .on_protocol_error */ on_protocol_error_queued,
+	/* .on_line_blocked */ on_line_blocked_queued,
+	/* .on_line_idle */ on_line_idle_queued,
+	/* .on_context_log */ NULL,
+	/* .on_dnis_digit_received */ on_dnis_digit_received_queued,
+	/* .on_ani_digit_received */ on_ani_digit_received_queued,
+	/* .on_billing_pulse_received */ on_billing_pulse_received_queued,
+	/* .on_call_log_created */ NULL,
+	/* .on_processing_lag */ on_processing_lag_queued,
+	/* .on_channel_available */ on_channel_available_queued,
+	/* .on_span_alarm */ on_span_alarm_queued
 };
 
 static openr2_dtmf_interface_t default_dtmf_engine = {
@@ -206,6 +462,78 @@ static openr2_dtmf_interface_t default_dtmf_engine = {
 	/* .dtmf_rx */ (openr2_dtmf_rx_func)openr2_dtmf_rx
 };
 
+/* publish a copy of the settings, calls starting from now on use it */
+static int config_publish(openr2_context_t *r2context)
+{
+	openr2_config_t *config, *old;
+	config = malloc(sizeof(*config));
+	if (!config) {
+		r2context->last_error = OR2_LIBERR_OUT_OF_MEMORY;
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to publish the configuration, new calls keep the previous one\n");
+		return -1;
+	}
+	memcpy(config, &r2context->config, sizeof(*config));
+	/* the context reference, dropped when something newer is published */
+	config->refs = 1;
+	openr2_mutex_lock(r2context->config_lock);
+	old = r2context->live_config;
+	openr2_atomic_store_ptr(&r2context->live_config, config);
+	if (old && !--old->refs) {
+		free(old);
+	}
+	openr2_mutex_unlock(r2context->config_lock);
+	return 0;
+}
+
+/* setters publish right away unless they are part of a batch of changes */
+static void config_changed(openr2_context_t *r2context)
+{
+	if (!r2context->config_batch) {
+		config_publish(r2context);
+	}
+}
+
+/* called when a call starts, changes published later do not affect it */
+void openr2_context_pin_config(openr2_context_t *r2context, openr2_chan_t *r2chan)
+{
+	openr2_config_t *old = r2chan->config;
+	/* nothing new since the last call of the channel, the usual case */
+	if (openr2_atomic_load_ptr(&r2context->live_config) == old) {
+		return;
+	}
+	openr2_mutex_lock(r2context->config_lock);
+	r2chan->config = r2context->live_config;
+	r2chan->config->refs++;
+	if (old && !--old->refs) {
+		free(old);
+	}
+	openr2_mutex_unlock(r2context->config_lock);
+}
+
+void openr2_context_unpin_config(openr2_context_t *r2context, openr2_chan_t *r2chan)
+{
+	if (!r2chan->config) {
+		return;
+	}
+	openr2_mutex_lock(r2context->config_lock);
+	if (!--r2chan->config->refs) {
+		free(r2chan->config);
+	}
+	openr2_mutex_unlock(r2context->config_lock);
+	r2chan->config = NULL;
+}
+
+OR2_DECLARE(void) openr2_context_begin_config(openr2_context_t *r2context)
+{
+	r2context->config_batch = 1;
+}
+
+OR2_DECLARE(int) openr2_context_apply_config(openr2_context_t *r2context)
+{
+	r2context->config_batch = 0;
+	return config_publish(r2context);
+}
+
 OR2_DECLARE(openr2_context_t *) openr2_context_new(openr2_variant_t variant, openr2_event_interface_t *evmanager, int max_ani, int max_dnis)
 {
 	openr2_context_t *r2context = NULL;
@@ -267,6 +595,15 @@ OR2_DECLARE(openr2_context_t *) openr2_context_new(openr2_variant_t variant, ope
 		if (!evmanager->on_call_log_created) {
 			evmanager->on_call_log_created = on_call_log_created_default;
 		}
+		if (!evmanager->on_processing_lag) {
+			evmanager->on_processing_lag = on_processing_lag_default;
+		}
+		if (!evmanager->on_channel_available) {
+			evmanager->on_channel_available = on_channel_available_default;
+		}
+		if (!evmanager->on_span_alarm) {
+			evmanager->on_span_alarm = on_span_alarm_default;
+		}
 	}
 	r2context = calloc(1, sizeof(*r2context));
 	if (!r2context) {
@@ -278,9 +615,14 @@ OR2_DECLARE(openr2_context_t *) openr2_context_new(openr2_variant_t variant, ope
 	r2context->transcoder = &default_transcoder;
 	r2context->variant = variant;
 	r2context->evmanager = evmanager;
+	/* the interface may be shared with a previous context, so look at what it ended up with */
+	r2context->span_alarm_events = (evmanager->on_span_alarm != on_span_alarm_default);
 	r2context->dtmfeng = &default_dtmf_engine;
 	r2context->loglevel = OR2_LOG_ERROR | OR2_LOG_WARNING | OR2_LOG_NOTICE;
-	openr2_mutex_create(&r2context->timers_lock);
+	openr2_mutex_create_ex(&r2context->timers_lock, 0);
+	openr2_mutex_create_ex(&r2context->events_lock, 0);
+	openr2_mutex_create_ex(&r2context->spans_lock, 0);
+	openr2_mutex_create_ex(&r2context->config_lock, 0);
 	if (openr2_proto_configure_context(r2context, variant, max_ani, max_dnis)) {
 		free(r2context);
 		return NULL;
@@ -289,6 +631,11 @@ OR2_DECLARE(openr2_context_t *) openr2_context_new(openr2_variant_t variant, ope
 		free(r2context);
 		return NULL;
 	}
+	/* channels need a published configuration from the start */
+	if (config_publish(r2context)) {
+		free(r2context);
+		return NULL;
+	}
 	return r2context;
 }
 
@@ -387,16 +734,16 @@ OR2_DECLARE(int) openr2_context_set_dtmf_interface(openr2_context_t *r2context,
    so probably we could trust on that instead of having the user to call this function? */
 OR2_DECLARE(int) openr2_context_get_time_to_next_event(openr2_context_t *r2context)
 {
-	int res, ms;
+	int res, ms, i;
 	struct timeval currtime;
-	/* iterate over all the channels to get the next event time,
-	   during this loop, timers cannot be deleted or created */
-	openr2_chan_t *current = r2context->chanlist;
+	openr2_chan_t *current;
 	openr2_chan_t *winner = NULL;
 
+	/* iterate over all the channels to get the next event time,
+	   during this loop, timers cannot be deleted or created */
 	openr2_mutex_lock(r2context->timers_lock);
 
-	res = gettimeofday(&currtime, NULL);
+	res = openr2_gettimeofday(r2context, &currtime);
 	if (-1 == res) {
 		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to get next context event time: %s\n", strerror(errno));
 
@@ -404,179 +751,515 @@ OR2_DECLARE(int) openr2_context_get_time_to_next_event(openr2_context_t *r2conte
 		return -1;
 	}
 
-	while (current) {
-		/* ignore any entry with no sched timer */
-		if (current->timers_count < 1) {
-			current = current->next;
+	for (i = 0; i < r2context->chans_count; i++) {
+		current = r2context->chans[i];
+		/* ignore any entry with no sched timer. Single owner channels change their
+		   timers without the timers lock, their owner must ask them directly */
+		if (current->timers_count < 1 || openr2_chan_is_single_owner(current)) {
 			continue;
 		}
-		/* if no winner, set this as winner */
-		if (!winner) {
-			winner = current;
-		}
-		current = current->next;
-		/* if no more chans, return the winner */
-		if (!current) {
-			ms = (((winner->sched_timers[0].time.tv_sec - currtime.tv_sec) * 1000) + 
-			     ((winner->sched_timers[0].time.tv_usec - currtime.tv_usec) / 1000));
-
-			openr2_mutex_unlock(r2context->timers_lock);
-
-			/* if the time has passed already, return 0 to attend immediately */
-			if (ms < 0) {
-				return 0;
-			}	
-			return ms;
-		}
 		/* if the winner timer is after the current timer, then we have a new winner */
-		if (openr2_timercmp(&winner->sched_timers[0].time, &current->sched_timers[0].time, >) ) {
+		if (!winner || openr2_timercmp(&winner->sched_timers[0].time, &current->sched_timers[0].time, >)) {
 			winner = current;
 		}
 	}
+	if (!winner) {
+		openr2_mutex_unlock(r2context->timers_lock);
+		return -1;
+	}
+	ms = (((winner->sched_timers[0].time.tv_sec - currtime.tv_sec) * 1000) +
+	     ((winner->sched_timers[0].time.tv_usec - currtime.tv_usec) / 1000));
 
 	openr2_mutex_unlock(r2context->timers_lock);
-	return -1;
-}
 
-void openr2_context_add_channel(openr2_context_t *r2context, openr2_chan_t *r2chan)
-{
-	/* put the channel at the head of the list*/
-	openr2_chan_t *head = r2context->chanlist;
-	r2context->chanlist = r2chan;
-	r2chan->next = head;
-	/* set the channel log level to our level. Users can override this */
-	openr2_chan_set_log_level(r2chan, r2context->loglevel);
+	/* if the time has passed already, return 0 to attend immediately */
+	if (ms < 0) {
+		return 0;
+	}
+	return ms;
 }
 
-void openr2_context_remove_channel(openr2_context_t *r2context, openr2_chan_t *r2chan)
+/* make room for needed entries in an array of channels */
+static int chans_grow(openr2_chan_t ***chans, int *size, int needed)
 {
-	openr2_chan_t *curr = r2context->chanlist;
-	openr2_chan_t *prev = NULL;
-	while (curr) {
-		if(curr == r2chan) {
-			if (prev) {
-				prev->next = curr->next;
-			}	
-			if (curr == r2context->chanlist) {
-				r2context->chanlist = NULL;
-			}	
-			break;
-		}
-		prev = curr;
-		curr = curr->next;
+	openr2_chan_t **grown;
+	int newsize;
+	if (needed <= *size) {
+		return 0;
+	}
+	newsize = *size ? *size : 32;
+	while (newsize < needed) {
+		newsize *= 2;
+	}
+	grown = realloc(*chans, newsize * sizeof(*grown));
+	if (!grown) {
+		return -1;
 	}
+	memset(&grown[*size], 0, (newsize - *size) * sizeof(*grown));
+	*chans = grown;
+	*size = newsize;
+	return 0;
 }
 
-OR2_DECLARE(void) openr2_context_delete(openr2_context_t *r2context)
+static int span_add_channel(openr2_context_t *r2context, openr2_chan_t *r2chan)
 {
-	openr2_chan_t *current, *next;
-	current = r2context->chanlist;
-	while ( current ) {
-		next = current->next;
-		openr2_chan_delete(current);
-		current = next;
+	openr2_span_chans_t *spans, *span;
+	int size;
+	if (r2chan->span_id >= r2context->spans_size) {
+		size = r2context->spans_size ? r2context->spans_size : 8;
+		while (size <= r2chan->span_id) {
+			size *= 2;
+		}
+		spans = realloc(r2context->spans, size * sizeof(*spans));
+		if (!spans) {
+			return -1;
+		}
+		memset(&spans[r2context->spans_size], 0, (size - r2context->spans_size) * sizeof(*spans));
+		r2context->spans = spans;
+		r2context->spans_size = size;
 	}
-	openr2_mutex_destroy(&r2context->timers_lock);
-	free(r2context);
+	span = &r2context->spans[r2chan->span_id];
+	if (chans_grow(&span->chans, &span->size, span->count + 1)) {
+		return -1;
+	}
+	r2chan->span_index = span->count;
+	span->chans[span->count++] = r2chan;
+	return 0;
 }
 
-OR2_DECLARE(openr2_liberr_t) openr2_context_get_last_error(openr2_context_t *r2context)
+static void span_remove_channel(openr2_context_t *r2context, openr2_chan_t *r2chan)
 {
-	return r2context->last_error;
+	openr2_span_chans_t *span;
+	if (r2chan->span_index < 0) {
+		return;
+	}
+	/* the last channel of the span takes our place */
+	span = &r2context->spans[r2chan->span_id];
+	span->chans[r2chan->span_index] = span->chans[--span->count];
+	span->chans[r2chan->span_index]->span_index = r2chan->span_index;
+	span->chans[span->count] = NULL;
+	r2chan->span_index = -1;
 }
 
-OR2_DECLARE(const char *) openr2_context_error_string(openr2_liberr_t error)
+static int span_id_check(openr2_context_t *r2context, openr2_chan_t *r2chan, int span_id)
 {
-	switch ( error ) {
-	case OR2_LIBERR_SYSCALL_FAILED: return "System call failed";
-	case OR2_LIBERR_INVALID_CHAN_SIGNALING: return "Invalid channel signaling";
-	case OR2_LIBERR_CANNOT_SET_IDLE: return "Failed to set IDLE state on channel";
-	case OR2_LIBERR_NO_IO_IFACE_AVAILABLE: return "No I/O interface available for channel";
-	case OR2_LIBERR_INVALID_CHAN_NUMBER: return "Invalid channel number";
-	case OR2_LIBERR_OUT_OF_MEMORY: return "Out of memory";
-	case OR2_LIBERR_INVALID_INTERFACE: return "Invalid interface";
-	default: return "*Unknown*";
+	if (span_id < 0 || span_id >= OR2_MAX_SPAN_ID) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Invalid span id %d for channel %d, it must be between 0 and %d\n",
+				span_id, r2chan->number, OR2_MAX_SPAN_ID - 1);
+		return -1;
 	}
+	return 0;
 }
 
-OR2_DECLARE(openr2_variant_t) openr2_context_get_variant(openr2_context_t *r2context)
+/* channels are added and removed by the thread creating and deleting
+   them, like the rest of the context configuration is changed. The timers
+   lock keeps the threads walking the channel array for timers and lock
+   stats from seeing it while it is reallocated or reordered */
+int openr2_context_add_channel(openr2_context_t *r2context, openr2_chan_t *r2chan)
 {
-	return r2context->variant;
+	int channo = r2chan->number;
+	int indexed = (channo >= 0 && channo < OR2_MAX_CHAN_NUMBER);
+	if (span_id_check(r2context, r2chan, r2chan->span_id)) {
+		return -1;
+	}
+	openr2_mutex_lock(r2context->timers_lock);
+	if (chans_grow(&r2context->chans, &r2context->chans_size, r2context->chans_count + 1)
+	    || (indexed && chans_grow(&r2context->chans_by_number, &r2context->chans_by_number_size, channo + 1))
+	    || span_add_channel(r2context, r2chan)) {
+		openr2_mutex_unlock(r2context->timers_lock);
+		r2context->last_error = OR2_LIBERR_OUT_OF_MEMORY;
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to add channel %d to the context\n", channo);
+		return -1;
+	}
+	if (indexed) {
+		if (r2context->chans_by_number[channo]) {
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_WARNING, "Channel %d added twice, only the last one can be found by number\n", channo);
+		}
+		r2context->chans_by_number[channo] = r2chan;
+	}
+	r2chan->chan_index = r2context->chans_count;
+	r2context->chans[r2context->chans_count++] = r2chan;
+	openr2_mutex_unlock(r2context->timers_lock);
+	/* set the channel log level to our level. Users can override this */
+	openr2_chan_set_log_level(r2chan, r2context->loglevel);
+	return 0;
 }
 
-OR2_DECLARE(void) openr2_context_set_ani_first(openr2_context_t *r2context, int ani_first)
+void openr2_context_remove_channel(openr2_context_t *r2context, openr2_chan_t *r2chan)
 {
-	if (ani_first < 0) {
+	int channo = r2chan->number;
+	if (r2chan->chan_index < 0) {
 		return;
 	}
-	r2context->get_ani_first = ani_first ? 1 : 0;
+	openr2_mutex_lock(r2context->timers_lock);
+	span_remove_channel(r2context, r2chan);
+	if (channo >= 0 && channo < r2context->chans_by_number_size && r2context->chans_by_number[channo] == r2chan) {
+		r2context->chans_by_number[channo] = NULL;
+	}
+	/* the last channel takes our place */
+	r2context->chans[r2chan->chan_index] = r2context->chans[--r2context->chans_count];
+	r2context->chans[r2chan->chan_index]->chan_index = r2chan->chan_index;
+	r2context->chans[r2context->chans_count] = NULL;
+	r2chan->chan_index = -1;
+	openr2_mutex_unlock(r2context->timers_lock);
 }
 
-OR2_DECLARE(int) openr2_context_get_ani_first(openr2_context_t *r2context)
+/* move the channel to another span, ids out of range are refused */
+int openr2_context_set_channel_span(openr2_context_t *r2context, openr2_chan_t *r2chan, int span_id)
 {
-	return r2context->get_ani_first;
+	int res = 0;
+	if (span_id_check(r2context, r2chan, span_id)) {
+		return -1;
+	}
+	if (r2chan->span_id == span_id) {
+		return 0;
+	}
+	openr2_mutex_lock(r2context->timers_lock);
+	span_remove_channel(r2context, r2chan);
+	r2chan->span_id = span_id;
+	if (r2chan->chan_index >= 0 && span_add_channel(r2context, r2chan)) {
+		res = -1;
+	}
+	openr2_mutex_unlock(r2context->timers_lock);
+	if (res) {
+		r2context->last_error = OR2_LIBERR_OUT_OF_MEMORY;
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to move channel %d to span %d\n", r2chan->number, span_id);
+		return -1;
+	}
+	return 0;
 }
 
-OR2_DECLARE(void) openr2_context_set_skip_category_request(openr2_context_t *r2context, int skipcategory)
+OR2_DECLARE(openr2_chan_t *) openr2_context_get_chan(openr2_context_t *r2context, int channo)
 {
-	if (skipcategory < 0) {
-		return;
+	int i;
+	if (channo >= 0 && channo < OR2_MAX_CHAN_NUMBER) {
+		return channo < r2context->chans_by_number_size ? r2context->chans_by_number[channo] : NULL;
+	}
+	for (i = 0; i < r2context->chans_count; i++) {
+		if (r2context->chans[i]->number == channo) {
+			return r2context->chans[i];
+		}
 	}
-	r2context->skip_category = skipcategory ? 1 : 0;
+	return NULL;
 }
 
-OR2_DECLARE(int) openr2_context_get_skip_category_request(openr2_context_t *r2context)
+OR2_DECLARE(int) openr2_context_get_chan_count(openr2_context_t *r2context)
 {
-	return r2context->skip_category;
+	return r2context->chans_count;
 }
 
-OR2_DECLARE(void) openr2_context_set_immediate_accept(openr2_context_t *r2context, int immediate_accept)
+/* the getters below copy up to max entries and return how many there are */
+OR2_DECLARE(int) openr2_context_get_chans(openr2_context_t *r2context, openr2_chan_t *chans[], int max)
 {
-	if (immediate_accept < 0) {
-		return;
+	int n = r2context->chans_count < max ? r2context->chans_count : max;
+	if (n > 0) {
+		memcpy(chans, r2context->chans, n * sizeof(*chans));
 	}
-	r2context->immediate_accept = immediate_accept ? 1 : 0;
+	return r2context->chans_count;
 }
 
-OR2_DECLARE(int) openr2_context_get_immediate_accept(openr2_context_t *r2context)
+OR2_DECLARE(int) openr2_context_get_span_chans(openr2_context_t *r2context, int span_id, openr2_chan_t *chans[], int max)
 {
-	return r2context->immediate_accept;
+	openr2_span_chans_t *span;
+	int n;
+	if (span_id < 0 || span_id >= r2context->spans_size) {
+		return 0;
+	}
+	span = &r2context->spans[span_id];
+	n = span->count < max ? span->count : max;
+	if (n > 0) {
+		memcpy(chans, span->chans, n * sizeof(*chans));
+	}
+	return span->count;
 }
 
-OR2_DECLARE(void) openr2_context_set_log_level(openr2_context_t *r2context, openr2_log_level_t level)
+OR2_DECLARE(int) openr2_context_get_spans(openr2_context_t *r2context, int spans[], int max)
 {
-	r2context->loglevel = level;
+	int span_id, n = 0;
+	/* channels without a span id are not a span */
+	for (span_id = 1; span_id < r2context->spans_size; span_id++) {
+		if (!r2context->spans[span_id].count) {
+			continue;
+		}
+		if (n < max) {
+			spans[n] = span_id;
+		}
+		n++;
+	}
+	return n;
 }
 
-OR2_DECLARE(openr2_log_level_t) openr2_context_get_log_level(openr2_context_t *r2context)
+/* Record the alarm state a channel of the span found. Returns 1 if the span state
+   changed and the caller must report it, 0 if another channel of the span did already
+   and -1 if the span is not tracked and the channel has to report its own alarm */
+int openr2_context_update_span_alarm(openr2_context_t *r2context, int span_id, int alarm)
 {
-	return r2context->loglevel;
+	int *span_alarms;
+	int size, changed;
+	if (!r2context->span_alarm_events || span_id <= 0 || span_id >= OR2_MAX_SPAN_ID) {
+		return -1;
+	}
+	openr2_mutex_lock(r2context->spans_lock);
+	if (span_id >= r2context->span_alarms_size) {
+		size = r2context->span_alarms_size ? r2context->span_alarms_size : 16;
+		while (size <= span_id) {
+			size *= 2;
+		}
+		span_alarms = realloc(r2context->span_alarms, size * sizeof(*span_alarms));
+		if (!span_alarms) {
+			openr2_mutex_unlock(r2context->spans_lock);
+			return -1;
+		}
+		memset(&span_alarms[r2context->span_alarms_size], 0, (size - r2context->span_alarms_size) * sizeof(*span_alarms));
+		r2context->span_alarms = span_alarms;
+		r2context->span_alarms_size = size;
+	}
+	changed = (r2context->span_alarms[span_id] != alarm);
+	r2context->span_alarms[span_id] = alarm;
+	openr2_mutex_unlock(r2context->spans_lock);
+	return changed;
 }
 
-OR2_DECLARE(void) openr2_context_set_mf_threshold(openr2_context_t *r2context, int threshold)
+OR2_DECLARE(void) openr2_context_delete(openr2_context_t *r2context)
 {
-	if (threshold < 0) {
-		threshold = 0;
+	int span_id;
+	/* deleting the last one does not move the others */
+	while (r2context->chans_count) {
+		openr2_chan_delete(r2context->chans[r2context->chans_count - 1]);
+	}
+	free(r2context->chans);
+	free(r2context->chans_by_number);
+	for (span_id = 0; span_id < r2context->spans_size; span_id++) {
+		free(r2context->spans[span_id].chans);
+	}
+	free(r2context->spans);
+	openr2_io_uring_destroy(r2context);
+	openr2_io_replay_destroy(r2context);
+	openr2_io_impair_destroy(r2context);
+	openr2_numplan_free(r2context->numplan);
+	openr2_adapt_destroy(r2context);
+	openr2_admit_destroy(r2context);
+	openr2_mirror_close(r2context);
+	openr2_mutex_destroy(&r2context->timers_lock);
+	openr2_mutex_destroy(&r2context->events_lock);
+	openr2_mutex_destroy(&r2context->spans_lock);
+	/* the channels are gone, we hold the last reference */
+	free(r2context->live_config);
+	openr2_mutex_destroy(&r2context->config_lock);
+	free(r2context->span_alarms);
+	if (r2context->events) {
+		free(r2context->events);
 	}
-	r2context->mf_threshold = threshold;
+	free(r2context);
 }
 
-OR2_DECLARE(int) openr2_context_get_mf_threshold(openr2_context_t *r2context)
+OR2_DECLARE(int) openr2_context_enable_event_queue(openr2_context_t *r2context, int max_events)
 {
-	return r2context->mf_threshold;
+	openr2_event_t *events;
+	if (max_events <= 0) {
+		return -1;
+	}
+	if (r2context->events) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "The event queue is already enabled\n");
+		return -1;
+	}
+	events = calloc(max_events, sizeof(*events));
+	if (!events) {
+		r2context->last_error = OR2_LIBERR_OUT_OF_MEMORY;
+		return -1;
+	}
+	openr2_mutex_lock(r2context->events_lock);
+	r2context->events = events;
+	r2context->events_size = max_events;
+	r2context->events_head = 0;
+	r2context->events_count = 0;
+	openr2_mutex_unlock(r2context->events_lock);
+
+	/* media and logging are still delivered directly to the user */
+	r2context->queued_evmanager = queued_evmanager;
+	r2context->queued_evmanager.on_call_read = r2context->evmanager->on_call_read;
+	r2context->queued_evmanager.on_context_log = r2context->evmanager->on_context_log;
+	r2context->queued_evmanager.on_call_log_created = r2context->evmanager->on_call_log_created;
+	r2context->user_evmanager = r2context->evmanager;
+	r2context->evmanager = &r2context->queued_evmanager;
+	return 0;
 }
 
-OR2_DECLARE(void) openr2_context_set_dtmf_detection(openr2_context_t *r2context, int enable)
+OR2_DECLARE(void) openr2_context_disable_event_queue(openr2_context_t *r2context)
 {
-	if (enable < 0) {
+	if (!r2context->events) {
 		return;
 	}
-	r2context->detect_dtmf = enable ? 1 : 0;
-}
 
-OR2_DECLARE(int) openr2_context_get_dtmf_detection(openr2_context_t *r2context)
-{
-	return r2context->detect_dtmf;
+	/* any event not polled yet is lost, and so are the ones of channels
+	   being processed right now that still go through the queue */
+	openr2_mutex_lock(r2context->events_lock);
+	r2context->evmanager = r2context->user_evmanager;
+	r2context->user_evmanager = NULL;
+	free(r2context->events);
+	r2context->events = NULL;
+	r2context->events_size = 0;
+	r2context->events_head = 0;
+	r2context->events_count = 0;
+	openr2_mutex_unlock(r2context->events_lock);
+}
+
+OR2_DECLARE(int) openr2_context_poll_events(openr2_context_t *r2context, openr2_event_t *events, int max)
+{
+	int count = 0;
+	openr2_mutex_lock(r2context->events_lock);
+	if (!r2context->events) {
+		openr2_mutex_unlock(r2context->events_lock);
+		return -1;
+	}
+	while (count < max && r2context->events_count) {
+		memcpy(&events[count], &r2context->events[r2context->events_head], sizeof(events[0]));
+		r2context->events_head = (r2context->events_head + 1) % r2context->events_size;
+		r2context->events_count--;
+		count++;
+	}
+	openr2_mutex_unlock(r2context->events_lock);
+	return count;
+}
+
+OR2_DECLARE(unsigned) openr2_context_get_dropped_events(openr2_context_t *r2context)
+{
+	unsigned dropped;
+	openr2_mutex_lock(r2context->events_lock);
+	dropped = r2context->events_dropped;
+	openr2_mutex_unlock(r2context->events_lock);
+	return dropped;
+}
+
+OR2_DECLARE(const char *) openr2_context_get_event_string(openr2_event_type_t type)
+{
+	switch (type) {
+	case OR2_EVENT_NONE: return "None";
+	case OR2_EVENT_CALL_INIT: return "Call Init";
+	case OR2_EVENT_CALL_PROCEED: return "Call Proceed";
+	case OR2_EVENT_CALL_OFFERED: return "Call Offered";
+	case OR2_EVENT_CALL_ACCEPTED: return "Call Accepted";
+	case OR2_EVENT_CALL_ANSWERED: return "Call Answered";
+	case OR2_EVENT_CALL_DISCONNECT: return "Call Disconnect";
+	case OR2_EVENT_CALL_END: return "Call End";
+	case OR2_EVENT_HARDWARE_ALARM: return "Hardware Alarm";
+	case OR2_EVENT_OS_ERROR: return "OS Error";
+	case OR2_EVENT_PROTOCOL_ERROR: return "Protocol Error";
+	case OR2_EVENT_LINE_BLOCKED: return "Line Blocked";
+	case OR2_EVENT_LINE_IDLE: return "Line Idle";
+	case OR2_EVENT_DNIS_DIGIT: return "DNIS Digit";
+	case OR2_EVENT_ANI_DIGIT: return "ANI Digit";
+	case OR2_EVENT_BILLING_PULSE: return "Billing Pulse";
+	case OR2_EVENT_PROCESSING_LAG: return "Processing Lag";
+	case OR2_EVENT_CHANNEL_AVAILABLE: return "Channel Available";
+	case OR2_EVENT_SPAN_ALARM: return "Span Alarm";
+	default: return "*Unknown*";
+	}
+}
+
+OR2_DECLARE(openr2_liberr_t) openr2_context_get_last_error(openr2_context_t *r2context)
+{
+	return r2context->last_error;
+}
+
+OR2_DECLARE(const char *) openr2_context_error_string(openr2_liberr_t error)
+{
+	switch ( error ) {
+	case OR2_LIBERR_SYSCALL_FAILED: return "System call failed";
+	case OR2_LIBERR_INVALID_CHAN_SIGNALING: return "Invalid channel signaling";
+	case OR2_LIBERR_CANNOT_SET_IDLE: return "Failed to set IDLE state on channel";
+	case OR2_LIBERR_NO_IO_IFACE_AVAILABLE: return "No I/O interface available for channel";
+	case OR2_LIBERR_INVALID_CHAN_NUMBER: return "Invalid channel number";
+	case OR2_LIBERR_OUT_OF_MEMORY: return "Out of memory";
+	case OR2_LIBERR_INVALID_INTERFACE: return "Invalid interface";
+	default: return "*Unknown*";
+	}
+}
+
+OR2_DECLARE(openr2_variant_t) openr2_context_get_variant(openr2_context_t *r2context)
+{
+	return r2context->variant;
+}
+
+OR2_DECLARE(void) openr2_context_set_ani_first(openr2_context_t *r2context, int ani_first)
+{
+	if (ani_first < 0) {
+		return;
+	}
+	r2context->config.get_ani_first = ani_first ? 1 : 0;
+	config_changed(r2context);
+}
+
+OR2_DECLARE(int) openr2_context_get_ani_first(openr2_context_t *r2context)
+{
+	return r2context->config.get_ani_first;
+}
+
+OR2_DECLARE(void) openr2_context_set_skip_category_request(openr2_context_t *r2context, int skipcategory)
+{
+	if (skipcategory < 0) {
+		return;
+	}
+	r2context->config.skip_category = skipcategory ? 1 : 0;
+	config_changed(r2context);
+}
+
+OR2_DECLARE(int) openr2_context_get_skip_category_request(openr2_context_t *r2context)
+{
+	return r2context->config.skip_category;
+}
+
+OR2_DECLARE(void) openr2_context_set_immediate_accept(openr2_context_t *r2context, int immediate_accept)
+{
+	if (immediate_accept < 0) {
+		return;
+	}
+	r2context->config.immediate_accept = immediate_accept ? 1 : 0;
+	config_changed(r2context);
+}
+
+OR2_DECLARE(int) openr2_context_get_immediate_accept(openr2_context_t *r2context)
+{
+	return r2context->config.immediate_accept;
+}
+
+OR2_DECLARE(void) openr2_context_set_log_level(openr2_context_t *r2context, openr2_log_level_t level)
+{
+	r2context->loglevel = level;
+}
+
+OR2_DECLARE(openr2_log_level_t) openr2_context_get_log_level(openr2_context_t *r2context)
+{
+	return r2context->loglevel;
+}
+
+OR2_DECLARE(void) openr2_context_set_mf_threshold(openr2_context_t *r2context, int threshold)
+{
+	if (threshold < 0) {
+		threshold = 0;
+	}
+	r2context->config.mf_threshold = threshold;
+	config_changed(r2context);
+}
+
+OR2_DECLARE(int) openr2_context_get_mf_threshold(openr2_context_t *r2context)
+{
+	return r2context->config.mf_threshold;
+}
+
+OR2_DECLARE(void) openr2_context_set_dtmf_detection(openr2_context_t *r2context, int enable)
+{
+	if (enable < 0) {
+		return;
+	}
+	r2context->config.detect_dtmf = enable ? 1 : 0;
+	openr2_proto_compile_cas_table(r2context);
+	config_changed(r2context);
+}
+
+OR2_DECLARE(int) openr2_context_get_dtmf_detection(openr2_context_t *r2context)
+{
+	return r2context->config.detect_dtmf;
 }
 
 OR2_DECLARE(void) openr2_context_set_dtmf_dialing(openr2_context_t *r2context, int enable, int dtmf_on, int dtmf_off)
@@ -584,22 +1267,24 @@ OR2_DECLARE(void) openr2_context_set_dtmf_dialing(openr2_context_t *r2context, i
 	if (enable < 0) {
 		return;
 	}
-	r2context->dial_with_dtmf = enable ? 1 : 0;
-	if (r2context->dial_with_dtmf) {
-		r2context->dtmf_on = dtmf_on > 0 ? dtmf_on : OR2_DEFAULT_DTMF_ON;
-		r2context->dtmf_off = dtmf_off > 0 ? dtmf_off : OR2_DEFAULT_DTMF_OFF;
+	r2context->config.dial_with_dtmf = enable ? 1 : 0;
+	if (r2context->config.dial_with_dtmf) {
+		r2context->config.dtmf_on = dtmf_on > 0 ? dtmf_on : OR2_DEFAULT_DTMF_ON;
+		r2context->config.dtmf_off = dtmf_off > 0 ? dtmf_off : OR2_DEFAULT_DTMF_OFF;
 	}
+	openr2_proto_compile_cas_table(r2context);
+	config_changed(r2context);
 }
 
 OR2_DECLARE(int) openr2_context_get_dtmf_dialing(openr2_context_t *r2context, int *dtmf_on, int *dtmf_off)
 {
 	if (dtmf_on) {
-		*dtmf_on = r2context->dtmf_on;
+		*dtmf_on = r2context->config.dtmf_on;
 	}
 	if (dtmf_off) {
-		*dtmf_off = r2context->dtmf_off;
+		*dtmf_off = r2context->config.dtmf_off;
 	}	
-	return r2context->dial_with_dtmf;
+	return r2context->config.dial_with_dtmf;
 }
 
 OR2_DECLARE(int) openr2_context_set_log_directory(openr2_context_t *r2context, char *directory)
@@ -646,12 +1331,12 @@ OR2_DECLARE(char *) openr2_context_get_log_directory(openr2_context_t *r2context
 
 OR2_DECLARE(int) openr2_context_get_max_ani(openr2_context_t *r2context)
 {
-	return r2context->max_ani;
+	return r2context->config.max_ani;
 }
 
 OR2_DECLARE(int) openr2_context_get_max_dnis(openr2_context_t *r2context)
 {
-	return r2context->max_dnis;
+	return r2context->config.max_dnis;
 }
 
 OR2_DECLARE(void) openr2_context_set_mf_back_timeout(openr2_context_t *r2context, int ms)
@@ -660,12 +1345,13 @@ OR2_DECLARE(void) openr2_context_set_mf_back_timeout(openr2_context_t *r2context
 	if (ms < 0) {
 		return;
 	}
-	r2context->timers.mf_back_cycle = ms;
+	r2context->config.timers.mf_back_cycle = ms;
+	config_changed(r2context);
 }
 
 OR2_DECLARE(int) openr2_context_get_mf_back_timeout(openr2_context_t *r2context)
 {
-	return r2context->timers.mf_back_cycle;
+	return r2context->config.timers.mf_back_cycle;
 }
 
 OR2_DECLARE(void) openr2_context_set_metering_pulse_timeout(openr2_context_t *r2context, int ms)
@@ -674,12 +1360,14 @@ OR2_DECLARE(void) openr2_context_set_metering_pulse_timeout(openr2_context_t *r2
 	if (ms < 0) {
 		return;
 	}
-	r2context->timers.r2_metering_pulse = ms;
+	r2context->config.timers.r2_metering_pulse = ms;
+	openr2_proto_compile_cas_table(r2context);
+	config_changed(r2context);
 }
 
 OR2_DECLARE(int) openr2_context_get_metering_pulse_timeout(openr2_context_t *r2context)
 {
-	return r2context->timers.r2_metering_pulse;
+	return r2context->config.timers.r2_metering_pulse;
 }
 
 OR2_DECLARE(void) openr2_context_set_double_answer(openr2_context_t *r2context, int enable)
@@ -687,66 +1375,539 @@ OR2_DECLARE(void) openr2_context_set_double_answer(openr2_context_t *r2context,
 	if (enable < 0) {
 		return;
 	}
-	r2context->double_answer = enable;
+	r2context->config.double_answer = enable;
+	config_changed(r2context);
 }
 
 OR2_DECLARE(int) openr2_context_get_double_answer(openr2_context_t *r2context)
 {
-	return r2context->double_answer ? 1 : 0;
+	return r2context->config.double_answer ? 1 : 0;
 }
 
-OR2_DECLARE(int) openr2_context_set_io_type(openr2_context_t *r2context, openr2_io_type_t io_type, openr2_io_interface_t *io_interface)
+OR2_DECLARE(void) openr2_context_set_release_policy(openr2_context_t *r2context, openr2_release_policy_t policy)
 {
-	openr2_io_interface_t *internal_io_interface = NULL;
-	switch (io_type) {
-	case OR2_IO_CUSTOM:
-		/* sanity check for all members */
-		if (!io_interface) {
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "I/O interface cannot be null!\n");
+	if (policy != OR2_RELEASE_STANDARD && policy != OR2_RELEASE_FAST) {
+		return;
+	}
+	r2context->config.release_policy = policy;
+	config_changed(r2context);
+}
+
+OR2_DECLARE(openr2_release_policy_t) openr2_context_get_release_policy(openr2_context_t *r2context)
+{
+	return r2context->config.release_policy;
+}
+
+OR2_DECLARE(void) openr2_context_set_single_owner(openr2_context_t *r2context, int enable)
+{
+	if (enable < 0) {
+		return;
+	}
+	/* only affects channels created after this call */
+	if (enable) {
+		openr2_set_flag(r2context, OR2_CONTEXT_SINGLE_OWNER);
+	} else {
+		openr2_clear_flag(r2context, OR2_CONTEXT_SINGLE_OWNER);
+	}
+}
+
+OR2_DECLARE(int) openr2_context_get_single_owner(openr2_context_t *r2context)
+{
+	return openr2_test_flag(r2context, OR2_CONTEXT_SINGLE_OWNER) ? 1 : 0;
+}
+
+OR2_DECLARE(void) openr2_context_get_lock_stats(openr2_context_t *r2context, openr2_mutex_stats_t *timers_stats, openr2_mutex_stats_t *chans_stats)
+{
+	openr2_chan_t *current;
+	int i;
+	openr2_mutex_stats_t stats;
+	if (timers_stats) {
+		openr2_mutex_get_stats(r2context->timers_lock, timers_stats);
+	}
+	if (!chans_stats) {
+		return;
+	}
+	/* add up the counters of all the channel locks */
+	memset(chans_stats, 0, sizeof(*chans_stats));
+	openr2_mutex_lock(r2context->timers_lock);
+	for (i = 0; i < r2context->chans_count; i++) {
+		current = r2context->chans[i];
+		openr2_mutex_get_stats(current->lock, &stats);
+		chans_stats->acquisitions += stats.acquisitions;
+		chans_stats->contended += stats.contended;
+		chans_stats->wait_ns += stats.wait_ns;
+	}
+	openr2_mutex_unlock(r2context->timers_lock);
+}
+
+OR2_DECLARE(void) openr2_context_reset_lock_stats(openr2_context_t *r2context)
+{
+	openr2_chan_t *current;
+	int i;
+	openr2_mutex_reset_stats(r2context->timers_lock);
+	openr2_mutex_reset_stats(r2context->events_lock);
+	openr2_mutex_lock(r2context->timers_lock);
+	for (i = 0; i < r2context->chans_count; i++) {
+		current = r2context->chans[i];
+		openr2_mutex_reset_stats(current->lock);
+	}
+	openr2_mutex_unlock(r2context->timers_lock);
+}
+
+#define LOG_LOCK_STATS(name, stats) \
+	openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_NOTICE, "%s: %llu acquisitions, %llu contended, %llu ns waiting\n", \
+			name, (unsigned long long)(stats).acquisitions, (unsigned long long)(stats).contended, \
+			(unsigned long long)(stats).wait_ns);
+
+OR2_DECLARE(void) openr2_context_dump_lock_stats(openr2_context_t *r2context)
+{
+	openr2_chan_t *current;
+	int i;
+	openr2_mutex_stats_t stats;
+	char name[50];
+	openr2_mutex_get_stats(r2context->timers_lock, &stats);
+	LOG_LOCK_STATS("timers lock", stats);
+	openr2_mutex_get_stats(r2context->events_lock, &stats);
+	LOG_LOCK_STATS("events lock", stats);
+	openr2_mutex_lock(r2context->timers_lock);
+	for (i = 0; i < r2context->chans_count; i++) {
+		current = r2context->chans[i];
+		openr2_mutex_get_stats(current->lock, &stats);
+		snprintf(name, sizeof(name), "chan %d lock", current->number);
+		LOG_LOCK_STATS(name, stats);
+	}
+	openr2_mutex_unlock(r2context->timers_lock);
+}
+
+OR2_DECLARE(void) openr2_context_set_media_defer_threshold(openr2_context_t *r2context, int ms)
+{
+	if (ms < 0) {
+		return;
+	}
+	r2context->media_defer_threshold = ms;
+}
+
+OR2_DECLARE(int) openr2_context_get_media_defer_threshold(openr2_context_t *r2context)
+{
+	return r2context->media_defer_threshold;
+}
+
+OR2_DECLARE(unsigned) openr2_context_get_deferred_media(openr2_context_t *r2context)
+{
+	return r2context->media_deferred;
+}
+
+static int elapsed_ms(struct timeval *start)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return ((now.tv_sec - start->tv_sec) * 1000) + ((now.tv_usec - start->tv_usec) / 1000);
+}
+
+/* process the given ready channels by service class: first the ones in the MF compelled
+   cycle or any other signaling state, then the DTMF ones and last the ones just moving media.
+   Serviced entries are set to NULL. If the signaling work took longer than the media defer
+   threshold the remaining media channels are not processed, they are moved to the start of
+   ready_chans and their count returned so the caller can service them on its next pass */
+OR2_DECLARE(int) openr2_context_service(openr2_context_t *r2context, openr2_chan_t *ready_chans[], int n)
+{
+	struct timeval start;
+	int i, deferred = 0;
+	gettimeofday(&start, NULL);
+	for (i = 0; i < n; i++) {
+		if (ready_chans[i] && openr2_chan_get_service_class(ready_chans[i]) == OR2_CHAN_CLASS_SIGNALING) {
+			openr2_chan_process_signaling(ready_chans[i]);
+			ready_chans[i] = NULL;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		if (ready_chans[i] && openr2_chan_get_service_class(ready_chans[i]) == OR2_CHAN_CLASS_DTMF) {
+			openr2_chan_process_signaling(ready_chans[i]);
+			ready_chans[i] = NULL;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		if (!ready_chans[i]) {
+			continue;
+		}
+		if (r2context->media_defer_threshold && (deferred || elapsed_ms(&start) >= r2context->media_defer_threshold)) {
+			ready_chans[deferred++] = ready_chans[i];
+			if (i >= deferred) {
+				ready_chans[i] = NULL;
+			}
+			continue;
+		}
+		openr2_chan_process_signaling(ready_chans[i]);
+		ready_chans[i] = NULL;
+	}
+	if (deferred) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Deferred %d media channels after %d ms of signaling work\n", 
+				deferred, elapsed_ms(&start));
+		r2context->media_deferred += deferred;
+	}
+	return deferred;
+}
+
+OR2_DECLARE(void) openr2_context_set_lag_thresholds(openr2_context_t *r2context, int read_ms, int timer_ms)
+{
+	r2context->lag_read_threshold = read_ms < 0 ? 0 : read_ms;
+	r2context->lag_timer_threshold = timer_ms < 0 ? 0 : timer_ms;
+}
+
+OR2_DECLARE(void) openr2_context_get_lag_thresholds(openr2_context_t *r2context, int *read_ms, int *timer_ms)
+{
+	if (read_ms) {
+		*read_ms = r2context->lag_read_threshold;
+	}
+	if (timer_ms) {
+		*timer_ms = r2context->lag_timer_threshold;
+	}
+}
+
+OR2_DECLARE(void) openr2_context_set_process_budget(openr2_context_t *r2context, int max_iterations, int max_usecs)
+{
+	r2context->process_max_iterations = max_iterations < 0 ? 0 : max_iterations;
+	r2context->process_max_usecs = max_usecs < 0 ? 0 : max_usecs;
+}
+
+OR2_DECLARE(void) openr2_context_get_process_budget(openr2_context_t *r2context, int *max_iterations, int *max_usecs)
+{
+	if (max_iterations) {
+		*max_iterations = r2context->process_max_iterations;
+	}
+	if (max_usecs) {
+		*max_usecs = r2context->process_max_usecs;
+	}
+}
+
+OR2_DECLARE(int) openr2_context_io_tick(openr2_context_t *r2context, int wait_ms)
+{
+	if (r2context->io_type != OR2_IO_URING) {
+		return -1;
+	}
+	return openr2_io_uring_tick(r2context, wait_ms);
+}
+
+/* one pass over every channel of the context, with span I/O when the backend has it.
+   If block is set and there are no more than OR2_IO_MAX_SPAN_CHANS channels, waits
+   until one of them has something. It does not sleep when commands were posted already,
+   but commands posted while it sleeps wait for some channel activity. Returns the number
+   of channels processed */
+OR2_DECLARE(int) openr2_context_process_span(openr2_context_t *r2context, int block)
+{
+	return openr2_io_span_process(r2context, block);
+}
+
+OR2_DECLARE(void) openr2_context_get_io_tick_stats(openr2_context_t *r2context, unsigned *submits, unsigned *completions)
+{
+	openr2_io_uring_get_stats(r2context, submits, completions);
+}
+
+OR2_DECLARE(int) openr2_context_set_socket_io(openr2_context_t *r2context, const char *directory, int span_channels)
+{
+	/* 30 voice timeslots plus the signaling one if someone really wants it */
+	if (span_channels < 0 || span_channels > 31) {
+		return -1;
+	}
+	if (directory) {
+		if (strlen(directory) >= sizeof(r2context->io_socket_dir)) {
 			return -1;
 		}
-		if (!io_interface->open) {
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: open\n");
+		strncpy(r2context->io_socket_dir, directory, sizeof(r2context->io_socket_dir)-1);
+		r2context->io_socket_dir[sizeof(r2context->io_socket_dir)-1] = 0;
+	}
+	r2context->io_socket_span = span_channels;
+	return 0;
+}
+
+OR2_DECLARE(int) openr2_context_get_socket_io(openr2_context_t *r2context, char *directory, int len)
+{
+	if (directory && len > 0) {
+		strncpy(directory, r2context->io_socket_dir, len-1);
+		directory[len-1] = 0;
+	}
+	return r2context->io_socket_span;
+}
+
+OR2_DECLARE(int) openr2_context_set_io_recording(openr2_context_t *r2context, const char *directory)
+{
+	openr2_io_interface_t *record_io_interface;
+	/* channels hold their traces from open to close */
+	if (r2context->chans_count) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Cannot start or stop I/O recording once channels were created.\n");
+		return -1;
+	}
+	if (!directory) {
+		if (r2context->io_recorded) {
+			r2context->io = r2context->io_recorded;
+			r2context->io_recorded = NULL;
+		}
+		return 0;
+	}
+	record_io_interface = openr2_io_get_record_interface();
+	if (!record_io_interface) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unavailable I/O recording (no mmap support).\n");
+		return -1;
+	}
+	if (strlen(directory) >= sizeof(r2context->io_trace_dir)) {
+		return -1;
+	}
+	strncpy(r2context->io_trace_dir, directory, sizeof(r2context->io_trace_dir)-1);
+	r2context->io_trace_dir[sizeof(r2context->io_trace_dir)-1] = 0;
+	/* the recorder wraps whatever interface is set now */
+	if (!r2context->io_recorded) {
+		r2context->io_recorded = r2context->io;
+		r2context->io = record_io_interface;
+	}
+	return 0;
+}
+
+OR2_DECLARE(int) openr2_context_set_io_replay(openr2_context_t *r2context, const char *directory, openr2_replay_mode_t mode)
+{
+	if (mode != OR2_REPLAY_REAL_TIME && mode != OR2_REPLAY_MAX_SPEED) {
+		return -1;
+	}
+	if (directory) {
+		if (strlen(directory) >= sizeof(r2context->io_trace_dir)) {
 			return -1;
 		}
-		if (!io_interface->close) {
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: close\n");
+		strncpy(r2context->io_trace_dir, directory, sizeof(r2context->io_trace_dir)-1);
+		r2context->io_trace_dir[sizeof(r2context->io_trace_dir)-1] = 0;
+	}
+	if (r2context->chans_count && r2context->io_type != OR2_IO_REPLAY) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Cannot start I/O replay once channels were created.\n");
+		return -1;
+	}
+	return openr2_io_replay_start(r2context, mode);
+}
+
+OR2_DECLARE(int) openr2_context_get_replay_status(openr2_context_t *r2context, int *pending_chans, unsigned *divergences)
+{
+	return openr2_io_replay_status(r2context, pending_chans, divergences);
+}
+
+OR2_DECLARE(int) openr2_context_set_io_impairments(openr2_context_t *r2context, const openr2_impairments_t *impairments)
+{
+	if (!impairments) {
+		/* channels hold their impairment state from open to close */
+		if (r2context->io_impaired && r2context->chans_count) {
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Cannot remove line impairments once channels were created.\n");
 			return -1;
 		}
-		if (!io_interface->set_cas) {
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: set_cas\n");
+		if (r2context->io_impaired) {
+			r2context->io = r2context->io_impaired;
+			r2context->io_impaired = NULL;
+		}
+		return 0;
+	}
+	if (!r2context->io_impaired && r2context->chans_count) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Cannot add line impairments once channels were created.\n");
+		return -1;
+	}
+	/* the impairments themselves can be changed at any time */
+	if (openr2_io_impair_configure(r2context, impairments)) {
+		return -1;
+	}
+	if (!r2context->io_impaired) {
+		r2context->io_impaired = r2context->io;
+		r2context->io = openr2_io_get_impair_interface();
+	}
+	return 0;
+}
+
+OR2_DECLARE(int) openr2_context_get_impairment_stats(openr2_context_t *r2context, openr2_impairment_stats_t *stats)
+{
+	return openr2_io_impair_get_stats(r2context, stats);
+}
+
+OR2_DECLARE(int) openr2_context_set_adaptive_timers(openr2_context_t *r2context, const openr2_adaptive_timers_t *config)
+{
+	return openr2_adapt_configure(r2context, config);
+}
+
+OR2_DECLARE(int) openr2_context_get_timer_stats(openr2_context_t *r2context, openr2_adaptive_timer_t timer, openr2_timer_stats_t *stats)
+{
+	return openr2_context_get_span_timer_stats(r2context, 0, timer, stats);
+}
+
+OR2_DECLARE(int) openr2_context_get_span_timer_stats(openr2_context_t *r2context, int span_id, openr2_adaptive_timer_t timer, openr2_timer_stats_t *stats)
+{
+	int configured;
+	switch (timer) {
+	case OR2_ADAPTIVE_R2_SEIZE:
+		configured = r2context->config.timers.r2_seize;
+		break;
+	case OR2_ADAPTIVE_MF_BACK_CYCLE:
+		configured = r2context->config.timers.mf_back_cycle;
+		break;
+	default:
+		return -1;
+	}
+	return openr2_adapt_get_stats(r2context, span_id, timer, configured, stats);
+}
+
+OR2_DECLARE(int) openr2_context_set_admission(openr2_context_t *r2context, const openr2_admission_t *admission)
+{
+	return openr2_admit_configure(r2context, admission);
+}
+
+OR2_DECLARE(int) openr2_context_get_admission_stats(openr2_context_t *r2context, openr2_admission_stats_t *stats)
+{
+	return openr2_admit_get_stats(r2context, stats);
+}
+
+OR2_DECLARE(int) openr2_context_set_load(openr2_context_t *r2context, int load)
+{
+	return openr2_admit_set_load(r2context, load);
+}
+
+OR2_DECLARE(int) openr2_context_set_state_mirror(openr2_context_t *r2context, const char *path)
+{
+	if (!path) {
+		openr2_mirror_close(r2context);
+		return 0;
+	}
+	return openr2_mirror_open(r2context, path);
+}
+
+OR2_DECLARE(const char *) openr2_context_get_lag_string(openr2_lag_type_t type)
+{
+	switch (type) {
+	case OR2_LAG_READ_GAP: return "Late Read";
+	case OR2_LAG_TIMER: return "Late Timer";
+	case OR2_LAG_READ_OVERRUN: return "Read Overrun";
+	default: return "*Unknown*";
+	}
+}
+
+static int openr2_context_check_io_interface(openr2_context_t *r2context, openr2_io_interface_t *io_interface)
+{
+	/* sanity check for all members */
+	if (!io_interface) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "I/O interface cannot be null!\n");
+		return -1;
+	}
+	if (!io_interface->open) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: open\n");
+		return -1;
+	}
+	if (!io_interface->close) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: close\n");
+		return -1;
+	}
+	if (!io_interface->set_cas) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: set_cas\n");
+		return -1;
+	}
+	if (!io_interface->get_cas) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: get_cas\n");
+		return -1;
+	}
+	if (!io_interface->flush_write_buffers) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: flush_write_buffers\n");
+		return -1;
+	}
+	if (!io_interface->write) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: write\n");
+		return -1;
+	}
+	if (!io_interface->read) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: read\n");
+		return -1;
+	}
+	if (!io_interface->setup) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: setup\n");
+		return -1;
+	}
+	if (!io_interface->wait) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: wait\n");
+		return -1;
+	}
+	if (!io_interface->get_oob_event) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: get_oob_event\n");
+		return -1;
+	}
+	if (!io_interface->get_alarm_state) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: get_alarm_state\n");
+		return -1;
+	}
+	/* the optional members were appended later, catch interfaces filling just one of a pair */
+	if (!io_interface->play_loop != !io_interface->stop_loop) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "I/O interface methods play_loop and stop_loop go together\n");
+		return -1;
+	}
+	if (!io_interface->wait_span && (io_interface->read_span || io_interface->write_span || io_interface->get_cas_span)) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "I/O interface span methods need wait_span\n");
+		return -1;
+	}
+	return 0;
+}
+
+OR2_DECLARE(int) openr2_context_set_io_type(openr2_context_t *r2context, openr2_io_type_t io_type, openr2_io_interface_t *io_interface)
+{
+	openr2_io_interface_t *internal_io_interface = NULL;
+	switch (io_type) {
+	case OR2_IO_CUSTOM:
+		if (openr2_context_check_io_interface(r2context, io_interface)) {
 			return -1;
 		}
-		if (!io_interface->get_cas) {
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: get_cas\n");
+		r2context->io = io_interface;
+		r2context->io_type = io_type;
+		return 0;
+	case OR2_IO_LOOPBACK:
+		internal_io_interface = openr2_io_get_loopback_interface();
+		if (!internal_io_interface) {
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unavailable loopback I/O interface (no eventfd support).\n");
 			return -1;
 		}
-		if (!io_interface->flush_write_buffers) {
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: flush_write_buffers\n");
+		r2context->io_type = io_type;
+		r2context->io = internal_io_interface;
+		return 0;
+	case OR2_IO_URING:
+		internal_io_interface = openr2_io_get_uring_interface();
+		if (!internal_io_interface) {
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unavailable io_uring I/O interface.\n");
 			return -1;
 		}
-		if (!io_interface->write) {
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: write\n");
+		/* data goes through the ring, everything else through the given interface or Zaptel/DAHDI */
+		if (!io_interface) {
+			io_interface = openr2_io_get_zt_interface();
+			if (!io_interface) {
+				openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "io_uring I/O needs an I/O interface when Zaptel or DAHDI is not available.\n");
+				return -1;
+			}
+		} else if (openr2_context_check_io_interface(r2context, io_interface)) {
 			return -1;
 		}
-		if (!io_interface->read) {
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: read\n");
+		if (r2context->io_ring) {
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Cannot change the io_uring I/O interface once channels were opened.\n");
 			return -1;
 		}
-		if (!io_interface->setup) {
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: setup\n");
+		r2context->io_lower = io_interface;
+		r2context->io_type = io_type;
+		r2context->io = internal_io_interface;
+		return 0;
+	case OR2_IO_REPLAY:
+		internal_io_interface = openr2_io_get_replay_interface();
+		if (!internal_io_interface) {
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unavailable replay I/O interface (no mmap support).\n");
 			return -1;
 		}
-		if (!io_interface->wait) {
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: wait\n");
+		/* real time replay unless openr2_context_set_io_replay() said otherwise */
+		if (!r2context->io_trace && openr2_io_replay_start(r2context, OR2_REPLAY_REAL_TIME)) {
 			return -1;
 		}
-		if (!io_interface->get_oob_event) {
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unspecified I/O interface method: get_oob_event\n");
+		r2context->io_type = io_type;
+		r2context->io = internal_io_interface;
+		return 0;
+	case OR2_IO_SOCKET:
+		internal_io_interface = openr2_io_get_socket_interface();
+		if (!internal_io_interface) {
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Unavailable socket I/O interface (no UNIX sockets support).\n");
 			return -1;
 		}
-		r2context->io = io_interface;
 		r2context->io_type = io_type;
+		r2context->io = internal_io_interface;
 		return 0;
 	case OR2_IO_ZT:
 		/* check that zaptel interface is available */
@@ -777,122 +1938,72 @@ OR2_DECLARE(int) openr2_context_set_io_type(openr2_context_t *r2context, openr2_
 	return -1;
 }
 
-#define LOADTONE(mytone) \
-	else if (1 == sscanf(line, #mytone "=%c", (char *)&intvalue)) { \
-		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Found value %d for tone %s\n", intvalue, #mytone); \
-		if (strchr("1234567890BCDEF", intvalue)) { \
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Changing tone %s from %02X to %02X\n", \
-			#mytone, r2context->mytone, intvalue); \
-			r2context->mytone = intvalue; \
-		} else { \
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Disabling tone %s, its value was %02X\n", \
-			#mytone, r2context->mytone); \
-			r2context->mytone = OR2_MF_TONE_INVALID; \
-		} \
-	}
-
-#define LOADTIMER(mytimer) \
-	else if (1 == sscanf(line, #mytimer "=%d", &intvalue)) { \
-		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Found value %d for timer %s\n", intvalue, #mytimer); \
-		if (intvalue >= 0) { \
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Changing timer %s from %d to %d\n", \
-			#mytimer, r2context->mytimer, intvalue); \
-			r2context->mytimer = intvalue; \
-		} \
-	}
-
-#define LOADSETTING(mysetting) \
-	else if (1 == sscanf(line, #mysetting "=%d", &intvalue)) { \
-		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Found value %d for setting %s\n", intvalue, #mysetting); \
-		if (intvalue >= 0) { \
-			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Changing setting %s from %d to %d\n", \
-			#mysetting, r2context->mysetting, intvalue); \
-			r2context->mysetting = intvalue; \
-		} \
-	}
-
-OR2_DECLARE(int) openr2_context_configure_from_advanced_file(openr2_context_t *r2context, const char *filename)
+OR2_DECLARE(int) openr2_context_add_number_plan(openr2_context_t *r2context, const char *prefix, int length)
 {
-	FILE *variant_file;
-	int intvalue = 0;
-	char line[255];
-	if (!filename) {
+	/* channels walk the plan without locking */
+	if (r2context->chans_count) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Cannot change the number plan once channels were created.\n");
 		return -1;
 	}
-	variant_file = fopen(filename, "r");
-	if (!variant_file) {
-		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to open R2 variant file '%s'\n", filename);
+	if (openr2_numplan_add(&r2context->numplan, prefix, length)) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Invalid number plan prefix '%s' of length %d\n", 
+				prefix ? prefix : "(null)", length);
 		return -1;
 	}
-	openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_NOTICE, "Reading R2 definitions from protocol file '%s'\n", filename);
-	while (fgets(line, sizeof(line), variant_file))	{
+	return 0;
+}
 
-		if ('#' == line[0] || '\n' == line[0] || ' ' == line[0]) {
-			continue;
-		}
+OR2_DECLARE(int) openr2_context_clear_number_plan(openr2_context_t *r2context)
+{
+	if (r2context->chans_count) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Cannot change the number plan once channels were created.\n");
+		return -1;
+	}
+	openr2_numplan_free(r2context->numplan);
+	r2context->numplan = NULL;
+	return 0;
+}
+
+OR2_DECLARE(int) openr2_context_get_number_plan_size(openr2_context_t *r2context)
+{
+	return openr2_numplan_count(r2context->numplan);
+}
+
+OR2_DECLARE(void) openr2_context_dump_cas_table(openr2_context_t *r2context)
+{
+	openr2_proto_dump_cas_table(r2context);
+}
 
-		/* Group A tones */
-		LOADTONE(mf_ga_tones.request_next_ani_digit)
-		LOADTONE(mf_ga_tones.request_next_dnis_digit)
-		LOADTONE(mf_ga_tones.request_dnis_minus_1)
-		LOADTONE(mf_ga_tones.request_dnis_minus_2)
-		LOADTONE(mf_ga_tones.request_dnis_minus_3)
-		LOADTONE(mf_ga_tones.request_all_dnis_again)
-		LOADTONE(mf_ga_tones.request_category)
-		LOADTONE(mf_ga_tones.request_category_and_change_to_gc)
-		LOADTONE(mf_ga_tones.request_change_to_g2)
-		LOADTONE(mf_ga_tones.address_complete_charge_setup)
-		LOADTONE(mf_ga_tones.network_congestion)
-
-		/* Group B tones */
-		LOADTONE(mf_gb_tones.accept_call_with_charge)
-		LOADTONE(mf_gb_tones.accept_call_no_charge)
-		LOADTONE(mf_gb_tones.busy_number)
-		LOADTONE(mf_gb_tones.network_congestion)
-		LOADTONE(mf_gb_tones.unallocated_number)
-		LOADTONE(mf_gb_tones.line_out_of_order)
-		LOADTONE(mf_gb_tones.special_info_tone)
-		LOADTONE(mf_gb_tones.number_changed)
-
-		/* Group C tones */
-		LOADTONE(mf_gc_tones.request_next_ani_digit)
-		LOADTONE(mf_gc_tones.request_change_to_g2)
-		LOADTONE(mf_gc_tones.request_next_dnis_digit_and_change_to_ga)
-
-		/* Group I tones */
-		LOADTONE(mf_g1_tones.no_more_dnis_available)
-		LOADTONE(mf_g1_tones.no_more_ani_available)
-		LOADTONE(mf_g1_tones.caller_ani_is_restricted)
-
-		/* Group II tones */
-		LOADTONE(mf_g2_tones.national_subscriber)
-		LOADTONE(mf_g2_tones.national_priority_subscriber)
-		LOADTONE(mf_g2_tones.international_subscriber)
-		LOADTONE(mf_g2_tones.international_priority_subscriber)
-		LOADTONE(mf_g2_tones.collect_call)
-		LOADTONE(mf_g2_tones.pay_phone)
-
-		/* Timers */
-		LOADTIMER(timers.mf_back_cycle)
-		LOADTIMER(timers.mf_back_resume_cycle)
-		LOADTIMER(timers.mf_fwd_safety)
-		LOADTIMER(timers.r2_seize)
-		LOADTIMER(timers.r2_seize_persist)
-		LOADTIMER(timers.r2_answer)
-		LOADTIMER(timers.r2_metering_pulse)
-		LOADTIMER(timers.r2_double_answer)
-		LOADTIMER(timers.r2_answer_delay)
-		LOADTIMER(timers.r2_set_call_down)
-		LOADTIMER(timers.cas_persistence_check)
-		LOADTIMER(timers.dtmf_start_dial)
-
-		/* misc settings */
-		LOADSETTING(mf_threshold)
+OR2_DECLARE(int) openr2_context_set_profile(openr2_context_t *r2context, openr2_profile_t *profile)
+{
+	if (!profile) {
+		return -1;
 	}
+	openr2_profile_apply(profile, r2context);
 	r2context->configured_from_file = 1;
-	fclose(variant_file);
+	/* the tones and the metering pulse timer may have changed */
+	openr2_proto_compile_cas_table(r2context);
+	openr2_proto_compile_mf_tables(r2context);
+	config_changed(r2context);
 	return 0;
 }
-#undef LOADTONE
-#undef LOADTIMER
+
+OR2_DECLARE(int) openr2_context_configure_from_advanced_file(openr2_context_t *r2context, const char *filename)
+{
+	openr2_profile_t *profile;
+	int res;
+	if (!filename) {
+		return -1;
+	}
+	/* contexts configured from the same file share what was read from it */
+	profile = openr2_profile_get(filename);
+	if (!profile) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to open R2 variant file '%s'\n", filename);
+		return -1;
+	}
+	openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_NOTICE, "Using R2 definitions from protocol file '%s'\n", filename);
+	res = openr2_context_set_profile(r2context, profile);
+	openr2_profile_release(profile);
+	return res;
+}
 
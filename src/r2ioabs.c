@@ -69,6 +69,7 @@ static int dummy_write(openr2_chan_t *r2chan, const void *buf, int size) { DUMMY
 static int dummy_setup(openr2_chan_t *r2chan) { DUMMY_CHAN_RETURN }
 static int dummy_wait(openr2_chan_t *r2chan, int *flags, int wait) { DUMMY_CHAN_RETURN }
 static int dummy_get_oob_event(openr2_chan_t *r2chan, openr2_oob_event_t *event) { DUMMY_CHAN_RETURN }
+static int dummy_get_alarm_state(openr2_chan_t *r2chan, int *alarm) { DUMMY_CHAN_RETURN }
 
 /* dummy io interface */
 static openr2_io_interface_t dummy_io_interface = 
@@ -82,7 +83,8 @@ static openr2_io_interface_t dummy_io_interface =
 	/* .read */ dummy_read,
 	/* .setup */ dummy_setup,
 	/* .wait */ dummy_wait,
-	/* .get_oob_event */ dummy_get_oob_event
+	/* .get_oob_event */ dummy_get_oob_event,
+	/* .get_alarm_state */ dummy_get_alarm_state
 };
 
 openr2_io_interface_t *openr2_io_get_dummy_interface()
@@ -243,7 +245,7 @@ static int zt_setup(openr2_chan_t *r2chan)
 	}
 	chan_buffers.txbufpolicy = ZT_POLICY_IMMEDIATE;
 	chan_buffers.rxbufpolicy = ZT_POLICY_IMMEDIATE;
-	chan_buffers.numbufs = 4;
+	chan_buffers.numbufs = OR2_CHAN_IO_NUMBUFS;
 	chan_buffers.bufsize = OR2_CHAN_READ_SIZE;
 	res = ioctl(chanfd, ZT_SET_BUFINFO, &chan_buffers);
 	if (res) {
@@ -379,13 +381,14 @@ openr2_io_interface_t *openr2_io_get_zt_interface()
 
 #endif
 
+/* channels in the middle of a span pass use what it staged for them */
 #define IO(r2chan) int rc = 0; \
 	if (!r2chan->r2context->io) {  \
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, \
 				"%s: Cannot perform I/O operation because no valid I/O interface is available.\n", __FUNCTION__); \
 		return -1; \
 	} \
-	rc = r2chan->r2context->io
+	rc = (r2chan->span_staged ? openr2_io_get_span_staged_interface() : r2chan->r2context->io)
 
 openr2_io_fd_t openr2_io_open(openr2_context_t *r2context, int channo)
 {
@@ -470,3 +473,16 @@ int openr2_io_get_alarm_state(openr2_chan_t *r2chan, int *alarm)
 	return rc;
 }
 
+int openr2_io_play_loop(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	/* optional, callers check the interface has it */
+	IO(r2chan)->play_loop(r2chan, buf, size);
+	return rc;
+}
+
+int openr2_io_stop_loop(openr2_chan_t *r2chan)
+{
+	IO(r2chan)->stop_loop(r2chan);
+	return rc;
+}
+
@@ -0,0 +1,566 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * Line impairment simulator. openr2_context_set_io_impairments() wraps the
+ * I/O interface of the context and degrades what the library receives from
+ * it the way a real trunk would: audio is delayed (with jitter, which shows
+ * up as slipped or repeated samples), attenuated, tilted (twist), buried in
+ * white noise or dropped a frame at a time, CAS changes are delayed, the CAS
+ * bits glitch for a few ms now and then and the line flaps into alarm. The
+ * transmit direction is left alone, wrap both ends for a symmetric line.
+ *
+ * Every random decision comes from a generator per channel seeded from the
+ * configured seed and the channel number, so a run can be reproduced as long
+ * as the channels see the same traffic.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef __linux__
+/* usleep() */
+#define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <math.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include "openr2/r2log-pvt.h"
+#include "openr2/r2chan-pvt.h"
+#include "openr2/r2context-pvt.h"
+#include "openr2/r2utils-pvt.h"
+#include "openr2/r2ioabs.h"
+
+/* longest delay (plus jitter) we simulate, a satellite hop and then some */
+#define IMP_MAX_DELAY_MS 500
+
+/* received audio history, must hold the longest delay plus a read */
+#define IMP_HISTORY_SIZE 8192
+
+/* CAS changes waiting for their delay to expire */
+#define IMP_MAX_PENDING_CAS 16
+
+/* RMS of a 0 dBm0 sine in linear samples (alaw peaks at +3.14 dBm0) */
+#define IMP_0DBM0_RMS 16171.0f
+
+/* twist tilts the spectrum around this frequency */
+#define IMP_TWIST_HZ 1200.0f
+
+#define IMP_SAMPLE_RATE 8000
+
+#define IMP_ALAW_SILENCE 0xD5
+
+/* R2 uses the A and B bits */
+#define IMP_CAS_A 0x8
+#define IMP_CAS_B 0x4
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* kinds of queued CAS changes */
+#define IMP_CAS_LINE 0
+#define IMP_CAS_GLITCH_START 1
+#define IMP_CAS_GLITCH_END 2
+
+typedef struct imp_config {
+	openr2_impairments_t params;
+	/* derived from params */
+	int delay_samples;
+	int jitter_samples;
+	float gain;
+	float low_gain;
+	float high_gain;
+	float lowpass_coef;
+	float noise_rms;
+	openr2_impairment_stats_t stats;
+} imp_config_t;
+
+typedef struct imp_pending_cas {
+	int kind;
+	/* the line bits, or the bit to flip for a glitch */
+	int cas;
+	uint64_t due;
+} imp_pending_cas_t;
+
+typedef struct imp_chan {
+	uint32_t rng;
+	/* received audio, ALAW, rx_pos is where the next sample goes */
+	uint8_t history[IMP_HISTORY_SIZE];
+	unsigned rx_pos;
+	int last_delay;
+	float lowpass;
+	/* CAS the lower interface last reported, what reached us after the
+	   delay and what the library sees, which differs during a glitch */
+	int cas_real;
+	int cas_line;
+	int cas_seen;
+	int glitching;
+	imp_pending_cas_t pending[IMP_MAX_PENDING_CAS];
+	int pending_count;
+	/* next spontaneous events and the end of the current alarm flap */
+	uint64_t next_glitch;
+	uint64_t next_flap;
+	uint64_t flap_end;
+	int in_flap;
+	/* OR2_OOB_EVENT_ALARM_ON or OFF waiting to be reported */
+	int flap_event;
+} imp_chan_t;
+
+static uint64_t imp_now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+/* xorshift32, plenty for this and the same on every platform */
+static uint32_t imp_rand(imp_chan_t *c)
+{
+	uint32_t x = c->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	c->rng = x;
+	return x;
+}
+
+/* uniform in [0, 1) */
+static float imp_randf(imp_chan_t *c)
+{
+	return (imp_rand(c) >> 8) * (1.0f / 16777216.0f);
+}
+
+/* events happen at random with an average rate per minute */
+static uint64_t imp_next_event(imp_chan_t *c, uint64_t now, int per_minute)
+{
+	if (per_minute <= 0) {
+		return 0;
+	}
+	return now + (uint64_t)(-logf(1.0f - imp_randf(c)) * 60000000.0f / per_minute);
+}
+
+#define IMP_STAT(r2context, member) __atomic_fetch_add(&((imp_config_t *)(r2context)->io_impair)->stats.member, 1, __ATOMIC_RELAXED)
+
+#define IMPAIRED(r2chan) (r2chan)->r2context->io_impaired
+
+#define IMP_CHAN(r2chan) imp_config_t *config = (r2chan)->r2context->io_impair; \
+	imp_chan_t *c = imp_get_chan(r2chan); \
+	if (!c) { \
+		return -1; \
+	}
+
+/* channels opened by us get their state on setup, channels
+   created with openr2_chan_new_from_fd() get it on first use */
+static imp_chan_t *imp_get_chan(openr2_chan_t *r2chan)
+{
+	imp_config_t *config = r2chan->r2context->io_impair;
+	imp_chan_t *c = r2chan->io_impair;
+	uint64_t now;
+	if (c) {
+		return c;
+	}
+	c = calloc(1, sizeof(*c));
+	if (!c) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Failed to allocate the line impairment state\n");
+		return NULL;
+	}
+	/* never zero, xorshift would get stuck */
+	c->rng = (config->params.seed * 2654435761u) ^ (uint32_t)(r2chan->number + 1) * 40503u;
+	if (!c->rng) {
+		c->rng = 1;
+	}
+	memset(c->history, IMP_ALAW_SILENCE, sizeof(c->history));
+	c->last_delay = config->delay_samples;
+	now = imp_now();
+	c->next_glitch = imp_next_event(c, now, config->params.cas_glitches_per_min);
+	c->next_flap = imp_next_event(c, now, config->params.alarm_flaps_per_min);
+	r2chan->io_impair = c;
+	return c;
+}
+
+/* the queue is kept in delivery order, a glitch may outlast line changes queued after it */
+static void imp_queue_cas(imp_chan_t *c, int kind, int cas, uint64_t due)
+{
+	int i;
+	if (c->pending_count == IMP_MAX_PENDING_CAS) {
+		/* the line is flapping faster than we deliver it, drop the oldest change */
+		c->pending_count--;
+		memmove(&c->pending[0], &c->pending[1], c->pending_count * sizeof(c->pending[0]));
+	}
+	for (i = c->pending_count; i > 0 && c->pending[i - 1].due > due; i--) {
+		c->pending[i] = c->pending[i - 1];
+	}
+	c->pending[i].kind = kind;
+	c->pending[i].cas = cas;
+	c->pending[i].due = due;
+	c->pending_count++;
+}
+
+/* starts the spontaneous events that are due, returns non zero if there is something to report */
+static int imp_check_events(openr2_chan_t *r2chan, imp_config_t *config, imp_chan_t *c, uint64_t now)
+{
+	int bit;
+	if (c->next_glitch && now >= c->next_glitch) {
+		/* a short hit on one of the R2 bits, the persistence check is supposed to catch it */
+		bit = (imp_rand(c) & 1) ? IMP_CAS_A : IMP_CAS_B;
+		imp_queue_cas(c, IMP_CAS_GLITCH_START, bit, now + config->delay_samples * 125);
+		imp_queue_cas(c, IMP_CAS_GLITCH_END, 0, now + config->delay_samples * 125 + config->params.cas_glitch_ms * 1000);
+		c->next_glitch = imp_next_event(c, now, config->params.cas_glitches_per_min);
+		IMP_STAT(r2chan->r2context, cas_glitches);
+	}
+	if (c->in_flap && now >= c->flap_end) {
+		c->in_flap = 0;
+		c->flap_event = OR2_OOB_EVENT_ALARM_OFF;
+		c->next_flap = imp_next_event(c, now, config->params.alarm_flaps_per_min);
+	} else if (!c->in_flap && c->next_flap && now >= c->next_flap) {
+		c->in_flap = 1;
+		c->flap_end = now + config->params.alarm_flap_ms * 1000;
+		c->flap_event = OR2_OOB_EVENT_ALARM_ON;
+		IMP_STAT(r2chan->r2context, alarm_flaps);
+	}
+	return c->flap_event || (c->pending_count && now >= c->pending[0].due);
+}
+
+/* applies the first due CAS change, returns non zero if there was one */
+static int imp_apply_cas(imp_chan_t *c, uint64_t now)
+{
+	imp_pending_cas_t *change = &c->pending[0];
+	if (!c->pending_count || now < change->due) {
+		return 0;
+	}
+	switch (change->kind) {
+	case IMP_CAS_GLITCH_START:
+		c->glitching = 1;
+		c->cas_seen = c->cas_line ^ change->cas;
+		break;
+	case IMP_CAS_GLITCH_END:
+		c->glitching = 0;
+		c->cas_seen = c->cas_line;
+		break;
+	default:
+		c->cas_line = change->cas;
+		if (!c->glitching) {
+			c->cas_seen = change->cas;
+		}
+		break;
+	}
+	c->pending_count--;
+	memmove(&c->pending[0], &c->pending[1], c->pending_count * sizeof(c->pending[0]));
+	return 1;
+}
+
+/* reads the real bits and schedules their delivery if they changed */
+static int imp_read_cas(openr2_chan_t *r2chan, imp_config_t *config, imp_chan_t *c, uint64_t now)
+{
+	int cas;
+	int res = IMPAIRED(r2chan)->get_cas(r2chan, &cas);
+	if (res) {
+		return res;
+	}
+	/* like the library, we start with all bits off */
+	if (cas != c->cas_real) {
+		c->cas_real = cas;
+		imp_queue_cas(c, IMP_CAS_LINE, cas, now + config->delay_samples * 125);
+		if (config->delay_samples) {
+			IMP_STAT(r2chan->r2context, cas_delayed);
+		}
+	}
+	return 0;
+}
+
+static openr2_io_fd_t imp_open(openr2_context_t *r2context, int channo)
+{
+	return r2context->io_impaired->open(r2context, channo);
+}
+
+static int imp_close(openr2_chan_t *r2chan)
+{
+	if (r2chan->io_impair) {
+		free(r2chan->io_impair);
+		r2chan->io_impair = NULL;
+	}
+	return IMPAIRED(r2chan)->close(r2chan);
+}
+
+static int imp_setup(openr2_chan_t *r2chan)
+{
+	int res = IMPAIRED(r2chan)->setup(r2chan);
+	imp_get_chan(r2chan);
+	return res;
+}
+
+static int imp_set_cas(openr2_chan_t *r2chan, int cas)
+{
+	return IMPAIRED(r2chan)->set_cas(r2chan, cas);
+}
+
+static int imp_get_cas(openr2_chan_t *r2chan, int *cas)
+{
+	uint64_t now = imp_now();
+	int res;
+	IMP_CHAN(r2chan);
+	res = imp_read_cas(r2chan, config, c, now);
+	if (res) {
+		return res;
+	}
+	imp_check_events(r2chan, config, c, now);
+	while (imp_apply_cas(c, now));
+	*cas = c->cas_seen;
+	return 0;
+}
+
+static int imp_flush_write_buffers(openr2_chan_t *r2chan)
+{
+	return IMPAIRED(r2chan)->flush_write_buffers(r2chan);
+}
+
+static int imp_write(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	return IMPAIRED(r2chan)->write(r2chan, buf, size);
+}
+
+static int16_t imp_process_sample(openr2_chan_t *r2chan, imp_config_t *config, imp_chan_t *c, uint8_t alaw)
+{
+	float x = TI(r2chan)->alaw_to_linear(alaw);
+	float noise;
+	if (config->params.twist_db) {
+		c->lowpass += config->lowpass_coef * (x - c->lowpass);
+		x = (c->lowpass * config->low_gain) + ((x - c->lowpass) * config->high_gain);
+	}
+	x *= config->gain;
+	if (config->noise_rms > 0.0f) {
+		/* close enough to gaussian: the sum of 4 uniforms has a variance of 1/3 */
+		noise = imp_randf(c) + imp_randf(c) + imp_randf(c) + imp_randf(c) - 2.0f;
+		x += noise * 1.7320508f * config->noise_rms;
+	}
+	if (x > 32767.0f) {
+		x = 32767.0f;
+	} else if (x < -32768.0f) {
+		x = -32768.0f;
+	}
+	return (int16_t)x;
+}
+
+static int imp_read(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	uint8_t *rbuf = (uint8_t *)buf;
+	unsigned start;
+	int res, i, delay;
+	IMP_CHAN(r2chan);
+	if (size > IMP_HISTORY_SIZE - (IMP_MAX_DELAY_MS * 8)) {
+		size = IMP_HISTORY_SIZE - (IMP_MAX_DELAY_MS * 8);
+	}
+	res = IMPAIRED(r2chan)->read(r2chan, buf, size);
+	if (res <= 0) {
+		return res;
+	}
+	IMP_STAT(r2chan->r2context, frames);
+	if (config->params.drop_per_mille && (int)(imp_rand(c) % 1000) < config->params.drop_per_mille) {
+		/* the frame never makes it, the delay line does not see it either */
+		IMP_STAT(r2chan->r2context, frames_dropped);
+		return 0;
+	}
+	for (i = 0; i < res; i++) {
+		c->history[(c->rx_pos + i) % IMP_HISTORY_SIZE] = rbuf[i];
+	}
+	c->rx_pos = (c->rx_pos + res) % IMP_HISTORY_SIZE;
+	/* the jitter is drawn again on every frame, going back and forth in the history slips samples */
+	delay = config->delay_samples;
+	if (config->jitter_samples) {
+		delay += imp_rand(c) % (config->jitter_samples + 1);
+	}
+	if (delay != c->last_delay) {
+		__atomic_fetch_add(&config->stats.samples_slipped, (unsigned long)abs(delay - c->last_delay), __ATOMIC_RELAXED);
+		c->last_delay = delay;
+	}
+	start = (c->rx_pos + IMP_HISTORY_SIZE - res - delay) % IMP_HISTORY_SIZE;
+	for (i = 0; i < res; i++) {
+		rbuf[i] = TI(r2chan)->linear_to_alaw(imp_process_sample(r2chan, config, c, c->history[(start + i) % IMP_HISTORY_SIZE]));
+	}
+	return res;
+}
+
+static int imp_wait(openr2_chan_t *r2chan, int *flags, int block)
+{
+	int requested, res;
+	IMP_CHAN(r2chan);
+	if (!flags || !*flags) {
+		return -1;
+	}
+	requested = *flags;
+	for ( ; ; ) {
+		*flags = requested;
+		/* our own events are not on the descriptor, do not sleep on it when they may come */
+		res = IMPAIRED(r2chan)->wait(r2chan, flags, (block && !(requested & OR2_IO_OOB_EVENT)) ? 1 : 0);
+		if (res) {
+			return res;
+		}
+		if ((requested & OR2_IO_OOB_EVENT) && imp_check_events(r2chan, config, c, imp_now())) {
+			*flags |= OR2_IO_OOB_EVENT;
+		}
+		if (*flags || !block) {
+			return 0;
+		}
+		usleep(1000);
+	}
+	return 0;
+}
+
+static int imp_get_oob_event(openr2_chan_t *r2chan, openr2_oob_event_t *event)
+{
+	uint64_t now = imp_now();
+	int res;
+	IMP_CHAN(r2chan);
+	res = IMPAIRED(r2chan)->get_oob_event(r2chan, event);
+	if (res) {
+		return res;
+	}
+	if (*event == OR2_OOB_EVENT_CAS_CHANGE) {
+		/* reported when its delay expires */
+		res = imp_read_cas(r2chan, config, c, now);
+		if (res) {
+			return res;
+		}
+		*event = OR2_OOB_EVENT_NONE;
+	}
+	if (*event != OR2_OOB_EVENT_NONE) {
+		return 0;
+	}
+	imp_check_events(r2chan, config, c, now);
+	if (c->flap_event) {
+		*event = c->flap_event;
+		c->flap_event = 0;
+	} else if (c->pending_count && now >= c->pending[0].due) {
+		/* the library reads the bits next, get_cas applies the change */
+		*event = OR2_OOB_EVENT_CAS_CHANGE;
+	}
+	return 0;
+}
+
+static int imp_get_alarm_state(openr2_chan_t *r2chan, int *alarm)
+{
+	imp_chan_t *c = imp_get_chan(r2chan);
+	int res;
+	if (!c) {
+		return -1;
+	}
+	res = IMPAIRED(r2chan)->get_alarm_state(r2chan, alarm);
+	if (!res && c->in_flap) {
+		*alarm = 1;
+	}
+	return res;
+}
+
+static int imp_play_loop(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	if (!IMPAIRED(r2chan)->play_loop) {
+		return -1;
+	}
+	return IMPAIRED(r2chan)->play_loop(r2chan, buf, size);
+}
+
+static int imp_stop_loop(openr2_chan_t *r2chan)
+{
+	if (!IMPAIRED(r2chan)->stop_loop) {
+		return 0;
+	}
+	return IMPAIRED(r2chan)->stop_loop(r2chan);
+}
+
+static openr2_io_interface_t imp_io_interface = {
+	/* .open */ imp_open,
+	/* .close */ imp_close,
+	/* .set_cas */ imp_set_cas,
+	/* .get_cas */ imp_get_cas,
+	/* .flush_write_buffers */ imp_flush_write_buffers,
+	/* .write */ imp_write,
+	/* .read */ imp_read,
+	/* .setup */ imp_setup,
+	/* .wait */ imp_wait,
+	/* .get_oob_event */ imp_get_oob_event,
+	/* .get_alarm_state */ imp_get_alarm_state,
+	/* .play_loop */ imp_play_loop,
+	/* .stop_loop */ imp_stop_loop
+};
+
+openr2_io_interface_t *openr2_io_get_impair_interface(void)
+{
+	return &imp_io_interface;
+}
+
+int openr2_io_impair_configure(openr2_context_t *r2context, const openr2_impairments_t *impairments)
+{
+	imp_config_t *config = r2context->io_impair;
+	const openr2_impairments_t *p = impairments;
+	if (p->delay_ms < 0 || p->jitter_ms < 0 || p->delay_ms + p->jitter_ms > IMP_MAX_DELAY_MS
+	    || p->drop_per_mille < 0 || p->drop_per_mille > 1000 || p->attenuation_db < 0
+	    || p->cas_glitch_ms < 0 || p->alarm_flap_ms < 0 || p->noise_dbm0 > 0) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Invalid line impairments\n");
+		return -1;
+	}
+	if (!config) {
+		config = calloc(1, sizeof(*config));
+		if (!config) {
+			r2context->last_error = OR2_LIBERR_OUT_OF_MEMORY;
+			return -1;
+		}
+		r2context->io_impair = config;
+	}
+	/* channels pick the changes up on their next operation, the statistics keep counting */
+	config->params = *p;
+	config->delay_samples = p->delay_ms * (IMP_SAMPLE_RATE / 1000);
+	config->jitter_samples = p->jitter_ms * (IMP_SAMPLE_RATE / 1000);
+	config->gain = powf(10.0f, -p->attenuation_db / 20.0f);
+	/* positive twist makes the high frequencies louder, half the tilt on each side */
+	config->high_gain = powf(10.0f, p->twist_db / 40.0f);
+	config->low_gain = 1.0f / config->high_gain;
+	config->lowpass_coef = 1.0f - expf(-2.0f * (float)M_PI * IMP_TWIST_HZ / IMP_SAMPLE_RATE);
+	config->noise_rms = p->noise_dbm0 ? IMP_0DBM0_RMS * powf(10.0f, p->noise_dbm0 / 20.0f) : 0.0f;
+	return 0;
+}
+
+int openr2_io_impair_get_stats(openr2_context_t *r2context, openr2_impairment_stats_t *stats)
+{
+	imp_config_t *config = r2context->io_impair;
+	if (!config) {
+		return -1;
+	}
+	stats->frames = __atomic_load_n(&config->stats.frames, __ATOMIC_RELAXED);
+	stats->frames_dropped = __atomic_load_n(&config->stats.frames_dropped, __ATOMIC_RELAXED);
+	stats->samples_slipped = __atomic_load_n(&config->stats.samples_slipped, __ATOMIC_RELAXED);
+	stats->cas_delayed = __atomic_load_n(&config->stats.cas_delayed, __ATOMIC_RELAXED);
+	stats->cas_glitches = __atomic_load_n(&config->stats.cas_glitches, __ATOMIC_RELAXED);
+	stats->alarm_flaps = __atomic_load_n(&config->stats.alarm_flaps, __ATOMIC_RELAXED);
+	return 0;
+}
+
+void openr2_io_impair_destroy(openr2_context_t *r2context)
+{
+	/* channels freed their state on close */
+	if (r2context->io_impair) {
+		free(r2context->io_impair);
+		r2context->io_impair = NULL;
+	}
+}
@@ -0,0 +1,662 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * In-memory loopback I/O backend. Opening the same channel number twice
+ * (usually from two contexts, one per trunk side) connects both channels
+ * back to back inside the process. CAS bits written by one side are the rx
+ * bits of the other and raise a CAS change OOB event there. Audio goes
+ * through a lock-free ring per direction and is delivered at 8000 samples
+ * per second by a virtual clock. Each channel descriptor is an eventfd that
+ * becomes readable when the channel has something to report, so channels
+ * can be polled with poll(), epoll() or openr2_io_wait() as usual.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef __linux__
+/* clock_nanosleep() and eventfd() */
+#define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include "openr2/r2log-pvt.h"
+#include "openr2/r2chan-pvt.h"
+#include "openr2/r2context-pvt.h"
+#include "openr2/r2utils-pvt.h"
+#include "openr2/r2ioabs.h"
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <time.h>
+#include "openr2/queue.h"
+
+/* virtual clock tick, one read buffer worth of samples */
+#define LOOP_TICK_SAMPLES OR2_CHAN_READ_SIZE
+#define LOOP_TICK_NS (LOOP_TICK_SAMPLES * 125000)
+
+/* audio bytes that can be in flight in each direction, like the driver buffers */
+#define LOOP_RING_SIZE (OR2_CHAN_IO_NUMBUFS * OR2_CHAN_READ_SIZE)
+
+/* ALAW encoded silence, sent when the far end is not writing */
+#define LOOP_ALAW_SILENCE 0xD5
+
+/* longest tone loop we accept, one second */
+#define LOOP_TONE_MAX_SIZE 8000
+
+/* pending OOB events */
+#define LOOP_EV_CAS (1 << 0)
+#define LOOP_EV_ALARM_ON (1 << 1)
+#define LOOP_EV_ALARM_OFF (1 << 2)
+
+struct loop_link;
+
+typedef struct loop_end {
+	/* eventfd handed to the channel as its descriptor, -1 when closed */
+	int efd;
+	/* CAS bits written by this side and the far end bits get_cas_span last reported */
+	volatile int cas_tx;
+	int cas_span_seen;
+	/* LOOP_EV_* flags waiting for get_oob_event */
+	volatile int events;
+	/* virtual clock value when this side started to receive and samples read since then */
+	uint64_t rx_start;
+	uint64_t rx_read;
+	/* audio written by the other side, this side is the only reader */
+	queue_state_t *rx;
+	/* tone the other side plays when this side ran out of written audio */
+	pthread_mutex_t tx_loop_lock;
+	volatile int tx_loop_len;
+	int tx_loop_pos;
+	uint8_t tx_loop[LOOP_TONE_MAX_SIZE];
+	struct loop_link *link;
+} loop_end_t;
+
+typedef struct loop_link {
+	int channo;
+	loop_end_t ends[2];
+	struct loop_link *next;
+} loop_link_t;
+
+/* protects the link list, the link ends being opened or closed and the clock thread state */
+static pthread_mutex_t loop_lock = PTHREAD_MUTEX_INITIALIZER;
+static loop_link_t *loop_links = NULL;
+static int loop_open_ends = 0;
+static int loop_clock_running = 0;
+
+/* virtual clock in samples, only the clock thread writes it */
+static volatile uint64_t loop_clock = 0;
+
+static uint64_t loop_clock_now(void)
+{
+	return __atomic_load_n(&loop_clock, __ATOMIC_ACQUIRE);
+}
+
+static void loop_kick(loop_end_t *end)
+{
+	uint64_t one = 1;
+	if (end->efd != -1) {
+		/* only fails if the counter is about to overflow, which means it is readable anyway */
+		if (write(end->efd, &one, sizeof(one)) != sizeof(one)) {
+			return;
+		}
+	}
+}
+
+static void loop_post_event(loop_end_t *end, int event)
+{
+	int clear = 0;
+	if (event == LOOP_EV_ALARM_ON) {
+		clear = LOOP_EV_ALARM_OFF;
+	} else if (event == LOOP_EV_ALARM_OFF) {
+		clear = LOOP_EV_ALARM_ON;
+	}
+	if (clear) {
+		__atomic_fetch_and(&end->events, ~clear, __ATOMIC_ACQ_REL);
+	}
+	__atomic_fetch_or(&end->events, event, __ATOMIC_ACQ_REL);
+	loop_kick(end);
+}
+
+static loop_end_t *loop_peer(loop_end_t *end)
+{
+	loop_end_t *peer = (end == &end->link->ends[0]) ? &end->link->ends[1] : &end->link->ends[0];
+	return (peer->efd != -1) ? peer : NULL;
+}
+
+static void *loop_clock_run(openr2_thread_t *thread, void *data)
+{
+	struct timespec next;
+	loop_link_t *link;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for ( ; ; ) {
+		next.tv_nsec += LOOP_TICK_NS;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		pthread_mutex_lock(&loop_lock);
+		if (!loop_open_ends) {
+			loop_clock_running = 0;
+			pthread_mutex_unlock(&loop_lock);
+			break;
+		}
+		__atomic_store_n(&loop_clock, loop_clock + LOOP_TICK_SAMPLES, __ATOMIC_RELEASE);
+		/* a new frame is ready on every channel */
+		for (link = loop_links; link; link = link->next) {
+			loop_kick(&link->ends[0]);
+			loop_kick(&link->ends[1]);
+		}
+		pthread_mutex_unlock(&loop_lock);
+	}
+	return NULL;
+}
+
+/*! \brief must be called with loop_lock held */
+static loop_end_t *loop_find_end(int efd)
+{
+	loop_link_t *link;
+	for (link = loop_links; link; link = link->next) {
+		if (link->ends[0].efd == efd) {
+			return &link->ends[0];
+		}
+		if (link->ends[1].efd == efd) {
+			return &link->ends[1];
+		}
+	}
+	return NULL;
+}
+
+/* channels opened by us have the end attached on setup, channels
+   created with openr2_chan_new_from_fd() get it on first use */
+static loop_end_t *loop_get_end(openr2_chan_t *r2chan)
+{
+	if (!r2chan->io_private) {
+		pthread_mutex_lock(&loop_lock);
+		r2chan->io_private = loop_find_end((int)(long)r2chan->fd);
+		pthread_mutex_unlock(&loop_lock);
+		if (!r2chan->io_private) {
+			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Descriptor %ld is not a loopback channel\n", (long)r2chan->fd);
+		}
+	}
+	return r2chan->io_private;
+}
+
+#define LOOP_END(r2chan) loop_end_t *end = loop_get_end(r2chan); \
+	if (!end) { \
+		return -1; \
+	}
+
+static openr2_io_fd_t loop_open(openr2_context_t *r2context, int channo)
+{
+	loop_link_t *link;
+	loop_end_t *end = NULL, *peer = NULL;
+	int efd;
+
+	pthread_mutex_lock(&loop_lock);
+	for (link = loop_links; link; link = link->next) {
+		if (link->channo != channo) {
+			continue;
+		}
+		if (link->ends[0].efd == -1) {
+			end = &link->ends[0];
+			peer = &link->ends[1];
+		} else if (link->ends[1].efd == -1) {
+			end = &link->ends[1];
+			peer = &link->ends[0];
+		} else {
+			pthread_mutex_unlock(&loop_lock);
+			r2context->last_error = OR2_LIBERR_INVALID_CHAN_NUMBER;
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Loopback channel %d is already open on both sides\n", channo);
+			return NULL;
+		}
+		break;
+	}
+	if (!link) {
+		link = calloc(1, sizeof(*link));
+		if (!link) {
+			pthread_mutex_unlock(&loop_lock);
+			r2context->last_error = OR2_LIBERR_OUT_OF_MEMORY;
+			return NULL;
+		}
+		link->channo = channo;
+		link->ends[0].link = link;
+		link->ends[1].link = link;
+		link->ends[0].efd = -1;
+		link->ends[1].efd = -1;
+		link->ends[0].rx = queue_init(NULL, LOOP_RING_SIZE, 0);
+		link->ends[1].rx = queue_init(NULL, LOOP_RING_SIZE, 0);
+		pthread_mutex_init(&link->ends[0].tx_loop_lock, NULL);
+		pthread_mutex_init(&link->ends[1].tx_loop_lock, NULL);
+		if (!link->ends[0].rx || !link->ends[1].rx) {
+			pthread_mutex_unlock(&loop_lock);
+			r2context->last_error = OR2_LIBERR_OUT_OF_MEMORY;
+			if (link->ends[0].rx) {
+				queue_free(link->ends[0].rx);
+			}
+			if (link->ends[1].rx) {
+				queue_free(link->ends[1].rx);
+			}
+			free(link);
+			return NULL;
+		}
+		link->next = loop_links;
+		loop_links = link;
+		end = &link->ends[0];
+		peer = &link->ends[1];
+	}
+
+	efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (efd == -1) {
+		pthread_mutex_unlock(&loop_lock);
+		r2context->last_error = OR2_LIBERR_SYSCALL_FAILED;
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to create loopback channel %d eventfd (%s)\n", channo, strerror(errno));
+		return NULL;
+	}
+
+	/* nothing the previous user of this side left unread is valid */
+	queue_flush(end->rx);
+	end->events = 0;
+	end->cas_tx = 0;
+	end->cas_span_seen = 0;
+	end->rx_start = loop_clock_now();
+	end->rx_read = 0;
+	end->efd = efd;
+	end->tx_loop_len = 0;
+
+	/* the other side was alone and in alarm until now */
+	if (peer->efd != -1) {
+		loop_post_event(peer, LOOP_EV_ALARM_OFF);
+	}
+
+	loop_open_ends++;
+	if (!loop_clock_running) {
+		if (openr2_thread_create_detached(loop_clock_run, NULL) != OR2_SUCCESS) {
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to start the loopback clock, no audio will flow\n");
+		} else {
+			loop_clock_running = 1;
+		}
+	}
+	pthread_mutex_unlock(&loop_lock);
+	return (openr2_io_fd_t)(long)efd;
+}
+
+static int loop_close(openr2_chan_t *r2chan)
+{
+	loop_end_t *peer;
+	LOOP_END(r2chan);
+	pthread_mutex_lock(&loop_lock);
+	close(end->efd);
+	end->efd = -1;
+	peer = loop_peer(end);
+	if (peer) {
+		/* the far end just lost its line */
+		__atomic_store_n(&peer->tx_loop_len, 0, __ATOMIC_RELEASE);
+		loop_post_event(peer, LOOP_EV_ALARM_ON);
+	}
+	loop_open_ends--;
+	r2chan->io_private = NULL;
+	/* links are kept for reuse, the other side may still be using this one */
+	pthread_mutex_unlock(&loop_lock);
+	return 0;
+}
+
+static int loop_setup(openr2_chan_t *r2chan)
+{
+	LOOP_END(r2chan);
+	return 0;
+}
+
+static int loop_set_cas(openr2_chan_t *r2chan, int cas)
+{
+	loop_end_t *peer;
+	LOOP_END(r2chan);
+	__atomic_store_n(&end->cas_tx, cas, __ATOMIC_RELEASE);
+	/* the far end may be closing its descriptor, CAS changes are rare enough to just lock */
+	pthread_mutex_lock(&loop_lock);
+	peer = loop_peer(end);
+	if (peer) {
+		loop_post_event(peer, LOOP_EV_CAS);
+	}
+	pthread_mutex_unlock(&loop_lock);
+	return 0;
+}
+
+static int loop_get_cas(openr2_chan_t *r2chan, int *cas)
+{
+	loop_end_t *peer;
+	LOOP_END(r2chan);
+	peer = loop_peer(end);
+	/* nobody drives the line when the other side is not open */
+	*cas = peer ? __atomic_load_n(&peer->cas_tx, __ATOMIC_ACQUIRE) : 0;
+	return 0;
+}
+
+static int loop_get_alarm_state(openr2_chan_t *r2chan, int *alarm)
+{
+	LOOP_END(r2chan);
+	*alarm = loop_peer(end) ? 0 : 1;
+	return 0;
+}
+
+static int loop_get_oob_event(openr2_chan_t *r2chan, openr2_oob_event_t *event)
+{
+	int events;
+	LOOP_END(r2chan);
+	*event = OR2_OOB_EVENT_NONE;
+	events = __atomic_load_n(&end->events, __ATOMIC_ACQUIRE);
+	/* alarms first, like the hardware does */
+	if (events & LOOP_EV_ALARM_ON) {
+		*event = OR2_OOB_EVENT_ALARM_ON;
+		__atomic_fetch_and(&end->events, ~LOOP_EV_ALARM_ON, __ATOMIC_ACQ_REL);
+	} else if (events & LOOP_EV_ALARM_OFF) {
+		*event = OR2_OOB_EVENT_ALARM_OFF;
+		__atomic_fetch_and(&end->events, ~LOOP_EV_ALARM_OFF, __ATOMIC_ACQ_REL);
+	} else if (events & LOOP_EV_CAS) {
+		*event = OR2_OOB_EVENT_CAS_CHANGE;
+		__atomic_fetch_and(&end->events, ~LOOP_EV_CAS, __ATOMIC_ACQ_REL);
+	}
+	return 0;
+}
+
+static int loop_flush_write_buffers(openr2_chan_t *r2chan)
+{
+	LOOP_END(r2chan);
+	/* the ring belongs to the reader, what is in flight (at most LOOP_RING_SIZE samples) is played out */
+	return 0;
+}
+
+/* samples the virtual clock delivered to this side and it did not read yet */
+static int loop_rx_due(loop_end_t *end)
+{
+	uint64_t due = loop_clock_now() - end->rx_start - end->rx_read;
+	return (due > (uint64_t)LOOP_RING_SIZE * 2) ? (LOOP_RING_SIZE * 2) : (int)due;
+}
+
+static int loop_read(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	uint8_t *rbuf = (uint8_t *)buf;
+	loop_end_t *peer;
+	int due, got, chunk;
+	LOOP_END(r2chan);
+	due = loop_rx_due(end);
+	if (due > LOOP_RING_SIZE) {
+		/* we were not read in time, the driver buffers would have overflowed */
+		end->rx_read = loop_clock_now() - end->rx_start - LOOP_RING_SIZE;
+		queue_flush(end->rx);
+		due = LOOP_RING_SIZE;
+	}
+	if (size > due) {
+		size = due;
+	}
+	got = queue_read(end->rx, rbuf, size);
+	if (got < size) {
+		peer = loop_peer(end);
+		if (peer && __atomic_load_n(&end->tx_loop_len, __ATOMIC_ACQUIRE)) {
+			/* the far end handed us a tone to repeat once its written audio is out */
+			pthread_mutex_lock(&end->tx_loop_lock);
+			while (got < size && end->tx_loop_len) {
+				chunk = end->tx_loop_len - end->tx_loop_pos;
+				if (chunk > size - got) {
+					chunk = size - got;
+				}
+				memcpy(rbuf + got, end->tx_loop + end->tx_loop_pos, chunk);
+				got += chunk;
+				end->tx_loop_pos = (end->tx_loop_pos + chunk) % end->tx_loop_len;
+			}
+			pthread_mutex_unlock(&end->tx_loop_lock);
+		}
+	}
+	if (got < size) {
+		memset(rbuf + got, LOOP_ALAW_SILENCE, size - got);
+	}
+	end->rx_read += size;
+	return size;
+}
+
+static int loop_write(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	loop_end_t *peer;
+	LOOP_END(r2chan);
+	peer = loop_peer(end);
+	if (!peer) {
+		/* nobody listening, the audio goes nowhere */
+		return size;
+	}
+	return queue_write(peer->rx, buf, size);
+}
+
+static int loop_play_loop(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	loop_end_t *peer;
+	LOOP_END(r2chan);
+	if (size <= 0 || size > LOOP_TONE_MAX_SIZE) {
+		return -1;
+	}
+	pthread_mutex_lock(&loop_lock);
+	peer = loop_peer(end);
+	if (peer) {
+		/* the loop lives with the reader, like the written audio */
+		pthread_mutex_lock(&peer->tx_loop_lock);
+		memcpy(peer->tx_loop, buf, size);
+		peer->tx_loop_pos = 0;
+		__atomic_store_n(&peer->tx_loop_len, size, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&peer->tx_loop_lock);
+	}
+	pthread_mutex_unlock(&loop_lock);
+	return 0;
+}
+
+static int loop_stop_loop(openr2_chan_t *r2chan)
+{
+	loop_end_t *peer;
+	LOOP_END(r2chan);
+	pthread_mutex_lock(&loop_lock);
+	peer = loop_peer(end);
+	if (peer) {
+		pthread_mutex_lock(&peer->tx_loop_lock);
+		__atomic_store_n(&peer->tx_loop_len, 0, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&peer->tx_loop_lock);
+	}
+	pthread_mutex_unlock(&loop_lock);
+	return 0;
+}
+
+static int loop_ready_flags(loop_end_t *end, int flags)
+{
+	loop_end_t *peer;
+	int ready = 0;
+	if ((flags & OR2_IO_READ) && loop_rx_due(end) >= OR2_CHAN_READ_SIZE) {
+		ready |= OR2_IO_READ;
+	}
+	if (flags & OR2_IO_WRITE) {
+		peer = loop_peer(end);
+		if (!peer || queue_free_space(peer->rx) >= OR2_CHAN_READ_SIZE) {
+			ready |= OR2_IO_WRITE;
+		}
+	}
+	if ((flags & OR2_IO_OOB_EVENT) && __atomic_load_n(&end->events, __ATOMIC_ACQUIRE)) {
+		ready |= OR2_IO_OOB_EVENT;
+	}
+	return ready;
+}
+
+static int loop_wait(openr2_chan_t *r2chan, int *flags, int block)
+{
+	struct pollfd pfd;
+	uint64_t count;
+	int ready, res;
+	LOOP_END(r2chan);
+	if (!flags || !*flags) {
+		return -1;
+	}
+	for ( ; ; ) {
+		/* consume the wake ups first so the descriptor only polls readable again on news */
+		if (read(end->efd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+			EMI(r2chan)->on_os_error(r2chan, errno);
+			return -1;
+		}
+		ready = loop_ready_flags(end, *flags);
+		if (ready || !block) {
+			*flags = ready;
+			return 0;
+		}
+		pfd.fd = end->efd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		/* do not sleep past the protocol timers */
+		res = poll(&pfd, 1, openr2_chan_get_time_to_next_event(r2chan));
+		if (res == -1 && errno != EINTR) {
+			EMI(r2chan)->on_os_error(r2chan, errno);
+			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Failed to wait for loopback channel: %s\n", strerror(errno));
+			return -1;
+		}
+		if (!res) {
+			*flags = 0;
+			return 0;
+		}
+	}
+	return 0;
+}
+
+static int loop_wait_span(openr2_context_t *r2context, openr2_chan_t *chans[], int flags[], int n, int block)
+{
+	struct pollfd pfds[OR2_IO_MAX_SPAN_CHANS];
+	loop_end_t *ends[OR2_IO_MAX_SPAN_CHANS];
+	int ready[OR2_IO_MAX_SPAN_CHANS];
+	uint64_t count;
+	int i, any, res;
+	if (n > OR2_IO_MAX_SPAN_CHANS) {
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		ends[i] = loop_get_end(chans[i]);
+		if (!ends[i]) {
+			return -1;
+		}
+		pfds[i].fd = ends[i]->efd;
+		pfds[i].events = POLLIN;
+	}
+	for ( ; ; ) {
+		any = 0;
+		for (i = 0; i < n; i++) {
+			if (read(ends[i]->efd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+				EMI(chans[i])->on_os_error(chans[i], errno);
+				return -1;
+			}
+			ready[i] = loop_ready_flags(ends[i], flags[i]);
+			any |= ready[i];
+		}
+		if (any || !block) {
+			memcpy(flags, ready, n * sizeof(flags[0]));
+			return 0;
+		}
+		for (i = 0; i < n; i++) {
+			pfds[i].revents = 0;
+		}
+		res = poll(pfds, n, openr2_context_get_time_to_next_event(r2context));
+		if (res == -1 && errno != EINTR) {
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to wait for loopback span: %s\n", strerror(errno));
+			return -1;
+		}
+		if (!res) {
+			memset(flags, 0, n * sizeof(flags[0]));
+			return 0;
+		}
+	}
+	return 0;
+}
+
+static int loop_read_span(openr2_context_t *r2context, openr2_chan_t *chans[], void *bufs[], int sizes[], int n)
+{
+	int i;
+	for (i = 0; i < n; i++) {
+		sizes[i] = loop_read(chans[i], bufs[i], sizes[i]);
+	}
+	return 0;
+}
+
+static int loop_write_span(openr2_context_t *r2context, openr2_chan_t *chans[], const void *bufs[], int sizes[], int n)
+{
+	int i;
+	for (i = 0; i < n; i++) {
+		sizes[i] = loop_write(chans[i], bufs[i], sizes[i]);
+	}
+	return 0;
+}
+
+static int loop_get_cas_span(openr2_context_t *r2context, openr2_chan_t *chans[], int cas[], int n, uint32_t *changed)
+{
+	loop_end_t *end;
+	int i;
+	*changed = 0;
+	for (i = 0; i < n; i++) {
+		end = loop_get_end(chans[i]);
+		if (!end || loop_get_cas(chans[i], &cas[i])) {
+			return -1;
+		}
+		if (cas[i] != end->cas_span_seen) {
+			end->cas_span_seen = cas[i];
+			*changed |= (1u << i);
+		}
+	}
+	return 0;
+}
+
+static openr2_io_interface_t loop_io_interface = {
+	/* .open */ loop_open,
+	/* .close */ loop_close,
+	/* .set_cas */ loop_set_cas,
+	/* .get_cas */ loop_get_cas,
+	/* .flush_write_buffers */ loop_flush_write_buffers,
+	/* .write */ loop_write,
+	/* .read */ loop_read,
+	/* .setup */ loop_setup,
+	/* .wait */ loop_wait,
+	/* .get_oob_event */ loop_get_oob_event,
+	/* .get_alarm_state */ loop_get_alarm_state,
+	/* .play_loop */ loop_play_loop,
+	/* .stop_loop */ loop_stop_loop,
+	/* .wait_span */ loop_wait_span,
+	/* .read_span */ loop_read_span,
+	/* .write_span */ loop_write_span,
+	/* .get_cas_span */ loop_get_cas_span
+};
+
+openr2_io_interface_t *openr2_io_get_loopback_interface(void)
+{
+	return &loop_io_interface;
+}
+
+#else
+
+openr2_io_interface_t *openr2_io_get_loopback_interface(void)
+{
+	return NULL;
+}
+
+#endif
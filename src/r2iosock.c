@@ -0,0 +1,866 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * UNIX socket I/O backend. Each channel, or each span when the context is
+ * configured to multiplex spans, is carried over one SOCK_SEQPACKET UNIX
+ * socket so both sides of a trunk can live in different processes. Every
+ * packet is one frame with a 4 byte header (type, channel slot in the span
+ * and payload length) followed by the payload:
+ *
+ *   SOCK_FRAME_AUDIO  up to OR2_CHAN_READ_SIZE ALAW samples
+ *   SOCK_FRAME_CAS    1 byte with the ABCD bits the sender is transmitting
+ *   SOCK_FRAME_ALARM  1 byte, 0 when the sender channel is open, 1 when closed
+ *   SOCK_FRAME_FLUSH  no payload, audio not played yet must be discarded
+ *
+ * Sockets live in the directory given with openr2_context_set_socket_io().
+ * The first side opening a socket binds and listens on it, the other side
+ * connects. The listening descriptor is replaced in place (dup2) by the
+ * connection once accepted, so the descriptor handed to the user never
+ * changes, and a side whose peer goes away listens again for a new one.
+ * Connected descriptors (i.e. one end of a socketpair) can also be given to
+ * openr2_chan_new_from_fd(), in which case the descriptor stays owned by the
+ * user and the channel stays in alarm once the peer hangs up.
+ *
+ * There is no common clock between the two processes, each channel paces its
+ * reads and writes to 8000 samples per second from the monotonic clock. The
+ * descriptor only polls readable on socket traffic, so users polling it must
+ * not wait longer than a read period (20ms) while reading is enabled.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef __linux__
+/* clock_gettime() and MSG_NOSIGNAL */
+#define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include "openr2/r2log-pvt.h"
+#include "openr2/r2chan-pvt.h"
+#include "openr2/r2context-pvt.h"
+#include "openr2/r2utils-pvt.h"
+#include "openr2/r2ioabs.h"
+
+#ifdef HAVE_SYS_UN_H
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include "openr2/queue.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* an E1 has 30 voice timeslots, allow for the full 31 in case someone uses 16 */
+#define SOCK_MAX_SLOTS 31
+
+/* audio bytes buffered in each direction, like the driver buffers */
+#define SOCK_RING_SIZE (OR2_CHAN_IO_NUMBUFS * OR2_CHAN_READ_SIZE)
+
+/* the two processes do not run in lock step, leave room for their jitter */
+#define SOCK_RX_SIZE (SOCK_RING_SIZE * 2)
+
+/* ALAW encoded silence, sent when the far end is not writing */
+#define SOCK_ALAW_SILENCE 0xD5
+
+#define SOCK_FRAME_AUDIO 1
+#define SOCK_FRAME_CAS 2
+#define SOCK_FRAME_ALARM 3
+#define SOCK_FRAME_FLUSH 4
+
+/* pending OOB events */
+#define SOCK_EV_CAS (1 << 0)
+#define SOCK_EV_ALARM_ON (1 << 1)
+#define SOCK_EV_ALARM_OFF (1 << 2)
+
+typedef struct sock_frame_hdr {
+	uint8_t type;
+	uint8_t slot;
+	uint16_t len;
+} sock_frame_hdr_t;
+
+typedef enum {
+	SOCK_DOWN,
+	SOCK_LISTENING,
+	SOCK_CONNECTED
+} sock_state_t;
+
+struct sock_span;
+
+typedef struct sock_slot {
+	struct sock_span *span;
+	int number;
+	/* a local channel is using this slot */
+	int open;
+	/* CAS bits written by this side */
+	int cas_tx;
+	/* the far end has this slot open and the CAS bits it transmits */
+	int remote_open;
+	int remote_cas;
+	/* SOCK_EV_* flags waiting for get_oob_event */
+	int events;
+	/* monotonic clock in ns when the slot was opened, samples read and written since then */
+	uint64_t start_ns;
+	uint64_t rx_read;
+	uint64_t tx_sent;
+	/* audio received from the far end */
+	queue_state_t *rx;
+} sock_slot_t;
+
+typedef struct sock_span {
+	/* context that opened it, NULL for descriptors given by the user */
+	openr2_context_t *r2context;
+	char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	int fd;
+	sock_state_t state;
+	/* we created the descriptor and must close it */
+	int owned;
+	/* the socket path is bound by us and must be removed */
+	int bound;
+	int nslots;
+	int users;
+	pthread_mutex_t lock;
+	sock_slot_t slots[SOCK_MAX_SLOTS];
+	struct sock_span *next;
+} sock_span_t;
+
+/* protects the span list and the span users count */
+static pthread_mutex_t sock_lock = PTHREAD_MUTEX_INITIALIZER;
+static sock_span_t *sock_spans = NULL;
+
+static uint64_t sock_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000) + now.tv_nsec;
+}
+
+/* samples the channel clock produced since the slot was opened */
+static uint64_t sock_slot_clock(sock_slot_t *slot)
+{
+	return (sock_now_ns() - slot->start_ns) / 125000;
+}
+
+static void sock_post_event(sock_slot_t *slot, int event)
+{
+	if (!slot->open) {
+		return;
+	}
+	if (event == SOCK_EV_ALARM_ON) {
+		slot->events &= ~SOCK_EV_ALARM_OFF;
+	} else if (event == SOCK_EV_ALARM_OFF) {
+		slot->events &= ~SOCK_EV_ALARM_ON;
+	}
+	slot->events |= event;
+}
+
+static void sock_set_cloexec_nonblock(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+	if (flags != -1) {
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+static void sock_span_down(sock_span_t *span);
+
+/*! \brief must be called with the span lock held */
+static int sock_send(sock_span_t *span, int type, int slot, const void *payload, int len)
+{
+	uint8_t frame[sizeof(sock_frame_hdr_t) + OR2_CHAN_READ_SIZE];
+	sock_frame_hdr_t *hdr = (sock_frame_hdr_t *)frame;
+	if (span->state != SOCK_CONNECTED) {
+		return -1;
+	}
+	hdr->type = type;
+	hdr->slot = slot;
+	hdr->len = len;
+	if (len) {
+		memcpy(frame + sizeof(*hdr), payload, len);
+	}
+	if (send(span->fd, frame, sizeof(*hdr) + len, MSG_DONTWAIT | MSG_NOSIGNAL) == -1) {
+		/* a full socket buffer only loses this frame, the far end is not reading */
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+			sock_span_down(span);
+		}
+		return -1;
+	}
+	return 0;
+}
+
+static void sock_send_state(sock_span_t *span, int slotno)
+{
+	sock_slot_t *slot = &span->slots[slotno];
+	uint8_t val = slot->open ? 0 : 1;
+	sock_send(span, SOCK_FRAME_ALARM, slotno, &val, 1);
+	if (slot->open) {
+		val = slot->cas_tx;
+		sock_send(span, SOCK_FRAME_CAS, slotno, &val, 1);
+	}
+}
+
+static void sock_span_up(sock_span_t *span)
+{
+	int i;
+	span->state = SOCK_CONNECTED;
+	/* tell the far end which of our channels are there and what they transmit */
+	for (i = 0; i < span->nslots; i++) {
+		if (span->slots[i].open) {
+			sock_send_state(span, i);
+		}
+	}
+}
+
+/*! \brief fill a socket address with the span path, fails for paths that do not fit */
+static int sock_addr(sock_span_t *span, struct sockaddr_un *addr)
+{
+	size_t len = strlen(span->path);
+	if (len >= sizeof(addr->sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	memcpy(addr->sun_path, span->path, len + 1);
+	return 0;
+}
+
+/*! \brief replace the span descriptor with a socket listening on the span path */
+static int sock_listen(sock_span_t *span)
+{
+	struct sockaddr_un addr;
+	int s;
+	if (sock_addr(span, &addr)) {
+		return -1;
+	}
+	s = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (s == -1) {
+		return -1;
+	}
+	/* whoever had the path before us is gone */
+	unlink(span->path);
+	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) || listen(s, 1)) {
+		close(s);
+		return -1;
+	}
+	span->bound = 1;
+	if (span->fd == -1) {
+		span->fd = s;
+	} else {
+		/* keep the descriptor number the user is polling */
+		dup2(s, span->fd);
+		close(s);
+	}
+	sock_set_cloexec_nonblock(span->fd);
+	span->state = SOCK_LISTENING;
+	return 0;
+}
+
+/*! \brief connect to the far end if it is already listening, listen for it otherwise */
+static int sock_connect_or_listen(sock_span_t *span)
+{
+	struct sockaddr_un addr;
+	int s, tries;
+	if (sock_addr(span, &addr)) {
+		return -1;
+	}
+	for (tries = 0; tries < 2; tries++) {
+		s = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+		if (s == -1) {
+			return -1;
+		}
+		if (!connect(s, (struct sockaddr *)&addr, sizeof(addr))) {
+			span->fd = s;
+			sock_set_cloexec_nonblock(span->fd);
+			span->state = SOCK_CONNECTED;
+			return 0;
+		}
+		close(s);
+		if (errno != ENOENT && errno != ECONNREFUSED) {
+			return -1;
+		}
+		if (errno == ENOENT) {
+			/* do not remove a path the far end may have just bound */
+			s = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+			if (s == -1) {
+				return -1;
+			}
+			if (!bind(s, (struct sockaddr *)&addr, sizeof(addr))) {
+				if (listen(s, 1)) {
+					close(s);
+					return -1;
+				}
+				span->bound = 1;
+				span->fd = s;
+				sock_set_cloexec_nonblock(span->fd);
+				span->state = SOCK_LISTENING;
+				return 0;
+			}
+			close(s);
+			if (errno != EADDRINUSE) {
+				return -1;
+			}
+			/* the far end won the race, connect to it */
+			continue;
+		}
+		/* stale socket file left by a dead process */
+		return sock_listen(span);
+	}
+	return -1;
+}
+
+static void sock_span_down(sock_span_t *span)
+{
+	int i;
+	for (i = 0; i < span->nslots; i++) {
+		if (span->slots[i].remote_open) {
+			span->slots[i].remote_open = 0;
+			span->slots[i].remote_cas = 0;
+			sock_post_event(&span->slots[i], SOCK_EV_ALARM_ON);
+		}
+	}
+	span->state = SOCK_DOWN;
+	if (span->path[0] && sock_listen(span)) {
+		if (span->r2context) {
+			openr2_log2(span->r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to listen again on %s: %s\n", span->path, strerror(errno));
+		}
+	}
+}
+
+static void sock_dispatch(sock_span_t *span, sock_frame_hdr_t *hdr, uint8_t *payload, int len)
+{
+	sock_slot_t *slot;
+	if (hdr->slot >= span->nslots || hdr->len != len) {
+		/* the far end is not speaking our protocol, just ignore it */
+		return;
+	}
+	slot = &span->slots[hdr->slot];
+	switch (hdr->type) {
+	case SOCK_FRAME_AUDIO:
+		if (slot->open) {
+			/* drops what does not fit, like a driver overrun */
+			queue_write(slot->rx, payload, len);
+		}
+		break;
+	case SOCK_FRAME_CAS:
+		if (len == 1) {
+			slot->remote_cas = payload[0];
+			sock_post_event(slot, SOCK_EV_CAS);
+		}
+		break;
+	case SOCK_FRAME_FLUSH:
+		if (slot->open) {
+			queue_flush(slot->rx);
+		}
+		break;
+	case SOCK_FRAME_ALARM:
+		if (len == 1) {
+			slot->remote_open = payload[0] ? 0 : 1;
+			if (!slot->remote_open) {
+				slot->remote_cas = 0;
+			}
+			sock_post_event(slot, slot->remote_open ? SOCK_EV_ALARM_OFF : SOCK_EV_ALARM_ON);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/*! \brief accept the far end or process everything it sent, must be called with the span lock held */
+static void sock_drain(sock_span_t *span)
+{
+	uint8_t frame[sizeof(sock_frame_hdr_t) + OR2_CHAN_READ_SIZE];
+	ssize_t res;
+	int s;
+	if (span->state == SOCK_LISTENING) {
+		s = accept(span->fd, NULL, NULL);
+		if (s == -1) {
+			return;
+		}
+		dup2(s, span->fd);
+		close(s);
+		sock_set_cloexec_nonblock(span->fd);
+		sock_span_up(span);
+	}
+	while (span->state == SOCK_CONNECTED) {
+		res = recv(span->fd, frame, sizeof(frame), MSG_DONTWAIT);
+		if (res == -1 && errno == EINTR) {
+			continue;
+		}
+		if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		if (res <= 0) {
+			/* the far end process is gone */
+			sock_span_down(span);
+			break;
+		}
+		if (res < (ssize_t)sizeof(sock_frame_hdr_t)) {
+			continue;
+		}
+		sock_dispatch(span, (sock_frame_hdr_t *)frame, frame + sizeof(sock_frame_hdr_t), res - sizeof(sock_frame_hdr_t));
+	}
+}
+
+static sock_slot_t *sock_open_slot(sock_span_t *span, int slotno, int number)
+{
+	sock_slot_t *slot = &span->slots[slotno];
+	if (!slot->rx) {
+		slot->rx = queue_init(NULL, SOCK_RX_SIZE, 0);
+		if (!slot->rx) {
+			return NULL;
+		}
+	}
+	queue_flush(slot->rx);
+	slot->span = span;
+	slot->number = number;
+	slot->events = 0;
+	slot->cas_tx = 0;
+	slot->start_ns = sock_now_ns();
+	slot->rx_read = 0;
+	slot->tx_sent = 0;
+	slot->open = 1;
+	span->users++;
+	sock_send_state(span, slotno);
+	return slot;
+}
+
+static sock_span_t *sock_span_new(openr2_context_t *r2context, int fd, int nslots)
+{
+	sock_span_t *span = calloc(1, sizeof(*span));
+	if (!span) {
+		return NULL;
+	}
+	span->r2context = r2context;
+	span->fd = fd;
+	span->nslots = nslots;
+	pthread_mutex_init(&span->lock, NULL);
+	return span;
+}
+
+static void sock_span_free(sock_span_t *span)
+{
+	int i;
+	for (i = 0; i < span->nslots; i++) {
+		if (span->slots[i].rx) {
+			queue_free(span->slots[i].rx);
+		}
+	}
+	pthread_mutex_destroy(&span->lock);
+	free(span);
+}
+
+/*! \brief must be called with sock_lock held */
+static sock_span_t *sock_find_span(openr2_context_t *r2context, const char *path, int fd)
+{
+	sock_span_t *span;
+	for (span = sock_spans; span; span = span->next) {
+		if (path && span->r2context == r2context && !strcmp(span->path, path)) {
+			return span;
+		}
+		if (!path && span->fd == fd) {
+			return span;
+		}
+	}
+	return NULL;
+}
+
+/* channels opened by us get their slot on setup, descriptors
+   given to openr2_chan_new_from_fd() are adopted on first use */
+static sock_slot_t *sock_get_slot(openr2_chan_t *r2chan)
+{
+	sock_span_t *span;
+	sock_slot_t *slot = NULL;
+	int fd = (int)(long)r2chan->fd;
+	if (r2chan->io_private) {
+		return r2chan->io_private;
+	}
+	pthread_mutex_lock(&sock_lock);
+	span = sock_find_span(NULL, NULL, fd);
+	if (span) {
+		slot = &span->slots[span->nslots == 1 ? 0 : (r2chan->number - 1) % span->nslots];
+		if (!span->owned && slot->open) {
+			/* the descriptor was handed to a channel again, whoever used it before is gone */
+			pthread_mutex_lock(&span->lock);
+			slot->open = 0;
+			span->users--;
+			slot = sock_open_slot(span, 0, r2chan->number);
+			pthread_mutex_unlock(&span->lock);
+		} else if (!slot->open) {
+			slot = NULL;
+		}
+	} else {
+		span = sock_span_new(r2chan->r2context, fd, 1);
+		if (span) {
+			span->state = SOCK_CONNECTED;
+			slot = sock_open_slot(span, 0, r2chan->number);
+			if (slot) {
+				span->next = sock_spans;
+				sock_spans = span;
+			} else {
+				sock_span_free(span);
+			}
+		}
+	}
+	pthread_mutex_unlock(&sock_lock);
+	if (!slot) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Descriptor %d is not a socket channel\n", fd);
+		return NULL;
+	}
+	r2chan->io_private = slot;
+	return slot;
+}
+
+#define SOCK_SLOT(r2chan) sock_slot_t *slot = sock_get_slot(r2chan); \
+	if (!slot) { \
+		return -1; \
+	} \
+	pthread_mutex_lock(&slot->span->lock);
+
+#define SOCK_UNLOCK() pthread_mutex_unlock(&slot->span->lock)
+
+static openr2_io_fd_t sock_open(openr2_context_t *r2context, int channo)
+{
+	sock_span_t *span;
+	char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	const char *dir = r2context->io_socket_dir[0] ? r2context->io_socket_dir : "/tmp";
+	int nslots = r2context->io_socket_span ? r2context->io_socket_span : 1;
+	int slotno, len;
+
+	if (channo <= 0) {
+		r2context->last_error = OR2_LIBERR_INVALID_CHAN_NUMBER;
+		return NULL;
+	}
+	slotno = (channo - 1) % nslots;
+	if (nslots > 1) {
+		len = snprintf(path, sizeof(path), "%s/openr2-span%d.sock", dir, ((channo - 1) / nslots) + 1);
+	} else {
+		len = snprintf(path, sizeof(path), "%s/openr2-chan%d.sock", dir, channo);
+	}
+	if (len >= (int)sizeof(path)) {
+		r2context->last_error = OR2_LIBERR_INVALID_CHAN_NUMBER;
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Socket path for channel %d is too long\n", channo);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&sock_lock);
+	span = sock_find_span(r2context, path, -1);
+	if (!span) {
+		span = sock_span_new(r2context, -1, nslots);
+		if (!span) {
+			pthread_mutex_unlock(&sock_lock);
+			r2context->last_error = OR2_LIBERR_OUT_OF_MEMORY;
+			return NULL;
+		}
+		/* the length was checked when building the path */
+		memcpy(span->path, path, len + 1);
+		span->owned = 1;
+		if (sock_connect_or_listen(span)) {
+			pthread_mutex_unlock(&sock_lock);
+			r2context->last_error = OR2_LIBERR_SYSCALL_FAILED;
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to connect or listen on %s: %s\n", path, strerror(errno));
+			sock_span_free(span);
+			return NULL;
+		}
+		span->next = sock_spans;
+		sock_spans = span;
+	}
+	pthread_mutex_lock(&span->lock);
+	if (span->slots[slotno].open) {
+		pthread_mutex_unlock(&span->lock);
+		pthread_mutex_unlock(&sock_lock);
+		r2context->last_error = OR2_LIBERR_INVALID_CHAN_NUMBER;
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Socket channel %d is already open\n", channo);
+		return NULL;
+	}
+	if (!sock_open_slot(span, slotno, channo)) {
+		pthread_mutex_unlock(&span->lock);
+		pthread_mutex_unlock(&sock_lock);
+		r2context->last_error = OR2_LIBERR_OUT_OF_MEMORY;
+		return NULL;
+	}
+	pthread_mutex_unlock(&span->lock);
+	pthread_mutex_unlock(&sock_lock);
+	return (openr2_io_fd_t)(long)span->fd;
+}
+
+static int sock_close(openr2_chan_t *r2chan)
+{
+	sock_span_t *span, **prev;
+	SOCK_SLOT(r2chan);
+	span = slot->span;
+	slot->open = 0;
+	/* the far end just lost its line */
+	sock_send_state(span, slot - span->slots);
+	SOCK_UNLOCK();
+	r2chan->io_private = NULL;
+
+	pthread_mutex_lock(&sock_lock);
+	if (--span->users) {
+		pthread_mutex_unlock(&sock_lock);
+		return 0;
+	}
+	for (prev = &sock_spans; *prev; prev = &(*prev)->next) {
+		if (*prev == span) {
+			*prev = span->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sock_lock);
+	if (span->owned) {
+		close(span->fd);
+	}
+	if (span->bound) {
+		unlink(span->path);
+	}
+	sock_span_free(span);
+	return 0;
+}
+
+static int sock_setup(openr2_chan_t *r2chan)
+{
+	SOCK_SLOT(r2chan);
+	SOCK_UNLOCK();
+	return 0;
+}
+
+static int sock_set_cas(openr2_chan_t *r2chan, int cas)
+{
+	uint8_t val = cas;
+	SOCK_SLOT(r2chan);
+	slot->cas_tx = cas;
+	sock_send(slot->span, SOCK_FRAME_CAS, slot - slot->span->slots, &val, 1);
+	SOCK_UNLOCK();
+	return 0;
+}
+
+static int sock_get_cas(openr2_chan_t *r2chan, int *cas)
+{
+	SOCK_SLOT(r2chan);
+	sock_drain(slot->span);
+	/* nobody drives the line when the other side is not there */
+	*cas = slot->remote_open ? slot->remote_cas : 0;
+	SOCK_UNLOCK();
+	return 0;
+}
+
+static int sock_get_alarm_state(openr2_chan_t *r2chan, int *alarm)
+{
+	SOCK_SLOT(r2chan);
+	sock_drain(slot->span);
+	*alarm = (slot->span->state == SOCK_CONNECTED && slot->remote_open) ? 0 : 1;
+	SOCK_UNLOCK();
+	return 0;
+}
+
+static int sock_get_oob_event(openr2_chan_t *r2chan, openr2_oob_event_t *event)
+{
+	SOCK_SLOT(r2chan);
+	sock_drain(slot->span);
+	*event = OR2_OOB_EVENT_NONE;
+	/* alarms first, like the hardware does */
+	if (slot->events & SOCK_EV_ALARM_ON) {
+		*event = OR2_OOB_EVENT_ALARM_ON;
+		slot->events &= ~SOCK_EV_ALARM_ON;
+	} else if (slot->events & SOCK_EV_ALARM_OFF) {
+		*event = OR2_OOB_EVENT_ALARM_OFF;
+		slot->events &= ~SOCK_EV_ALARM_OFF;
+	} else if (slot->events & SOCK_EV_CAS) {
+		*event = OR2_OOB_EVENT_CAS_CHANGE;
+		slot->events &= ~SOCK_EV_CAS;
+	}
+	SOCK_UNLOCK();
+	return 0;
+}
+
+static int sock_flush_write_buffers(openr2_chan_t *r2chan)
+{
+	SOCK_SLOT(r2chan);
+	/* what we sent sits in the far end receive buffer, tell it to drop it like the driver would */
+	slot->tx_sent = sock_slot_clock(slot);
+	if (slot->remote_open) {
+		sock_send(slot->span, SOCK_FRAME_FLUSH, slot - slot->span->slots, NULL, 0);
+	}
+	SOCK_UNLOCK();
+	return 0;
+}
+
+/* samples the clock produced for this channel and it did not read yet */
+static int sock_rx_due(sock_slot_t *slot)
+{
+	uint64_t due = sock_slot_clock(slot) - slot->rx_read;
+	return (due > (uint64_t)SOCK_RING_SIZE * 2) ? (SOCK_RING_SIZE * 2) : (int)due;
+}
+
+/* room left in our virtual driver transmit buffer */
+static int sock_tx_room(sock_slot_t *slot)
+{
+	uint64_t now = sock_slot_clock(slot);
+	if (slot->tx_sent < now) {
+		/* we did not write for a while, the buffer played out */
+		slot->tx_sent = now;
+	}
+	return SOCK_RING_SIZE - (int)(slot->tx_sent - now);
+}
+
+static int sock_read(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	uint8_t *rbuf = (uint8_t *)buf;
+	int due, got;
+	SOCK_SLOT(r2chan);
+	sock_drain(slot->span);
+	due = sock_rx_due(slot);
+	if (due > SOCK_RING_SIZE) {
+		/* we were not read in time, the driver buffers would have overflowed */
+		slot->rx_read = sock_slot_clock(slot) - SOCK_RING_SIZE;
+		queue_flush(slot->rx);
+		due = SOCK_RING_SIZE;
+	}
+	if (size > due) {
+		size = due;
+	}
+	got = queue_read(slot->rx, rbuf, size);
+	if (got < size) {
+		memset(rbuf + got, SOCK_ALAW_SILENCE, size - got);
+	}
+	slot->rx_read += size;
+	SOCK_UNLOCK();
+	return size;
+}
+
+static int sock_write(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	const uint8_t *wbuf = (const uint8_t *)buf;
+	int room, chunk, sent = 0;
+	SOCK_SLOT(r2chan);
+	room = sock_tx_room(slot);
+	if (size > room) {
+		size = room;
+	}
+	while (sent < size) {
+		chunk = (size - sent) > OR2_CHAN_READ_SIZE ? OR2_CHAN_READ_SIZE : (size - sent);
+		/* audio for a far end that is not there goes nowhere, but still takes its time */
+		if (slot->remote_open) {
+			sock_send(slot->span, SOCK_FRAME_AUDIO, slot - slot->span->slots, wbuf + sent, chunk);
+		}
+		sent += chunk;
+	}
+	slot->tx_sent += size;
+	SOCK_UNLOCK();
+	return size;
+}
+
+static int sock_ready_flags(sock_slot_t *slot, int flags)
+{
+	int ready = 0;
+	if ((flags & OR2_IO_READ) && sock_rx_due(slot) >= OR2_CHAN_READ_SIZE) {
+		ready |= OR2_IO_READ;
+	}
+	if ((flags & OR2_IO_WRITE) && sock_tx_room(slot) >= OR2_CHAN_READ_SIZE) {
+		ready |= OR2_IO_WRITE;
+	}
+	if ((flags & OR2_IO_OOB_EVENT) && slot->events) {
+		ready |= OR2_IO_OOB_EVENT;
+	}
+	return ready;
+}
+
+static int sock_wait(openr2_chan_t *r2chan, int *flags, int block)
+{
+	struct pollfd pfd;
+	int ready, res, timeout, ms;
+	SOCK_SLOT(r2chan);
+	if (!flags || !*flags) {
+		SOCK_UNLOCK();
+		return -1;
+	}
+	for ( ; ; ) {
+		sock_drain(slot->span);
+		ready = sock_ready_flags(slot, *flags);
+		if (ready || !block) {
+			*flags = ready;
+			break;
+		}
+		/* the clock makes us readable or writable, the socket only tells about the far end */
+		timeout = -1;
+		if (*flags & OR2_IO_READ) {
+			timeout = (((OR2_CHAN_READ_SIZE - sock_rx_due(slot)) * 125) + 999) / 1000;
+		}
+		if (*flags & OR2_IO_WRITE) {
+			ms = (((OR2_CHAN_READ_SIZE - sock_tx_room(slot)) * 125) + 999) / 1000;
+			if (timeout == -1 || ms < timeout) {
+				timeout = ms;
+			}
+		}
+		pfd.fd = slot->span->fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		/* let other channels of the span use it while we sleep */
+		SOCK_UNLOCK();
+		res = poll(&pfd, 1, timeout);
+		if (res == -1 && errno != EINTR) {
+			EMI(r2chan)->on_os_error(r2chan, errno);
+			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Failed to wait for socket channel: %s\n", strerror(errno));
+			return -1;
+		}
+		pthread_mutex_lock(&slot->span->lock);
+	}
+	SOCK_UNLOCK();
+	return 0;
+}
+
+static openr2_io_interface_t sock_io_interface = {
+	/* .open */ sock_open,
+	/* .close */ sock_close,
+	/* .set_cas */ sock_set_cas,
+	/* .get_cas */ sock_get_cas,
+	/* .flush_write_buffers */ sock_flush_write_buffers,
+	/* .write */ sock_write,
+	/* .read */ sock_read,
+	/* .setup */ sock_setup,
+	/* .wait */ sock_wait,
+	/* .get_oob_event */ sock_get_oob_event,
+	/* .get_alarm_state */ sock_get_alarm_state
+};
+
+openr2_io_interface_t *openr2_io_get_socket_interface(void)
+{
+	return &sock_io_interface;
+}
+
+#else
+
+openr2_io_interface_t *openr2_io_get_socket_interface(void)
+{
+	return NULL;
+}
+
+#endif
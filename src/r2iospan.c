@@ -0,0 +1,322 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * Span I/O. Backends that can move a whole span in one operation provide
+ * the optional span members of openr2_io_interface_t. openr2_context_process_span()
+ * then asks them once per group of up to OR2_IO_MAX_SPAN_CHANS channels which
+ * channels are ready, reads their audio and CAS bits and stages all of it in
+ * the channels. While the channels are processed, their I/O calls are served
+ * from what was staged by the interface below instead of going to the
+ * backend, and the tones they write are collected and handed to the backend
+ * in a single write when every channel of the group is done.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include "openr2/r2log-pvt.h"
+#include "openr2/r2chan-pvt.h"
+#include "openr2/r2context-pvt.h"
+#include "openr2/r2utils-pvt.h"
+#include "openr2/r2ioabs.h"
+
+#define SPAN_IO(r2chan) (r2chan)->r2context->io
+
+static openr2_io_fd_t span_open(openr2_context_t *r2context, int channo)
+{
+	return r2context->io->open(r2context, channo);
+}
+
+static int span_close(openr2_chan_t *r2chan)
+{
+	return SPAN_IO(r2chan)->close(r2chan);
+}
+
+static int span_set_cas(openr2_chan_t *r2chan, int cas)
+{
+	return SPAN_IO(r2chan)->set_cas(r2chan, cas);
+}
+
+static int span_get_cas(openr2_chan_t *r2chan, int *cas)
+{
+	if (!r2chan->span_cas_valid) {
+		return SPAN_IO(r2chan)->get_cas(r2chan, cas);
+	}
+	*cas = r2chan->span_cas;
+	return 0;
+}
+
+static int span_flush_write_buffers(openr2_chan_t *r2chan)
+{
+	/* whatever we collected for this frame goes too */
+	r2chan->span_tx_len = 0;
+	return SPAN_IO(r2chan)->flush_write_buffers(r2chan);
+}
+
+static int span_write(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	/* one frame per channel and pass, more than that (or speech written
+	   from a callback on top of a tone) goes straight to the backend */
+	if (r2chan->span_tx_len || size > (int)sizeof(r2chan->span_tx)) {
+		return SPAN_IO(r2chan)->write(r2chan, buf, size);
+	}
+	memcpy(r2chan->span_tx, buf, size);
+	r2chan->span_tx_len = size;
+	return size;
+}
+
+static int span_read(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	int len = r2chan->span_rx_len;
+	r2chan->span_rx_len = 0;
+	if (len <= 0) {
+		return len;
+	}
+	if (len > size) {
+		len = size;
+	}
+	memcpy((void *)buf, r2chan->span_rx, len);
+	return len;
+}
+
+static int span_setup(openr2_chan_t *r2chan)
+{
+	return SPAN_IO(r2chan)->setup(r2chan);
+}
+
+static int span_wait(openr2_chan_t *r2chan, int *flags, int block)
+{
+	int ready = 0;
+	if (!flags || !*flags) {
+		return -1;
+	}
+	/* never blocks, the span wait already did */
+	if ((*flags & OR2_IO_READ) && r2chan->span_rx_len) {
+		ready |= OR2_IO_READ;
+	}
+	/* only polled for when there was a tone to write, see span_chan_wants() */
+	if ((*flags & OR2_IO_WRITE) && (r2chan->span_flags & OR2_IO_WRITE) && !r2chan->span_tx_len) {
+		ready |= OR2_IO_WRITE;
+	}
+	if ((*flags & OR2_IO_OOB_EVENT) && ((r2chan->span_flags & OR2_IO_OOB_EVENT) || r2chan->span_cas_changed)) {
+		ready |= OR2_IO_OOB_EVENT;
+	}
+	*flags = ready;
+	return 0;
+}
+
+static int span_get_oob_event(openr2_chan_t *r2chan, openr2_oob_event_t *event)
+{
+	int res;
+	*event = OR2_OOB_EVENT_NONE;
+	if (r2chan->span_flags & OR2_IO_OOB_EVENT) {
+		/* alarms and anything else the span CAS bitmap does not tell us */
+		r2chan->span_flags &= ~OR2_IO_OOB_EVENT;
+		res = SPAN_IO(r2chan)->get_oob_event(r2chan, event);
+		if (res) {
+			return res;
+		}
+	}
+	if (*event == OR2_OOB_EVENT_CAS_CHANGE || (*event == OR2_OOB_EVENT_NONE && r2chan->span_cas_changed)) {
+		r2chan->span_cas_changed = 0;
+		*event = OR2_OOB_EVENT_CAS_CHANGE;
+	}
+	return 0;
+}
+
+static int span_get_alarm_state(openr2_chan_t *r2chan, int *alarm)
+{
+	return SPAN_IO(r2chan)->get_alarm_state(r2chan, alarm);
+}
+
+static int span_play_loop(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	return SPAN_IO(r2chan)->play_loop(r2chan, buf, size);
+}
+
+static int span_stop_loop(openr2_chan_t *r2chan)
+{
+	return SPAN_IO(r2chan)->stop_loop(r2chan);
+}
+
+/* I/O of channels with staged span I/O */
+static openr2_io_interface_t span_io_interface = {
+	/* .open */ span_open,
+	/* .close */ span_close,
+	/* .set_cas */ span_set_cas,
+	/* .get_cas */ span_get_cas,
+	/* .flush_write_buffers */ span_flush_write_buffers,
+	/* .write */ span_write,
+	/* .read */ span_read,
+	/* .setup */ span_setup,
+	/* .wait */ span_wait,
+	/* .get_oob_event */ span_get_oob_event,
+	/* .get_alarm_state */ span_get_alarm_state,
+	/* .play_loop */ span_play_loop,
+	/* .stop_loop */ span_stop_loop
+};
+
+openr2_io_interface_t *openr2_io_get_span_staged_interface(void)
+{
+	return &span_io_interface;
+}
+
+/* flags the channel would poll for in openr2_chan_process(), backends
+   are writable most of the time, asking for it when there is no tone
+   to write would not let the span wait ever sleep */
+static int span_chan_wants(openr2_chan_t *r2chan)
+{
+	int flags = OR2_IO_OOB_EVENT;
+	if (r2chan->inalarm) {
+		return flags;
+	}
+	if (r2chan->read_enabled) {
+		flags |= OR2_IO_READ;
+	}
+	if (r2chan->dialing_dtmf) {
+		flags |= OR2_IO_WRITE;
+	} else if (OR2_MF_OFF_STATE != r2chan->mf_state && !r2chan->mf_looping &&
+			MFI(r2chan)->mf_want_generate(r2chan->mf_write_handle, r2chan->mf_write_tone)) {
+		flags |= OR2_IO_WRITE;
+	}
+	return flags;
+}
+
+static int span_service(openr2_context_t *r2context, openr2_chan_t *chans[], int n, int block)
+{
+	openr2_io_interface_t *io = r2context->io;
+	openr2_chan_t *iochans[OR2_IO_MAX_SPAN_CHANS];
+	void *bufs[OR2_IO_MAX_SPAN_CHANS];
+	int flags[OR2_IO_MAX_SPAN_CHANS];
+	int sizes[OR2_IO_MAX_SPAN_CHANS];
+	int cas[OR2_IO_MAX_SPAN_CHANS];
+	uint32_t changed = 0;
+	int i, m, res;
+
+	for (i = 0; i < n; i++) {
+		flags[i] = span_chan_wants(chans[i]);
+		chans[i]->span_rx_len = 0;
+		chans[i]->span_tx_len = 0;
+		chans[i]->span_cas_valid = 0;
+		chans[i]->span_cas_changed = 0;
+		/* posted commands do not wake up the backend, do not sleep on them */
+		if (block && openr2_chan_has_commands(chans[i])) {
+			block = 0;
+		}
+	}
+	if (io->wait_span(r2context, chans, flags, n, block)) {
+		return -1;
+	}
+
+	/* audio of every channel that has some */
+	for (i = 0, m = 0; i < n; i++) {
+		if (flags[i] & OR2_IO_READ) {
+			iochans[m] = chans[i];
+			bufs[m] = chans[i]->span_rx;
+			sizes[m] = sizeof(chans[i]->span_rx);
+			m++;
+		}
+	}
+	if (m && io->read_span) {
+		if (io->read_span(r2context, iochans, bufs, sizes, m)) {
+			return -1;
+		}
+	} else {
+		for (i = 0; i < m; i++) {
+			sizes[i] = io->read(iochans[i], bufs[i], sizes[i]);
+		}
+	}
+	for (i = 0; i < m; i++) {
+		iochans[i]->span_rx_len = sizes[i];
+	}
+
+	/* CAS bits of the whole group, the backend tells us which ones changed */
+	if (io->get_cas_span) {
+		if (io->get_cas_span(r2context, chans, cas, n, &changed)) {
+			return -1;
+		}
+		for (i = 0; i < n; i++) {
+			chans[i]->span_cas = cas[i];
+			chans[i]->span_cas_valid = 1;
+			chans[i]->span_cas_changed = (changed & (1u << i)) ? 1 : 0;
+		}
+	}
+
+	/* timers are due on idle channels too, run every channel */
+	for (i = 0; i < n; i++) {
+		chans[i]->span_flags = flags[i];
+		chans[i]->span_staged = 1;
+		res = openr2_chan_process_signaling(chans[i]);
+		chans[i]->span_staged = 0;
+		if (res == -1) {
+			openr2_log(chans[i], OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Span processing of the channel failed\n");
+		}
+	}
+
+	/* and the tones they generated, in one go */
+	for (i = 0, m = 0; i < n; i++) {
+		if (chans[i]->span_tx_len > 0) {
+			iochans[m] = chans[i];
+			bufs[m] = chans[i]->span_tx;
+			sizes[m] = chans[i]->span_tx_len;
+			m++;
+			chans[i]->span_tx_len = 0;
+		}
+	}
+	if (m && io->write_span) {
+		return io->write_span(r2context, iochans, (const void **)bufs, sizes, m);
+	}
+	for (i = 0; i < m; i++) {
+		io->write(iochans[i], bufs[i], sizes[i]);
+	}
+	return 0;
+}
+
+int openr2_io_span_process(openr2_context_t *r2context, int block)
+{
+	int i, n, total, res = 0;
+
+	if (!r2context->io) {
+		return -1;
+	}
+	total = r2context->chans_count;
+	if (!r2context->io->wait_span) {
+		/* no span support, the usual per channel calls */
+		for (i = 0; i < total; i++) {
+			openr2_chan_process_signaling(r2context->chans[i]);
+		}
+		return total;
+	}
+	/* we can only sleep on the backend when a single call covers every channel */
+	if (total > OR2_IO_MAX_SPAN_CHANS) {
+		block = 0;
+	}
+	/* the context channel array is handed over in slices, no copies */
+	for (i = 0; i < total; i += n) {
+		n = total - i < OR2_IO_MAX_SPAN_CHANS ? total - i : OR2_IO_MAX_SPAN_CHANS;
+		if (span_service(r2context, &r2context->chans[i], n, block)) {
+			res = -1;
+		}
+	}
+	return res ? res : total;
+}
@@ -0,0 +1,846 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * I/O recording and replay. Recording wraps whatever I/O interface the
+ * context uses and appends everything the library got from it (readiness,
+ * received audio, CAS bits, OOB events and alarms) and what it asked from it
+ * (CAS bits and audio lengths written, flushes) to a trace file per channel,
+ * r2trace-chan<N>.bin in the recording directory. The trace is written
+ * through a shared memory mapping that grows as needed, so recording a
+ * channel costs a memcpy per operation and no system calls.
+ *
+ * The OR2_IO_REPLAY interface feeds a trace back to the library in the same
+ * order. Waits are released when their recorded time comes, either in real
+ * time or, in OR2_REPLAY_MAX_SPEED mode, on a virtual clock that jumps to the
+ * next recorded event or protocol timer as soon as the channels are idle,
+ * and that the protocol timers of the context follow. Whatever the library
+ * does differently than in the recording is counted as a divergence, which
+ * makes traces usable as regression tests. Actions the application took
+ * during the recording (making or answering calls) are not part of the trace
+ * and must be repeated by the application replaying it.
+ *
+ * Trace files start with a trace_file_hdr_t followed by records made of a
+ * trace_rec_hdr_t and len bytes of payload (only received audio has one).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef __linux__
+/* ftruncate() and usleep() */
+#define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#include "openr2/r2log-pvt.h"
+#include "openr2/r2chan-pvt.h"
+#include "openr2/r2context-pvt.h"
+#include "openr2/r2utils-pvt.h"
+#include "openr2/r2ioabs.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TRACE_MAGIC "OR2T"
+#define TRACE_VERSION 1
+
+/* mapping size of a new trace, doubled every time it fills up */
+#define TRACE_INITIAL_SIZE (64 * 1024)
+
+/* record types, TRACE_FAILED is or'ed when the operation returned -1 */
+#define TRACE_END 0
+#define TRACE_WAIT 1
+#define TRACE_READ 2
+#define TRACE_WRITE 3
+#define TRACE_OOB 4
+#define TRACE_CAS 5
+#define TRACE_ALARM 6
+#define TRACE_SET_CAS 7
+#define TRACE_FLUSH 8
+#define TRACE_FAILED 0x80
+#define TRACE_TYPE(type) ((type) & ~TRACE_FAILED)
+
+typedef struct trace_file_hdr {
+	char magic[4];
+	uint16_t version;
+	uint16_t channo;
+	/* wall clock time of the first record */
+	uint32_t start_sec;
+	uint32_t start_usec;
+	uint32_t reserved[2];
+} trace_file_hdr_t;
+
+typedef struct trace_rec_hdr {
+	uint8_t type;
+	/* wait flags (result in the low nibble, requested in the high one), event, CAS bits,
+	   alarm or hash of the audio written */
+	uint8_t value;
+	/* payload size, or bytes written for TRACE_WRITE */
+	uint16_t len;
+	/* microseconds since the previous record */
+	uint32_t delta_us;
+} trace_rec_hdr_t;
+
+typedef struct trace_file {
+	int fd;
+	int channo;
+	uint8_t *map;
+	size_t size;
+	/* recording: bytes written, replay: read position */
+	size_t pos;
+	/* time of the previous record, recorded time in us for replay */
+	struct timeval last;
+	uint64_t next_us;
+	/* last CAS bits seen on replay, reported when the trace runs out */
+	int cas;
+	struct trace_file *next;
+} trace_file_t;
+
+typedef struct trace_replay {
+	openr2_replay_mode_t mode;
+	pthread_mutex_t lock;
+	trace_file_t *traces;
+	/* recorded time in us that is being replayed now (virtual clock) and,
+	   for real time replay, when replay started in both time lines */
+	uint64_t clock_us;
+	uint64_t base_us;
+	struct timeval real_start;
+	unsigned divergences;
+} trace_replay_t;
+
+static uint64_t trace_tv_us(const struct timeval *tv)
+{
+	return ((uint64_t)tv->tv_sec * 1000000) + tv->tv_usec;
+}
+
+/* what we write does not change what we do next, a hash is enough to check it on replay */
+static uint8_t trace_hash(const void *buf, int size)
+{
+	const uint8_t *data = buf;
+	uint32_t hash = 2166136261u;
+	int i;
+	for (i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+	return (hash >> 24) ^ (hash >> 16) ^ (hash >> 8) ^ hash;
+}
+
+static int trace_map(trace_file_t *trace, size_t size)
+{
+	if (trace->map) {
+		munmap(trace->map, trace->size);
+		trace->map = NULL;
+	}
+	if (ftruncate(trace->fd, size)) {
+		return -1;
+	}
+	trace->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, trace->fd, 0);
+	if (trace->map == MAP_FAILED) {
+		trace->map = NULL;
+		return -1;
+	}
+	trace->size = size;
+	return 0;
+}
+
+static trace_file_t *trace_create(openr2_chan_t *r2chan)
+{
+	char path[OR2_MAX_PATH];
+	trace_file_hdr_t *hdr;
+	trace_file_t *trace;
+	int len = snprintf(path, sizeof(path), "%s/r2trace-chan%d.bin", r2chan->r2context->io_trace_dir, r2chan->number);
+	if (len >= (int)sizeof(path)) {
+		return NULL;
+	}
+	trace = calloc(1, sizeof(*trace));
+	if (!trace) {
+		return NULL;
+	}
+	trace->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (trace->fd == -1 || trace_map(trace, TRACE_INITIAL_SIZE)) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Failed to create I/O trace %s: %s\n", path, strerror(errno));
+		if (trace->fd != -1) {
+			close(trace->fd);
+		}
+		free(trace);
+		return NULL;
+	}
+	trace->channo = r2chan->number;
+	gettimeofday(&trace->last, NULL);
+	hdr = (trace_file_hdr_t *)trace->map;
+	memcpy(hdr->magic, TRACE_MAGIC, sizeof(hdr->magic));
+	hdr->version = TRACE_VERSION;
+	hdr->channo = r2chan->number;
+	hdr->start_sec = trace->last.tv_sec;
+	hdr->start_usec = trace->last.tv_usec;
+	trace->pos = sizeof(*hdr);
+	return trace;
+}
+
+static void trace_append(openr2_chan_t *r2chan, trace_file_t *trace, int type, int value, int len, const void *payload)
+{
+	struct timeval now;
+	trace_rec_hdr_t *rec;
+	size_t need = sizeof(*rec) + (payload ? len : 0);
+	uint64_t delta;
+	size_t newsize;
+	if (!trace->map) {
+		return;
+	}
+	if (trace->pos + need > trace->size) {
+		newsize = trace->size * 2;
+		if (trace_map(trace, newsize)) {
+			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Failed to grow I/O trace, recording stopped: %s\n", strerror(errno));
+			return;
+		}
+	}
+	gettimeofday(&now, NULL);
+	delta = trace_tv_us(&now) - trace_tv_us(&trace->last);
+	trace->last = now;
+	rec = (trace_rec_hdr_t *)(trace->map + trace->pos);
+	rec->type = type;
+	rec->value = value;
+	rec->len = len;
+	rec->delta_us = (delta > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)delta;
+	if (payload && len) {
+		memcpy(trace->map + trace->pos + sizeof(*rec), payload, len);
+	}
+	trace->pos += need;
+}
+
+static void trace_close_recording(trace_file_t *trace)
+{
+	if (trace->map) {
+		munmap(trace->map, trace->size);
+	}
+	/* drop the unused tail of the mapping */
+	if (ftruncate(trace->fd, trace->pos)) {
+		/* the tail is zeroes, which reads back as the end of the trace anyway */
+	}
+	close(trace->fd);
+	free(trace);
+}
+
+/* recording starts on setup, or on first use for channels created with openr2_chan_new_from_fd() */
+static trace_file_t *trace_get(openr2_chan_t *r2chan)
+{
+	if (!r2chan->io_trace) {
+		r2chan->io_trace = trace_create(r2chan);
+	}
+	return r2chan->io_trace;
+}
+
+#define RECORDED(r2chan) (r2chan)->r2context->io_recorded
+
+#define TRACE_RECORD(r2chan, type, value, len, payload) \
+	do { \
+		trace_file_t *trace = trace_get(r2chan); \
+		if (trace) { \
+			trace_append(r2chan, trace, type, value, len, payload); \
+		} \
+	} while (0)
+
+static openr2_io_fd_t record_open(openr2_context_t *r2context, int channo)
+{
+	return r2context->io_recorded->open(r2context, channo);
+}
+
+static int record_close(openr2_chan_t *r2chan)
+{
+	if (r2chan->io_trace) {
+		trace_close_recording(r2chan->io_trace);
+		r2chan->io_trace = NULL;
+	}
+	return RECORDED(r2chan)->close(r2chan);
+}
+
+static int record_setup(openr2_chan_t *r2chan)
+{
+	int res = RECORDED(r2chan)->setup(r2chan);
+	trace_get(r2chan);
+	return res;
+}
+
+static int record_set_cas(openr2_chan_t *r2chan, int cas)
+{
+	int res = RECORDED(r2chan)->set_cas(r2chan, cas);
+	TRACE_RECORD(r2chan, TRACE_SET_CAS | (res ? TRACE_FAILED : 0), cas, 0, NULL);
+	return res;
+}
+
+static int record_get_cas(openr2_chan_t *r2chan, int *cas)
+{
+	int res = RECORDED(r2chan)->get_cas(r2chan, cas);
+	TRACE_RECORD(r2chan, TRACE_CAS | (res ? TRACE_FAILED : 0), res ? 0 : *cas, 0, NULL);
+	return res;
+}
+
+static int record_flush_write_buffers(openr2_chan_t *r2chan)
+{
+	int res = RECORDED(r2chan)->flush_write_buffers(r2chan);
+	TRACE_RECORD(r2chan, TRACE_FLUSH | (res ? TRACE_FAILED : 0), 0, 0, NULL);
+	return res;
+}
+
+static int record_write(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	int res = RECORDED(r2chan)->write(r2chan, buf, size);
+	TRACE_RECORD(r2chan, TRACE_WRITE | (res == -1 ? TRACE_FAILED : 0), res > 0 ? trace_hash(buf, res) : 0, res == -1 ? 0 : res, NULL);
+	return res;
+}
+
+static int record_read(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	int res = RECORDED(r2chan)->read(r2chan, buf, size);
+	TRACE_RECORD(r2chan, TRACE_READ | (res == -1 ? TRACE_FAILED : 0), 0, res > 0 ? res : 0, res > 0 ? buf : NULL);
+	return res;
+}
+
+static int record_wait(openr2_chan_t *r2chan, int *flags, int block)
+{
+	int requested = flags ? *flags : 0;
+	int res = RECORDED(r2chan)->wait(r2chan, flags, block);
+	/* most polls find nothing, replay tells those apart by time so they are not recorded */
+	if (res) {
+		TRACE_RECORD(r2chan, TRACE_WAIT | TRACE_FAILED, requested << 4, 0, NULL);
+	} else if (flags && *flags) {
+		TRACE_RECORD(r2chan, TRACE_WAIT, (requested << 4) | (*flags & 0x0F), 0, NULL);
+	}
+	return res;
+}
+
+static int record_get_oob_event(openr2_chan_t *r2chan, openr2_oob_event_t *event)
+{
+	int res = RECORDED(r2chan)->get_oob_event(r2chan, event);
+	TRACE_RECORD(r2chan, TRACE_OOB | (res ? TRACE_FAILED : 0), res ? 0 : *event, 0, NULL);
+	return res;
+}
+
+static int record_get_alarm_state(openr2_chan_t *r2chan, int *alarm)
+{
+	int res = RECORDED(r2chan)->get_alarm_state(r2chan, alarm);
+	TRACE_RECORD(r2chan, TRACE_ALARM | (res ? TRACE_FAILED : 0), res ? 0 : *alarm, 0, NULL);
+	return res;
+}
+
+static openr2_io_interface_t record_io_interface = {
+	/* .open */ record_open,
+	/* .close */ record_close,
+	/* .set_cas */ record_set_cas,
+	/* .get_cas */ record_get_cas,
+	/* .flush_write_buffers */ record_flush_write_buffers,
+	/* .write */ record_write,
+	/* .read */ record_read,
+	/* .setup */ record_setup,
+	/* .wait */ record_wait,
+	/* .get_oob_event */ record_get_oob_event,
+	/* .get_alarm_state */ record_get_alarm_state
+};
+
+openr2_io_interface_t *openr2_io_get_record_interface(void)
+{
+	return &record_io_interface;
+}
+
+/*
+ * replay
+ */
+
+static trace_rec_hdr_t *trace_peek(trace_file_t *trace)
+{
+	trace_rec_hdr_t *rec;
+	if (trace->pos + sizeof(*rec) > trace->size) {
+		return NULL;
+	}
+	rec = (trace_rec_hdr_t *)(trace->map + trace->pos);
+	if (rec->type == TRACE_END || trace->pos + sizeof(*rec) + (TRACE_TYPE(rec->type) == TRACE_READ ? rec->len : 0) > trace->size) {
+		return NULL;
+	}
+	return rec;
+}
+
+static void trace_skip(trace_file_t *trace, trace_rec_hdr_t *rec)
+{
+	trace->pos += sizeof(*rec) + (TRACE_TYPE(rec->type) == TRACE_READ ? rec->len : 0);
+	rec = trace_peek(trace);
+	if (rec) {
+		trace->next_us += rec->delta_us;
+	}
+}
+
+/*! \brief must be called with the replay lock held */
+static uint64_t replay_now_us(trace_replay_t *replay)
+{
+	struct timeval now;
+	if (replay->mode == OR2_REPLAY_MAX_SPEED) {
+		return replay->clock_us;
+	}
+	gettimeofday(&now, NULL);
+	return replay->base_us + (trace_tv_us(&now) - trace_tv_us(&replay->real_start));
+}
+
+/*! \brief next record of the given type, anything else in between is a divergence, must be called with the replay lock held */
+static trace_rec_hdr_t *replay_take(openr2_chan_t *r2chan, trace_replay_t *replay, trace_file_t *trace, int type)
+{
+	trace_rec_hdr_t *rec = trace_peek(trace);
+	int skipped = 0;
+	while (rec && TRACE_TYPE(rec->type) != type) {
+		skipped++;
+		trace_skip(trace, rec);
+		rec = trace_peek(trace);
+	}
+	if (skipped) {
+		replay->divergences++;
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "Replay diverged, skipped %d recorded operations to find the next %d\n", skipped, type);
+	}
+	if (rec && replay->mode == OR2_REPLAY_MAX_SPEED && trace->next_us > replay->clock_us) {
+		replay->clock_us = trace->next_us;
+	}
+	return rec;
+}
+
+static int replay_clock_gettime(openr2_context_t *r2context, struct timeval *tv)
+{
+	trace_replay_t *replay = r2context->io_trace;
+	uint64_t now;
+	pthread_mutex_lock(&replay->lock);
+	now = replay->clock_us;
+	pthread_mutex_unlock(&replay->lock);
+	tv->tv_sec = now / 1000000;
+	tv->tv_usec = now % 1000000;
+	return 0;
+}
+
+/* recorded time the idle channels can jump to: the next recorded poll result or protocol timer */
+static uint64_t replay_next_event_us(openr2_context_t *r2context, trace_replay_t *replay)
+{
+	openr2_chan_t *current;
+	trace_rec_hdr_t *rec;
+	trace_file_t *trace;
+	uint64_t next = 0, t;
+	int i;
+	for (trace = replay->traces; trace; trace = trace->next) {
+		rec = trace_peek(trace);
+		if (rec && TRACE_TYPE(rec->type) == TRACE_WAIT && (!next || trace->next_us < next)) {
+			next = trace->next_us;
+		}
+	}
+	pthread_mutex_unlock(&replay->lock);
+	openr2_mutex_lock(r2context->timers_lock);
+	for (i = 0; i < r2context->chans_count; i++) {
+		current = r2context->chans[i];
+		if (current->timers_count < 1) {
+			continue;
+		}
+		t = trace_tv_us(&current->sched_timers[0].time);
+		if (!next || t < next) {
+			next = t;
+		}
+	}
+	openr2_mutex_unlock(r2context->timers_lock);
+	pthread_mutex_lock(&replay->lock);
+	return next;
+}
+
+static trace_file_t *replay_get_trace(openr2_chan_t *r2chan)
+{
+	trace_replay_t *replay = r2chan->r2context->io_trace;
+	trace_file_t *trace;
+	if (r2chan->io_trace) {
+		return r2chan->io_trace;
+	}
+	if (!replay) {
+		return NULL;
+	}
+	pthread_mutex_lock(&replay->lock);
+	for (trace = replay->traces; trace; trace = trace->next) {
+		if (trace->fd == (int)(long)r2chan->fd) {
+			r2chan->io_trace = trace;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&replay->lock);
+	if (!r2chan->io_trace) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Descriptor %ld is not a replayed channel\n", (long)r2chan->fd);
+	}
+	return r2chan->io_trace;
+}
+
+#define REPLAY(r2chan) trace_replay_t *replay = r2chan->r2context->io_trace; \
+	trace_file_t *trace = replay_get_trace(r2chan); \
+	if (!trace) { \
+		return -1; \
+	} \
+	pthread_mutex_lock(&replay->lock);
+
+#define REPLAY_RETURN(res) \
+	do { \
+		pthread_mutex_unlock(&replay->lock); \
+		return (res); \
+	} while (0)
+
+static openr2_io_fd_t replay_open(openr2_context_t *r2context, int channo)
+{
+	trace_replay_t *replay = r2context->io_trace;
+	trace_file_hdr_t *hdr;
+	trace_file_t *trace;
+	char path[OR2_MAX_PATH];
+	struct stat st;
+	uint64_t start;
+
+	if (!replay) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Replay I/O used without calling openr2_context_set_io_replay()\n");
+		return NULL;
+	}
+	if (snprintf(path, sizeof(path), "%s/r2trace-chan%d.bin", r2context->io_trace_dir, channo) >= (int)sizeof(path)) {
+		return NULL;
+	}
+	trace = calloc(1, sizeof(*trace));
+	if (!trace) {
+		r2context->last_error = OR2_LIBERR_OUT_OF_MEMORY;
+		return NULL;
+	}
+	trace->fd = open(path, O_RDONLY);
+	if (trace->fd == -1 || fstat(trace->fd, &st) || st.st_size < (off_t)sizeof(*hdr)) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to open I/O trace %s\n", path);
+		goto failed;
+	}
+	trace->size = st.st_size;
+	trace->map = mmap(NULL, trace->size, PROT_READ, MAP_SHARED, trace->fd, 0);
+	if (trace->map == MAP_FAILED) {
+		trace->map = NULL;
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to map I/O trace %s: %s\n", path, strerror(errno));
+		goto failed;
+	}
+	hdr = (trace_file_hdr_t *)trace->map;
+	if (memcmp(hdr->magic, TRACE_MAGIC, sizeof(hdr->magic)) || hdr->version != TRACE_VERSION) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "%s is not an openr2 I/O trace\n", path);
+		goto failed;
+	}
+	trace->channo = channo;
+	trace->pos = sizeof(*hdr);
+	start = ((uint64_t)hdr->start_sec * 1000000) + hdr->start_usec;
+	trace->next_us = start;
+	if (trace_peek(trace)) {
+		trace->next_us += ((trace_rec_hdr_t *)(trace->map + trace->pos))->delta_us;
+	}
+
+	pthread_mutex_lock(&replay->lock);
+	/* replay starts at the earliest recorded channel */
+	if (!replay->traces || start < replay->base_us) {
+		replay->base_us = start;
+		replay->clock_us = start;
+		gettimeofday(&replay->real_start, NULL);
+	}
+	trace->next = replay->traces;
+	replay->traces = trace;
+	pthread_mutex_unlock(&replay->lock);
+	return (openr2_io_fd_t)(long)trace->fd;
+
+failed:
+	r2context->last_error = OR2_LIBERR_INVALID_CHAN_NUMBER;
+	if (trace->map) {
+		munmap(trace->map, trace->size);
+	}
+	if (trace->fd != -1) {
+		close(trace->fd);
+	}
+	free(trace);
+	return NULL;
+}
+
+static int replay_close(openr2_chan_t *r2chan)
+{
+	trace_file_t **prev;
+	REPLAY(r2chan);
+	for (prev = &replay->traces; *prev; prev = &(*prev)->next) {
+		if (*prev == trace) {
+			*prev = trace->next;
+			break;
+		}
+	}
+	munmap(trace->map, trace->size);
+	close(trace->fd);
+	free(trace);
+	r2chan->io_trace = NULL;
+	REPLAY_RETURN(0);
+}
+
+static int replay_setup(openr2_chan_t *r2chan)
+{
+	REPLAY(r2chan);
+	REPLAY_RETURN(0);
+}
+
+static int replay_set_cas(openr2_chan_t *r2chan, int cas)
+{
+	trace_rec_hdr_t *rec;
+	REPLAY(r2chan);
+	rec = replay_take(r2chan, replay, trace, TRACE_SET_CAS);
+	if (!rec) {
+		REPLAY_RETURN(0);
+	}
+	if (rec->value != cas) {
+		replay->divergences++;
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "Replay diverged, CAS 0x%02X written instead of 0x%02X\n", cas, rec->value);
+	}
+	trace_skip(trace, rec);
+	REPLAY_RETURN((rec->type & TRACE_FAILED) ? -1 : 0);
+}
+
+static int replay_get_cas(openr2_chan_t *r2chan, int *cas)
+{
+	trace_rec_hdr_t *rec;
+	REPLAY(r2chan);
+	rec = replay_take(r2chan, replay, trace, TRACE_CAS);
+	if (rec) {
+		trace->cas = rec->value;
+		trace_skip(trace, rec);
+	}
+	*cas = trace->cas;
+	REPLAY_RETURN((rec && (rec->type & TRACE_FAILED)) ? -1 : 0);
+}
+
+static int replay_flush_write_buffers(openr2_chan_t *r2chan)
+{
+	trace_rec_hdr_t *rec;
+	REPLAY(r2chan);
+	rec = replay_take(r2chan, replay, trace, TRACE_FLUSH);
+	if (rec) {
+		trace_skip(trace, rec);
+	}
+	REPLAY_RETURN(0);
+}
+
+static int replay_write(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	trace_rec_hdr_t *rec;
+	int res = size;
+	REPLAY(r2chan);
+	rec = replay_take(r2chan, replay, trace, TRACE_WRITE);
+	if (rec) {
+		res = (rec->type & TRACE_FAILED) ? -1 : rec->len;
+		if (res > 0 && (res > size || rec->value != trace_hash(buf, res))) {
+			replay->divergences++;
+			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "Replay diverged, written audio differs from the recording\n");
+		}
+		trace_skip(trace, rec);
+	}
+	REPLAY_RETURN(res);
+}
+
+static int replay_read(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	trace_rec_hdr_t *rec;
+	int res = 0;
+	REPLAY(r2chan);
+	rec = replay_take(r2chan, replay, trace, TRACE_READ);
+	if (rec) {
+		res = (rec->type & TRACE_FAILED) ? -1 : ((rec->len < size) ? rec->len : size);
+		if (res > 0) {
+			memcpy((void *)buf, (uint8_t *)rec + sizeof(*rec), res);
+		}
+		trace_skip(trace, rec);
+	}
+	REPLAY_RETURN(res);
+}
+
+static int replay_wait(openr2_chan_t *r2chan, int *flags, int block)
+{
+	trace_rec_hdr_t *rec;
+	uint64_t now, next;
+	int res = 0;
+	REPLAY(r2chan);
+	if (!flags || !*flags) {
+		REPLAY_RETURN(-1);
+	}
+	for ( ; ; ) {
+		rec = trace_peek(trace);
+		now = replay_now_us(replay);
+		if (rec && TRACE_TYPE(rec->type) == TRACE_WAIT && trace->next_us <= now) {
+			/* this is a poll the recording saw something on */
+			if (((rec->value >> 4) & *flags) != (rec->value >> 4)) {
+				replay->divergences++;
+				openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "Replay diverged, polled for 0x%X instead of 0x%X\n", *flags, rec->value >> 4);
+			}
+			res = (rec->type & TRACE_FAILED) ? -1 : 0;
+			*flags &= rec->value & 0x0F;
+			trace_skip(trace, rec);
+			break;
+		}
+		if (replay->mode == OR2_REPLAY_MAX_SPEED) {
+			/* nothing due here, move the virtual clock so the next poll or timer gets due, timers first */
+			next = replay_next_event_us(r2chan->r2context, replay);
+			if (next > replay->clock_us) {
+				replay->clock_us = next;
+			}
+			if (block && rec && TRACE_TYPE(rec->type) == TRACE_WAIT && trace->next_us > replay->clock_us) {
+				replay->clock_us = trace->next_us;
+			}
+		}
+		if (!block || !rec || TRACE_TYPE(rec->type) != TRACE_WAIT) {
+			*flags = 0;
+			break;
+		}
+		if (replay->mode == OR2_REPLAY_REAL_TIME) {
+			pthread_mutex_unlock(&replay->lock);
+			usleep((useconds_t)(trace->next_us - now));
+			pthread_mutex_lock(&replay->lock);
+		}
+	}
+	REPLAY_RETURN(res);
+}
+
+static int replay_get_oob_event(openr2_chan_t *r2chan, openr2_oob_event_t *event)
+{
+	trace_rec_hdr_t *rec;
+	REPLAY(r2chan);
+	*event = OR2_OOB_EVENT_NONE;
+	rec = replay_take(r2chan, replay, trace, TRACE_OOB);
+	if (rec) {
+		*event = rec->value;
+		trace_skip(trace, rec);
+	}
+	REPLAY_RETURN((rec && (rec->type & TRACE_FAILED)) ? -1 : 0);
+}
+
+static int replay_get_alarm_state(openr2_chan_t *r2chan, int *alarm)
+{
+	trace_rec_hdr_t *rec;
+	REPLAY(r2chan);
+	*alarm = 0;
+	rec = replay_take(r2chan, replay, trace, TRACE_ALARM);
+	if (rec) {
+		*alarm = rec->value;
+		trace_skip(trace, rec);
+	}
+	REPLAY_RETURN((rec && (rec->type & TRACE_FAILED)) ? -1 : 0);
+}
+
+static openr2_io_interface_t replay_io_interface = {
+	/* .open */ replay_open,
+	/* .close */ replay_close,
+	/* .set_cas */ replay_set_cas,
+	/* .get_cas */ replay_get_cas,
+	/* .flush_write_buffers */ replay_flush_write_buffers,
+	/* .write */ replay_write,
+	/* .read */ replay_read,
+	/* .setup */ replay_setup,
+	/* .wait */ replay_wait,
+	/* .get_oob_event */ replay_get_oob_event,
+	/* .get_alarm_state */ replay_get_alarm_state
+};
+
+openr2_io_interface_t *openr2_io_get_replay_interface(void)
+{
+	return &replay_io_interface;
+}
+
+int openr2_io_replay_start(openr2_context_t *r2context, openr2_replay_mode_t mode)
+{
+	trace_replay_t *replay = r2context->io_trace;
+	if (!replay) {
+		replay = calloc(1, sizeof(*replay));
+		if (!replay) {
+			r2context->last_error = OR2_LIBERR_OUT_OF_MEMORY;
+			return -1;
+		}
+		pthread_mutex_init(&replay->lock, NULL);
+		r2context->io_trace = replay;
+	}
+	replay->mode = mode;
+	r2context->gettime = (mode == OR2_REPLAY_MAX_SPEED) ? replay_clock_gettime : NULL;
+	return 0;
+}
+
+int openr2_io_replay_status(openr2_context_t *r2context, int *pending, unsigned *divergences)
+{
+	trace_replay_t *replay = r2context->io_trace;
+	trace_file_t *trace;
+	int count = 0;
+	if (!replay) {
+		return -1;
+	}
+	pthread_mutex_lock(&replay->lock);
+	for (trace = replay->traces; trace; trace = trace->next) {
+		if (trace_peek(trace)) {
+			count++;
+		}
+	}
+	if (pending) {
+		*pending = count;
+	}
+	if (divergences) {
+		*divergences = replay->divergences;
+	}
+	pthread_mutex_unlock(&replay->lock);
+	return 0;
+}
+
+void openr2_io_replay_destroy(openr2_context_t *r2context)
+{
+	trace_replay_t *replay = r2context->io_trace;
+	if (!replay) {
+		return;
+	}
+	/* channels closed their traces already */
+	r2context->gettime = NULL;
+	pthread_mutex_destroy(&replay->lock);
+	free(replay);
+	r2context->io_trace = NULL;
+}
+
+#else
+
+openr2_io_interface_t *openr2_io_get_record_interface(void)
+{
+	return NULL;
+}
+
+openr2_io_interface_t *openr2_io_get_replay_interface(void)
+{
+	return NULL;
+}
+
+int openr2_io_replay_start(openr2_context_t *r2context, openr2_replay_mode_t mode)
+{
+	return -1;
+}
+
+int openr2_io_replay_status(openr2_context_t *r2context, int *pending, unsigned *divergences)
+{
+	return -1;
+}
+
+void openr2_io_replay_destroy(openr2_context_t *r2context)
+{
+}
+
+#endif
@@ -0,0 +1,843 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * io_uring I/O backend. Audio reads and writes of every channel in a context
+ * go through one io_uring instance instead of one read(), write() and
+ * ZT_IOMUX ioctl() per channel every 20ms. Each channel always has a read
+ * queued on the ring into a registered buffer, writes are staged and queued
+ * one at a time per channel, and nothing reaches the kernel until the ring is
+ * submitted. Applications driving many channels from one thread call
+ * openr2_context_io_tick() once per loop to submit everything queued since the
+ * last tick and wait for completions with a single io_uring_enter(), then
+ * process the channels as usual. Channels processed without ticking the
+ * context submit their own requests when polled, which still saves the
+ * ioctl() but not the per channel system call.
+ *
+ * Opening channels, CAS bits, alarms and OOB events are left to the lower I/O
+ * interface given to openr2_context_set_io_type() (Zaptel/DAHDI by default),
+ * so any descriptor io_uring can read and write (DAHDI channels, pipes,
+ * FIFOs, sockets) can be driven through the ring.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef __linux__
+/* syscall() */
+#define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include "openr2/r2zapcompat.h"
+#include "openr2/r2log-pvt.h"
+#include "openr2/r2chan-pvt.h"
+#include "openr2/r2context-pvt.h"
+#include "openr2/r2utils-pvt.h"
+#include "openr2/r2ioabs.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <time.h>
+
+/* channels a single context can drive through its ring */
+#define URING_MAX_CHANS 512
+
+/* one read plus one write per channel in flight, rounded up */
+#define URING_ENTRIES 1024
+
+/* staged audio per channel, like the driver buffers */
+#define URING_TX_SIZE (OR2_CHAN_IO_NUMBUFS * OR2_CHAN_READ_SIZE)
+
+/* registered memory per channel: read buffer, staging and in flight write buffers */
+#define URING_SLOT_BUF_SIZE (OR2_CHAN_READ_SIZE + (2 * URING_TX_SIZE))
+
+/* blocking waits wake up at least this often to check the lower interface for events */
+#define URING_MAX_WAIT_MS 20
+
+#define URING_OP_READ 1
+#define URING_OP_WRITE 2
+#define URING_OP_CANCEL 3
+
+#define URING_USER_DATA(slotno, op) ((((uint64_t)(slotno)) << 8) | (op))
+
+typedef struct uring_slot {
+	openr2_chan_t *r2chan;
+	int fd;
+	/* requests queued or in flight for this slot */
+	int inflight;
+	/* a read is queued or in flight */
+	int reading;
+	/* bytes waiting in rxbuf for openr2_io_read(), 0 if none */
+	int rx_len;
+	/* the last read was interrupted by a pending event (ELAST) */
+	int oob;
+	/* errno of the last failed read */
+	int rx_error;
+	/* bytes staged in txbuf and being written from txflight */
+	int tx_len;
+	int tx_busy;
+	uint8_t *rxbuf;
+	uint8_t *txbuf;
+	uint8_t *txflight;
+} uring_slot_t;
+
+typedef struct uring_ring {
+	int fd;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned sq_entries;
+	struct io_uring_sqe *sqes;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr;
+	void *cq_ptr;
+	size_t sq_len;
+	size_t cq_len;
+	size_t sqes_len;
+	/* entries queued since the last submission */
+	unsigned pending;
+	/* whether buffers and descriptors could be registered with the kernel */
+	int fixed_bufs;
+	int fixed_files;
+	/* the user ticks the ring with openr2_context_io_tick() */
+	int ticked;
+	/* the lower interface reports events through read errors (ELAST) */
+	int oob_in_band;
+	openr2_io_interface_t *lower;
+	openr2_mutex_t *lock;
+	uint8_t *bufs;
+	unsigned submits;
+	unsigned completions;
+	uring_slot_t slots[URING_MAX_CHANS];
+} uring_ring_t;
+
+static int uring_sys_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int uring_sys_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void uring_ring_free(uring_ring_t *ring)
+{
+	if (ring->sqes) {
+		munmap(ring->sqes, ring->sqes_len);
+	}
+	if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) {
+		munmap(ring->cq_ptr, ring->cq_len);
+	}
+	if (ring->sq_ptr) {
+		munmap(ring->sq_ptr, ring->sq_len);
+	}
+	if (ring->fd != -1) {
+		close(ring->fd);
+	}
+	if (ring->bufs) {
+		free(ring->bufs);
+	}
+	if (ring->lock) {
+		openr2_mutex_destroy(&ring->lock);
+	}
+	free(ring);
+}
+
+static uring_ring_t *uring_ring_new(openr2_context_t *r2context)
+{
+	struct io_uring_params p;
+	struct iovec iov;
+	int files[URING_MAX_CHANS];
+	uring_ring_t *ring;
+	unsigned i;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring) {
+		return NULL;
+	}
+	ring->fd = -1;
+	ring->lower = r2context->io_lower;
+#ifdef ELAST
+	ring->oob_in_band = (ring->lower == openr2_io_get_zt_interface());
+#endif
+	if (openr2_mutex_create_ex(&ring->lock, 0)) {
+		uring_ring_free(ring);
+		return NULL;
+	}
+	memset(&p, 0, sizeof(p));
+	ring->fd = uring_sys_setup(URING_ENTRIES, &p);
+	if (ring->fd == -1) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to create io_uring: %s\n", strerror(errno));
+		uring_ring_free(ring);
+		return NULL;
+	}
+	ring->sq_len = p.sq_off.array + (p.sq_entries * sizeof(unsigned));
+	ring->cq_len = p.cq_off.cqes + (p.cq_entries * sizeof(struct io_uring_cqe));
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_len > ring->sq_len) {
+			ring->sq_len = ring->cq_len;
+		}
+		ring->cq_len = ring->sq_len;
+	}
+	ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED) {
+		ring->sq_ptr = NULL;
+		uring_ring_free(ring);
+		return NULL;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ptr = ring->sq_ptr;
+	} else {
+		ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ptr == MAP_FAILED) {
+			ring->cq_ptr = NULL;
+			uring_ring_free(ring);
+			return NULL;
+		}
+	}
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		uring_ring_free(ring);
+		return NULL;
+	}
+	ring->sq_head = (unsigned *)((char *)ring->sq_ptr + p.sq_off.head);
+	ring->sq_tail = (unsigned *)((char *)ring->sq_ptr + p.sq_off.tail);
+	ring->sq_mask = (unsigned *)((char *)ring->sq_ptr + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)((char *)ring->sq_ptr + p.sq_off.array);
+	ring->sq_entries = p.sq_entries;
+	ring->cq_head = (unsigned *)((char *)ring->cq_ptr + p.cq_off.head);
+	ring->cq_tail = (unsigned *)((char *)ring->cq_ptr + p.cq_off.tail);
+	ring->cq_mask = (unsigned *)((char *)ring->cq_ptr + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + p.cq_off.cqes);
+
+	ring->bufs = calloc(URING_MAX_CHANS, URING_SLOT_BUF_SIZE);
+	if (!ring->bufs) {
+		uring_ring_free(ring);
+		return NULL;
+	}
+	for (i = 0; i < URING_MAX_CHANS; i++) {
+		ring->slots[i].fd = -1;
+		ring->slots[i].rxbuf = ring->bufs + (i * URING_SLOT_BUF_SIZE);
+		ring->slots[i].txbuf = ring->slots[i].rxbuf + OR2_CHAN_READ_SIZE;
+		ring->slots[i].txflight = ring->slots[i].txbuf + URING_TX_SIZE;
+		files[i] = -1;
+	}
+
+	/* the kernel maps the buffers and takes the descriptor references once instead of on every request,
+	   both are optional and just cost a bit more per request when not available (i.e. memlock limits) */
+	iov.iov_base = ring->bufs;
+	iov.iov_len = URING_MAX_CHANS * URING_SLOT_BUF_SIZE;
+	ring->fixed_bufs = uring_sys_register(ring->fd, IORING_REGISTER_BUFFERS, &iov, 1) ? 0 : 1;
+	ring->fixed_files = uring_sys_register(ring->fd, IORING_REGISTER_FILES, files, URING_MAX_CHANS) ? 0 : 1;
+	if (!ring->fixed_bufs || !ring->fixed_files) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_NOTICE, "io_uring running without %s%s\n",
+				ring->fixed_bufs ? "" : "registered buffers ", ring->fixed_files ? "" : "fixed files");
+	}
+	return ring;
+}
+
+/*! \brief push everything queued to the kernel, must be called with the ring lock held */
+static int uring_submit(uring_ring_t *ring)
+{
+	int res;
+	while (ring->pending) {
+		res = uring_sys_enter(ring->fd, ring->pending, 0, 0, NULL, 0);
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			/* EAGAIN and EBUSY mean the completion queue is full, reaping will make room */
+			return -1;
+		}
+		ring->submits++;
+		ring->pending -= (res > (int)ring->pending) ? ring->pending : (unsigned)res;
+		if (!res) {
+			break;
+		}
+	}
+	return 0;
+}
+
+static struct io_uring_sqe *uring_get_sqe(uring_ring_t *ring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail = *ring->sq_tail;
+	unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	if ((tail - head) >= ring->sq_entries) {
+		/* the submission queue is full, no point on waiting for the next tick */
+		uring_submit(ring);
+		head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+		if ((tail - head) >= ring->sq_entries) {
+			return NULL;
+		}
+	}
+	sqe = &ring->sqes[tail & *ring->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+static void uring_push_sqe(uring_ring_t *ring)
+{
+	unsigned tail = *ring->sq_tail;
+	ring->sq_array[tail & *ring->sq_mask] = tail & *ring->sq_mask;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->pending++;
+}
+
+static int uring_queue_rw(uring_ring_t *ring, int slotno, int op, uint8_t *buf, int len)
+{
+	uring_slot_t *slot = &ring->slots[slotno];
+	struct io_uring_sqe *sqe = uring_get_sqe(ring);
+	if (!sqe) {
+		return -1;
+	}
+	if (ring->fixed_bufs) {
+		sqe->opcode = (op == URING_OP_READ) ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+		sqe->buf_index = 0;
+	} else {
+		sqe->opcode = (op == URING_OP_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+	}
+	if (ring->fixed_files) {
+		sqe->fd = slotno;
+		sqe->flags = IOSQE_FIXED_FILE;
+	} else {
+		sqe->fd = slot->fd;
+	}
+	/* channels are streams, use the current file position */
+	sqe->off = (uint64_t)-1;
+	sqe->addr = (uint64_t)(unsigned long)buf;
+	sqe->len = len;
+	sqe->user_data = URING_USER_DATA(slotno, op);
+	uring_push_sqe(ring);
+	slot->inflight++;
+	return 0;
+}
+
+static void uring_queue_read(uring_ring_t *ring, int slotno)
+{
+	uring_slot_t *slot = &ring->slots[slotno];
+	if (slot->reading || slot->fd == -1) {
+		return;
+	}
+	if (!uring_queue_rw(ring, slotno, URING_OP_READ, slot->rxbuf, OR2_CHAN_READ_SIZE)) {
+		slot->reading = 1;
+	}
+}
+
+static void uring_queue_write(uring_ring_t *ring, int slotno)
+{
+	uring_slot_t *slot = &ring->slots[slotno];
+	uint8_t *tmp;
+	int len;
+	if (slot->tx_busy || !slot->tx_len) {
+		return;
+	}
+	/* swap staging and in flight buffers so the channel can keep staging while this is written */
+	tmp = slot->txflight;
+	slot->txflight = slot->txbuf;
+	slot->txbuf = tmp;
+	len = slot->tx_len;
+	slot->tx_len = 0;
+	if (!uring_queue_rw(ring, slotno, URING_OP_WRITE, slot->txflight, len)) {
+		slot->tx_busy = 1;
+	}
+}
+
+static void uring_handle_cqe(uring_ring_t *ring, struct io_uring_cqe *cqe)
+{
+	int slotno = (int)((cqe->user_data >> 8) & 0xFFFF);
+	int op = (int)(cqe->user_data & 0xFF);
+	uring_slot_t *slot;
+	if (slotno >= URING_MAX_CHANS) {
+		return;
+	}
+	slot = &ring->slots[slotno];
+	slot->inflight--;
+	switch (op) {
+	case URING_OP_READ:
+		slot->reading = 0;
+		if (slot->fd == -1 || cqe->res == -ECANCELED) {
+			break;
+		}
+		if (cqe->res > 0) {
+			if (slot->r2chan && slot->r2chan->read_enabled && !slot->r2chan->inalarm) {
+				slot->rx_len = cqe->res;
+			} else {
+				/* nobody is going to read it, keep the driver buffers moving like it does when idle */
+				uring_queue_read(ring, slotno);
+			}
+#ifdef ELAST
+		} else if (cqe->res == -ELAST) {
+			slot->oob = 1;
+			uring_queue_read(ring, slotno);
+#endif
+		} else {
+			/* end of file or error, reported on the next read */
+			slot->rx_error = cqe->res ? -cqe->res : EPIPE;
+		}
+		break;
+	case URING_OP_WRITE:
+		slot->tx_busy = 0;
+		if (slot->fd != -1) {
+			uring_queue_write(ring, slotno);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/*! \brief process all completions, no system call involved, must be called with the ring lock held */
+static int uring_reap(uring_ring_t *ring)
+{
+	unsigned head = *ring->cq_head;
+	unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	int count = 0;
+	while (head != tail) {
+		uring_handle_cqe(ring, &ring->cqes[head & *ring->cq_mask]);
+		head++;
+		count++;
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	ring->completions += count;
+	return count;
+}
+
+/*! \brief submit and wait for at least one completion or ms milliseconds, must be called with the ring lock held */
+static int uring_submit_and_wait(uring_ring_t *ring, int ms)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned submit = ring->pending;
+	int res;
+	memset(&arg, 0, sizeof(arg));
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	arg.ts = (uint64_t)(unsigned long)&ts;
+	openr2_mutex_unlock(ring->lock);
+	res = uring_sys_enter(ring->fd, submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+	openr2_mutex_lock(ring->lock);
+	if (res < 0) {
+		if (errno == ETIME || errno == EINTR) {
+			return 0;
+		}
+		return -1;
+	}
+	ring->submits++;
+	ring->pending -= ((unsigned)res > ring->pending) ? ring->pending : (unsigned)res;
+	return 0;
+}
+
+static uring_ring_t *uring_get_ring(openr2_context_t *r2context)
+{
+	if (!r2context->io_ring) {
+		r2context->io_ring = uring_ring_new(r2context);
+	}
+	return r2context->io_ring;
+}
+
+/* channels get their slot on setup, looked up by the descriptor the lower interface opened */
+static uring_slot_t *uring_get_slot(openr2_chan_t *r2chan)
+{
+	uring_ring_t *ring = r2chan->r2context->io_ring;
+	int i, fd = (int)(long)r2chan->fd;
+	if (r2chan->io_private) {
+		return r2chan->io_private;
+	}
+	if (!ring) {
+		return NULL;
+	}
+	openr2_mutex_lock(ring->lock);
+	for (i = 0; i < URING_MAX_CHANS; i++) {
+		if (ring->slots[i].fd == fd && !ring->slots[i].r2chan) {
+			ring->slots[i].r2chan = r2chan;
+			r2chan->io_private = &ring->slots[i];
+			break;
+		}
+	}
+	openr2_mutex_unlock(ring->lock);
+	if (!r2chan->io_private) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Descriptor %d is not an io_uring channel\n", fd);
+	}
+	return r2chan->io_private;
+}
+
+#define URING_SLOT(r2chan) uring_ring_t *ring; \
+	uring_slot_t *slot = uring_get_slot(r2chan); \
+	if (!slot) { \
+		return -1; \
+	} \
+	ring = r2chan->r2context->io_ring;
+
+#define URING_SLOTNO ((int)(slot - ring->slots))
+
+static openr2_io_fd_t uring_open(openr2_context_t *r2context, int channo)
+{
+	openr2_io_fd_t fd;
+	uring_ring_t *ring = uring_get_ring(r2context);
+	int i, ufd;
+	if (!ring) {
+		r2context->last_error = OR2_LIBERR_SYSCALL_FAILED;
+		return NULL;
+	}
+	fd = ring->lower->open(r2context, channo);
+	if (!fd) {
+		return NULL;
+	}
+	ufd = (int)(long)fd;
+	openr2_mutex_lock(ring->lock);
+	for (i = 0; i < URING_MAX_CHANS; i++) {
+		if (ring->slots[i].fd == -1 && !ring->slots[i].inflight) {
+			break;
+		}
+	}
+	if (i == URING_MAX_CHANS) {
+		openr2_mutex_unlock(ring->lock);
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "No room for channel %d in the io_uring, max is %d channels\n", channo, URING_MAX_CHANS);
+		r2context->last_error = OR2_LIBERR_INVALID_CHAN_NUMBER;
+		close(ufd);
+		return NULL;
+	}
+	if (ring->fixed_files) {
+		struct io_uring_files_update update;
+		memset(&update, 0, sizeof(update));
+		update.offset = i;
+		update.fds = (uint64_t)(unsigned long)&ufd;
+		if (uring_sys_register(ring->fd, IORING_REGISTER_FILES_UPDATE, &update, 1) != 1) {
+			openr2_mutex_unlock(ring->lock);
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to register channel %d with the io_uring: %s\n", channo, strerror(errno));
+			r2context->last_error = OR2_LIBERR_SYSCALL_FAILED;
+			close(ufd);
+			return NULL;
+		}
+	}
+	ring->slots[i].fd = ufd;
+	ring->slots[i].r2chan = NULL;
+	ring->slots[i].rx_len = 0;
+	ring->slots[i].rx_error = 0;
+	ring->slots[i].oob = 0;
+	ring->slots[i].tx_len = 0;
+	openr2_mutex_unlock(ring->lock);
+	return fd;
+}
+
+static int uring_close(openr2_chan_t *r2chan)
+{
+	struct io_uring_sqe *sqe;
+	int res, ufd = -1;
+	URING_SLOT(r2chan);
+	openr2_mutex_lock(ring->lock);
+	/* the buffers belong to the slot, nothing can be left in flight before it is reused */
+	if (slot->reading) {
+		sqe = uring_get_sqe(ring);
+		if (sqe) {
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->fd = -1;
+			sqe->addr = URING_USER_DATA(URING_SLOTNO, URING_OP_READ);
+			sqe->user_data = URING_USER_DATA(URING_SLOTNO, URING_OP_CANCEL);
+			uring_push_sqe(ring);
+			slot->inflight++;
+		}
+	}
+	slot->tx_len = 0;
+	while (slot->inflight) {
+		if (uring_submit_and_wait(ring, URING_MAX_WAIT_MS)) {
+			break;
+		}
+		uring_reap(ring);
+	}
+	if (ring->fixed_files) {
+		struct io_uring_files_update update;
+		memset(&update, 0, sizeof(update));
+		update.offset = URING_SLOTNO;
+		update.fds = (uint64_t)(unsigned long)&ufd;
+		uring_sys_register(ring->fd, IORING_REGISTER_FILES_UPDATE, &update, 1);
+	}
+	slot->fd = -1;
+	slot->r2chan = NULL;
+	openr2_mutex_unlock(ring->lock);
+	res = ring->lower->close(r2chan);
+	r2chan->io_private = NULL;
+	return res;
+}
+
+static int uring_setup(openr2_chan_t *r2chan)
+{
+	URING_SLOT(r2chan);
+	if (ring->lower->setup(r2chan)) {
+		return -1;
+	}
+	openr2_mutex_lock(ring->lock);
+	uring_queue_read(ring, URING_SLOTNO);
+	openr2_mutex_unlock(ring->lock);
+	return 0;
+}
+
+static int uring_set_cas(openr2_chan_t *r2chan, int cas)
+{
+	URING_SLOT(r2chan);
+	return ring->lower->set_cas(r2chan, cas);
+}
+
+static int uring_get_cas(openr2_chan_t *r2chan, int *cas)
+{
+	URING_SLOT(r2chan);
+	return ring->lower->get_cas(r2chan, cas);
+}
+
+static int uring_get_alarm_state(openr2_chan_t *r2chan, int *alarm)
+{
+	URING_SLOT(r2chan);
+	return ring->lower->get_alarm_state(r2chan, alarm);
+}
+
+static int uring_get_oob_event(openr2_chan_t *r2chan, openr2_oob_event_t *event)
+{
+	URING_SLOT(r2chan);
+	openr2_mutex_lock(ring->lock);
+	slot->oob = 0;
+	openr2_mutex_unlock(ring->lock);
+	return ring->lower->get_oob_event(r2chan, event);
+}
+
+static int uring_flush_write_buffers(openr2_chan_t *r2chan)
+{
+	URING_SLOT(r2chan);
+	openr2_mutex_lock(ring->lock);
+	/* what is in flight is already in the driver, the lower interface flushes that */
+	slot->tx_len = 0;
+	openr2_mutex_unlock(ring->lock);
+	return ring->lower->flush_write_buffers(r2chan);
+}
+
+static int uring_read(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	int res = 0, myerrno;
+	URING_SLOT(r2chan);
+	openr2_mutex_lock(ring->lock);
+	uring_reap(ring);
+	if (slot->rx_error) {
+		myerrno = slot->rx_error;
+		slot->rx_error = 0;
+		/* try again on the next tick */
+		uring_queue_read(ring, URING_SLOTNO);
+		openr2_mutex_unlock(ring->lock);
+		EMI(r2chan)->on_os_error(r2chan, myerrno);
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Failed to read from channel %d: %s\n", r2chan->number, strerror(myerrno));
+		return -1;
+	}
+	if (slot->rx_len) {
+		res = (size < slot->rx_len) ? size : slot->rx_len;
+		memcpy((void *)buf, slot->rxbuf, res);
+		slot->rx_len = 0;
+		uring_queue_read(ring, URING_SLOTNO);
+	}
+	openr2_mutex_unlock(ring->lock);
+	return res;
+}
+
+static int uring_write(openr2_chan_t *r2chan, const void *buf, int size)
+{
+	URING_SLOT(r2chan);
+	openr2_mutex_lock(ring->lock);
+	if (size > (URING_TX_SIZE - slot->tx_len)) {
+		/* the driver would have blocked, just write what fits */
+		size = URING_TX_SIZE - slot->tx_len;
+	}
+	memcpy(slot->txbuf + slot->tx_len, buf, size);
+	slot->tx_len += size;
+	uring_queue_write(ring, URING_SLOTNO);
+	openr2_mutex_unlock(ring->lock);
+	return size;
+}
+
+static int uring_ready_flags(uring_ring_t *ring, uring_slot_t *slot, int flags)
+{
+	int ready = 0;
+	if ((flags & OR2_IO_READ) && (slot->rx_len || slot->rx_error)) {
+		ready |= OR2_IO_READ;
+	}
+	if ((flags & OR2_IO_WRITE) && (URING_TX_SIZE - slot->tx_len) >= OR2_CHAN_READ_SIZE) {
+		ready |= OR2_IO_WRITE;
+	}
+	if ((flags & OR2_IO_OOB_EVENT) && slot->oob) {
+		ready |= OR2_IO_OOB_EVENT;
+	}
+	return ready;
+}
+
+static int uring_wait(openr2_chan_t *r2chan, int *flags, int block)
+{
+	int ready, oobflags;
+	URING_SLOT(r2chan);
+	if (!flags || !*flags) {
+		return -1;
+	}
+	openr2_mutex_lock(ring->lock);
+	/* nobody else is going to submit what this channel queued */
+	if (!ring->ticked || block) {
+		uring_submit(ring);
+	}
+	for ( ; ; ) {
+		uring_reap(ring);
+		/* make sure reads are armed even if the channel was not reading until now */
+		uring_queue_read(ring, URING_SLOTNO);
+		ready = uring_ready_flags(ring, slot, *flags);
+		if (!ring->oob_in_band && (*flags & OR2_IO_OOB_EVENT) && !(ready & OR2_IO_OOB_EVENT)) {
+			oobflags = OR2_IO_OOB_EVENT;
+			openr2_mutex_unlock(ring->lock);
+			if (ring->lower->wait(r2chan, &oobflags, 0)) {
+				return -1;
+			}
+			openr2_mutex_lock(ring->lock);
+			ready |= oobflags & OR2_IO_OOB_EVENT;
+		}
+		if (ready || !block) {
+			break;
+		}
+		if (uring_submit_and_wait(ring, URING_MAX_WAIT_MS)) {
+			openr2_mutex_unlock(ring->lock);
+			EMI(r2chan)->on_os_error(r2chan, errno);
+			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Failed to wait for io_uring completions: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+	openr2_mutex_unlock(ring->lock);
+	*flags = ready;
+	return 0;
+}
+
+int openr2_io_uring_tick(openr2_context_t *r2context, int wait_ms)
+{
+	uring_ring_t *ring = r2context->io_ring;
+	int res, count;
+	if (!ring) {
+		return -1;
+	}
+	openr2_mutex_lock(ring->lock);
+	ring->ticked = 1;
+	count = uring_reap(ring);
+	if (count || !wait_ms) {
+		res = uring_submit(ring);
+	} else {
+		res = uring_submit_and_wait(ring, wait_ms < 0 ? URING_MAX_WAIT_MS : wait_ms);
+	}
+	count += uring_reap(ring);
+	openr2_mutex_unlock(ring->lock);
+	return res ? -1 : count;
+}
+
+void openr2_io_uring_get_stats(openr2_context_t *r2context, unsigned *submits, unsigned *completions)
+{
+	uring_ring_t *ring = r2context->io_ring;
+	if (submits) {
+		*submits = ring ? ring->submits : 0;
+	}
+	if (completions) {
+		*completions = ring ? ring->completions : 0;
+	}
+}
+
+void openr2_io_uring_destroy(openr2_context_t *r2context)
+{
+	if (r2context->io_ring) {
+		uring_ring_free(r2context->io_ring);
+		r2context->io_ring = NULL;
+	}
+}
+
+static openr2_io_interface_t uring_io_interface = {
+	/* .open */ uring_open,
+	/* .close */ uring_close,
+	/* .set_cas */ uring_set_cas,
+	/* .get_cas */ uring_get_cas,
+	/* .flush_write_buffers */ uring_flush_write_buffers,
+	/* .write */ uring_write,
+	/* .read */ uring_read,
+	/* .setup */ uring_setup,
+	/* .wait */ uring_wait,
+	/* .get_oob_event */ uring_get_oob_event,
+	/* .get_alarm_state */ uring_get_alarm_state
+};
+
+openr2_io_interface_t *openr2_io_get_uring_interface(void)
+{
+	int fd;
+	struct io_uring_params p;
+	/* the headers do not mean the running kernel supports it, or that we are allowed to use it */
+	memset(&p, 0, sizeof(p));
+	fd = uring_sys_setup(1, &p);
+	if (fd == -1) {
+		return NULL;
+	}
+	close(fd);
+	if (!(p.features & IORING_FEAT_EXT_ARG)) {
+		return NULL;
+	}
+	return &uring_io_interface;
+}
+
+#else
+
+openr2_io_interface_t *openr2_io_get_uring_interface(void)
+{
+	return NULL;
+}
+
+int openr2_io_uring_tick(openr2_context_t *r2context, int wait_ms)
+{
+	return -1;
+}
+
+void openr2_io_uring_get_stats(openr2_context_t *r2context, unsigned *submits, unsigned *completions)
+{
+	if (submits) {
+		*submits = 0;
+	}
+	if (completions) {
+		*completions = 0;
+	}
+}
+
+void openr2_io_uring_destroy(openr2_context_t *r2context)
+{
+}
+
+#endif
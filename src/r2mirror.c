@@ -0,0 +1,135 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * Channel state mirror. Drivers give back the CAS bits we receive but not
+ * the ones we transmit, and several signals share bits, so after a restart
+ * the received bits alone cannot tell an answered incoming call from one
+ * still in setup. The mirror is a file, usually in /dev/shm, mapped by the
+ * context with one record per channel number holding the signal the channel
+ * transmits. Records are written on every CAS change with a single aligned
+ * store, a standby process mapping the same file can read them at any time.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef __linux__
+/* ftruncate() */
+#define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "openr2/r2log-pvt.h"
+#include "openr2/r2chan-pvt.h"
+#include "openr2/r2context-pvt.h"
+#include "openr2/r2mirror-pvt.h"
+
+#define MIRROR_MAGIC 0x4f52324d /* OR2M */
+#define MIRROR_VERSION 1
+
+/* channel numbers the mirror has room for */
+#define MIRROR_MAX_CHANS 4096
+
+/* the signal is stored plus one so a zeroed record means unknown */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t chans;
+	uint32_t reserved;
+	int32_t tx_signal[MIRROR_MAX_CHANS];
+} mirror_map_t;
+
+int openr2_mirror_open(openr2_context_t *r2context, const char *path)
+{
+	mirror_map_t *map;
+	int fd;
+	openr2_mirror_close(r2context);
+	fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (fd == -1) {
+		r2context->last_error = OR2_LIBERR_SYSCALL_FAILED;
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to open state mirror %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (ftruncate(fd, sizeof(*map))) {
+		r2context->last_error = OR2_LIBERR_SYSCALL_FAILED;
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to size state mirror %s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, sizeof(*map), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		r2context->last_error = OR2_LIBERR_SYSCALL_FAILED;
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_ERROR, "Failed to map state mirror %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (map->magic != MIRROR_MAGIC || map->version != MIRROR_VERSION || map->chans != MIRROR_MAX_CHANS) {
+		/* new file or from something else, nothing in it can be trusted */
+		if (map->magic) {
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_WARNING, "Ignoring the contents of state mirror %s\n", path);
+		}
+		memset(map, 0, sizeof(*map));
+		map->version = MIRROR_VERSION;
+		map->chans = MIRROR_MAX_CHANS;
+		map->magic = MIRROR_MAGIC;
+	}
+	r2context->mirror = map;
+	openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Mirroring channel state to %s\n", path);
+	return 0;
+}
+
+void openr2_mirror_close(openr2_context_t *r2context)
+{
+	if (!r2context->mirror) {
+		return;
+	}
+	munmap(r2context->mirror, sizeof(mirror_map_t));
+	r2context->mirror = NULL;
+}
+
+void openr2_mirror_update(openr2_chan_t *r2chan)
+{
+	mirror_map_t *map = r2chan->r2context->mirror;
+	if (!map || r2chan->number <= 0 || r2chan->number >= MIRROR_MAX_CHANS) {
+		return;
+	}
+	openr2_atomic_store_32(&map->tx_signal[r2chan->number], r2chan->cas_tx_signal + 1);
+}
+
+openr2_cas_signal_t openr2_mirror_get_tx(openr2_chan_t *r2chan)
+{
+	mirror_map_t *map = r2chan->r2context->mirror;
+	int32_t signal;
+	if (!map || r2chan->number <= 0 || r2chan->number >= MIRROR_MAX_CHANS) {
+		return OR2_CAS_INVALID;
+	}
+	signal = openr2_atomic_load_32(&map->tx_signal[r2chan->number]);
+	if (signal <= 0 || signal > OR2_CAS_ANSWER + 1) {
+		return OR2_CAS_INVALID;
+	}
+	return signal - 1;
+}
@@ -0,0 +1,148 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * Number plan trie. Every node has a child per DNIS digit and, when some
+ * prefix ends there, the length of the numbers starting with that prefix.
+ * Channels keep the node they are at and step one digit at a time, the
+ * longest prefix seen so far tells how many digits the number has.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include "openr2/r2proto.h"
+#include "openr2/r2numplan-pvt.h"
+
+/* nodes are referenced by 16 bit indexes */
+#define NUMPLAN_MAX_NODES 32767
+
+typedef struct {
+	/* index of the node for each digit, 0 for none since nothing points to the root */
+	short child[10];
+	/* length of the numbers with the prefix ending here, 0 for none */
+	unsigned char length;
+} numplan_node_t;
+
+struct openr2_numplan_s {
+	numplan_node_t *nodes;
+	int used;
+	int size;
+	int prefixes;
+};
+
+static int numplan_new_node(openr2_numplan_t *plan)
+{
+	numplan_node_t *nodes;
+	int size;
+	if (plan->used == plan->size) {
+		if (plan->size == NUMPLAN_MAX_NODES) {
+			return -1;
+		}
+		size = plan->size ? plan->size * 2 : 64;
+		if (size > NUMPLAN_MAX_NODES) {
+			size = NUMPLAN_MAX_NODES;
+		}
+		nodes = realloc(plan->nodes, size * sizeof(*nodes));
+		if (!nodes) {
+			return -1;
+		}
+		plan->nodes = nodes;
+		plan->size = size;
+	}
+	memset(&plan->nodes[plan->used], 0, sizeof(plan->nodes[0]));
+	return plan->used++;
+}
+
+int openr2_numplan_add(openr2_numplan_t **plan, const char *prefix, int length)
+{
+	const char *digit;
+	int node, child;
+	if (!prefix || length <= 0 || length >= OR2_MAX_DNIS || (int)strlen(prefix) > length) {
+		return -1;
+	}
+	for (digit = prefix; *digit; digit++) {
+		if (*digit < '0' || *digit > '9') {
+			return -1;
+		}
+	}
+	if (!*plan) {
+		*plan = calloc(1, sizeof(**plan));
+		if (!*plan) {
+			return -1;
+		}
+		if (numplan_new_node(*plan) != OR2_NUMPLAN_ROOT) {
+			free(*plan);
+			*plan = NULL;
+			return -1;
+		}
+	}
+	node = OR2_NUMPLAN_ROOT;
+	for (digit = prefix; *digit; digit++) {
+		child = (*plan)->nodes[node].child[*digit - '0'];
+		if (!child) {
+			child = numplan_new_node(*plan);
+			if (child < 0) {
+				return -1;
+			}
+			(*plan)->nodes[node].child[*digit - '0'] = child;
+		}
+		node = child;
+	}
+	if (!(*plan)->nodes[node].length) {
+		(*plan)->prefixes++;
+	}
+	(*plan)->nodes[node].length = length;
+	return 0;
+}
+
+void openr2_numplan_free(openr2_numplan_t *plan)
+{
+	if (!plan) {
+		return;
+	}
+	free(plan->nodes);
+	free(plan);
+}
+
+int openr2_numplan_count(const openr2_numplan_t *plan)
+{
+	return plan ? plan->prefixes : 0;
+}
+
+/* Move from node with the given digit. Returns the new node, or OR2_NUMPLAN_NONE
+   if no longer prefix can match. length is updated when a prefix ends at the new node */
+int openr2_numplan_step(const openr2_numplan_t *plan, int node, char digit, int *length)
+{
+	int child;
+	if (!plan || node == OR2_NUMPLAN_NONE || digit < '0' || digit > '9') {
+		return OR2_NUMPLAN_NONE;
+	}
+	child = plan->nodes[node].child[digit - '0'];
+	if (!child) {
+		return OR2_NUMPLAN_NONE;
+	}
+	if (plan->nodes[child].length) {
+		*length = plan->nodes[child].length;
+	}
+	return child;
+}
@@ -0,0 +1,469 @@
+/*
+ * OpenR2
+ * MFC/R2 call setup library
+ *
+ * Advanced configuration profiles. An advanced file is read once into the
+ * list of settings it changes, which is what contexts apply on top of their
+ * variant defaults. Profiles are cached by path and kept while the file
+ * stays the same, so every span of a box configured from the same file
+ * shares a single copy instead of parsing it again.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "openr2/r2log-pvt.h"
+#include "openr2/r2chan-pvt.h"
+#include "openr2/r2context-pvt.h"
+#include "openr2/r2profile-pvt.h"
+
+/* power of 2, at least twice the number of keys */
+#define PROFILE_HASH_SIZE 128
+
+typedef enum {
+	PROFILE_TONE,
+	PROFILE_TIMER,
+	PROFILE_SETTING,
+	PROFILE_RELEASE_POLICY,
+	PROFILE_NUMBER_PLAN
+} profile_key_type_t;
+
+/* a key of the advanced file and the setting it changes */
+typedef struct {
+	const char *name;
+	size_t offset;
+	profile_key_type_t type;
+} profile_key_t;
+
+#define TONE_KEY(field) { #field, offsetof(openr2_config_t, field), PROFILE_TONE }
+#define TIMER_KEY(field) { #field, offsetof(openr2_config_t, field), PROFILE_TIMER }
+#define SETTING_KEY(field) { #field, offsetof(openr2_config_t, field), PROFILE_SETTING }
+
+static const profile_key_t profile_keys[] = {
+	/* Group A tones */
+	TONE_KEY(mf_ga_tones.request_next_ani_digit),
+	TONE_KEY(mf_ga_tones.request_next_dnis_digit),
+	TONE_KEY(mf_ga_tones.request_dnis_minus_1),
+	TONE_KEY(mf_ga_tones.request_dnis_minus_2),
+	TONE_KEY(mf_ga_tones.request_dnis_minus_3),
+	TONE_KEY(mf_ga_tones.request_all_dnis_again),
+	TONE_KEY(mf_ga_tones.request_category),
+	TONE_KEY(mf_ga_tones.request_category_and_change_to_gc),
+	TONE_KEY(mf_ga_tones.request_change_to_g2),
+	TONE_KEY(mf_ga_tones.address_complete_charge_setup),
+	TONE_KEY(mf_ga_tones.network_congestion),
+
+	/* Group B tones */
+	TONE_KEY(mf_gb_tones.accept_call_with_charge),
+	TONE_KEY(mf_gb_tones.accept_call_no_charge),
+	TONE_KEY(mf_gb_tones.busy_number),
+	TONE_KEY(mf_gb_tones.network_congestion),
+	TONE_KEY(mf_gb_tones.unallocated_number),
+	TONE_KEY(mf_gb_tones.line_out_of_order),
+	TONE_KEY(mf_gb_tones.special_info_tone),
+	TONE_KEY(mf_gb_tones.number_changed),
+
+	/* Group C tones */
+	TONE_KEY(mf_gc_tones.request_next_ani_digit),
+	TONE_KEY(mf_gc_tones.request_change_to_g2),
+	TONE_KEY(mf_gc_tones.request_next_dnis_digit_and_change_to_ga),
+
+	/* Group I tones */
+	TONE_KEY(mf_g1_tones.no_more_dnis_available),
+	TONE_KEY(mf_g1_tones.no_more_ani_available),
+	TONE_KEY(mf_g1_tones.caller_ani_is_restricted),
+
+	/* Group II tones */
+	TONE_KEY(mf_g2_tones.national_subscriber),
+	TONE_KEY(mf_g2_tones.national_priority_subscriber),
+	TONE_KEY(mf_g2_tones.international_subscriber),
+	TONE_KEY(mf_g2_tones.international_priority_subscriber),
+	TONE_KEY(mf_g2_tones.collect_call),
+	TONE_KEY(mf_g2_tones.pay_phone),
+
+	/* Timers */
+	TIMER_KEY(timers.mf_back_cycle),
+	TIMER_KEY(timers.mf_back_resume_cycle),
+	TIMER_KEY(timers.mf_fwd_safety),
+	TIMER_KEY(timers.r2_seize),
+	TIMER_KEY(timers.r2_seize_persist),
+	TIMER_KEY(timers.r2_answer),
+	TIMER_KEY(timers.r2_metering_pulse),
+	TIMER_KEY(timers.r2_double_answer),
+	TIMER_KEY(timers.r2_answer_delay),
+	TIMER_KEY(timers.r2_set_call_down),
+	TIMER_KEY(timers.cas_persistence_check),
+	TIMER_KEY(timers.dtmf_start_dial),
+
+	/* misc settings */
+	SETTING_KEY(mf_threshold),
+	SETTING_KEY(fast_clear_back),
+	{ "release_policy", offsetof(openr2_config_t, release_policy), PROFILE_RELEASE_POLICY },
+
+	/* number plan, one prefix,length pair per line */
+	{ "number_plan", 0, PROFILE_NUMBER_PLAN }
+};
+
+#undef TONE_KEY
+#undef TIMER_KEY
+#undef SETTING_KEY
+
+/* a setting found in the file, in file order */
+typedef struct {
+	const profile_key_t *key;
+	int value;
+} profile_op_t;
+
+typedef struct {
+	char prefix[20];
+	int length;
+} profile_prefix_t;
+
+struct openr2_profile_s {
+	/* file the profile was read from and the version of it we read */
+	char path[OR2_MAX_PATH];
+	time_t mtime;
+	long mtime_nsec;
+	off_t size;
+	ino_t inode;
+	/* users, plus one while the profile is in the cache */
+	int refs;
+	profile_op_t *ops;
+	int ops_count;
+	profile_prefix_t *prefixes;
+	int prefixes_count;
+	struct openr2_profile_s *next;
+};
+
+/* files rewritten within the same second only differ in the nanoseconds */
+#if defined(__APPLE__)
+#define profile_mtime_nsec(_st) ((_st)->st_mtimespec.tv_nsec)
+#elif defined(st_mtime)
+#define profile_mtime_nsec(_st) ((_st)->st_mtim.tv_nsec)
+#else
+#define profile_mtime_nsec(_st) 0
+#endif
+
+/* protects the cache, the key index and the profile references. Created
+   by the first user and kept for the life of the process */
+static openr2_mutex_t *profile_lock = NULL;
+static openr2_profile_t *profile_cache = NULL;
+
+/* index in profile_keys plus one of the key hashed to each slot, 0 for none */
+static unsigned char profile_slots[PROFILE_HASH_SIZE];
+static int profile_slots_ready = 0;
+
+static openr2_mutex_t *profile_get_lock(void)
+{
+	openr2_mutex_t *lock = openr2_atomic_load_ptr(&profile_lock);
+	if (lock) {
+		return lock;
+	}
+	if (openr2_mutex_create(&lock) != OR2_SUCCESS) {
+		return NULL;
+	}
+	/* somebody else may have been faster creating it */
+	if (openr2_atomic_cas_ptr(&profile_lock, NULL, lock)) {
+		openr2_mutex_destroy(&lock);
+		lock = openr2_atomic_load_ptr(&profile_lock);
+	}
+	return lock;
+}
+
+static unsigned profile_hash(const char *name, size_t len)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)name[i];
+		hash *= 16777619u;
+	}
+	return hash & (PROFILE_HASH_SIZE - 1);
+}
+
+static void profile_index_keys(void)
+{
+	unsigned slot;
+	unsigned i;
+	if (profile_slots_ready) {
+		return;
+	}
+	for (i = 0; i < openr2_array_len(profile_keys); i++) {
+		slot = profile_hash(profile_keys[i].name, strlen(profile_keys[i].name));
+		while (profile_slots[slot]) {
+			slot = (slot + 1) & (PROFILE_HASH_SIZE - 1);
+		}
+		profile_slots[slot] = i + 1;
+	}
+	profile_slots_ready = 1;
+}
+
+static const profile_key_t *profile_find_key(const char *name, size_t len)
+{
+	const profile_key_t *key;
+	unsigned slot = profile_hash(name, len);
+	while (profile_slots[slot]) {
+		key = &profile_keys[profile_slots[slot] - 1];
+		if (!strncmp(key->name, name, len) && !key->name[len]) {
+			return key;
+		}
+		slot = (slot + 1) & (PROFILE_HASH_SIZE - 1);
+	}
+	return NULL;
+}
+
+static int profile_add_op(openr2_profile_t *profile, const profile_key_t *key, int value)
+{
+	profile_op_t *ops = realloc(profile->ops, (profile->ops_count + 1) * sizeof(*ops));
+	if (!ops) {
+		return -1;
+	}
+	ops[profile->ops_count].key = key;
+	ops[profile->ops_count].value = value;
+	profile->ops = ops;
+	profile->ops_count++;
+	return 0;
+}
+
+static int profile_add_prefix(openr2_profile_t *profile, const char *prefix, int length)
+{
+	profile_prefix_t *prefixes = realloc(profile->prefixes, (profile->prefixes_count + 1) * sizeof(*prefixes));
+	if (!prefixes) {
+		return -1;
+	}
+	strcpy(prefixes[profile->prefixes_count].prefix, prefix);
+	prefixes[profile->prefixes_count].length = length;
+	profile->prefixes = prefixes;
+	profile->prefixes_count++;
+	return 0;
+}
+
+/* turn a line of the file into the setting it changes, lines with
+   unknown keys or invalid values are ignored like they always were */
+static int profile_parse_line(openr2_profile_t *profile, const char *line)
+{
+	const profile_key_t *key;
+	const char *value = strchr(line, '=');
+	char prefix[20];
+	int intvalue;
+	if (!value) {
+		return 0;
+	}
+	key = profile_find_key(line, value - line);
+	if (!key) {
+		return 0;
+	}
+	value++;
+	switch (key->type) {
+	case PROFILE_TONE:
+		if (!*value) {
+			return 0;
+		}
+		intvalue = strchr("1234567890BCDEF", *value) ? *value : OR2_MF_TONE_INVALID;
+		return profile_add_op(profile, key, intvalue);
+	case PROFILE_TIMER:
+	case PROFILE_SETTING:
+		if (1 != sscanf(value, "%d", &intvalue) || intvalue < 0) {
+			return 0;
+		}
+		return profile_add_op(profile, key, intvalue);
+	case PROFILE_RELEASE_POLICY:
+		if (!strncmp(value, "fast", sizeof("fast") - 1)) {
+			return profile_add_op(profile, key, OR2_RELEASE_FAST);
+		}
+		if (!strncmp(value, "standard", sizeof("standard") - 1)) {
+			return profile_add_op(profile, key, OR2_RELEASE_STANDARD);
+		}
+		return 0;
+	case PROFILE_NUMBER_PLAN:
+		if (2 != sscanf(value, "%19[0-9],%d", prefix, &intvalue)) {
+			return 0;
+		}
+		return profile_add_prefix(profile, prefix, intvalue);
+	}
+	return 0;
+}
+
+static void profile_unref(openr2_profile_t *profile)
+{
+	if (--profile->refs) {
+		return;
+	}
+	free(profile->ops);
+	free(profile->prefixes);
+	free(profile);
+}
+
+static openr2_profile_t *profile_read(const char *filename, struct stat *st)
+{
+	openr2_profile_t *profile;
+	FILE *variant_file;
+	char line[255];
+	variant_file = fopen(filename, "r");
+	if (!variant_file) {
+		return NULL;
+	}
+	profile = calloc(1, sizeof(*profile));
+	if (!profile) {
+		fclose(variant_file);
+		return NULL;
+	}
+	strcpy(profile->path, filename);
+	profile->mtime = st->st_mtime;
+	profile->mtime_nsec = profile_mtime_nsec(st);
+	profile->size = st->st_size;
+	profile->inode = st->st_ino;
+	profile->refs = 1;
+	while (fgets(line, sizeof(line), variant_file)) {
+		if ('#' == line[0] || '\n' == line[0] || ' ' == line[0]) {
+			continue;
+		}
+		if (profile_parse_line(profile, line)) {
+			fclose(variant_file);
+			profile_unref(profile);
+			return NULL;
+		}
+	}
+	fclose(variant_file);
+	return profile;
+}
+
+OR2_DECLARE(openr2_profile_t *) openr2_profile_get(const char *filename)
+{
+	openr2_profile_t *profile, **prev;
+	openr2_mutex_t *lock;
+	struct stat st;
+	if (!filename || strlen(filename) >= OR2_MAX_PATH || stat(filename, &st)) {
+		return NULL;
+	}
+	lock = profile_get_lock();
+	if (!lock) {
+		return NULL;
+	}
+	openr2_mutex_lock(lock);
+	for (prev = &profile_cache; *prev; prev = &(*prev)->next) {
+		profile = *prev;
+		if (strcmp(profile->path, filename)) {
+			continue;
+		}
+		if (profile->mtime == st.st_mtime && profile->mtime_nsec == profile_mtime_nsec(&st)
+		    && profile->size == st.st_size && profile->inode == st.st_ino) {
+			profile->refs++;
+			openr2_mutex_unlock(lock);
+			return profile;
+		}
+		/* the file changed, whoever uses the old version keeps it */
+		*prev = profile->next;
+		profile_unref(profile);
+		break;
+	}
+	profile_index_keys();
+	profile = profile_read(filename, &st);
+	if (profile) {
+		/* the caller reference, the cache got the first one */
+		profile->refs++;
+		profile->next = profile_cache;
+		profile_cache = profile;
+	}
+	openr2_mutex_unlock(lock);
+	return profile;
+}
+
+OR2_DECLARE(void) openr2_profile_release(openr2_profile_t *profile)
+{
+	if (!profile) {
+		return;
+	}
+	/* whoever got the profile created the lock */
+	openr2_mutex_lock(profile_lock);
+	profile_unref(profile);
+	openr2_mutex_unlock(profile_lock);
+}
+
+OR2_DECLARE(void) openr2_profile_clear_cache(void)
+{
+	openr2_profile_t *profile;
+	openr2_mutex_t *lock = openr2_atomic_load_ptr(&profile_lock);
+	/* nothing was ever cached without the lock */
+	if (!lock) {
+		return;
+	}
+	openr2_mutex_lock(lock);
+	while (profile_cache) {
+		profile = profile_cache;
+		profile_cache = profile->next;
+		profile_unref(profile);
+	}
+	openr2_mutex_unlock(lock);
+}
+
+/* change the context settings the way the file says, profiles are never
+   modified once read so no lock is needed to go through them */
+void openr2_profile_apply(openr2_profile_t *profile, openr2_context_t *r2context)
+{
+	const profile_op_t *op;
+	char *config = (char *)&r2context->config;
+	openr2_mf_tone_t *tone;
+	int *setting;
+	int i;
+	for (i = 0; i < profile->ops_count; i++) {
+		op = &profile->ops[i];
+		switch (op->key->type) {
+		case PROFILE_TONE:
+			tone = (openr2_mf_tone_t *)(config + op->key->offset);
+			if (op->value != OR2_MF_TONE_INVALID) {
+				openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Changing tone %s from %02X to %02X\n",
+						op->key->name, *tone, op->value);
+			} else {
+				openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Disabling tone %s, its value was %02X\n",
+						op->key->name, *tone);
+			}
+			*tone = op->value;
+			break;
+		case PROFILE_TIMER:
+		case PROFILE_SETTING:
+			setting = (int *)(config + op->key->offset);
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Changing %s %s from %d to %d\n",
+					op->key->type == PROFILE_TIMER ? "timer" : "setting", op->key->name, *setting, op->value);
+			*setting = op->value;
+			break;
+		case PROFILE_RELEASE_POLICY:
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Using %s release policy\n",
+					op->value == OR2_RELEASE_FAST ? "fast" : "standard");
+			r2context->config.release_policy = op->value;
+			break;
+		case PROFILE_NUMBER_PLAN:
+			break;
+		}
+	}
+	for (i = 0; i < profile->prefixes_count; i++) {
+		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Found number plan prefix %s of length %d\n",
+				profile->prefixes[i].prefix, profile->prefixes[i].length);
+		openr2_context_add_number_plan(r2context, profile->prefixes[i].prefix, profile->prefixes[i].length);
+	}
+}
@@ -49,25 +49,33 @@
 #include "openr2/r2proto-pvt.h"
 #include "openr2/r2chan-pvt.h"
 #include "openr2/r2context-pvt.h"
+#include "openr2/r2numplan-pvt.h"
+#include "openr2/r2adapt-pvt.h"
+#include "openr2/r2admit-pvt.h"
+#include "openr2/r2mirror-pvt.h"
 
 #define R2(r2chan, signal) (r2chan)->r2context->cas_signals[OR2_CAS_##signal]
 
-#define GA_TONE(r2chan) (r2chan)->r2context->mf_ga_tones
-#define GB_TONE(r2chan) (r2chan)->r2context->mf_gb_tones
-#define GC_TONE(r2chan) (r2chan)->r2context->mf_gc_tones
+#define GA_TONE(r2chan) (r2chan)->config->mf_ga_tones
+#define GB_TONE(r2chan) (r2chan)->config->mf_gb_tones
+#define GC_TONE(r2chan) (r2chan)->config->mf_gc_tones
 
-#define GI_TONE(r2chan) (r2chan)->r2context->mf_g1_tones
-#define GII_TONE(r2chan) (r2chan)->r2context->mf_g2_tones
+#define GI_TONE(r2chan) (r2chan)->config->mf_g1_tones
+#define GII_TONE(r2chan) (r2chan)->config->mf_g2_tones
 
-#define TIMER(r2chan) (r2chan)->r2context->timers
+/* what a received tone means in the given group */
+#define MF_DECODE(r2chan, group, tone) \
+	(((unsigned)(tone) < OR2_MF_DECODE_SIZE) ? (r2chan)->config->mf_##group##_decode[(tone)] : 0)
 
-#define DIAL_DTMF(r2chan) ((r2chan)->r2context->dial_with_dtmf)
-#define DETECT_DTMF(r2chan) ((r2chan)->r2context->detect_dtmf)
-#define IS_DTMF_R2(r2chan) ((r2chan)->r2context->dial_with_dtmf || (r2chan)->r2context->detect_dtmf)
+#define TIMER(r2chan) (r2chan)->config->timers
+
+#define DIAL_DTMF(r2chan) ((r2chan)->config->dial_with_dtmf)
+#define DETECT_DTMF(r2chan) ((r2chan)->config->detect_dtmf)
+#define IS_DTMF_R2(r2chan) ((r2chan)->config->dial_with_dtmf || (r2chan)->config->detect_dtmf)
 
 /* Note that we compare >= because even if max_dnis is zero
    we could get 1 digit, want it or not :-) */
-#define DNIS_COMPLETE(r2chan) ((r2chan)->dnis_len >= (uint32_t) (r2chan)->r2context->max_dnis)
+#define DNIS_COMPLETE(r2chan) ((r2chan)->dnis_len >= (uint32_t) (r2chan)->config->max_dnis || OR2_NUMPLAN_COMPLETE(r2chan))
 
 #define OFFER_CALL(r2chan) \
 	do { \
@@ -84,29 +92,34 @@
 
 static void r2config_argentina(openr2_context_t *r2context)
 {
-	r2context->mf_g1_tones.no_more_dnis_available = OR2_MF_TONE_INVALID;
-	r2context->mf_g1_tones.caller_ani_is_restricted = OR2_MF_TONE_15;
-	r2context->mf_g1_tones.no_more_ani_available = OR2_MF_TONE_12;
-	r2context->mf_g2_tones.pay_phone = OR2_MF_TONE_4;
-	r2context->timers.r2_metering_pulse = 400;
+	r2context->config.mf_g1_tones.no_more_dnis_available = OR2_MF_TONE_INVALID;
+	r2context->config.mf_g1_tones.caller_ani_is_restricted = OR2_MF_TONE_15;
+	r2context->config.mf_g1_tones.no_more_ani_available = OR2_MF_TONE_12;
+	r2context->config.mf_g2_tones.pay_phone = OR2_MF_TONE_4;
+	r2context->config.timers.r2_metering_pulse = 400;
+	/* metering pulses are clear back signals too */
+	r2context->config.fast_clear_back = 0;
 }
 
 static void r2config_brazil(openr2_context_t *r2context)
 {
-	r2context->mf_g1_tones.no_more_dnis_available = OR2_MF_TONE_INVALID;
-	r2context->mf_g1_tones.caller_ani_is_restricted = OR2_MF_TONE_12;
+	r2context->config.mf_g1_tones.no_more_dnis_available = OR2_MF_TONE_INVALID;
+	r2context->config.mf_g1_tones.caller_ani_is_restricted = OR2_MF_TONE_12;
+
+	r2context->config.mf_g2_tones.collect_call = OR2_MF_TONE_8;
 
-	r2context->mf_g2_tones.collect_call = OR2_MF_TONE_8;
+	r2context->config.mf_ga_tones.address_complete_charge_setup = OR2_MF_TONE_INVALID;
+	r2context->config.mf_ga_tones.request_dnis_minus_1 = OR2_MF_TONE_9;
 
-	r2context->mf_ga_tones.address_complete_charge_setup = OR2_MF_TONE_INVALID;
-	r2context->mf_ga_tones.request_dnis_minus_1 = OR2_MF_TONE_9;
+	r2context->config.mf_gb_tones.accept_call_with_charge = OR2_MF_TONE_1;
+	r2context->config.mf_gb_tones.busy_number = OR2_MF_TONE_2;
+	r2context->config.mf_gb_tones.accept_call_no_charge = OR2_MF_TONE_5;
+	r2context->config.mf_gb_tones.special_info_tone = OR2_MF_TONE_6; /* holding? */
+	r2context->config.mf_gb_tones.number_changed = OR2_MF_TONE_3;
+	r2context->config.mf_gb_tones.unallocated_number = OR2_MF_TONE_7; 
 
-	r2context->mf_gb_tones.accept_call_with_charge = OR2_MF_TONE_1;
-	r2context->mf_gb_tones.busy_number = OR2_MF_TONE_2;
-	r2context->mf_gb_tones.accept_call_no_charge = OR2_MF_TONE_5;
-	r2context->mf_gb_tones.special_info_tone = OR2_MF_TONE_6; /* holding? */
-	r2context->mf_gb_tones.number_changed = OR2_MF_TONE_3;
-	r2context->mf_gb_tones.unallocated_number = OR2_MF_TONE_7; 
+	/* a clear back may be followed by a new answer (double answer) */
+	r2context->config.fast_clear_back = 0;
 }
 
 static void r2config_china(openr2_context_t *r2context)
@@ -116,15 +129,15 @@ static void r2config_china(openr2_context_t *r2context)
 	   used, so their value never changes during a call */
 	r2context->cas_nonr2_bits = 0x3;    /* 0011 */
 
-	r2context->mf_ga_tones.request_next_ani_digit = OR2_MF_TONE_1;
-	r2context->mf_ga_tones.request_category = OR2_MF_TONE_6;
-	r2context->mf_ga_tones.address_complete_charge_setup = OR2_MF_TONE_INVALID;
+	r2context->config.mf_ga_tones.request_next_ani_digit = OR2_MF_TONE_1;
+	r2context->config.mf_ga_tones.request_category = OR2_MF_TONE_6;
+	r2context->config.mf_ga_tones.address_complete_charge_setup = OR2_MF_TONE_INVALID;
 
-	r2context->mf_gb_tones.accept_call_with_charge = OR2_MF_TONE_1;
-	r2context->mf_gb_tones.busy_number = OR2_MF_TONE_2;
-	r2context->mf_gb_tones.special_info_tone = OR2_MF_TONE_INVALID;
+	r2context->config.mf_gb_tones.accept_call_with_charge = OR2_MF_TONE_1;
+	r2context->config.mf_gb_tones.busy_number = OR2_MF_TONE_2;
+	r2context->config.mf_gb_tones.special_info_tone = OR2_MF_TONE_INVALID;
 
-	r2context->mf_g1_tones.no_more_dnis_available = OR2_MF_TONE_INVALID;
+	r2context->config.mf_g1_tones.no_more_dnis_available = OR2_MF_TONE_INVALID;
 
 	/* ANI can come before DNIS */
 	openr2_set_flag(r2context, OR2_ANI_CAN_COME_FIRST);
@@ -133,9 +146,9 @@ static void r2config_china(openr2_context_t *r2context)
 	openr2_set_flag(r2context, OR2_FORCE_USE_MAX_ANI);
 
 	/* override max_ani and warn the user if the former value is different from OR2_MAX_ANI */
-	if (r2context->max_ani != OR2_MAX_ANI)
+	if (r2context->config.max_ani != OR2_MAX_ANI)
 		openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_DEBUG, "Overriding max_ani to %d\n", OR2_MAX_ANI);
-	r2context->max_ani = OR2_MAX_ANI;
+	r2context->config.max_ani = OR2_MAX_ANI;
 }
 
 static void r2config_itu(openr2_context_t *r2context)
@@ -149,42 +162,42 @@ static void r2config_mexico(openr2_context_t *r2context)
 	/* Telmex, Avantel and most telcos in Mexico send DNIS first and ANI at the end, however
 	   this can be modified by the user because I know of at least 1 telco (Maxcom)
 	   which requires the ANI first and the DNIS later */
-	r2context->get_ani_first = 0;
+	r2context->config.get_ani_first = 0;
 
 	/* Mexico use a special signal to request 
 	   calling party category AND switch to Group C */
-	r2context->mf_ga_tones.request_category = OR2_MF_TONE_INVALID;
-	r2context->mf_ga_tones.request_category_and_change_to_gc = OR2_MF_TONE_6;
-	r2context->mf_ga_tones.address_complete_charge_setup = OR2_MF_TONE_INVALID;
+	r2context->config.mf_ga_tones.request_category = OR2_MF_TONE_INVALID;
+	r2context->config.mf_ga_tones.request_category_and_change_to_gc = OR2_MF_TONE_6;
+	r2context->config.mf_ga_tones.address_complete_charge_setup = OR2_MF_TONE_INVALID;
 
 	/* GA next ANI is replaces by GC next ANI signal */
-	r2context->mf_ga_tones.request_next_ani_digit = OR2_MF_TONE_INVALID;
+	r2context->config.mf_ga_tones.request_next_ani_digit = OR2_MF_TONE_INVALID;
 
 	/* Group B */
-	r2context->mf_gb_tones.accept_call_with_charge = OR2_MF_TONE_1;
-	r2context->mf_gb_tones.accept_call_no_charge = OR2_MF_TONE_5;
-	r2context->mf_gb_tones.busy_number = OR2_MF_TONE_2;
-	r2context->mf_gb_tones.unallocated_number = OR2_MF_TONE_2;
-	r2context->mf_gb_tones.special_info_tone = OR2_MF_TONE_INVALID;
+	r2context->config.mf_gb_tones.accept_call_with_charge = OR2_MF_TONE_1;
+	r2context->config.mf_gb_tones.accept_call_no_charge = OR2_MF_TONE_5;
+	r2context->config.mf_gb_tones.busy_number = OR2_MF_TONE_2;
+	r2context->config.mf_gb_tones.unallocated_number = OR2_MF_TONE_2;
+	r2context->config.mf_gb_tones.special_info_tone = OR2_MF_TONE_INVALID;
 
 	/* GROUP C */
-	r2context->mf_gc_tones.request_next_ani_digit = OR2_MF_TONE_1;
-	r2context->mf_gc_tones.request_change_to_g2 = OR2_MF_TONE_3;
-	r2context->mf_gc_tones.request_next_dnis_digit_and_change_to_ga = OR2_MF_TONE_5;
-	r2context->mf_gc_tones.network_congestion = OR2_MF_TONE_4;
+	r2context->config.mf_gc_tones.request_next_ani_digit = OR2_MF_TONE_1;
+	r2context->config.mf_gc_tones.request_change_to_g2 = OR2_MF_TONE_3;
+	r2context->config.mf_gc_tones.request_next_dnis_digit_and_change_to_ga = OR2_MF_TONE_5;
+	r2context->config.mf_gc_tones.network_congestion = OR2_MF_TONE_4;
 	
 	/* Mexico has no signal when running out of DNIS, 
 	   timeout is used instead*/
-	r2context->mf_g1_tones.no_more_dnis_available = OR2_MF_TONE_INVALID;
+	r2context->config.mf_g1_tones.no_more_dnis_available = OR2_MF_TONE_INVALID;
 }
 
 static void r2config_venezuela(openr2_context_t *r2context)
 {
 
-	r2context->mf_ga_tones.request_next_ani_digit = OR2_MF_TONE_9;
+	r2context->config.mf_ga_tones.request_next_ani_digit = OR2_MF_TONE_9;
 
-	r2context->mf_g1_tones.caller_ani_is_restricted = OR2_MF_TONE_12;
-	r2context->mf_g1_tones.no_more_dnis_available = OR2_MF_TONE_INVALID;
+	r2context->config.mf_g1_tones.caller_ani_is_restricted = OR2_MF_TONE_12;
+	r2context->config.mf_g1_tones.no_more_dnis_available = OR2_MF_TONE_INVALID;
 }
 
 static void r2config_colombia(openr2_context_t *r2context)
@@ -198,16 +211,16 @@ static void r2config_colombia(openr2_context_t *r2context)
 	 * is important to change the accept_call_with_charge tone, not
 	 * sure about the others though.
 	 *
-	 * r2context->mf_ga_tones.request_next_ani_digit = OR2_MF_TONE_1;
-	 * r2context->mf_ga_tones.request_category = OR2_MF_TONE_6; 
+	 * r2context->config.mf_ga_tones.request_next_ani_digit = OR2_MF_TONE_1;
+	 * r2context->config.mf_ga_tones.request_category = OR2_MF_TONE_6; 
 	 *
 	 * */
-	r2context->mf_g1_tones.caller_ani_is_restricted = OR2_MF_TONE_12;
+	r2context->config.mf_g1_tones.caller_ani_is_restricted = OR2_MF_TONE_12;
 
-	r2context->mf_gb_tones.accept_call_with_charge = OR2_MF_TONE_1;
-	r2context->mf_gb_tones.busy_number = OR2_MF_TONE_2;
-	r2context->mf_gb_tones.accept_call_no_charge = OR2_MF_TONE_5;
-	r2context->mf_gb_tones.unallocated_number = OR2_MF_TONE_6;
+	r2context->config.mf_gb_tones.accept_call_with_charge = OR2_MF_TONE_1;
+	r2context->config.mf_gb_tones.busy_number = OR2_MF_TONE_2;
+	r2context->config.mf_gb_tones.accept_call_no_charge = OR2_MF_TONE_5;
+	r2context->config.mf_gb_tones.unallocated_number = OR2_MF_TONE_6;
 }
 
 /* These are the R2 signals to be sent in th A and B CAS bits, the
@@ -311,10 +324,55 @@ static openr2_variant_entry_t r2variants[] =
 	}
 };
 
+/* one period of any R2 MF pair (or silence) at 8kHz, all the frequencies are multiples of 20Hz */
+#define MF_LOOP_SAMPLES 400
+
+static void stop_mf_loop(openr2_chan_t *r2chan)
+{
+	if (!r2chan->mf_looping) {
+		return;
+	}
+	r2chan->mf_looping = 0;
+	if (openr2_io_stop_loop(r2chan)) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "failed to stop MF tone loop\n");
+	}
+}
+
+/* hand the selected tone to the I/O backend if it can repeat it, otherwise we keep writing it on every write-ready */
+static void start_mf_loop(openr2_chan_t *r2chan)
+{
+	int16_t tone_buf[MF_LOOP_SAMPLES];
+	uint8_t loop_buf[MF_LOOP_SAMPLES];
+	int res, i, samples = 0;
+	if (!r2chan->r2context->io->play_loop || !r2chan->r2context->io->stop_loop) {
+		return;
+	}
+	while (samples < MF_LOOP_SAMPLES) {
+		res = MFI(r2chan)->mf_generate_tone(r2chan->mf_write_handle, tone_buf + samples, MF_LOOP_SAMPLES - samples);
+		if (res <= 0) {
+			/* the generator does not produce a continuous tone, leave it in charge */
+			return;
+		}
+		samples += res;
+	}
+	for (i = 0; i < MF_LOOP_SAMPLES; i++) {
+		loop_buf[i] = TI(r2chan)->linear_to_alaw(tone_buf[i]);
+	}
+	if (!openr2_io_play_loop(r2chan, loop_buf, MF_LOOP_SAMPLES)) {
+		r2chan->mf_looping = 1;
+	} else {
+		/* what the generator gave us is lost, start the tone again for the write path */
+		MFI(r2chan)->mf_select_tone(r2chan->mf_write_handle, r2chan->mf_write_tone);
+	}
+}
+
 static void turn_off_mf_engine(openr2_chan_t *r2chan)
 {
+	stop_mf_loop(r2chan);
+
 	/* this is not needed for DTMF R2 mf engine, but does not hurt either */
 	openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.mf_back_cycle);
+	openr2_adapt_cancel(r2chan, OR2_ADAPTIVE_MF_BACK_CYCLE);
 
 	/* this is not needed for MFC R2 mf engine, but does not hurt either */
 	r2chan->dialing_dtmf = 0;
@@ -335,6 +393,7 @@ static int set_cas_signal(openr2_chan_t *r2chan, openr2_cas_signal_t signal)
 	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_CAS_TRACE, "CAS Tx >> [%s] 0x%02X\n", cas_names[signal], cas);
 	r2chan->cas_write = cas;
 	r2chan->cas_tx_signal = signal;
+	openr2_mirror_update(r2chan);
 	/* set the NON R2 bits to 1 */
 	cas |= r2chan->r2context->cas_nonr2_bits; 
 	res = openr2_io_set_cas(r2chan, cas);
@@ -346,6 +405,107 @@ static int set_cas_signal(openr2_chan_t *r2chan, openr2_cas_signal_t signal)
 	return 0;
 }
 
+/* the first meaning given to a tone wins, the same way
+   the order of the comparisons used to decide it */
+static void mf_decode(unsigned char *table, openr2_mf_tone_t tone, int meaning)
+{
+	if (tone == OR2_MF_TONE_INVALID || (unsigned)tone >= OR2_MF_DECODE_SIZE || table[tone]) {
+		return;
+	}
+	table[tone] = meaning;
+}
+
+static void mf_decode_flag(unsigned char *table, openr2_mf_tone_t tone, int flag)
+{
+	if (tone == OR2_MF_TONE_INVALID || (unsigned)tone >= OR2_MF_DECODE_SIZE) {
+		return;
+	}
+	table[tone] |= flag;
+}
+
+/* categories can be 0, always overwrite */
+static void mf_decode_category(unsigned char *table, openr2_mf_tone_t tone, openr2_calling_party_category_t category)
+{
+	if (tone == OR2_MF_TONE_INVALID || (unsigned)tone >= OR2_MF_DECODE_SIZE) {
+		return;
+	}
+	table[tone] = category;
+}
+
+/* Build the tone to meaning lookups out of the MF tones of the context.
+   Needs to be called again whenever any tone changes */
+void openr2_proto_compile_mf_tables(openr2_context_t *r2context)
+{
+	unsigned char *ga = r2context->config.mf_ga_decode;
+	unsigned char *gb = r2context->config.mf_gb_decode;
+	unsigned char *gc = r2context->config.mf_gc_decode;
+	unsigned char *gi = r2context->config.mf_gi_decode;
+	unsigned char *gii = r2context->config.mf_gii_decode;
+	openr2_mf_tone_t ani_tone = r2context->config.mf_ga_tones.request_next_ani_digit;
+	int tone;
+
+	memset(r2context->config.mf_ga_decode, 0, sizeof(r2context->config.mf_ga_decode));
+	memset(r2context->config.mf_gb_decode, 0, sizeof(r2context->config.mf_gb_decode));
+	memset(r2context->config.mf_gc_decode, 0, sizeof(r2context->config.mf_gc_decode));
+	memset(r2context->config.mf_gi_decode, 0, sizeof(r2context->config.mf_gi_decode));
+	memset(r2context->config.mf_gii_decode, OR2_CALLING_PARTY_CATEGORY_UNKNOWN, sizeof(r2context->config.mf_gii_decode));
+
+	/* Group A, DNIS requests take precedence over anything else */
+	mf_decode(ga, r2context->config.mf_ga_tones.request_next_dnis_digit, OR2_MF_GA_NEXT_DNIS);
+	mf_decode(ga, r2context->config.mf_ga_tones.request_dnis_minus_1, OR2_MF_GA_DNIS_MINUS_1);
+	mf_decode(ga, r2context->config.mf_ga_tones.request_dnis_minus_2, OR2_MF_GA_DNIS_MINUS_2);
+	mf_decode(ga, r2context->config.mf_ga_tones.request_dnis_minus_3, OR2_MF_GA_DNIS_MINUS_3);
+	mf_decode(ga, r2context->config.mf_ga_tones.request_all_dnis_again, OR2_MF_GA_ALL_DNIS_AGAIN);
+	if (r2context->config.mf_ga_tones.request_category) {
+		mf_decode(ga, r2context->config.mf_ga_tones.request_category, OR2_MF_GA_CATEGORY);
+	} else {
+		mf_decode(ga, r2context->config.mf_ga_tones.request_category_and_change_to_gc, OR2_MF_GA_CATEGORY_AND_CHANGE_TO_GC);
+	}
+	mf_decode(ga, r2context->config.mf_ga_tones.request_change_to_g2, OR2_MF_GA_CHANGE_TO_G2);
+	mf_decode(ga, r2context->config.mf_ga_tones.address_complete_charge_setup, OR2_MF_GA_ADDRESS_COMPLETE);
+	mf_decode(ga, r2context->config.mf_ga_tones.network_congestion, OR2_MF_GA_NETWORK_CONGESTION);
+	/* the ANI request is usually the same tone as the category request, 
+	   which one it is depends on whether we already sent the category */
+	if (ani_tone != OR2_MF_TONE_INVALID && (unsigned)ani_tone < OR2_MF_DECODE_SIZE
+	    && (ga[ani_tone] < OR2_MF_GA_NEXT_DNIS || ga[ani_tone] > OR2_MF_GA_ALL_DNIS_AGAIN)) {
+		ga[ani_tone] |= OR2_MF_GA_NEXT_ANI;
+	}
+
+	/* Group B */
+	mf_decode(gb, r2context->config.mf_gb_tones.accept_call_with_charge, OR2_MF_GB_ACCEPT_WITH_CHARGE);
+	mf_decode(gb, r2context->config.mf_gb_tones.accept_call_no_charge, OR2_MF_GB_ACCEPT_NO_CHARGE);
+	mf_decode(gb, r2context->config.mf_gb_tones.special_info_tone, OR2_MF_GB_SPECIAL_INFO);
+	mf_decode(gb, r2context->config.mf_gb_tones.busy_number, OR2_MF_GB_BUSY_NUMBER);
+	mf_decode(gb, r2context->config.mf_gb_tones.network_congestion, OR2_MF_GB_NETWORK_CONGESTION);
+	mf_decode(gb, r2context->config.mf_gb_tones.unallocated_number, OR2_MF_GB_UNALLOCATED_NUMBER);
+	mf_decode(gb, r2context->config.mf_gb_tones.number_changed, OR2_MF_GB_NUMBER_CHANGED);
+	mf_decode(gb, r2context->config.mf_gb_tones.line_out_of_order, OR2_MF_GB_LINE_OUT_OF_ORDER);
+
+	/* Group C */
+	mf_decode(gc, r2context->config.mf_gc_tones.request_next_ani_digit, OR2_MF_GC_NEXT_ANI);
+	mf_decode(gc, r2context->config.mf_gc_tones.request_change_to_g2, OR2_MF_GC_CHANGE_TO_G2);
+	mf_decode(gc, r2context->config.mf_gc_tones.request_next_dnis_digit_and_change_to_ga, OR2_MF_GC_NEXT_DNIS_AND_CHANGE_TO_GA);
+	mf_decode(gc, r2context->config.mf_gc_tones.network_congestion, OR2_MF_GC_NETWORK_CONGESTION);
+
+	/* Group I, digits and the end of ANI/DNIS signals are flags */
+	for (tone = OR2_MF_TONE_10; tone <= OR2_MF_TONE_9; tone++) {
+		gi[tone] |= OR2_MF_GI_DIGIT;
+	}
+	mf_decode_flag(gi, r2context->config.mf_g1_tones.no_more_dnis_available, OR2_MF_GI_NO_MORE_DNIS);
+	mf_decode_flag(gi, r2context->config.mf_g1_tones.no_more_ani_available, OR2_MF_GI_NO_MORE_ANI);
+	mf_decode_flag(gi, r2context->config.mf_g1_tones.caller_ani_is_restricted, OR2_MF_GI_ANI_RESTRICTED);
+
+	/* Group II, the calling party categories. The first category
+	   given to a tone wins, so they go in reverse order */
+	mf_decode_category(gii, r2context->config.mf_g2_tones.pay_phone, OR2_CALLING_PARTY_CATEGORY_PAY_PHONE);
+	mf_decode_category(gii, r2context->config.mf_g2_tones.test_equipment, OR2_CALLING_PARTY_CATEGORY_TEST_EQUIPMENT);
+	mf_decode_category(gii, r2context->config.mf_g2_tones.collect_call, OR2_CALLING_PARTY_CATEGORY_COLLECT_CALL);
+	mf_decode_category(gii, r2context->config.mf_g2_tones.international_priority_subscriber, OR2_CALLING_PARTY_CATEGORY_INTERNATIONAL_PRIORITY_SUBSCRIBER);
+	mf_decode_category(gii, r2context->config.mf_g2_tones.international_subscriber, OR2_CALLING_PARTY_CATEGORY_INTERNATIONAL_SUBSCRIBER);
+	mf_decode_category(gii, r2context->config.mf_g2_tones.national_priority_subscriber, OR2_CALLING_PARTY_CATEGORY_NATIONAL_PRIORITY_SUBSCRIBER);
+	mf_decode_category(gii, r2context->config.mf_g2_tones.national_subscriber, OR2_CALLING_PARTY_CATEGORY_NATIONAL_SUBSCRIBER);
+}
+
 /* Here we configure R2 as ITU and finally call a country specific function to alter the protocol description according
    to the specified R2 variant. The ITU blue book Q400 - Q490 defines other tones, but lets just use this for starters,
    other tones will be added as needed */
@@ -373,86 +533,93 @@ int openr2_proto_configure_context(openr2_context_t *r2context, openr2_variant_t
 	r2context->cas_r2_bits = 0xC; /*  1100 */
 
 	/* set default values for the protocol timers */
-	r2context->timers.mf_back_cycle = 2000;
-	r2context->timers.mf_back_resume_cycle = 150;
+	r2context->config.timers.mf_back_cycle = 2000;
+	r2context->config.timers.mf_back_resume_cycle = 150;
 
 	/* this was 10000 but someone from mx reported that Telmex needs more time in international calls */
-	r2context->timers.mf_fwd_safety = 30000;
+	r2context->config.timers.mf_fwd_safety = 30000;
 
-	r2context->timers.r2_seize = 2000;
-	r2context->timers.r2_seize_persist = 150;
-	r2context->timers.r2_answer = 60000; 
-	r2context->timers.r2_metering_pulse = 0;
-	r2context->timers.r2_answer_delay = 150;
-	r2context->timers.r2_double_answer = 400;
+	r2context->config.timers.r2_seize = 2000;
+	r2context->config.timers.r2_seize_persist = 150;
+	r2context->config.timers.r2_answer = 60000; 
+	r2context->config.timers.r2_metering_pulse = 0;
+	r2context->config.timers.r2_answer_delay = 150;
+	r2context->config.timers.r2_double_answer = 400;
 
 	/* if, after we send clear forward, the other side does not go back to IDLE, we go back to IDLE
 	 * after this period of time anyways */
-	r2context->timers.r2_set_call_down = 3000;
+	r2context->config.timers.r2_set_call_down = 3000;
 
 	/* DTMF start dialing timer */
-	r2context->timers.dtmf_start_dial = 500;
+	r2context->config.timers.dtmf_start_dial = 500;
 
 	/* Max ANI and DNIS */
-	r2context->max_dnis = (max_dnis >= OR2_MAX_DNIS) ? OR2_MAX_DNIS - 1 : max_dnis;
-	r2context->max_ani = (max_ani >= OR2_MAX_ANI) ? OR2_MAX_ANI - 1 : max_ani;
+	r2context->config.max_dnis = (max_dnis >= OR2_MAX_DNIS) ? OR2_MAX_DNIS - 1 : max_dnis;
+	r2context->config.max_ani = (max_ani >= OR2_MAX_ANI) ? OR2_MAX_ANI - 1 : max_ani;
 
 	/* the forward R2 side always send DNIS first but
 	   most variants continue by asking ANI first
 	   and continuing with DNIS at the end  */
-	r2context->get_ani_first = 1;
+	r2context->config.get_ani_first = 1;
 
 	/* accept the call bypassing the use of group B and II tones */
-	r2context->immediate_accept = 0;
+	r2context->config.immediate_accept = 0;
+
+	/* Q.422 lets the outgoing end clear forward right away on clear back,
+	   variants where the clear back is not final say otherwise */
+	r2context->config.fast_clear_back = 1;
 
 	/* Group A tones. Requests of ANI, DNIS and Calling Party Category */
-	r2context->mf_ga_tones.request_next_dnis_digit = OR2_MF_TONE_1;
-	r2context->mf_ga_tones.request_dnis_minus_1 = OR2_MF_TONE_2;
-	r2context->mf_ga_tones.request_dnis_minus_2 = OR2_MF_TONE_7;
-	r2context->mf_ga_tones.request_dnis_minus_3 = OR2_MF_TONE_8;
-	r2context->mf_ga_tones.request_all_dnis_again = OR2_MF_TONE_INVALID;
-	r2context->mf_ga_tones.request_next_ani_digit = OR2_MF_TONE_5;
-	r2context->mf_ga_tones.request_category = OR2_MF_TONE_5;
-	r2context->mf_ga_tones.request_category_and_change_to_gc = OR2_MF_TONE_INVALID;
-	r2context->mf_ga_tones.request_change_to_g2 = OR2_MF_TONE_3;
+	r2context->config.mf_ga_tones.request_next_dnis_digit = OR2_MF_TONE_1;
+	r2context->config.mf_ga_tones.request_dnis_minus_1 = OR2_MF_TONE_2;
+	r2context->config.mf_ga_tones.request_dnis_minus_2 = OR2_MF_TONE_7;
+	r2context->config.mf_ga_tones.request_dnis_minus_3 = OR2_MF_TONE_8;
+	r2context->config.mf_ga_tones.request_all_dnis_again = OR2_MF_TONE_INVALID;
+	r2context->config.mf_ga_tones.request_next_ani_digit = OR2_MF_TONE_5;
+	r2context->config.mf_ga_tones.request_category = OR2_MF_TONE_5;
+	r2context->config.mf_ga_tones.request_category_and_change_to_gc = OR2_MF_TONE_INVALID;
+	r2context->config.mf_ga_tones.request_change_to_g2 = OR2_MF_TONE_3;
         /* It's unusual, but an ITU-compliant switch can accept in Group A */
-	r2context->mf_ga_tones.address_complete_charge_setup = OR2_MF_TONE_6;
-	r2context->mf_ga_tones.network_congestion = OR2_MF_TONE_4;
+	r2context->config.mf_ga_tones.address_complete_charge_setup = OR2_MF_TONE_6;
+	r2context->config.mf_ga_tones.network_congestion = OR2_MF_TONE_4;
 
 	/* Group B tones. Decisions about what to do with the call */
-	r2context->mf_gb_tones.accept_call_with_charge = OR2_MF_TONE_6;
-	r2context->mf_gb_tones.accept_call_no_charge = OR2_MF_TONE_7;
-	r2context->mf_gb_tones.busy_number = OR2_MF_TONE_3;
-	r2context->mf_gb_tones.network_congestion = OR2_MF_TONE_4;
-	r2context->mf_gb_tones.unallocated_number = OR2_MF_TONE_5;
-	r2context->mf_gb_tones.line_out_of_order = OR2_MF_TONE_8;
-	r2context->mf_gb_tones.special_info_tone = OR2_MF_TONE_2;
-	r2context->mf_gb_tones.number_changed = OR2_MF_TONE_INVALID;
+	r2context->config.mf_gb_tones.accept_call_with_charge = OR2_MF_TONE_6;
+	r2context->config.mf_gb_tones.accept_call_no_charge = OR2_MF_TONE_7;
+	r2context->config.mf_gb_tones.busy_number = OR2_MF_TONE_3;
+	r2context->config.mf_gb_tones.network_congestion = OR2_MF_TONE_4;
+	r2context->config.mf_gb_tones.unallocated_number = OR2_MF_TONE_5;
+	r2context->config.mf_gb_tones.line_out_of_order = OR2_MF_TONE_8;
+	r2context->config.mf_gb_tones.special_info_tone = OR2_MF_TONE_2;
+	r2context->config.mf_gb_tones.number_changed = OR2_MF_TONE_INVALID;
 
 	/* Group C tones. Similar to Group A but for Mexico */
-	r2context->mf_gc_tones.request_next_ani_digit = OR2_MF_TONE_INVALID;
-	r2context->mf_gc_tones.request_change_to_g2 = OR2_MF_TONE_INVALID;
-	r2context->mf_gc_tones.request_next_dnis_digit_and_change_to_ga = OR2_MF_TONE_INVALID;
-	r2context->mf_gc_tones.network_congestion = OR2_MF_TONE_INVALID;
+	r2context->config.mf_gc_tones.request_next_ani_digit = OR2_MF_TONE_INVALID;
+	r2context->config.mf_gc_tones.request_change_to_g2 = OR2_MF_TONE_INVALID;
+	r2context->config.mf_gc_tones.request_next_dnis_digit_and_change_to_ga = OR2_MF_TONE_INVALID;
+	r2context->config.mf_gc_tones.network_congestion = OR2_MF_TONE_INVALID;
 
 	/* Group I tones. Attend requests of Group A  */
-	r2context->mf_g1_tones.no_more_dnis_available = OR2_MF_TONE_15;
-	r2context->mf_g1_tones.no_more_ani_available = OR2_MF_TONE_15;
+	r2context->config.mf_g1_tones.no_more_dnis_available = OR2_MF_TONE_15;
+	r2context->config.mf_g1_tones.no_more_ani_available = OR2_MF_TONE_15;
 	/* even though ITU does not define this signal, many countries do
 	   and it does not hurt to add it anyway */
-	r2context->mf_g1_tones.caller_ani_is_restricted = OR2_MF_TONE_12;
+	r2context->config.mf_g1_tones.caller_ani_is_restricted = OR2_MF_TONE_12;
 
 	/* Group II tones. */
-	r2context->mf_g2_tones.national_subscriber = OR2_MF_TONE_1;
-	r2context->mf_g2_tones.national_priority_subscriber = OR2_MF_TONE_2;
-	r2context->mf_g2_tones.test_equipment = OR2_MF_TONE_3;
-	r2context->mf_g2_tones.international_subscriber = OR2_MF_TONE_7;
-	r2context->mf_g2_tones.international_priority_subscriber = OR2_MF_TONE_9;
-	r2context->mf_g2_tones.collect_call = OR2_MF_TONE_INVALID;
-	r2context->mf_g2_tones.pay_phone = OR2_MF_TONE_INVALID;
+	r2context->config.mf_g2_tones.national_subscriber = OR2_MF_TONE_1;
+	r2context->config.mf_g2_tones.national_priority_subscriber = OR2_MF_TONE_2;
+	r2context->config.mf_g2_tones.test_equipment = OR2_MF_TONE_3;
+	r2context->config.mf_g2_tones.international_subscriber = OR2_MF_TONE_7;
+	r2context->config.mf_g2_tones.international_priority_subscriber = OR2_MF_TONE_9;
+	r2context->config.mf_g2_tones.collect_call = OR2_MF_TONE_INVALID;
+	r2context->config.mf_g2_tones.pay_phone = OR2_MF_TONE_INVALID;
 
 	/* now configure the country specific variations */
 	r2variants[i].config(r2context);
+
+	openr2_proto_compile_cas_table(r2context);
+	openr2_proto_compile_mf_tables(r2context);
 	return 0;
 }
 
@@ -703,6 +870,12 @@ static void openr2_proto_init(openr2_chan_t *r2chan)
 	r2chan->dnis[0] = '\0';
 	r2chan->dnis_len = 0;
 	r2chan->dnis_index = 0;
+	r2chan->numplan_node = OR2_NUMPLAN_ROOT;
+	r2chan->numplan_length = 0;
+	r2chan->adapt_timing = 0;
+	openr2_admit_setup_done(r2chan);
+	r2chan->shedding = 0;
+	r2chan->quiet = 0;
 	r2chan->caller_ani_is_restricted = 0;
 	r2chan->caller_category = OR2_MF_TONE_INVALID;
 	r2_set_state(r2chan, OR2_IDLE);
@@ -742,6 +915,7 @@ int openr2_proto_set_blocked(openr2_chan_t *r2chan)
 	return 0;
 }
 
+static void report_channel_available(openr2_chan_t *r2chan);
 static void handle_protocol_error(openr2_chan_t *r2chan, openr2_protocol_error_t reason)
 {
 	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, 
@@ -759,6 +933,7 @@ static void handle_protocol_error(openr2_chan_t *r2chan, openr2_protocol_error_t
 	MFI(r2chan)->mf_select_tone(r2chan->mf_write_handle, 0);
 	openr2_proto_set_idle(r2chan);
 	EMI(r2chan)->on_protocol_error(r2chan, reason);
+	report_channel_available(r2chan);
 }
 
 static void close_logfile(openr2_chan_t *r2chan)
@@ -856,6 +1031,18 @@ static void open_logfile(openr2_chan_t *r2chan, int backward)
 	}
 }
 
+/* follow the DNIS in the number plan, if any */
+static void numplan_dnis_digit(openr2_chan_t *r2chan, char digit)
+{
+	if (!r2chan->r2context->numplan || r2chan->numplan_node == OR2_NUMPLAN_NONE) {
+		return;
+	}
+	r2chan->numplan_node = openr2_numplan_step(r2chan->r2context->numplan, r2chan->numplan_node, digit, &r2chan->numplan_length);
+	if (OR2_NUMPLAN_COMPLETE(r2chan)) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "DNIS %s is complete according to the number plan\n", r2chan->dnis);
+	}
+}
+
 static void on_dtmf_received(void *user_data, const char *digits, int len)
 {
 	const char *digit = NULL;
@@ -879,6 +1066,7 @@ static void on_dtmf_received(void *user_data, const char *digits, int len)
 	while (len && *digit) {
 		r2chan->dnis[r2chan->dnis_len++] = *digit;
 		r2chan->dnis[r2chan->dnis_len] = '\0';
+		numplan_dnis_digit(r2chan, *digit);
 		rc = EMI(r2chan)->on_dnis_digit_received(r2chan, *digit);
 		if (!rc) {
 			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "User requested us to stop getting DNIS!\n");
@@ -891,6 +1079,9 @@ static void on_dtmf_received(void *user_data, const char *digits, int len)
 
 static void handle_incoming_call(openr2_chan_t *r2chan)
 {
+	/* the call keeps the settings in use now until it ends */
+	openr2_context_pin_config(r2chan->r2context, r2chan);
+
 	open_logfile(r2chan, 1);
 
 	if (!DETECT_DTMF(r2chan)) {
@@ -911,6 +1102,10 @@ static void handle_incoming_call(openr2_chan_t *r2chan)
 		r2chan->mf_state = OR2_MF_SEIZE_ACK_TXD;
 		r2chan->mf_group = OR2_MF_BACK_INIT;
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Initialized R2 MF detector\n");
+		/* calls over the admission limits get network congestion
+		   on the first MF tone, the user never hears about them */
+		r2chan->shedding = !openr2_admit_call(r2chan);
+		r2chan->quiet = r2chan->shedding;
 	} else {
 		/* DTMF R2, init the DTMF detector to get DNIS */
 		if (!DTMF(r2chan)->dtmf_rx_init(r2chan->dtmf_read_handle, on_dtmf_received, r2chan)) {
@@ -925,6 +1120,7 @@ static void handle_incoming_call(openr2_chan_t *r2chan)
 	}
 	r2_set_state(r2chan, OR2_SEIZE_ACK_TXD);
 	r2chan->call_state = OR2_CALL_COLLECTING;
+	r2chan->call_id++;
 	r2chan->direction = OR2_DIR_BACKWARD;
 	if (set_cas_signal(r2chan, OR2_CAS_SEIZE_ACK)) {
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Failed to send seize ack!, incoming call not proceeding!\n");
@@ -932,7 +1128,9 @@ static void handle_incoming_call(openr2_chan_t *r2chan)
 		return;
 	}
 	/* notify the user that a new call is starting to arrive */
-	EMI(r2chan)->on_call_init(r2chan);
+	if (!r2chan->quiet) {
+		EMI(r2chan)->on_call_init(r2chan);
+	}
 }
 
 static void mf_fwd_safety_timeout_expired(openr2_chan_t *r2chan)
@@ -944,6 +1142,9 @@ static void mf_back_cycle_timeout_expired(openr2_chan_t *r2chan);
 static void prepare_mf_tone(openr2_chan_t *r2chan, int tone)
 {
 	int ret;
+	if (r2chan->mf_write_tone != tone) {
+		stop_mf_loop(r2chan);
+	}
 	/* put silence only if we have a write tone */
 	if (!tone && r2chan->mf_write_tone) {
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_MF_TRACE, "MF Tx >> %c [OFF]\n", r2chan->mf_write_tone);
@@ -965,7 +1166,8 @@ static void prepare_mf_tone(openr2_chan_t *r2chan, int tone)
 			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_MF_TRACE, "MF Tx >> %c [ON]\n", tone);
 			if (r2chan->direction == OR2_DIR_BACKWARD) {
 				/* schedule a new timer that will handle the timeout for our backward request */
-				r2chan->timer_ids.mf_back_cycle = openr2_chan_add_timer(r2chan, TIMER(r2chan).mf_back_cycle, 
+				r2chan->timer_ids.mf_back_cycle = openr2_chan_add_timer(r2chan, 
+				openr2_adapt_timeout(r2chan, OR2_ADAPTIVE_MF_BACK_CYCLE, TIMER(r2chan).mf_back_cycle), 
 				mf_back_cycle_timeout_expired, "mf_back_cycle");
 			}
 			if (openr2_io_flush_write_buffers(r2chan)) {
@@ -974,6 +1176,8 @@ static void prepare_mf_tone(openr2_chan_t *r2chan, int tone)
 			}
 		}	
 		r2chan->mf_write_tone = tone;
+		/* silence between tones is generated as well */
+		start_mf_loop(r2chan);
 	}
 }
 
@@ -1023,8 +1227,81 @@ static void mf_send_dnis(openr2_chan_t *r2chan, int offset)
 	}
 }
 
+/* the first clearing signal of the call was sent or received */
+static void release_started(openr2_chan_t *r2chan)
+{
+	if (r2chan->releasing) {
+		return;
+	}
+	if (openr2_gettimeofday(r2chan->r2context, &r2chan->release_start)) {
+		return;
+	}
+	r2chan->releasing = 1;
+}
+
+int openr2_proto_is_available(openr2_chan_t *r2chan)
+{
+	return r2chan->call_state == OR2_CALL_IDLE && r2chan->r2_state == OR2_IDLE && !r2chan->inalarm
+	       && r2chan->cas_read == r2chan->r2context->cas_signals[OR2_CAS_IDLE];
+}
+
+static void report_channel_available(openr2_chan_t *r2chan)
+{
+	openr2_chan_release_stats_t *stats = &r2chan->release_stats;
+	struct timeval now;
+	int ms;
+	if (!openr2_proto_is_available(r2chan)) {
+		return;
+	}
+	if (r2chan->releasing && !openr2_gettimeofday(r2chan->r2context, &now)) {
+		ms = (now.tv_sec - r2chan->release_start.tv_sec) * 1000 + (now.tv_usec - r2chan->release_start.tv_usec) / 1000;
+		if (ms >= 0) {
+			stats->releases++;
+			stats->last_release_ms = ms;
+			stats->total_release_ms += ms;
+			if (ms > stats->max_release_ms) {
+				stats->max_release_ms = ms;
+			}
+			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Channel available %d ms after clearing started\n", ms);
+		}
+	}
+	r2chan->releasing = 0;
+	EMI(r2chan)->on_channel_available(r2chan);
+}
+
+static void report_call_end(openr2_chan_t *r2chan);
+
+/* with the fast release policy we do what the user would have done
+   after the far end disconnection if they did not do it already */
+static void fast_release(openr2_chan_t *r2chan, openr2_cas_state_t state)
+{
+	if (r2chan->config->release_policy != OR2_RELEASE_FAST
+	    || r2chan->call_state != OR2_CALL_DISCONNECTED || r2chan->r2_state != state) {
+		return;
+	}
+	if (state == OR2_CLEAR_FWD_RXD) {
+		/* answering the clear forward with idle is the release guard */
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Fast release after clear forward\n");
+		report_call_end(r2chan);
+	} else if (r2chan->direction == OR2_DIR_FORWARD) {
+		if (state == OR2_CLEAR_BACK_RXD && !r2chan->config->fast_clear_back) {
+			return;
+		}
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Fast release, clearing forward now\n");
+		openr2_proto_disconnect_call(r2chan, OR2_CAUSE_NORMAL_CLEARING);
+	}
+}
+
 static void report_call_disconnection(openr2_chan_t *r2chan, openr2_call_disconnect_cause_t cause)
 {
+	openr2_cas_state_t state = r2chan->r2_state;
+	release_started(r2chan);
+	if (r2chan->quiet) {
+		/* a call we rejected ourselves, nobody to tell about it */
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Unreported call cleared\n");
+		report_call_end(r2chan);
+		return;
+	}
 	/* help the user a bit if unallocated number is the cause */
 	if (r2chan->r2context->variant == OR2_VAR_BRAZIL && cause == OR2_CAUSE_UNALLOCATED_NUMBER) {
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_NOTICE, "Far end disconnected. Reason: %s or Collect Call Blocked\n", openr2_proto_get_disconnect_string(cause));
@@ -1033,13 +1310,19 @@ static void report_call_disconnection(openr2_chan_t *r2chan, openr2_call_disconn
 	}
 	r2chan->call_state = OR2_CALL_DISCONNECTED;
 	EMI(r2chan)->on_call_disconnect(r2chan, cause);
+	fast_release(r2chan, state);
 }
 
 static void report_call_end(openr2_chan_t *r2chan)
 {
+	int quiet = r2chan->quiet;
 	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Call ended\n");
 	openr2_proto_set_idle(r2chan);
-	EMI(r2chan)->on_call_end(r2chan);
+	if (!quiet) {
+		EMI(r2chan)->on_call_end(r2chan);
+	}
+	/* unless they made a new call already */
+	report_channel_available(r2chan);
 }
 
 static void r2_metering_pulse(openr2_chan_t *r2chan)
@@ -1051,29 +1334,6 @@ static void r2_metering_pulse(openr2_chan_t *r2chan)
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_CAS_TRACE, "CAS Rx << [%s] 0x%02X\n", \
 		(OR2_CAS_##signal_name != OR2_CAS_INVALID) \
 		? cas_names[OR2_CAS_##signal_name] : openr2_proto_get_rx_cas_string(r2chan), cas); 
-/* verify if the received bits are a disconnection signal of some sort */
-static int check_backward_disconnection(openr2_chan_t *r2chan, int cas, 
-		openr2_call_disconnect_cause_t *cause, openr2_cas_state_t *state)
-{
-	if (cas == R2(r2chan, CLEAR_BACK)) {
-		CAS_LOG_RX(CLEAR_BACK);
-		*state = OR2_CLEAR_BACK_RXD;
-		*cause = OR2_CAUSE_NORMAL_CLEARING;
-		return -1;
-	}
-	/* this is apparently just used in Brazil, but I don't think it's a bad idea to
-	   to have it here for other variants as well just in case. If we ever find a reason to
-	   just accept this signal for Brazil, we need just to check the variant here 
-	   as well, or use some sort of per-variant flag to accept it */
-	if (cas == R2(r2chan, FORCED_RELEASE)) {
-		CAS_LOG_RX(FORCED_RELEASE);
-		*state = OR2_FORCED_RELEASE_RXD;
-		*cause = OR2_CAUSE_FORCED_RELEASE;
-		return -1;
-	}	
-	return 0;
-}
-
 static void persistence_check_expired(openr2_chan_t *r2chan)
 {
 	int cas, res, myerrno;
@@ -1110,14 +1370,277 @@ static void persistence_check_expired(openr2_chan_t *r2chan)
 	}
 }
 
+/* dense index of the R2 states in the CAS table */
+static const openr2_cas_state_t cas_table_states[OR2_NUM_R2_STATES] =
+{
+	OR2_INVALID_STATE,
+	OR2_INIT,
+	OR2_IDLE,
+	OR2_SEIZE_ACK_TXD,
+	OR2_ANSWER_TXD,
+	OR2_CLEAR_BACK_TXD,
+	OR2_CLEAR_FWD_RXD,
+	OR2_EXECUTING_DOUBLE_ANSWER,
+	OR2_FORCED_RELEASE_TXD,
+	OR2_SEIZE_TXD,
+	OR2_SEIZE_ACK_RXD,
+	OR2_CLEAR_BACK_TONE_RXD,
+	OR2_ACCEPT_RXD,
+	OR2_ANSWER_RXD,
+	OR2_CLEAR_BACK_RXD,
+	OR2_ANSWER_RXD_MF_PENDING,
+	OR2_CLEAR_FWD_TXD,
+	OR2_FORCED_RELEASE_RXD,
+	OR2_CLEAR_BACK_AFTER_CLEAR_FWD_RXD,
+	OR2_SEIZE_TXD_CLEAR_FWD_PENDING,
+	OR2_DOUBLE_SEIZURE_CLEAR_FWD_PENDING,
+	OR2_BLOCKED,
+	OR2_DOUBLE_SEIZURE
+};
+
+static const char *cas_action_names[OR2_NUM_CAS_ACTIONS] =
+{
+	/* OR2_CAS_ACTION_PROTOCOL_ERROR */ "protocol error",
+	/* OR2_CAS_ACTION_STATE_ERROR */ "state error",
+	/* OR2_CAS_ACTION_UNHANDLED_STATE */ "unhandled state",
+	/* OR2_CAS_ACTION_IGNORE */ "ignore",
+	/* OR2_CAS_ACTION_SET_STATE */ "set state",
+	/* OR2_CAS_ACTION_LINE_IDLE */ "line idle",
+	/* OR2_CAS_ACTION_LINE_BLOCKED */ "line blocked",
+	/* OR2_CAS_ACTION_INCOMING_CALL */ "incoming call",
+	/* OR2_CAS_ACTION_DISCONNECT */ "disconnect",
+	/* OR2_CAS_ACTION_CALL_END */ "call end",
+	/* OR2_CAS_ACTION_SEIZE_ACK_MF */ "MF seize ack",
+	/* OR2_CAS_ACTION_SEIZE_ACK_DTMF */ "DTMF seize ack",
+	/* OR2_CAS_ACTION_SEIZE_ACK_CLEAR_FWD */ "seize ack with clear forward pending",
+	/* OR2_CAS_ACTION_GLARE */ "glare",
+	/* OR2_CAS_ACTION_ANSWER_MF */ "MF answer",
+	/* OR2_CAS_ACTION_ANSWER_DTMF */ "DTMF answer",
+	/* OR2_CAS_ACTION_CLEAR_BACK_METERING */ "clear back or metering pulse",
+	/* OR2_CAS_ACTION_METERING_PULSE */ "metering pulse"
+};
+
+static int cas_state_index(openr2_cas_state_t state)
+{
+	switch (state) {
+	case OR2_INVALID_STATE: return 0;
+	case OR2_INIT: return 1;
+	case OR2_IDLE: return 2;
+	case OR2_SEIZE_ACK_TXD: return 3;
+	case OR2_ANSWER_TXD: return 4;
+	case OR2_CLEAR_BACK_TXD: return 5;
+	case OR2_CLEAR_FWD_RXD: return 6;
+	case OR2_EXECUTING_DOUBLE_ANSWER: return 7;
+	case OR2_FORCED_RELEASE_TXD: return 8;
+	case OR2_SEIZE_TXD: return 9;
+	case OR2_SEIZE_ACK_RXD: return 10;
+	case OR2_CLEAR_BACK_TONE_RXD: return 11;
+	case OR2_ACCEPT_RXD: return 12;
+	case OR2_ANSWER_RXD: return 13;
+	case OR2_CLEAR_BACK_RXD: return 14;
+	case OR2_ANSWER_RXD_MF_PENDING: return 15;
+	case OR2_CLEAR_FWD_TXD: return 16;
+	case OR2_FORCED_RELEASE_RXD: return 17;
+	case OR2_CLEAR_BACK_AFTER_CLEAR_FWD_RXD: return 18;
+	case OR2_SEIZE_TXD_CLEAR_FWD_PENDING: return 19;
+	case OR2_DOUBLE_SEIZURE_CLEAR_FWD_PENDING: return 20;
+	case OR2_BLOCKED: return 21;
+	case OR2_DOUBLE_SEIZURE: return 22;
+	}
+	return -1;
+}
+
+/* every bit pattern of the state gets the same default */
+static void cas_state_default(openr2_context_t *r2context, openr2_cas_state_t state, openr2_cas_action_t action,
+		openr2_log_level_t note_level, const char *note)
+{
+	openr2_cas_transition_t *row = r2context->config.cas_table[cas_state_index(state)];
+	int bits;
+	for (bits = 0; bits < OR2_NUM_CAS_BITS; bits++) {
+		row[bits].action = action;
+		row[bits].signal = OR2_CAS_INVALID;
+		row[bits].next_state = state;
+		row[bits].cause = OR2_CAUSE_NORMAL_CLEARING;
+		row[bits].note_level = note_level;
+		row[bits].note = note;
+	}
+}
+
+/* Signals sharing their bits with a signal already in the row are not
+   added, the first signal added for some bits wins, the same way the
+   order of the comparisons used to decide which signal we got. */
+static void cas_transition(openr2_context_t *r2context, openr2_cas_state_t state, openr2_cas_signal_t signal,
+		openr2_cas_action_t action, openr2_cas_state_t next_state, openr2_call_disconnect_cause_t cause,
+		openr2_log_level_t note_level, const char *note)
+{
+	openr2_cas_transition_t *entry;
+	entry = &r2context->config.cas_table[cas_state_index(state)][r2context->cas_signals[signal] & (OR2_NUM_CAS_BITS - 1)];
+	if (entry->signal != OR2_CAS_INVALID) {
+		return;
+	}
+	entry->action = action;
+	entry->signal = signal;
+	entry->next_state = next_state;
+	entry->cause = cause;
+	entry->note_level = note_level;
+	entry->note = note;
+}
+
+#define CAS_TRANSITION(state, signal, action, next_state) \
+	cas_transition(r2context, state, OR2_CAS_##signal, OR2_CAS_ACTION_##action, next_state, OR2_CAUSE_NORMAL_CLEARING, OR2_LOG_DEBUG, NULL)
+
+#define CAS_TRANSITION_NOTE(state, signal, action, next_state, level, note) \
+	cas_transition(r2context, state, OR2_CAS_##signal, OR2_CAS_ACTION_##action, next_state, OR2_CAUSE_NORMAL_CLEARING, level, note)
+
+/* the disconnection signals the forward side accepts from the backward side */
+static void cas_backward_disconnection(openr2_context_t *r2context, openr2_cas_state_t state, const char *note)
+{
+	cas_transition(r2context, state, OR2_CAS_CLEAR_BACK, OR2_CAS_ACTION_DISCONNECT, OR2_CLEAR_BACK_RXD,
+			OR2_CAUSE_NORMAL_CLEARING, OR2_LOG_DEBUG, note);
+	/* this is apparently just used in Brazil, but I don't think it's a bad idea to
+	   to have it here for other variants as well just in case. If we ever find a reason to
+	   just accept this signal for Brazil, we need just to check the variant here 
+	   as well, or use some sort of per-variant flag to accept it */
+	cas_transition(r2context, state, OR2_CAS_FORCED_RELEASE, OR2_CAS_ACTION_DISCONNECT, OR2_FORCED_RELEASE_RXD,
+			OR2_CAUSE_FORCED_RELEASE, OR2_LOG_DEBUG, note);
+}
+
+/* Build the CAS table of the context out of its CAS signals, DTMF settings
+   and metering pulse timer. Needs to be called again whenever any of those change */
+void openr2_proto_compile_cas_table(openr2_context_t *r2context)
+{
+	int i;
+
+	for (i = 0; i < OR2_NUM_R2_STATES; i++) {
+		cas_state_default(r2context, cas_table_states[i], OR2_CAS_ACTION_PROTOCOL_ERROR, OR2_LOG_DEBUG, NULL);
+	}
+	/* no state at all yet, or a state in which no CAS change is expected */
+	cas_state_default(r2context, OR2_INVALID_STATE, OR2_CAS_ACTION_STATE_ERROR, OR2_LOG_DEBUG, NULL);
+	cas_state_default(r2context, OR2_CLEAR_FWD_RXD, OR2_CAS_ACTION_UNHANDLED_STATE, OR2_LOG_DEBUG, NULL);
+	cas_state_default(r2context, OR2_FORCED_RELEASE_RXD, OR2_CAS_ACTION_UNHANDLED_STATE, OR2_LOG_DEBUG, NULL);
+	/* on initialization, only IDLE and BLOCK make sense */
+	cas_state_default(r2context, OR2_INIT, OR2_CAS_ACTION_STATE_ERROR, OR2_LOG_DEBUG, NULL);
+	CAS_TRANSITION(OR2_INIT, IDLE, LINE_IDLE, OR2_INIT);
+	CAS_TRANSITION(OR2_INIT, BLOCK, LINE_BLOCKED, OR2_INIT);
+
+	/* we're blocked, unless they are setting IDLE, we don't care */
+	cas_state_default(r2context, OR2_BLOCKED, OR2_CAS_ACTION_IGNORE, OR2_LOG_NOTICE, "Doing nothing on CAS change, we're blocked.\n");
+	CAS_TRANSITION(OR2_BLOCKED, IDLE, LINE_IDLE, OR2_BLOCKED);
+
+	/* we are in IDLE and just received a seize request
+	   lets handle this new call */
+	CAS_TRANSITION(OR2_IDLE, BLOCK, LINE_BLOCKED, OR2_IDLE);
+	CAS_TRANSITION(OR2_IDLE, IDLE, LINE_IDLE, OR2_IDLE);
+	CAS_TRANSITION(OR2_IDLE, SEIZE, INCOMING_CALL, OR2_IDLE);
+
+	/* if call setup already started or the call is answered 
+	   the only valid bit pattern is a clear forward, everything
+	   else is protocol error */
+	CAS_TRANSITION(OR2_SEIZE_ACK_TXD, CLEAR_FORWARD, DISCONNECT, OR2_CLEAR_FWD_RXD);
+	CAS_TRANSITION(OR2_ANSWER_TXD, CLEAR_FORWARD, DISCONNECT, OR2_CLEAR_FWD_RXD);
+	CAS_TRANSITION(OR2_EXECUTING_DOUBLE_ANSWER, CLEAR_FORWARD, DISCONNECT, OR2_CLEAR_FWD_RXD);
+	CAS_TRANSITION(OR2_CLEAR_BACK_TXD, CLEAR_FORWARD, CALL_END, OR2_CLEAR_BACK_TXD);
+	CAS_TRANSITION(OR2_FORCED_RELEASE_TXD, CLEAR_FORWARD, CALL_END, OR2_FORCED_RELEASE_TXD);
+
+	/* if we transmitted a seize we expect the seize ACK */
+	if (r2context->config.dial_with_dtmf) {
+		CAS_TRANSITION(OR2_SEIZE_TXD, SEIZE_ACK, SEIZE_ACK_DTMF, OR2_SEIZE_ACK_RXD);
+	} else {
+		CAS_TRANSITION(OR2_SEIZE_TXD, SEIZE_ACK, SEIZE_ACK_MF, OR2_SEIZE_ACK_RXD);
+	}
+	CAS_TRANSITION(OR2_SEIZE_TXD, SEIZE, GLARE, OR2_DOUBLE_SEIZURE);
+	CAS_TRANSITION_NOTE(OR2_SEIZE_TXD_CLEAR_FWD_PENDING, SEIZE_ACK, SEIZE_ACK_CLEAR_FWD, OR2_SEIZE_TXD_CLEAR_FWD_PENDING,
+			OR2_LOG_DEBUG, "MFC/R2 seize acknowledge received when clear forward pending, disconnecting call now!\n");
+	CAS_TRANSITION(OR2_SEIZE_TXD_CLEAR_FWD_PENDING, SEIZE, GLARE, OR2_DOUBLE_SEIZURE);
+
+	/* the other end cleared their end but we have not done so yet, do not report call end yet  */
+	CAS_TRANSITION_NOTE(OR2_DOUBLE_SEIZURE, CLEAR_FORWARD, SET_STATE, OR2_CLEAR_FWD_RXD,
+			OR2_LOG_WARNING, "Remote end cleared after glare, still waiting local clearing\n");
+	CAS_TRANSITION_NOTE(OR2_DOUBLE_SEIZURE_CLEAR_FWD_PENDING, IDLE, CALL_END, OR2_DOUBLE_SEIZURE_CLEAR_FWD_PENDING,
+			OR2_LOG_WARNING, "Remote end cleared after glare, completing local clearing\n");
+
+	/* once we got MF ACCEPT tone, we expect the CAS Answer 
+	   or some disconnection signal, anything else, protocol error */
+	CAS_TRANSITION(OR2_ACCEPT_RXD, ANSWER, ANSWER_MF, OR2_ANSWER_RXD);
+	cas_backward_disconnection(r2context, OR2_ACCEPT_RXD, NULL);
+
+	/* In MFC-R2 This state means we're during call setup (ANI/DNIS transmission) and the ACCEPT signal
+	   has not been received. Sometimes, since CAS signaling is faster than MF detectors we
+	   may receive the ANSWER signal before actually receiving the
+	   MF tone that indicates the call has been accepted (OR2_ACCEPT_RXD). We
+	   must not turn off the tone detector because the tone off condition is still missing.
+	   For DTMF R2 this is normal, during seize ack we just wait answer (or may be also disconnection?) */
+	if (!r2context->config.dial_with_dtmf) {
+		CAS_TRANSITION_NOTE(OR2_SEIZE_ACK_RXD, ANSWER, SET_STATE, OR2_ANSWER_RXD_MF_PENDING,
+				OR2_LOG_DEBUG, "Answer before accept detected!\n");
+	}
+	/* I believe we just fall here with release forced since clear back signal is usually (always?) the
+	   same as Seize ACK and therefore there will be not a bit patter change in that case. 
+	   I believe the correct behavior for this case is to just proceed with disconnection without waiting 
+	   for any other MF activity, the call is going down anyway */
+	cas_backward_disconnection(r2context, OR2_SEIZE_ACK_RXD, "Disconnection before accept detected!\n");
+	CAS_TRANSITION_NOTE(OR2_SEIZE_ACK_RXD, ANSWER, ANSWER_DTMF, OR2_ANSWER_RXD,
+			OR2_LOG_NOTICE, "DTMF/R2 call answered\n");
+
+	/* if the variant may have metering pulses, a clear back could be not really
+	   a clear back but a metering pulse */
+	for (i = 0; i < 2; i++) {
+		openr2_cas_state_t state = i ? OR2_ANSWER_RXD : OR2_ANSWER_RXD_MF_PENDING;
+		if (r2context->config.timers.r2_metering_pulse) {
+			CAS_TRANSITION(state, CLEAR_BACK, CLEAR_BACK_METERING, OR2_CLEAR_BACK_RXD);
+		} else {
+			CAS_TRANSITION(state, CLEAR_BACK, DISCONNECT, OR2_CLEAR_BACK_RXD);
+		}
+		/* For DTMF R2, for some strange reason they send CLEAR_FORWARD even when they are the backward side!! */
+		if (r2context->config.dial_with_dtmf || r2context->config.detect_dtmf) {
+			CAS_TRANSITION(state, CLEAR_FORWARD, DISCONNECT, OR2_CLEAR_FWD_RXD);
+		}
+		cas_transition(r2context, state, OR2_CAS_FORCED_RELEASE, OR2_CAS_ACTION_DISCONNECT, OR2_FORCED_RELEASE_RXD,
+				OR2_CAUSE_FORCED_RELEASE, OR2_LOG_DEBUG, NULL);
+	}
+	/* we got clear back but we have not transmitted clear fwd yet, then, the only
+	   reason for CAS change is a possible metering pulse */
+	if (r2context->config.timers.r2_metering_pulse) {
+		CAS_TRANSITION(OR2_CLEAR_BACK_RXD, ANSWER, METERING_PULSE, OR2_ANSWER_RXD);
+	}
+
+	CAS_TRANSITION(OR2_CLEAR_BACK_TONE_RXD, IDLE, CALL_END, OR2_CLEAR_BACK_TONE_RXD);
+	CAS_TRANSITION(OR2_CLEAR_FWD_TXD, IDLE, CALL_END, OR2_CLEAR_FWD_TXD);
+	/* we requested the disconnection, we don't report call end to the user since the channel
+	 * is still NOT available to be used, we need still to wait for IDLE */
+	CAS_TRANSITION(OR2_CLEAR_FWD_TXD, CLEAR_BACK, SET_STATE, OR2_CLEAR_BACK_AFTER_CLEAR_FWD_RXD);
+	CAS_TRANSITION(OR2_CLEAR_FWD_TXD, FORCED_RELEASE, SET_STATE, OR2_CLEAR_BACK_AFTER_CLEAR_FWD_RXD);
+	CAS_TRANSITION(OR2_CLEAR_BACK_AFTER_CLEAR_FWD_RXD, IDLE, CALL_END, OR2_CLEAR_BACK_AFTER_CLEAR_FWD_RXD);
+}
+#undef CAS_TRANSITION
+#undef CAS_TRANSITION_NOTE
+
+void openr2_proto_dump_cas_table(openr2_context_t *r2context)
+{
+	const openr2_cas_transition_t *entry;
+	int i, bits;
+	for (i = 0; i < OR2_NUM_R2_STATES; i++) {
+		for (bits = 0; bits < OR2_NUM_CAS_BITS; bits++) {
+			if ((bits & r2context->cas_r2_bits) != bits) {
+				continue;
+			}
+			entry = &r2context->config.cas_table[i][bits];
+			openr2_log2(r2context, OR2_CONTEXT_LOG, OR2_LOG_NOTICE, "%s + 0x%02X [%s] -> %s, %s\n",
+					r2state2str(cas_table_states[i]), bits,
+					entry->signal != OR2_CAS_INVALID ? cas_names[entry->signal] : "INVALID",
+					cas_action_names[entry->action], r2state2str(entry->next_state));
+		}
+	}
+}
+
 static void start_dialing_dtmf(openr2_chan_t *r2chan);
 static void r2_answer_timeout_expired(openr2_chan_t *r2chan);
 static int send_clear_forward(openr2_chan_t *r2chan);
+static void send_disconnect(openr2_chan_t *r2chan, openr2_call_disconnect_cause_t cause);
 int openr2_proto_handle_cas(openr2_chan_t *r2chan)
 {
-	int cas, res;
-	openr2_cas_state_t out_r2_state = OR2_INVALID_STATE;
-	openr2_call_disconnect_cause_t out_disconnect_cause = OR2_CAUSE_NORMAL_CLEARING;
+	int cas, res, state_index;
+	const openr2_cas_transition_t *transition;
 
 	/* if we have CAS persistence check and we're here because of the timer expired
 	   then we don't need to read the CAS again, let's go directly to handle the bits */
@@ -1167,316 +1690,164 @@ handlecas:
 	}
 
 	r2chan->cas_read = cas;
-	/* ok, bits have changed, we need to know in which 
-	   CAS state we are to know what to do */
-	switch (r2chan->r2_state) {
-	case OR2_IDLE:
-		if (cas == R2(r2chan, BLOCK)) {
-			CAS_LOG_RX(BLOCK);
-			EMI(r2chan)->on_line_blocked(r2chan);
-			return 0;
-		}
-		if (cas == R2(r2chan, IDLE)) {
-			CAS_LOG_RX(IDLE);
-			EMI(r2chan)->on_line_idle(r2chan);
-			return 0;
-		}
-		if (cas == R2(r2chan, SEIZE)) {
-			CAS_LOG_RX(SEIZE);
-			/* we are in IDLE and just received a seize request
-			   lets handle this new call */
-			handle_incoming_call(r2chan);
-		} else {
-			CAS_LOG_RX(INVALID);
-			handle_protocol_error(r2chan, OR2_INVALID_CAS_BITS);
-		}
+	/* ok, bits have changed, the CAS table tells us what they mean
+	   in the CAS state we are and what to do */
+	state_index = cas_state_index(r2chan->r2_state);
+	if (state_index < 0) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Do not know what to do with state %d.\n", r2chan->r2_state);
+		CAS_LOG_RX(INVALID);
+		handle_protocol_error(r2chan, OR2_INVALID_R2_STATE);
 		return 0;
+	}
+	transition = &r2chan->config->cas_table[state_index][cas & (OR2_NUM_CAS_BITS - 1)];
+	r2chan->cas_rx_signal = transition->signal;
+	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_CAS_TRACE, "CAS Rx << [%s] 0x%02X\n", 
+			openr2_proto_get_rx_cas_string(r2chan), cas);
+	if (transition->note) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, transition->note_level, "%s", transition->note);
+	}
 
-	case OR2_SEIZE_ACK_TXD:
-	case OR2_ANSWER_TXD:
-	case OR2_EXECUTING_DOUBLE_ANSWER:
-		/* if call setup already started or the call is answered 
-		   the only valid bit pattern is a clear forward, everything
-		   else is protocol error */
-		if (cas == R2(r2chan, CLEAR_FORWARD)) {
-			CAS_LOG_RX(CLEAR_FORWARD);
-			r2_set_state(r2chan, OR2_CLEAR_FWD_RXD);
-			report_call_disconnection(r2chan, OR2_CAUSE_NORMAL_CLEARING);
-		} else {
-			CAS_LOG_RX(INVALID);
-			handle_protocol_error(r2chan, OR2_INVALID_CAS_BITS);
-		}
-		return 0;
+	switch (transition->action) {
+	case OR2_CAS_ACTION_PROTOCOL_ERROR:
+		handle_protocol_error(r2chan, OR2_INVALID_CAS_BITS);
+		break;
 
-	case OR2_SEIZE_TXD:
-	case OR2_SEIZE_TXD_CLEAR_FWD_PENDING:
-		/* if we transmitted a seize we expect the seize ACK */
-		if (cas == R2(r2chan, SEIZE_ACK)) {
-			CAS_LOG_RX(SEIZE_ACK);
-			openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.r2_seize);
-			if (r2chan->r2_state == OR2_SEIZE_TXD_CLEAR_FWD_PENDING) {
-				openr2_log(r2chan, OR2_CHANNEL_LOG, 
-						OR2_LOG_DEBUG, "MFC/R2 seize acknowledge received when clear forward pending, disconnecting call now!\n");
-				if (send_clear_forward(r2chan)) {
-					openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Failed to send Clear Forward!, cannot disconnect call nicely! may be try again?\n");
-				}
-				return 0;
-			}
-			r2_set_state(r2chan, OR2_SEIZE_ACK_RXD);
-			/* check if this is DTMF R2 */
-			if (!DIAL_DTMF(r2chan)) {
-				/* Handle seize ack for MFC R2 
-				 * When the other side send us the seize ack, MF tones
-				 * can start, we start transmitting DNIS 
-				 * */
-				openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "MFC/R2 seize acknowledge received!\n");
-				r2chan->mf_group = OR2_MF_GI;
-				MFI(r2chan)->mf_write_init(r2chan->mf_write_handle, 1);
-				MFI(r2chan)->mf_read_init(r2chan->mf_read_handle, 0);
-				mf_send_dnis(r2chan, 0);
-			} else {
-				/* handle seize ack for DTMF R2 */
-				openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "DTMF/R2 call acknowledge!\n");
-				/* prepare 2 timers, one small to start dialing and the other to cancel the call if no answer */
-				r2chan->timer_ids.dtmf_start_dial = openr2_chan_add_timer(r2chan, TIMER(r2chan).dtmf_start_dial, start_dialing_dtmf, "start_dialing_dtmf");
-				r2chan->timer_ids.r2_answer = openr2_chan_add_timer(r2chan, TIMER(r2chan).r2_answer, r2_answer_timeout_expired, "r2_answer");
-			}
-			EMI(r2chan)->on_call_proceed(r2chan);
-		} else if (cas == R2(r2chan, SEIZE)) {
-			CAS_LOG_RX(SEIZE);
-			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "Double seize (glare) detected!\n");
-			/* ITU Q.400-Q490 3.2.7.1 Procedures under normal conditions 
-			 * It is said that we must release the connection, but, we must maintain the seize state
-			 * for a minimum of 100ms, we will move back to idle in 100ms or when the other end moves to idle,
-			 * whatever happens first */
-			r2_set_state(r2chan, OR2_DOUBLE_SEIZURE);
-			openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.r2_seize);
-			report_call_disconnection(r2chan, OR2_CAUSE_GLARE);
-			/*
-			 * at this point we have 2 possible paths to idle
-			 * -> send clear fwd
-			 * <- rx clear fwd
-			 * -> idle
-			 *  (report call end)
-			 *
-			 * <- rx clear fwd
-			 * -> send clear fwd
-			 * -> idle
-			 * (report call end)
-			 *
-			 * The path will depend on whether our local user clears the call first, or the remote end does
-			 */
-		} else {
-			CAS_LOG_RX(INVALID);
-			handle_protocol_error(r2chan, OR2_INVALID_CAS_BITS);
-		}
-		return 0;
+	case OR2_CAS_ACTION_UNHANDLED_STATE:
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Do not know what to do with state %d.\n", r2chan->r2_state);
+		/* fall through */
+	case OR2_CAS_ACTION_STATE_ERROR:
+		handle_protocol_error(r2chan, OR2_INVALID_R2_STATE);
+		break;
 
-	case OR2_DOUBLE_SEIZURE:
-	case OR2_DOUBLE_SEIZURE_CLEAR_FWD_PENDING:
-		if (cas == R2(r2chan, CLEAR_FORWARD)) {
-			if (r2chan->r2_state == OR2_DOUBLE_SEIZURE) {
-				CAS_LOG_RX(CLEAR_FORWARD);
-				/* the other end cleared their end but we have not done so yet, do not report call end yet  */
-				r2_set_state(r2chan, OR2_CLEAR_FWD_RXD);
-				openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "Remote end cleared after glare, still waiting local clearing\n");
-			} else {
-				CAS_LOG_RX(IDLE);
-				openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "Remote end cleared after glare, completing local clearing\n");
-				report_call_end(r2chan);
-			}
-		} else {
-			CAS_LOG_RX(INVALID);
-			handle_protocol_error(r2chan, OR2_INVALID_CAS_BITS);
-		}
-		return 0;
+	case OR2_CAS_ACTION_IGNORE:
+		break;
 
-	case OR2_CLEAR_BACK_TXD:
-	case OR2_FORCED_RELEASE_TXD:
-		if (cas == R2(r2chan, CLEAR_FORWARD)) {
-			CAS_LOG_RX(CLEAR_FORWARD);
-			report_call_end(r2chan);
-		} else {
-			CAS_LOG_RX(INVALID);
-			handle_protocol_error(r2chan, OR2_INVALID_CAS_BITS);
-		}
-		return 0;
+	case OR2_CAS_ACTION_SET_STATE:
+		r2_set_state(r2chan, transition->next_state);
+		break;
 
-	case OR2_ACCEPT_RXD:
-		/* once we got MF ACCEPT tone, we expect the CAS Answer 
-		   or some disconnection signal, anything else, protocol error */
-		if (cas == R2(r2chan, ANSWER)) {
-			CAS_LOG_RX(ANSWER);
-			openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.r2_answer);
-			r2_set_state(r2chan, OR2_ANSWER_RXD);
-			r2chan->call_state = OR2_CALL_ANSWERED;
-			turn_off_mf_engine(r2chan);
-			r2chan->answered = 1;
-			EMI(r2chan)->on_call_answered(r2chan);
-		} else if (check_backward_disconnection(r2chan, cas, &out_disconnect_cause, &out_r2_state)) {
-			r2_set_state(r2chan, out_r2_state);
-			report_call_disconnection(r2chan, out_disconnect_cause);
-		} else {
-			CAS_LOG_RX(INVALID);
-			handle_protocol_error(r2chan, OR2_INVALID_CAS_BITS);
-		}
-		return 0;
+	case OR2_CAS_ACTION_LINE_IDLE:
+		EMI(r2chan)->on_line_idle(r2chan);
+		/* we went idle before the far end did */
+		report_channel_available(r2chan);
+		break;
 
-	case OR2_SEIZE_ACK_RXD:
-		/* In MFC-R2 This state means we're during call setup (ANI/DNIS transmission) and the ACCEPT signal
-		   has not been received, which requires some special handling, read below for more info ...
-		   For DTMF R2 this is normal, during seize ack we just wait answer (or may be also disconnection?)  */
-		if (!DIAL_DTMF(r2chan) && cas == R2(r2chan, ANSWER)) {
-			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Answer before accept detected!\n");
-			/* sometimes, since CAS signaling is faster than MF detectors we
-			   may receive the ANSWER signal before actually receiving the
-			   MF tone that indicates the call has been accepted (OR2_ACCEPT_RXD). We
-			   must not turn off the tone detector because the tone off condition is still missing */
-			CAS_LOG_RX(ANSWER);
-			r2_set_state(r2chan, OR2_ANSWER_RXD_MF_PENDING);
-		} else if (check_backward_disconnection(r2chan, cas, &out_disconnect_cause, &out_r2_state)) {
-			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Disconnection before accept detected!\n");
-			/* I believe we just fall here with release forced since clear back signal is usually (always?) the
-			   same as Seize ACK and therefore there will be not a bit patter change in that case. 
-			   I believe the correct behavior for this case is to just proceed with disconnection without waiting 
-			   for any other MF activity, the call is going down anyway */
-			r2_set_state(r2chan, out_r2_state);
-			report_call_disconnection(r2chan, out_disconnect_cause);
-		} else if (cas == R2(r2chan, ANSWER)) {
-			/* DTMF R2 outgoing call just answered */
-			CAS_LOG_RX(ANSWER);
-			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_NOTICE, "DTMF/R2 call answered\n");
-			openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.r2_answer);
-			r2_set_state(r2chan, OR2_ANSWER_RXD);
-			r2chan->call_state = OR2_CALL_ANSWERED;
-			r2chan->answered = 1;
-			EMI(r2chan)->on_call_answered(r2chan);
-		} else {
-			CAS_LOG_RX(INVALID);
-			handle_protocol_error(r2chan, OR2_INVALID_CAS_BITS);
-		}
-		return 0;
+	case OR2_CAS_ACTION_LINE_BLOCKED:
+		EMI(r2chan)->on_line_blocked(r2chan);
+		break;
 
-	case OR2_ANSWER_RXD_MF_PENDING:
-	case OR2_ANSWER_RXD:
-		if (cas == R2(r2chan, CLEAR_BACK)) {
-			CAS_LOG_RX(CLEAR_BACK);
-			r2_set_state(r2chan, OR2_CLEAR_BACK_RXD);
-			if (TIMER(r2chan).r2_metering_pulse) {
-				/* if the variant may have metering pulses, this clear back could be not really
-				   a clear back but a metering pulse, lets put the timer. If the CAS signal does not
-				   come back to ANSWER then is really a clear back */
-				r2chan->timer_ids.r2_metering_pulse = openr2_chan_add_timer(r2chan, TIMER(r2chan).r2_metering_pulse, 
-						r2_metering_pulse, "r2_metering_pulse");
-			} else {
-				report_call_disconnection(r2chan, OR2_CAUSE_NORMAL_CLEARING);
-			}
-		/* For DTMF R2, for some strange reason they send CLEAR_FORWARD even when they are the backward side!! */
-		} else if (IS_DTMF_R2(r2chan) && cas == R2(r2chan, CLEAR_FORWARD)) {
-			CAS_LOG_RX(CLEAR_FORWARD);
-			r2_set_state(r2chan, OR2_CLEAR_FWD_RXD);
-			/* should we test for metering pulses here? */
-			report_call_disconnection(r2chan, OR2_CAUSE_NORMAL_CLEARING);
-		} else if (cas == R2(r2chan, FORCED_RELEASE)) {
-			CAS_LOG_RX(FORCED_RELEASE);
-			r2_set_state(r2chan, OR2_FORCED_RELEASE_RXD);
-			report_call_disconnection(r2chan, OR2_CAUSE_FORCED_RELEASE);
-		} else {
-			CAS_LOG_RX(INVALID);
-			handle_protocol_error(r2chan, OR2_INVALID_CAS_BITS);
-		}
-		return 0;
+	case OR2_CAS_ACTION_INCOMING_CALL:
+		handle_incoming_call(r2chan);
+		break;
 
-	case OR2_CLEAR_BACK_TONE_RXD:
-		if (cas == R2(r2chan, IDLE)) {
-			CAS_LOG_RX(IDLE);
-			report_call_end(r2chan);
-		} else {
-			CAS_LOG_RX(INVALID);
-			handle_protocol_error(r2chan, OR2_INVALID_CAS_BITS);
-		}
-		return 0;
+	case OR2_CAS_ACTION_DISCONNECT:
+		r2_set_state(r2chan, transition->next_state);
+		report_call_disconnection(r2chan, transition->cause);
+		break;
 
-	case OR2_CLEAR_FWD_TXD:
-		if (cas == R2(r2chan, IDLE)) {
-			CAS_LOG_RX(IDLE);
-			report_call_end(r2chan);
-		} else if (check_backward_disconnection(r2chan, cas, &out_disconnect_cause, &out_r2_state)) {
-			/* we requested the disconnection, we don't report call end to the user since the channel
-			 * is still NOT available to be used, we need still to wait for IDLE
-			 * */
-			r2_set_state(r2chan, OR2_CLEAR_BACK_AFTER_CLEAR_FWD_RXD);
-		} else {
-			CAS_LOG_RX(INVALID);
-			handle_protocol_error(r2chan, OR2_INVALID_CAS_BITS);
-		}
-		return 0;
+	case OR2_CAS_ACTION_CALL_END:
+		report_call_end(r2chan);
+		break;
 
-	case OR2_CLEAR_BACK_AFTER_CLEAR_FWD_RXD:
-		if (cas == R2(r2chan, IDLE)) {
-			CAS_LOG_RX(IDLE);
-			report_call_end(r2chan);
-		} else {
-			CAS_LOG_RX(INVALID);
-			handle_protocol_error(r2chan, OR2_INVALID_CAS_BITS);
-		}
-		return 0;
-	case OR2_CLEAR_BACK_RXD:
-		/* we got clear back but we have not transmitted clear fwd yet, then, the only
-		   reason for CAS change is a possible metering pulse, if we are not detecting a metering
-		   pulse then is a protocol error */
-		if (TIMER(r2chan).r2_metering_pulse && cas == R2(r2chan, ANSWER)) {
-			/* cancel the metering timer and let's pretend this never happened */
-			CAS_LOG_RX(ANSWER);
-			openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.r2_metering_pulse);
-			r2_set_state(r2chan, OR2_ANSWER_RXD);
-			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_NOTICE, "Metering pulse received");
-			EMI(r2chan)->on_billing_pulse_received(r2chan);
-		} else {
-			CAS_LOG_RX(INVALID);
-			handle_protocol_error(r2chan, OR2_INVALID_CAS_BITS);
+	case OR2_CAS_ACTION_SEIZE_ACK_CLEAR_FWD:
+		openr2_adapt_sample(r2chan, OR2_ADAPTIVE_R2_SEIZE);
+		openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.r2_seize);
+		if (send_clear_forward(r2chan)) {
+			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Failed to send Clear Forward!, cannot disconnect call nicely! may be try again?\n");
 		}
-		return 0;
+		break;
 
-	case OR2_BLOCKED:
-		/* we're blocked, unless they are setting IDLE, we don't care */
-		if (cas == R2(r2chan, IDLE)) {
-			CAS_LOG_RX(IDLE);
-			EMI(r2chan)->on_line_idle(r2chan);
-		} else {
-			CAS_LOG_RX(INVALID);
-			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_NOTICE, "Doing nothing on CAS change, we're blocked.\n");
-		}	
-		return 0;
+	case OR2_CAS_ACTION_SEIZE_ACK_MF:
+		/* Handle seize ack for MFC R2 
+		 * When the other side send us the seize ack, MF tones
+		 * can start, we start transmitting DNIS 
+		 * */
+		openr2_adapt_sample(r2chan, OR2_ADAPTIVE_R2_SEIZE);
+		openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.r2_seize);
+		r2_set_state(r2chan, transition->next_state);
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "MFC/R2 seize acknowledge received!\n");
+		r2chan->mf_group = OR2_MF_GI;
+		MFI(r2chan)->mf_write_init(r2chan->mf_write_handle, 1);
+		MFI(r2chan)->mf_read_init(r2chan->mf_read_handle, 0);
+		mf_send_dnis(r2chan, 0);
+		EMI(r2chan)->on_call_proceed(r2chan);
+		break;
 
-	case OR2_INIT:
-		/* on initialization, only IDLE and BLOCK make sense */
-		if (cas == R2(r2chan, IDLE)) {
-			CAS_LOG_RX(IDLE);
-			EMI(r2chan)->on_line_idle(r2chan);
-		} else if (cas == R2(r2chan, BLOCK)) {
-			CAS_LOG_RX(BLOCK);
-			EMI(r2chan)->on_line_blocked(r2chan);
-			return 0;
-		} else {
-			CAS_LOG_RX(INVALID);
-			handle_protocol_error(r2chan, OR2_INVALID_R2_STATE);
-		}	
-		return 0;
+	case OR2_CAS_ACTION_SEIZE_ACK_DTMF:
+		/* handle seize ack for DTMF R2 */
+		openr2_adapt_sample(r2chan, OR2_ADAPTIVE_R2_SEIZE);
+		openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.r2_seize);
+		r2_set_state(r2chan, transition->next_state);
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "DTMF/R2 call acknowledge!\n");
+		/* prepare 2 timers, one small to start dialing and the other to cancel the call if no answer */
+		r2chan->timer_ids.dtmf_start_dial = openr2_chan_add_timer(r2chan, TIMER(r2chan).dtmf_start_dial, start_dialing_dtmf, "start_dialing_dtmf");
+		r2chan->timer_ids.r2_answer = openr2_chan_add_timer(r2chan, TIMER(r2chan).r2_answer, r2_answer_timeout_expired, "r2_answer");
+		EMI(r2chan)->on_call_proceed(r2chan);
+		break;
 
-	case OR2_INVALID_STATE:
-		CAS_LOG_RX(INVALID);
-		handle_protocol_error(r2chan, OR2_INVALID_R2_STATE);
-		return 0;
+	case OR2_CAS_ACTION_GLARE:
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "Double seize (glare) detected!\n");
+		/* ITU Q.400-Q490 3.2.7.1 Procedures under normal conditions 
+		 * It is said that we must release the connection, but, we must maintain the seize state
+		 * for a minimum of 100ms, we will move back to idle in 100ms or when the other end moves to idle,
+		 * whatever happens first */
+		r2_set_state(r2chan, transition->next_state);
+		openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.r2_seize);
+		/* their seize is not an answer to ours */
+		openr2_adapt_cancel(r2chan, OR2_ADAPTIVE_R2_SEIZE);
+		report_call_disconnection(r2chan, OR2_CAUSE_GLARE);
+		/*
+		 * at this point we have 2 possible paths to idle
+		 * -> send clear fwd
+		 * <- rx clear fwd
+		 * -> idle
+		 *  (report call end)
+		 *
+		 * <- rx clear fwd
+		 * -> send clear fwd
+		 * -> idle
+		 * (report call end)
+		 *
+		 * The path will depend on whether our local user clears the call first, or the remote end does
+		 */
+		break;
 
-	case OR2_CLEAR_FWD_RXD:
-	case OR2_FORCED_RELEASE_RXD:
+	case OR2_CAS_ACTION_ANSWER_MF:
+		openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.r2_answer);
+		r2_set_state(r2chan, transition->next_state);
+		r2chan->call_state = OR2_CALL_ANSWERED;
+		turn_off_mf_engine(r2chan);
+		r2chan->answered = 1;
+		EMI(r2chan)->on_call_answered(r2chan);
 		break;
-	}
 
-	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Do not know what to do with state %d.\n", r2chan->r2_state);
-	CAS_LOG_RX(INVALID);
-	handle_protocol_error(r2chan, OR2_INVALID_R2_STATE);
+	case OR2_CAS_ACTION_ANSWER_DTMF:
+		/* DTMF R2 outgoing call just answered */
+		openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.r2_answer);
+		r2_set_state(r2chan, transition->next_state);
+		r2chan->call_state = OR2_CALL_ANSWERED;
+		r2chan->answered = 1;
+		EMI(r2chan)->on_call_answered(r2chan);
+		break;
+
+	case OR2_CAS_ACTION_CLEAR_BACK_METERING:
+		/* If the CAS signal does not come back to ANSWER then is really a clear back */
+		r2_set_state(r2chan, transition->next_state);
+		r2chan->timer_ids.r2_metering_pulse = openr2_chan_add_timer(r2chan, TIMER(r2chan).r2_metering_pulse, 
+				r2_metering_pulse, "r2_metering_pulse");
+		break;
+
+	case OR2_CAS_ACTION_METERING_PULSE:
+		/* cancel the metering timer and let's pretend this never happened */
+		openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.r2_metering_pulse);
+		r2_set_state(r2chan, transition->next_state);
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_NOTICE, "Metering pulse received");
+		EMI(r2chan)->on_billing_pulse_received(r2chan);
+		break;
+
+	case OR2_NUM_CAS_ACTIONS:
+		break;
+	}
 	return 0;
 }
 
@@ -1515,6 +1886,7 @@ int openr2_proto_accept_call(openr2_chan_t *r2chan, openr2_call_mode_t mode)
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "Cannot accept call if the call has not been offered!\n");
 		return -1;
 	}
+	openr2_admit_setup_done(r2chan);
 	if (!DETECT_DTMF(r2chan)) {
 		r2chan->mf_state = OR2_MF_ACCEPTED_TXD;
 		prepare_mf_tone(r2chan, get_tone_from_mode(r2chan, mode));		
@@ -1527,6 +1899,7 @@ int openr2_proto_accept_call(openr2_chan_t *r2chan, openr2_call_mode_t mode)
 
 static int send_clear_backward(openr2_chan_t *r2chan)
 {
+	release_started(r2chan);
 	r2_set_state(r2chan, OR2_CLEAR_BACK_TXD);
 	turn_off_mf_engine(r2chan);
 	return set_cas_signal(r2chan, OR2_CAS_CLEAR_BACK);	
@@ -1534,6 +1907,7 @@ static int send_clear_backward(openr2_chan_t *r2chan)
 
 static int send_forced_release(openr2_chan_t *r2chan)
 {
+	release_started(r2chan);
 	r2_set_state(r2chan, OR2_FORCED_RELEASE_TXD);
 	turn_off_mf_engine(r2chan);
 	return set_cas_signal(r2chan, OR2_CAS_FORCED_RELEASE);	
@@ -1581,7 +1955,7 @@ int openr2_proto_answer_call(openr2_chan_t *r2chan)
 	if (openr2_proto_do_answer(r2chan)) {
 		return -1;
 	}
-	if (r2chan->r2context->double_answer) {
+	if (r2chan->config->double_answer) {
 		r2chan->timer_ids.r2_double_answer = openr2_chan_add_timer(r2chan, TIMER(r2chan).r2_double_answer, 
 				double_answer_handler, "r2_double_answer");
 	}
@@ -1610,26 +1984,10 @@ static void request_calling_party_category(openr2_chan_t *r2chan)
 
 static openr2_calling_party_category_t tone2category(openr2_chan_t *r2chan)
 {
-	if (GII_TONE(r2chan).national_subscriber == r2chan->caller_category) {
-		return OR2_CALLING_PARTY_CATEGORY_NATIONAL_SUBSCRIBER;
-
-	} else if (GII_TONE(r2chan).national_priority_subscriber == r2chan->caller_category) {
-		return OR2_CALLING_PARTY_CATEGORY_NATIONAL_PRIORITY_SUBSCRIBER;
-
-	} else if (GII_TONE(r2chan).international_subscriber == r2chan->caller_category) {
-		return OR2_CALLING_PARTY_CATEGORY_INTERNATIONAL_SUBSCRIBER;
-
-	} else if (GII_TONE(r2chan).international_priority_subscriber == r2chan->caller_category) {
-		return OR2_CALLING_PARTY_CATEGORY_INTERNATIONAL_PRIORITY_SUBSCRIBER;
-	} else if (GII_TONE(r2chan).collect_call == r2chan->caller_category) {
-		return OR2_CALLING_PARTY_CATEGORY_COLLECT_CALL;
-	} else if (GII_TONE(r2chan).test_equipment == r2chan->caller_category) {
-		return OR2_CALLING_PARTY_CATEGORY_TEST_EQUIPMENT;
-	} else if (GII_TONE(r2chan).pay_phone == r2chan->caller_category) {
-		return OR2_CALLING_PARTY_CATEGORY_PAY_PHONE;
-	} else {
+	if ((unsigned)r2chan->caller_category >= OR2_MF_DECODE_SIZE) {
 		return OR2_CALLING_PARTY_CATEGORY_UNKNOWN;
 	}
+	return r2chan->config->mf_gii_decode[r2chan->caller_category];
 }
 
 static void bypass_change_to_g2(openr2_chan_t *r2chan)
@@ -1655,9 +2013,32 @@ static void request_change_to_g2(openr2_chan_t *r2chan)
 	prepare_mf_tone(r2chan, change_tone);
 }
 
+static void shed_call(openr2_chan_t *r2chan)
+{
+	int tone = GA_TONE(r2chan).network_congestion;
+	if (r2chan->mf_state == OR2_MF_DISCONNECT_TXD) {
+		/* already told them, they keep the tone until they see ours */
+		return;
+	}
+	if (r2chan->mf_group == OR2_MF_GB && r2chan->mf_state == OR2_MF_CHG_GII_TXD) {
+		send_disconnect(r2chan, OR2_CAUSE_NETWORK_CONGESTION);
+		return;
+	}
+	if (tone == OR2_MF_TONE_INVALID) {
+		/* no congestion in group A for this variant, go get it in group B */
+		request_change_to_g2(r2chan);
+		return;
+	}
+	release_started(r2chan);
+	r2chan->mf_group = OR2_MF_GA;
+	r2chan->mf_state = OR2_MF_DISCONNECT_TXD;
+	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Rejecting the call with network congestion signal 0x%X\n", tone);
+	prepare_mf_tone(r2chan, tone);
+}
+
 static void try_change_to_g2(openr2_chan_t *r2chan)
 {
-	if (r2chan->r2context->immediate_accept) {
+	if (r2chan->config->immediate_accept) {
 		bypass_change_to_g2(r2chan);
 		return;
 	}
@@ -1666,7 +2047,7 @@ static void try_change_to_g2(openr2_chan_t *r2chan)
 
 static void try_request_calling_party_category(openr2_chan_t *r2chan)
 {
-	if (r2chan->r2context->skip_category) {
+	if (r2chan->config->skip_category) {
 		try_change_to_g2(r2chan);
 		return;
 	}
@@ -1709,9 +2090,10 @@ static void mf_back_cycle_timeout_expired(openr2_chan_t *r2chan)
 		   and ask the calling party category (if needed). Since they are now in a silent 
 		   state we will not get a 'tone off' condition, hence we need a timeout to mute 
 		   our tone */
+		openr2_adapt_cancel(r2chan, OR2_ADAPTIVE_MF_BACK_CYCLE);
 		r2chan->timer_ids.mf_back_resume_cycle = openr2_chan_add_timer(r2chan, TIMER(r2chan).mf_back_resume_cycle, 
 				                                               mf_back_resume_cycle, "mf_back_resume_cycle");
-		if (!openr2_test_flag(r2chan->r2context, OR2_ANI_CAN_COME_FIRST) && !r2chan->r2context->get_ani_first) {
+		if (!openr2_test_flag(r2chan->r2context, OR2_ANI_CAN_COME_FIRST) && !r2chan->config->get_ani_first) {
 			/* we were not asked to get the ANI first, hence when this
 		           timeout occurs we know for sure we have not retrieved ANI yet,
 		           let's retrieve it now. */
@@ -1724,6 +2106,7 @@ static void mf_back_cycle_timeout_expired(openr2_chan_t *r2chan)
 		}
 	} else {
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "MF back cycle timed out!\n");
+		openr2_adapt_reset(r2chan, OR2_ADAPTIVE_MF_BACK_CYCLE);
 		handle_protocol_error(r2chan, OR2_BACK_MF_TIMEOUT);
 	}	
 }
@@ -1742,15 +2125,17 @@ static void request_next_dnis_digit(openr2_chan_t *r2chan)
 static void mf_receive_expected_dnis(openr2_chan_t *r2chan, int tone)
 {
 	int rc;
-	if (OR2_MF_TONE_10 <= tone && OR2_MF_TONE_9 >= tone) {
+	int meaning = MF_DECODE(r2chan, gi, tone);
+	if (meaning & OR2_MF_GI_DIGIT) {
 		if (r2chan->dnis_len == STR_LEN(r2chan->dnis)){
 			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "Dropping DNIS digit %c, exceeded max DNIS length of %d\n", tone, STR_LEN(r2chan->dnis));
 		} else {
 			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Getting DNIS digit %c\n", tone);
 			r2chan->dnis[r2chan->dnis_len++] = tone;
 			r2chan->dnis[r2chan->dnis_len] = '\0';
+			numplan_dnis_digit(r2chan, tone);
 		}
-		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "DNIS so far: %s, expected length: %d\n", r2chan->dnis, r2chan->r2context->max_dnis);
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "DNIS so far: %s, expected length: %d\n", r2chan->dnis, r2chan->config->max_dnis);
 		rc = EMI(r2chan)->on_dnis_digit_received(r2chan, tone);
 		if (DNIS_COMPLETE(r2chan) || !rc) {
 			if (!rc) {
@@ -1761,23 +2146,23 @@ static void mf_receive_expected_dnis(openr2_chan_t *r2chan, int tone)
 			/* if this is the first and last DNIS digit we have or
 			   we were not required to get the ANI first, request it now, 
 			   otherwise is time to go to GII signals */
-			if (1 == r2chan->dnis_len || !r2chan->r2context->get_ani_first) {
+			if (1 == r2chan->dnis_len || !r2chan->config->get_ani_first) {
 				try_request_calling_party_category(r2chan);
 			} else {
 				try_change_to_g2(r2chan);
 			} 
-		} else if (1 == r2chan->dnis_len && r2chan->r2context->get_ani_first) {
+		} else if (1 == r2chan->dnis_len && r2chan->config->get_ani_first) {
 			try_request_calling_party_category(r2chan);
 		} else {
 			request_next_dnis_digit(r2chan);
 		}
-	} else if (GI_TONE(r2chan).no_more_dnis_available == tone) {
+	} else if (meaning & OR2_MF_GI_NO_MORE_DNIS) {
 		/* not sure if we ever could get no more dnis as first DNIS tone
 		   but let's handle it just in case */
-		if (0 == r2chan->dnis_len || !r2chan->r2context->get_ani_first) {
+		if (0 == r2chan->dnis_len || !r2chan->config->get_ani_first) {
 			try_request_calling_party_category(r2chan);
 		} else {
-			if (r2chan->r2context->immediate_accept) {
+			if (r2chan->config->immediate_accept) {
 				bypass_change_to_g2(r2chan);
 			} else {
 				request_change_to_g2(r2chan);
@@ -1817,15 +2202,16 @@ static void mf_receive_expected_ani(openr2_chan_t *r2chan, int tone)
 	int next_ani_request_tone = GC_TONE(r2chan).request_next_ani_digit ? 
 		                    GC_TONE(r2chan).request_next_ani_digit : 
 				    GA_TONE(r2chan).request_next_ani_digit;
+	int meaning = MF_DECODE(r2chan, gi, tone);
 	/* no tone, just request next ANI if needed, otherwise
 	   switch to Group B/II  */
-	if (!tone || (OR2_MF_TONE_10 <= tone && OR2_MF_TONE_9 >= tone)) {
+	if (!tone || (meaning & OR2_MF_GI_DIGIT)) {
 		/* if we have a tone, save it */
 		if (tone) {
 			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Getting ANI digit %c\n", tone);
 			r2chan->ani[r2chan->ani_len++] = tone;
 			r2chan->ani[r2chan->ani_len] = '\0';
-			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "ANI so far: %s, expected length: %d\n", r2chan->ani, r2chan->r2context->max_ani);
+			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "ANI so far: %s, expected length: %d\n", r2chan->ani, r2chan->config->max_ani);
 			EMI(r2chan)->on_ani_digit_received(r2chan, tone);
 		}
 		/* we ask for more ANI digits just when either:
@@ -1834,13 +2220,13 @@ static void mf_receive_expected_ani(openr2_chan_t *r2chan, int tone)
 		  	  which basically means there's no tone for end of ANI digits (or we ignore it)
 		 */
 		if (!tone || (!openr2_test_flag(r2chan->r2context, OR2_FORCE_USE_MAX_ANI) &&
-					(uint32_t)r2chan->r2context->max_ani > r2chan->ani_len)) {
+					(uint32_t)r2chan->config->max_ani > r2chan->ani_len)) {
 			r2chan->mf_state = OR2_MF_ANI_RQ_TXD;
 			prepare_mf_tone(r2chan, next_ani_request_tone);
 		} else {
 			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Done getting ANI!\n");
-			if (!r2chan->r2context->get_ani_first || DNIS_COMPLETE(r2chan)) {
-				if (r2chan->r2context->immediate_accept) {
+			if (!r2chan->config->get_ani_first || DNIS_COMPLETE(r2chan)) {
+				if (r2chan->config->immediate_accept) {
 					bypass_change_to_g2(r2chan);
 				} else {
 					request_change_to_g2(r2chan);
@@ -1851,15 +2237,14 @@ static void mf_receive_expected_ani(openr2_chan_t *r2chan, int tone)
 		}
 	/* they notify us about no more ANI available or the ANI 
 	   is restricted AKA private */
-	} else if ( tone == GI_TONE(r2chan).no_more_ani_available ||
-		    tone == GI_TONE(r2chan).caller_ani_is_restricted ) {
+	} else if (meaning & (OR2_MF_GI_NO_MORE_ANI | OR2_MF_GI_ANI_RESTRICTED)) {
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Got end of ANI\n");
-		if ( tone == GI_TONE(r2chan).caller_ani_is_restricted ) {
+		if (meaning & OR2_MF_GI_ANI_RESTRICTED) {
 			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "ANI is restricted\n");
 			r2chan->caller_ani_is_restricted = 1;
 		}	
-		if (!r2chan->r2context->get_ani_first || DNIS_COMPLETE(r2chan)) {
-			if (r2chan->r2context->immediate_accept) {
+		if (!r2chan->config->get_ani_first || DNIS_COMPLETE(r2chan)) {
+			if (r2chan->config->immediate_accept) {
 				bypass_change_to_g2(r2chan);
 			} else {
 				request_change_to_g2(r2chan);
@@ -1875,7 +2260,12 @@ static void mf_receive_expected_ani(openr2_chan_t *r2chan, int tone)
 static void handle_forward_mf_tone(openr2_chan_t *r2chan, int tone)
 {
 	/* Cancel MF back timer since we got a response from the forward side */
+	openr2_adapt_sample(r2chan, OR2_ADAPTIVE_MF_BACK_CYCLE);
 	openr2_chan_cancel_timer(r2chan, &r2chan->timer_ids.mf_back_cycle);
+	if (r2chan->shedding) {
+		shed_call(r2chan);
+		return;
+	}
 	switch (r2chan->mf_group) {
 	/* we just sent the seize ACK and we are starting with the MF dance */
 	case OR2_MF_BACK_INIT:
@@ -1883,7 +2273,7 @@ static void handle_forward_mf_tone(openr2_chan_t *r2chan, int tone)
 		case OR2_MF_SEIZE_ACK_TXD:
 			/* after sending the seize ack, we expect either DNIS or ANI,
 			   depending on the variant */
-			if (r2chan->r2context->get_ani_first && openr2_test_flag(r2chan->r2context, OR2_ANI_CAN_COME_FIRST)) { 
+			if (r2chan->config->get_ani_first && openr2_test_flag(r2chan->r2context, OR2_ANI_CAN_COME_FIRST)) { 
 				mf_receive_expected_ani(r2chan, tone); 
 			} else 
 				mf_receive_expected_dnis(r2chan, tone);
@@ -1907,11 +2297,11 @@ static void handle_forward_mf_tone(openr2_chan_t *r2chan, int tone)
 		/* we requested the calling party category */
 		case OR2_MF_CATEGORY_RQ_TXD:
 			r2chan->caller_category = tone;
-			if (r2chan->r2context->max_ani > 0) {
+			if (r2chan->config->max_ani > 0) {
 				mf_receive_expected_ani(r2chan, 0);
 			} else {
 				/* switch to Group B/II, we're ready to answer! */
-				if (r2chan->r2context->immediate_accept) {
+				if (r2chan->config->immediate_accept) {
 					bypass_change_to_g2(r2chan);
 				} else {
 					request_change_to_g2(r2chan);
@@ -1951,7 +2341,7 @@ static void handle_forward_mf_tone(openr2_chan_t *r2chan, int tone)
 		/* we requested the calling party category */
 		case OR2_MF_CATEGORY_RQ_TXD:
 			r2chan->caller_category = tone;
-			if (r2chan->r2context->max_ani > 0) {
+			if (r2chan->config->max_ani > 0) {
 				mf_receive_expected_ani(r2chan, 0);
 			} else {
 				/* switch to Group B/II, we're ready to answer! */
@@ -1998,6 +2388,10 @@ static void handle_forward_mf_silence(openr2_chan_t *r2chan)
 				r2chan->timer_ids.r2_answer_delay = openr2_chan_add_timer(r2chan, TIMER(r2chan).r2_answer_delay, 
 						                                          ready_to_answer, "r2_answer_delay");
 				break;
+			/* we rejected the call with group A congestion, they will clear forward */
+			case OR2_MF_DISCONNECT_TXD:
+				openr2_chan_cancel_all_timers(r2chan);
+				break;
 			default:
 				/* no further action required. The other end should 
 				   handle our previous request */
@@ -2119,20 +2513,6 @@ static void r2_answer_timeout_expired(openr2_chan_t *r2chan)
 	report_call_disconnection(r2chan, OR2_CAUSE_NO_ANSWER);
 }
 
-static openr2_call_mode_t get_mode_from_tone(openr2_chan_t *r2chan, int tone)
-{
-	if (tone == GB_TONE(r2chan).accept_call_with_charge) {
-		return OR2_CALL_WITH_CHARGE;
-	} else if (GB_TONE(r2chan).accept_call_no_charge) {
-		return OR2_CALL_NO_CHARGE;
-	} else if (GB_TONE(r2chan).special_info_tone) {
-		return OR2_CALL_SPECIAL;
-	} else {
-		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "Unknown call type\n");
-		return OR2_CALL_UNKNOWN;
-	}	
-}
-
 static void handle_accept_tone(openr2_chan_t *r2chan, openr2_call_mode_t mode)
 {
 	openr2_mf_state_t previous_mf_state;
@@ -2173,99 +2553,114 @@ static void handle_accept_tone(openr2_chan_t *r2chan, openr2_call_mode_t mode)
 	}
 }
 
-static int handle_dnis_request(openr2_chan_t *r2chan, int tone)
+static void handle_group_a_request(openr2_chan_t *r2chan, int tone)
 {
-	if (tone == GA_TONE(r2chan).request_next_dnis_digit) {
+	int meaning = MF_DECODE(r2chan, ga, tone);
+	if ((meaning & OR2_MF_GA_NEXT_ANI) && r2chan->category_sent) {
+		mf_send_ani(r2chan);
+		return;
+	}
+	switch (meaning & ~OR2_MF_GA_NEXT_ANI) {
+	case OR2_MF_GA_NEXT_DNIS:
 		mf_send_dnis(r2chan, 1);
-		return 1;
-	} else if (tone == GA_TONE(r2chan).request_dnis_minus_1) {
+		break;
+	case OR2_MF_GA_DNIS_MINUS_1:
 		mf_send_dnis(r2chan, -1);
-		return 1;
-	} else if (tone == GA_TONE(r2chan).request_dnis_minus_2) {
+		break;
+	case OR2_MF_GA_DNIS_MINUS_2:
 		mf_send_dnis(r2chan, -2);
-		return 1;
-	} else if (tone == GA_TONE(r2chan).request_dnis_minus_3){
+		break;
+	case OR2_MF_GA_DNIS_MINUS_3:
 		mf_send_dnis(r2chan, -3);
-		return 1;
-	} else if (tone == GA_TONE(r2chan).request_all_dnis_again) {
+		break;
+	case OR2_MF_GA_ALL_DNIS_AGAIN:
 		r2chan->dnis_index = 0;
 		mf_send_dnis(r2chan, 0);
-		return 1;
-	}
-	return 0;
-}
-
-static void handle_group_a_request(openr2_chan_t *r2chan, int tone)
-{
-	openr2_mf_tone_t request_category_tone = GA_TONE(r2chan).request_category ?
-						 GA_TONE(r2chan).request_category :
-						 GA_TONE(r2chan).request_category_and_change_to_gc;
-	if (handle_dnis_request(r2chan, tone)) {
-		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Group A DNIS request handled\n");
-	} else if (r2chan->category_sent && (tone == GA_TONE(r2chan).request_next_ani_digit)) {
-		mf_send_ani(r2chan);
-	} else if (tone == request_category_tone) {
-		if (request_category_tone == GA_TONE(r2chan).request_category_and_change_to_gc) {
-			r2chan->mf_group = OR2_MF_GIII;
-		}
+		break;
+	case OR2_MF_GA_CATEGORY_AND_CHANGE_TO_GC:
+		r2chan->mf_group = OR2_MF_GIII;
+		mf_send_category(r2chan);
+		break;
+	case OR2_MF_GA_CATEGORY:
 		mf_send_category(r2chan);
-	} else if (tone == GA_TONE(r2chan).request_change_to_g2) {
+		break;
+	case OR2_MF_GA_CHANGE_TO_G2:
 		r2chan->mf_group = OR2_MF_GII;
 		mf_send_category(r2chan);
-        } else if (tone == GA_TONE(r2chan).address_complete_charge_setup) {
+		break;
+	case OR2_MF_GA_ADDRESS_COMPLETE:
 		handle_accept_tone(r2chan, OR2_CALL_WITH_CHARGE);
-	} else if (tone == GA_TONE(r2chan).network_congestion) {
+		break;
+	case OR2_MF_GA_NETWORK_CONGESTION:
 		r2_set_state(r2chan, OR2_CLEAR_BACK_TONE_RXD);
 		report_call_disconnection(r2chan, OR2_CAUSE_NETWORK_CONGESTION);
-	} else {
+		break;
+	default:
 		handle_protocol_error(r2chan, OR2_INVALID_MF_TONE);
+		break;
 	}
 }
 
 static void handle_group_c_request(openr2_chan_t *r2chan, int tone)
 {
-	if (tone == GC_TONE(r2chan).request_next_ani_digit) {
+	switch (MF_DECODE(r2chan, gc, tone)) {
+	case OR2_MF_GC_NEXT_ANI:
 		mf_send_ani(r2chan);
-	} else if (tone == GC_TONE(r2chan).request_change_to_g2) {
+		break;
+	case OR2_MF_GC_CHANGE_TO_G2:
 		/* requesting change to Group II means we should
 		   send the calling party category again?  */
 		r2chan->mf_group = OR2_MF_GII;
 		mf_send_category(r2chan);
-	} else if (tone == GC_TONE(r2chan).request_next_dnis_digit_and_change_to_ga) {
+		break;
+	case OR2_MF_GC_NEXT_DNIS_AND_CHANGE_TO_GA:
 		r2chan->mf_group = OR2_MF_GI;
 		mf_send_dnis(r2chan, 1);
-	} else if (tone == GC_TONE(r2chan).network_congestion) {
+		break;
+	case OR2_MF_GC_NETWORK_CONGESTION:
 		r2_set_state(r2chan, OR2_CLEAR_BACK_TONE_RXD);
 		report_call_disconnection(r2chan, OR2_CAUSE_NETWORK_CONGESTION);
-	} else {
+		break;
+	default:
 		handle_protocol_error(r2chan, OR2_INVALID_MF_TONE);
+		break;
 	}
 }
 
 static void handle_group_b_request(openr2_chan_t *r2chan, int tone)
 {
-	if (tone == GB_TONE(r2chan).accept_call_with_charge 
-	    || tone == GB_TONE(r2chan).accept_call_no_charge
-	    || tone == GB_TONE(r2chan).special_info_tone) {
-	    handle_accept_tone(r2chan, get_mode_from_tone(r2chan, tone));
-	} else if (tone == GB_TONE(r2chan).busy_number){
-		r2_set_state(r2chan, OR2_CLEAR_BACK_TONE_RXD);
-		report_call_disconnection(r2chan, OR2_CAUSE_BUSY_NUMBER);
-	} else if (tone == GB_TONE(r2chan).network_congestion) {
-		r2_set_state(r2chan, OR2_CLEAR_BACK_TONE_RXD);
-		report_call_disconnection(r2chan, OR2_CAUSE_NETWORK_CONGESTION);
-	} else if (tone == GB_TONE(r2chan).unallocated_number) {
-		r2_set_state(r2chan, OR2_CLEAR_BACK_TONE_RXD);
-		report_call_disconnection(r2chan, OR2_CAUSE_UNALLOCATED_NUMBER);
-	} else if (tone == GB_TONE(r2chan).number_changed) {
-		r2_set_state(r2chan, OR2_CLEAR_BACK_TONE_RXD);
-		report_call_disconnection(r2chan, OR2_CAUSE_NUMBER_CHANGED);
-	} else if (tone == GB_TONE(r2chan).line_out_of_order) {
-		r2_set_state(r2chan, OR2_CLEAR_BACK_TONE_RXD);
-		report_call_disconnection(r2chan, OR2_CAUSE_OUT_OF_ORDER);
-	} else {
+	openr2_call_disconnect_cause_t cause;
+	switch (MF_DECODE(r2chan, gb, tone)) {
+	case OR2_MF_GB_ACCEPT_WITH_CHARGE:
+		handle_accept_tone(r2chan, OR2_CALL_WITH_CHARGE);
+		return;
+	case OR2_MF_GB_ACCEPT_NO_CHARGE:
+		handle_accept_tone(r2chan, OR2_CALL_NO_CHARGE);
+		return;
+	case OR2_MF_GB_SPECIAL_INFO:
+		handle_accept_tone(r2chan, OR2_CALL_SPECIAL);
+		return;
+	case OR2_MF_GB_BUSY_NUMBER:
+		cause = OR2_CAUSE_BUSY_NUMBER;
+		break;
+	case OR2_MF_GB_NETWORK_CONGESTION:
+		cause = OR2_CAUSE_NETWORK_CONGESTION;
+		break;
+	case OR2_MF_GB_UNALLOCATED_NUMBER:
+		cause = OR2_CAUSE_UNALLOCATED_NUMBER;
+		break;
+	case OR2_MF_GB_NUMBER_CHANGED:
+		cause = OR2_CAUSE_NUMBER_CHANGED;
+		break;
+	case OR2_MF_GB_LINE_OUT_OF_ORDER:
+		cause = OR2_CAUSE_OUT_OF_ORDER;
+		break;
+	default:
 		handle_protocol_error(r2chan, OR2_INVALID_MF_TONE);
+		return;
 	}
+	r2_set_state(r2chan, OR2_CLEAR_BACK_TONE_RXD);
+	report_call_disconnection(r2chan, cause);
 }
 
 static void handle_backward_mf_silence(openr2_chan_t *r2chan, int tone)
@@ -2304,22 +2699,22 @@ static int check_threshold(openr2_chan_t *r2chan, int tone)
 	int res = 0;
 	int tone_threshold = 0;
 	struct timeval currtime = {0, 0};
-	if (r2chan->r2context->mf_threshold) {
+	if (r2chan->config->mf_threshold) {
 		if (r2chan->mf_threshold_tone != tone) {
-			res = gettimeofday(&r2chan->mf_threshold_time, NULL);
+			res = openr2_gettimeofday(r2chan->r2context, &r2chan->mf_threshold_time);
 			if (-1 == res) {
 				openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "gettimeofday failed when setting threshold time\n");
 				return -1;
 			}
 			r2chan->mf_threshold_tone = tone;
 		}
-		res = gettimeofday(&currtime, NULL);
+		res = openr2_gettimeofday(r2chan->r2context, &currtime);
 		if (-1 == res) {
 			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "gettimeofday failed when checking tone length\n");
 			return -1;
 		}
 		tone_threshold = timediff(&currtime, &r2chan->mf_threshold_time);
-		if (tone_threshold < r2chan->r2context->mf_threshold) {
+		if (tone_threshold < r2chan->config->mf_threshold) {
 			if (tone) {
 				openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_EX_DEBUG, "Tone %c ignored\n", tone);
 			} else {
@@ -2398,13 +2793,14 @@ void openr2_proto_handle_mf_tone(openr2_chan_t *r2chan, int tone)
 static void seize_timeout_expired(openr2_chan_t *r2chan)
 {
 	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_WARNING, "Seize Timeout Expired!\n");
+	openr2_adapt_reset(r2chan, OR2_ADAPTIVE_R2_SEIZE);
 	handle_protocol_error(r2chan, OR2_SEIZE_TIMEOUT);
 }
 
 static void start_dialing_dtmf(openr2_chan_t *r2chan)
 {
 	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_NOTICE, "Dialing %s with DTMF/R2 (tone on = %d, tone off = %d)\n", 
-			r2chan->dnis, r2chan->r2context->dtmf_on, r2chan->r2context->dtmf_off);
+			r2chan->dnis, r2chan->config->dtmf_on, r2chan->config->dtmf_off);
 	r2chan->dialing_dtmf = 1;
 	r2chan->mf_state = OR2_MF_DIALING_DTMF;
 }
@@ -2435,6 +2831,9 @@ int openr2_proto_make_call(openr2_chan_t *r2chan, const char *ani, const char *d
 		return -1;
 	}
 
+	/* the call keeps the settings in use now until it ends */
+	openr2_context_pin_config(r2chan->r2context, r2chan);
+
 	/* make sure both ANI and DNIS are numeric */
 	if (ani) {
 		digit = ani;
@@ -2475,7 +2874,8 @@ int openr2_proto_make_call(openr2_chan_t *r2chan, const char *ani, const char *d
 	r2_set_state(r2chan, OR2_SEIZE_TXD);
 
 	/* cannot wait forever for seize ack, put a timer */
-	r2chan->timer_ids.r2_seize = openr2_chan_add_timer(r2chan, TIMER(r2chan).r2_seize, seize_timeout_expired, "r2_seize");
+	r2chan->timer_ids.r2_seize = openr2_chan_add_timer(r2chan, openr2_adapt_timeout(r2chan, OR2_ADAPTIVE_R2_SEIZE, TIMER(r2chan).r2_seize), 
+			seize_timeout_expired, "r2_seize");
 	if (copy_ani) {
 		strncpy(r2chan->ani, ani, sizeof(r2chan->ani)-1);
 		r2chan->ani[sizeof(r2chan->ani)-1] = '\0';
@@ -2492,6 +2892,7 @@ int openr2_proto_make_call(openr2_chan_t *r2chan, const char *ani, const char *d
 	}	
 	r2chan->dnis_index = 0;
 	r2chan->call_state = OR2_CALL_DIALING;
+	r2chan->call_id++;
 	r2chan->direction = OR2_DIR_FORWARD;
 	r2chan->caller_category = category2tone(r2chan, category);
 	if (!DIAL_DTMF(r2chan)) {
@@ -2501,7 +2902,7 @@ int openr2_proto_make_call(openr2_chan_t *r2chan, const char *ani, const char *d
 			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Failed to initialize DTMF transmitter, cannot make call!!\n");
 			return -1;
 		}
-		DTMF(r2chan)->dtmf_tx_set_timing(r2chan->dtmf_write_handle, r2chan->r2context->dtmf_on, r2chan->r2context->dtmf_off);
+		DTMF(r2chan)->dtmf_tx_set_timing(r2chan->dtmf_write_handle, r2chan->config->dtmf_on, r2chan->config->dtmf_off);
 		if (DTMF(r2chan)->dtmf_tx_put(r2chan->dtmf_write_handle, r2chan->dnis, -1)) {
 			openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Failed to initialize DTMF transmit queue, cannot make call!!\n");
 			return -1;
@@ -2529,6 +2930,7 @@ static void send_disconnect(openr2_chan_t *r2chan, openr2_call_disconnect_cause_
 {
 	int tone = GB_TONE(r2chan).line_out_of_order;
 
+	release_started(r2chan);
 	r2chan->mf_state = OR2_MF_DISCONNECT_TXD;
 
 	switch (cause) {
@@ -2587,6 +2989,7 @@ static int send_clear_forward(openr2_chan_t *r2chan)
 	/* we don't rely on the other end to send us a reply for the CLEAR FORWARD we're about to send
 	 * so, we set this timer to ensure we bring this channel back to idle 
 	 * For MFC-R2 this is mostly a safety timer, for DTMF-R2 though I think this is a must */
+	release_started(r2chan);
 	openr2_chan_add_timer(r2chan, TIMER(r2chan).r2_set_call_down, r2_set_call_down, "r2_set_call_down");
 
 	r2_set_state(r2chan, OR2_CLEAR_FWD_TXD);
@@ -2595,6 +2998,89 @@ static int send_clear_forward(openr2_chan_t *r2chan)
 	return set_cas_signal(r2chan, OR2_CAS_CLEAR_FORWARD);
 }
 
+static int resync_answered_call(openr2_chan_t *r2chan, openr2_direction_t direction)
+{
+	openr2_cas_signal_t signal;
+	r2chan->direction = direction;
+	r2chan->call_state = OR2_CALL_ANSWERED;
+	r2chan->call_id++;
+	r2chan->answered = 1;
+	if (direction == OR2_DIR_FORWARD) {
+		r2_set_state(r2chan, OR2_ANSWER_RXD);
+		r2chan->cas_rx_signal = OR2_CAS_ANSWER;
+		signal = OR2_CAS_SEIZE;
+	} else {
+		r2_set_state(r2chan, OR2_ANSWER_TXD);
+		r2chan->cas_rx_signal = OR2_CAS_SEIZE;
+		signal = OR2_CAS_ANSWER;
+	}
+	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_NOTICE, "Recovered answered %s call\n",
+			direction == OR2_DIR_FORWARD ? "outgoing" : "incoming");
+	/* the driver should still have it, but make sure */
+	return set_cas_signal(r2chan, signal) ? -1 : 1;
+}
+
+/* Warm start. Instead of forcing idle, find out from the bits we receive and the
+   signal the state mirror says we transmit (if there is one) what was going on
+   when the previous user of the channel left. Answered calls are kept, calls
+   in any other stage are cleared without reporting them to the user */
+int openr2_proto_resync(openr2_chan_t *r2chan)
+{
+	openr2_cas_signal_t tx;
+	int cas;
+
+	openr2_proto_init(r2chan);
+	if (r2chan->inalarm || openr2_io_get_cas(r2chan, &cas)) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_NOTICE, "Cannot read the CAS bits, setting the channel idle\n");
+		return openr2_proto_set_idle(r2chan);
+	}
+	cas &= r2chan->r2context->cas_r2_bits;
+	tx = openr2_mirror_get_tx(r2chan);
+	openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Resync with Rx 0x%02X and Tx %s\n", cas,
+			tx == OR2_CAS_INVALID ? "unknown" : cas_names[tx]);
+	r2chan->cas_read = cas;
+
+	/* only the backward side sends answer, so this was our call and it was answered */
+	if (cas == R2(r2chan, ANSWER) && (tx == OR2_CAS_INVALID || tx == OR2_CAS_SEIZE)) {
+		return resync_answered_call(r2chan, OR2_DIR_FORWARD);
+	}
+	if (cas == R2(r2chan, SEIZE) && tx == OR2_CAS_ANSWER) {
+		return resync_answered_call(r2chan, OR2_DIR_BACKWARD);
+	}
+
+	/* their call still in setup, or one we cannot tell if we answered without a mirror */
+	if (cas == R2(r2chan, SEIZE) && tx != OR2_CAS_IDLE && tx != OR2_CAS_BLOCK) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_NOTICE, "Releasing incoming call found on resync\n");
+		r2chan->quiet = 1;
+		r2chan->direction = OR2_DIR_BACKWARD;
+		r2chan->call_state = OR2_CALL_DISCONNECTED;
+		r2chan->cas_rx_signal = OR2_CAS_SEIZE;
+		return send_clear_backward(r2chan) ? -1 : 0;
+	}
+
+	/* our call still in setup or cleared back by them, without a mirror only the
+	   backward signals tell us it was our call */
+	if ((tx == OR2_CAS_SEIZE && cas != R2(r2chan, IDLE))
+	    || (tx == OR2_CAS_INVALID && (cas == R2(r2chan, SEIZE_ACK) || cas == R2(r2chan, CLEAR_BACK)))) {
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_NOTICE, "Releasing outgoing call found on resync\n");
+		r2chan->quiet = 1;
+		r2chan->direction = OR2_DIR_FORWARD;
+		r2chan->call_state = OR2_CALL_DISCONNECTED;
+		return send_clear_forward(r2chan) ? -1 : 0;
+	}
+
+	if (tx == OR2_CAS_BLOCK) {
+		return openr2_proto_set_blocked(r2chan);
+	}
+
+	/* anything else ends idle, handle what they send as if we just went idle */
+	if (openr2_proto_set_idle(r2chan)) {
+		return -1;
+	}
+	r2chan->cas_read = -1;
+	return openr2_proto_handle_cas(r2chan) ? -1 : 0;
+}
+
 /* BUG BUG BUG: As of now, when the call is in OR2_CALL_OFFERED state, the user has to call
    openr2_chan_disconnect_call to reject a call with a reason, this will cause a MF tone to
    be sent to the forward side to let them know we are rejecting the call, at that moment
@@ -2607,6 +3093,13 @@ static int send_clear_forward(openr2_chan_t *r2chan)
    should be called. */
 int openr2_proto_disconnect_call(openr2_chan_t *r2chan, openr2_call_disconnect_cause_t cause)
 {
+	if (r2chan->config->release_policy == OR2_RELEASE_FAST
+	    && (r2chan->call_state == OR2_CALL_IDLE || r2chan->r2_state == OR2_CLEAR_FWD_TXD)) {
+		/* the fast release policy beat the user to it */
+		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_DEBUG, "Call already released\n");
+		return 0;
+	}
+
 	/* cannot drop a call when there is none to drop */
 	if (r2chan->call_state == OR2_CALL_IDLE) {
 		openr2_log(r2chan, OR2_CHANNEL_LOG, OR2_LOG_ERROR, "Cannot disconnect call when we don't have a call to disconnect\n");
@@ -22,6 +22,11 @@
  *
  */
 
+#ifdef __linux__
+/* syscall() for the futex based mutex */
+#define _GNU_SOURCE
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -42,6 +47,13 @@
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
+#ifndef WIN32
+#include <time.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 #define _openr2_assert(assertion, msg) \
 	if (!(assertion)) { \
@@ -162,7 +174,171 @@ openr2_status_t openr2_thread_create_detached_ex(openr2_thread_function_t func,
 }
 
 
+/* monotonic time in nanoseconds to measure lock waits */
+static uint64_t openr2_mutex_now_ns(void)
+{
+#ifdef WIN32
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (uint64_t)((double)count.QuadPart * 1000000000.0 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+#endif
+}
+
 openr2_status_t openr2_mutex_create(openr2_mutex_t **mutex)
+{
+	return openr2_mutex_create_ex(mutex, 1);
+}
+
+#ifdef OR2_FUTEX_MUTEX
+
+/* how many times to check the lock before going to sleep in the kernel */
+#define OR2_MUTEX_SPIN_COUNT 100
+
+static __inline__ void openr2_futex_wait(volatile int *addr, int val)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static __inline__ void openr2_futex_wake(volatile int *addr, int count)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static __inline__ int openr2_mutex_cmpxchg(volatile int *addr, int expected, int desired)
+{
+	__atomic_compare_exchange_n(addr, &expected, desired, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+	return expected;
+}
+
+openr2_status_t openr2_mutex_create_ex(openr2_mutex_t **mutex, int recursive)
+{
+	openr2_mutex_t *check = NULL;
+
+	check = (openr2_mutex_t *)openr2_calloc(1, sizeof(**mutex));
+	if (!check) {
+		return OR2_FAIL;
+	}
+	check->recursive = recursive ? 1 : 0;
+	*mutex = check;
+	return OR2_SUCCESS;
+}
+
+openr2_status_t openr2_mutex_destroy(openr2_mutex_t **mutex)
+{
+	openr2_mutex_t *mp = *mutex;
+	*mutex = NULL;
+	if (!mp) {
+		return OR2_FAIL;
+	}
+	if (mp->state) {
+		openr2_log_generic(OR2_GENERIC_LOG, OR2_LOG_ERROR, "Destroying locked mutex %p\n", mp);
+	}
+	openr2_safe_free(mp);
+	return OR2_SUCCESS;
+}
+
+/* slow path, kept out of line so the uncontended lock stays cheap */
+static __attribute__((noinline)) void openr2_mutex_lock_contended(openr2_mutex_t *mutex)
+{
+	uint64_t start = openr2_mutex_now_ns();
+	int spin, c = 1;
+
+	/* the lock is usually held for very short periods, spin a bit before sleeping */
+	for (spin = 0; spin < OR2_MUTEX_SPIN_COUNT; spin++) {
+#if defined(__i386__) || defined(__x86_64__)
+		__asm__ __volatile__("pause");
+#endif
+		if (!__atomic_load_n(&mutex->state, __ATOMIC_RELAXED)) {
+			c = openr2_mutex_cmpxchg(&mutex->state, 0, 1);
+			if (!c) {
+				goto done;
+			}
+		}
+	}
+
+	/* mark the lock as having waiters and sleep until we get it */
+	if (c != 2) {
+		c = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+	}
+	while (c) {
+		openr2_futex_wait(&mutex->state, 2);
+		c = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+	}
+
+done:
+	mutex->stats.contended++;
+	mutex->stats.wait_ns += openr2_mutex_now_ns() - start;
+}
+
+openr2_status_t _openr2_mutex_lock(openr2_mutex_t *mutex)
+{
+	unsigned long self = openr2_thread_self();
+
+	if (mutex->owner == self) {
+		if (!mutex->recursive) {
+			openr2_log_generic(OR2_GENERIC_LOG, OR2_LOG_ERROR, "Mutex %p is not recursive and is already held by this thread\n", mutex);
+			return OR2_FAIL;
+		}
+		mutex->depth++;
+		return OR2_SUCCESS;
+	}
+
+	/* fast path, nobody holds the lock */
+	if (openr2_mutex_cmpxchg(&mutex->state, 0, 1)) {
+		openr2_mutex_lock_contended(mutex);
+	}
+
+	mutex->owner = self;
+	mutex->depth = 1;
+	mutex->stats.acquisitions++;
+	return OR2_SUCCESS;
+}
+
+openr2_status_t _openr2_mutex_trylock(openr2_mutex_t *mutex)
+{
+	unsigned long self = openr2_thread_self();
+	if (mutex->owner == self) {
+		if (!mutex->recursive) {
+			return OR2_FAIL;
+		}
+		mutex->depth++;
+		return OR2_SUCCESS;
+	}
+	if (openr2_mutex_cmpxchg(&mutex->state, 0, 1)) {
+		return OR2_FAIL;
+	}
+	mutex->owner = self;
+	mutex->depth = 1;
+	mutex->stats.acquisitions++;
+	return OR2_SUCCESS;
+}
+
+openr2_status_t _openr2_mutex_unlock(openr2_mutex_t *mutex)
+{
+	if (mutex->owner != openr2_thread_self()) {
+		openr2_log_generic(OR2_GENERIC_LOG, OR2_LOG_ERROR, "Attempted to unlock mutex %p not held by this thread\n", mutex);
+		return OR2_FAIL;
+	}
+	if (--mutex->depth) {
+		return OR2_SUCCESS;
+	}
+	mutex->owner = 0;
+	/* if there may be waiters wake up one of them */
+	if (__atomic_fetch_sub(&mutex->state, 1, __ATOMIC_RELEASE) != 1) {
+		__atomic_store_n(&mutex->state, 0, __ATOMIC_RELEASE);
+		openr2_futex_wake(&mutex->state, 1);
+	}
+	return OR2_SUCCESS;
+}
+
+#else /* OR2_FUTEX_MUTEX */
+
+openr2_status_t openr2_mutex_create_ex(openr2_mutex_t **mutex, int recursive)
 {
 	openr2_status_t status = OR2_FAIL;
 #ifndef WIN32
@@ -170,16 +346,17 @@ openr2_status_t openr2_mutex_create(openr2_mutex_t **mutex)
 #endif
 	openr2_mutex_t *check = NULL;
 
-	check = (openr2_mutex_t *)openr2_malloc(sizeof(**mutex));
+	check = (openr2_mutex_t *)openr2_calloc(1, sizeof(**mutex));
 	if (!check)
 		goto done;
 #ifdef WIN32
+	/* critical sections are always recursive */
 	InitializeCriticalSection(&check->mutex);
 #else
 	if (pthread_mutexattr_init(&attr))
 		goto done;
 
-	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE))
+	if (recursive && pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE))
 		goto fail;
 
 	if (pthread_mutex_init(&check->mutex, &attr))
@@ -219,15 +396,34 @@ openr2_status_t openr2_mutex_destroy(openr2_mutex_t **mutex)
 
 openr2_status_t _openr2_mutex_lock(openr2_mutex_t *mutex)
 {
+	uint64_t start = 0;
+	int contended = 0;
 #ifdef WIN32
-	EnterCriticalSection(&mutex->mutex);
+	if (!TryEnterCriticalSection(&mutex->mutex)) {
+		contended = 1;
+		start = openr2_mutex_now_ns();
+		EnterCriticalSection(&mutex->mutex);
+	}
 #else
 	int err;
-	if ((err = pthread_mutex_lock(&mutex->mutex))) {
-		openr2_log_generic(OR2_GENERIC_LOG, OR2_LOG_ERROR, "Failed to lock mutex %d:%s\n", err, strerror(err));
-		return OR2_FAIL;
+	if (pthread_mutex_trylock(&mutex->mutex)) {
+		contended = 1;
+		start = openr2_mutex_now_ns();
+		if ((err = pthread_mutex_lock(&mutex->mutex))) {
+			openr2_log_generic(OR2_GENERIC_LOG, OR2_LOG_ERROR, "Failed to lock mutex %d:%s\n", err, strerror(err));
+			return OR2_FAIL;
+		}
 	}
 #endif
+	/* recursive re-entries are not counted */
+	if (mutex->depth++) {
+		return OR2_SUCCESS;
+	}
+	if (contended) {
+		mutex->stats.contended++;
+		mutex->stats.wait_ns += openr2_mutex_now_ns() - start;
+	}
+	mutex->stats.acquisitions++;
 	return OR2_SUCCESS;
 }
 
@@ -240,20 +436,40 @@ openr2_status_t _openr2_mutex_trylock(openr2_mutex_t *mutex)
 	if (pthread_mutex_trylock(&mutex->mutex))
 		return OR2_FAIL;
 #endif
+	if (!mutex->depth++) {
+		mutex->stats.acquisitions++;
+	}
 	return OR2_SUCCESS;
 }
 
 openr2_status_t _openr2_mutex_unlock(openr2_mutex_t *mutex)
 {
+	mutex->depth--;
 #ifdef WIN32
 	LeaveCriticalSection(&mutex->mutex);
 #else
-	if (pthread_mutex_unlock(&mutex->mutex))
+	if (pthread_mutex_unlock(&mutex->mutex)) {
+		mutex->depth++;
 		return OR2_FAIL;
+	}
 #endif
 	return OR2_SUCCESS;
 }
 
+#endif /* OR2_FUTEX_MUTEX */
+
+/* the counters are updated by the lock owner, reading them without
+   the lock may give slightly stale values, good enough for statistics */
+void openr2_mutex_get_stats(openr2_mutex_t *mutex, openr2_mutex_stats_t *stats)
+{
+	memcpy(stats, &mutex->stats, sizeof(*stats));
+}
+
+void openr2_mutex_reset_stats(openr2_mutex_t *mutex)
+{
+	memset(&mutex->stats, 0, sizeof(mutex->stats));
+}
+
 
 openr2_status_t openr2_interrupt_create(openr2_interrupt_t **ininterrupt, openr2_socket_t device)
 {